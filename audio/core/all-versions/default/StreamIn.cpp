@@ -49,12 +49,7 @@ class ReadThread : public Thread {
           mCommandMQ(commandMQ),
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
-          mEfGroup(efGroup),
-          mBuffer(nullptr) {}
-    bool init() {
-        mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
-        return mBuffer != nullptr;
-    }
+          mEfGroup(efGroup) {}
     virtual ~ReadThread() {}
 
    private:
@@ -64,7 +59,6 @@ class ReadThread : public Thread {
     StreamIn::DataMQ* mDataMQ;
     StreamIn::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
-    std::unique_ptr<uint8_t[]> mBuffer;
     IStreamIn::ReadParameters mParameters;
     IStreamIn::ReadStatus mStatus;
 
@@ -84,15 +78,33 @@ void ReadThread::doRead() {
             (int32_t)requestedToRead, (int32_t)availableToWrite);
         requestedToRead = availableToWrite;
     }
-    ssize_t readResult = mStream->read(mStream, &mBuffer[0], requestedToRead);
     mStatus.retval = Result::OK;
-    if (readResult >= 0) {
-        mStatus.reply.read = readResult;
-        if (!mDataMQ->write(&mBuffer[0], readResult)) {
-            ALOGW("data message queue write failed");
+    mStatus.reply.read = 0;
+    // Let the HAL read directly into the data MQ ring. When the writable space wraps around the
+    // end of the ring the read is split in two.
+    StreamIn::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginWrite(requestedToRead, &tx)) {
+        ALOGW("data message queue write failed");
+        return;
+    }
+    for (const auto& region : {tx.getFirstRegion(), tx.getSecondRegion()}) {
+        if (region.getLength() == 0) {
+            break;
+        }
+        ssize_t readResult = mStream->read(mStream, region.getAddress(), region.getLength());
+        if (readResult < 0) {
+            if (mStatus.reply.read == 0) {
+                mStatus.retval = Stream::analyzeStatus("read", readResult);
+            }
+            break;
         }
-    } else {
-        mStatus.retval = Stream::analyzeStatus("read", readResult);
+        mStatus.reply.read += readResult;
+        if (static_cast<size_t>(readResult) < region.getLength()) {
+            break;  // Short transfer, do not continue into the second region.
+        }
+    }
+    if (!mDataMQ->commitWrite(mStatus.reply.read)) {
+        ALOGW("data message queue write failed");
     }
 }
 
@@ -393,11 +405,6 @@ Return<void> StreamIn::prepareForReading(uint32_t frameSize, uint32_t framesCoun
     auto tempReadThread =
         std::make_unique<ReadThread>(&mStopReadThread, mStream, tempCommandMQ.get(),
                                      tempDataMQ.get(), tempStatusMQ.get(), tempElfGroup.get());
-    if (!tempReadThread->init()) {
-        ALOGW("failed to start reader thread: %s", strerror(-status));
-        sendError(Result::INVALID_ARGUMENTS);
-        return Void();
-    }
     status = tempReadThread->run("reader", PRIORITY_URGENT_AUDIO);
     if (status != OK) {
         ALOGW("failed to start reader thread: %s", strerror(-status));
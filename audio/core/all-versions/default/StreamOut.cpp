@@ -48,12 +48,7 @@ class WriteThread : public Thread {
           mCommandMQ(commandMQ),
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
-          mEfGroup(efGroup),
-          mBuffer(nullptr) {}
-    bool init() {
-        mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
-        return mBuffer != nullptr;
-    }
+          mEfGroup(efGroup) {}
     virtual ~WriteThread() {}
 
    private:
@@ -63,7 +58,6 @@ class WriteThread : public Thread {
     StreamOut::DataMQ* mDataMQ;
     StreamOut::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
-    std::unique_ptr<uint8_t[]> mBuffer;
     IStreamOut::WriteStatus mStatus;
 
     bool threadLoop() override;
@@ -77,13 +71,28 @@ void WriteThread::doWrite() {
     const size_t availToRead = mDataMQ->availableToRead();
     mStatus.retval = Result::OK;
     mStatus.reply.written = 0;
-    if (mDataMQ->read(&mBuffer[0], availToRead)) {
-        ssize_t writeResult = mStream->write(mStream, &mBuffer[0], availToRead);
-        if (writeResult >= 0) {
-            mStatus.reply.written = writeResult;
-        } else {
-            mStatus.retval = Stream::analyzeStatus("write", writeResult);
+    // Hand the HAL pointers straight into the data MQ ring instead of copying the data out first.
+    // When the readable data wraps around the end of the ring it is passed in two writes.
+    StreamOut::DataMQ::MemTransaction tx;
+    if (mDataMQ->beginRead(availToRead, &tx)) {
+        for (const auto& region : {tx.getFirstRegion(), tx.getSecondRegion()}) {
+            if (region.getLength() == 0) {
+                break;
+            }
+            ssize_t writeResult = mStream->write(mStream, region.getAddress(), region.getLength());
+            if (writeResult < 0) {
+                if (mStatus.reply.written == 0) {
+                    mStatus.retval = Stream::analyzeStatus("write", writeResult);
+                }
+                break;
+            }
+            mStatus.reply.written += writeResult;
+            if (static_cast<size_t>(writeResult) < region.getLength()) {
+                break;  // Short transfer, do not continue into the second region.
+            }
         }
+        // As with a copying read, the whole of the data is consumed even if the HAL accepted less.
+        mDataMQ->commitRead(availToRead);
     }
 }
 
@@ -377,11 +386,6 @@ Return<void> StreamOut::prepareForWriting(uint32_t frameSize, uint32_t framesCou
     auto tempWriteThread =
         std::make_unique<WriteThread>(&mStopWriteThread, mStream, tempCommandMQ.get(),
                                       tempDataMQ.get(), tempStatusMQ.get(), tempElfGroup.get());
-    if (!tempWriteThread->init()) {
-        ALOGW("failed to start writer thread: %s", strerror(-status));
-        sendError(Result::INVALID_ARGUMENTS);
-        return Void();
-    }
     status = tempWriteThread->run("writer", PRIORITY_URGENT_AUDIO);
     if (status != OK) {
         ALOGW("failed to start writer thread: %s", strerror(-status));
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the round trip latency and CPU cost of the StreamOut write path: the client writes one
+// period into the data MQ, posts a WRITE command and waits for the status, while the HAL side
+// drives a stub audio_stream_out that only touches the data it is given.
+
+#define LOG_TAG "StreamOutBenchmark"
+
+#include "core/default/Device.h"
+#include "core/default/StreamOut.h"
+
+#include <sys/resource.h>
+
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <fmq/EventFlag.h>
+#include <hardware/audio.h>
+
+using ::android::sp;
+using ::android::hardware::EventFlag;
+using ::android::hardware::audio::CPP_VERSION::implementation::Device;
+using ::android::hardware::audio::CPP_VERSION::implementation::StreamOut;
+
+using namespace ::android::hardware::audio::common::CPP_VERSION;
+using namespace ::android::hardware::audio::CPP_VERSION;
+
+namespace {
+
+constexpr uint32_t kFrameSize = 4;  // 16 bit stereo
+// Not a multiple of the benchmarked periods so that the data regularly wraps around the end of
+// the data MQ ring.
+constexpr uint32_t kFramesCount = 1000;
+
+// A sink that reads every byte so the cost of handing it memory is comparable to a real HAL.
+ssize_t stubWrite(audio_stream_out* /*stream*/, const void* buffer, size_t bytes) {
+    const uint8_t* data = static_cast<const uint8_t*>(buffer);
+    uint8_t sum = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        sum += data[i];
+    }
+    benchmark::DoNotOptimize(sum);
+    return bytes;
+}
+
+int stubOpenOutputStream(audio_hw_device* /*dev*/, audio_io_handle_t /*handle*/,
+                         audio_devices_t /*devices*/, audio_output_flags_t /*flags*/,
+                         audio_config* /*config*/, audio_stream_out** streamOut,
+                         const char* /*address*/) {
+    auto* stream = new audio_stream_out{};
+    stream->write = stubWrite;
+    *streamOut = stream;
+    return 0;
+}
+
+void stubCloseOutputStream(audio_hw_device* /*dev*/, audio_stream_out* stream) {
+    delete stream;
+}
+
+int stubCloseDevice(hw_device_t* /*device*/) {
+    return 0;
+}
+
+int64_t cpuTimeUs() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL + usage.ru_utime.tv_usec +
+           usage.ru_stime.tv_usec;
+}
+
+}  // namespace
+
+static void BM_StreamOutWrite(benchmark::State& state) {
+    const size_t periodBytes = state.range(0) * kFrameSize;
+
+    audio_hw_device halDevice{};
+    halDevice.common.close = stubCloseDevice;
+    halDevice.open_output_stream = stubOpenOutputStream;
+    halDevice.close_output_stream = stubCloseOutputStream;
+
+    sp<Device> device = new Device(&halDevice);
+    AudioConfig suggestedConfig;
+    auto [result, stream] =
+            device->openOutputStreamImpl(0 /*ioHandle*/, DeviceAddress{}, AudioConfig{},
+                                         0 /*flags*/, &suggestedConfig);
+    if (result != Result::OK) {
+        state.SkipWithError("Failed to open the stub output stream");
+        return;
+    }
+
+    std::unique_ptr<StreamOut::CommandMQ> commandMQ;
+    std::unique_ptr<StreamOut::DataMQ> dataMQ;
+    std::unique_ptr<StreamOut::StatusMQ> statusMQ;
+    stream->prepareForWriting(kFrameSize, kFramesCount,
+                              [&](Result r, const auto& commandDesc, const auto& dataDesc,
+                                  const auto& statusDesc, const auto& /*threadInfo*/) {
+                                  if (r != Result::OK) {
+                                      return;
+                                  }
+                                  commandMQ = std::make_unique<StreamOut::CommandMQ>(commandDesc);
+                                  dataMQ = std::make_unique<StreamOut::DataMQ>(dataDesc);
+                                  statusMQ = std::make_unique<StreamOut::StatusMQ>(statusDesc);
+                              });
+    EventFlag* efGroup = nullptr;
+    if (!dataMQ ||
+        EventFlag::createEventFlag(dataMQ->getEventFlagWord(), &efGroup) != ::android::OK) {
+        state.SkipWithError("Failed to prepare the stream for writing");
+        return;
+    }
+
+    std::vector<uint8_t> period(periodBytes, 0x5a);
+    const IStreamOut::WriteCommand command = IStreamOut::WriteCommand::WRITE;
+    IStreamOut::WriteStatus status;
+    const int64_t cpuStartUs = cpuTimeUs();
+
+    for (auto _ : state) {
+        dataMQ->write(period.data(), period.size());
+        commandMQ->write(&command);
+        efGroup->wake(static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY));
+        uint32_t efState = 0;
+        do {
+            efGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL), &efState);
+        } while (!statusMQ->read(&status));
+        if (status.retval != Result::OK || status.reply.written != periodBytes) {
+            state.SkipWithError("Write failed");
+            break;
+        }
+    }
+
+    state.counters["cpu_us_per_write"] =
+            benchmark::Counter(static_cast<double>(cpuTimeUs() - cpuStartUs) / state.iterations());
+    state.SetBytesProcessed(state.iterations() * periodBytes);
+
+    EventFlag::deleteEventFlag(&efGroup);
+    stream->close();
+}
+// Period sizes in frames: 1 ms, 2 ms, 5 ms and 10 ms at 48 kHz.
+BENCHMARK(BM_StreamOutWrite)->Arg(48)->Arg(96)->Arg(240)->Arg(480)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -27,8 +27,13 @@
 
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
+#include <inttypes.h>
+#include <stdio.h>
+
 #include <android/log.h>
 #include <media/EffectsFactoryApi.h>
+#include <system/audio.h>
+#include <utils/Timers.h>
 #include <utils/Trace.h>
 
 #include "VersionUtils.h"
@@ -47,25 +52,20 @@ namespace {
 class ProcessThread : public Thread {
    public:
     // ProcessThread's lifespan never exceeds Effect's lifespan.
-    ProcessThread(std::atomic<bool>* stop, effect_handle_t effect,
-                  std::atomic<audio_buffer_t*>* inBuffer, std::atomic<audio_buffer_t*>* outBuffer,
+    ProcessThread(std::atomic<bool>* stop, Effect* effect, effect_handle_t handle,
                   Effect::StatusMQ* statusMQ, EventFlag* efGroup)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mEffect(effect),
-          mHasProcessReverse((*mEffect)->process_reverse != NULL),
-          mInBuffer(inBuffer),
-          mOutBuffer(outBuffer),
+          mHasProcessReverse((*handle)->process_reverse != NULL),
           mStatusMQ(statusMQ),
           mEfGroup(efGroup) {}
     virtual ~ProcessThread() {}
 
    private:
     std::atomic<bool>* mStop;
-    effect_handle_t mEffect;
+    Effect* mEffect;
     bool mHasProcessReverse;
-    std::atomic<audio_buffer_t*>* mInBuffer;
-    std::atomic<audio_buffer_t*>* mOutBuffer;
     Effect::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
 
@@ -91,22 +91,9 @@ bool ProcessThread::threadLoop() {
         if (retval == Result::OK) {
             // affects both buffer pointers and their contents.
             std::atomic_thread_fence(std::memory_order_acquire);
-            int32_t processResult;
-            audio_buffer_t* inBuffer =
-                std::atomic_load_explicit(mInBuffer, std::memory_order_relaxed);
-            audio_buffer_t* outBuffer =
-                std::atomic_load_explicit(mOutBuffer, std::memory_order_relaxed);
-            if (inBuffer != nullptr && outBuffer != nullptr) {
-                if (efState & static_cast<uint32_t>(MessageQueueFlagBits::REQUEST_PROCESS)) {
-                    processResult = (*mEffect)->process(mEffect, inBuffer, outBuffer);
-                } else {
-                    processResult = (*mEffect)->process_reverse(mEffect, inBuffer, outBuffer);
-                }
-                std::atomic_thread_fence(std::memory_order_release);
-            } else {
-                ALOGE("processing buffers were not set before calling 'process'");
-                processResult = -ENODEV;
-            }
+            int32_t processResult = mEffect->processRequest(
+                    !(efState & static_cast<uint32_t>(MessageQueueFlagBits::REQUEST_PROCESS)));
+            std::atomic_thread_fence(std::memory_order_release);
             switch (processResult) {
                 case 0:
                     retval = Result::OK;
@@ -138,7 +125,14 @@ const char* Effect::sContextCallToCommand = "error";
 const char* Effect::sContextCallFunction = sContextCallToCommand;
 
 Effect::Effect(effect_handle_t handle)
-    : mHandle(handle), mEfGroup(nullptr), mStopProcessThread(false) {}
+    : mHandle(handle),
+      mEfGroup(nullptr),
+      mStopProcessThread(false),
+      mEnabled(false),
+      mInPlaceCapable(false),
+      mOutputFrameSize(0),
+      mProcessedByChain(false),
+      mChainResult(0) {}
 
 Effect::~Effect() {
     ATRACE_CALL();
@@ -152,12 +146,14 @@ Effect::~Effect() {
         status_t status = EventFlag::deleteEventFlag(&mEfGroup);
         ALOGE_IF(status, "processing MQ event flag deletion error: %s", strerror(-status));
     }
+    mChain.clear();
     mInBuffer.clear();
     mOutBuffer.clear();
 #if MAJOR_VERSION <= 5
     int status = EffectRelease(mHandle);
     ALOGW_IF(status, "Error releasing effect %p: %s", mHandle, strerror(-status));
 #endif
+    EffectChain::clearSession(mHandle);
     EffectMap::getInstance().remove(mHandle);
     mHandle = 0;
 }
@@ -373,8 +369,8 @@ Return<void> Effect::prepareForProcessing(prepareForProcessing_cb _hidl_cb) {
     }
 
     // Create and launch the thread.
-    mProcessThread = new ProcessThread(&mStopProcessThread, mHandle, &mHalInBufferPtr,
-                                       &mHalOutBufferPtr, tempStatusMQ.get(), mEfGroup);
+    mProcessThread =
+            new ProcessThread(&mStopProcessThread, this, mHandle, tempStatusMQ.get(), mEfGroup);
     status = mProcessThread->run("effect", PRIORITY_URGENT_AUDIO);
     if (status != OK) {
         ALOGW("failed to start effect processing thread: %s", strerror(-status));
@@ -405,9 +401,43 @@ Return<Result> Effect::setProcessBuffers(const AudioBuffer& inBuffer,
     // so it's OK to update the pair non-atomically.
     mHalInBufferPtr.store(mInBuffer->getHalBuffer(), std::memory_order_release);
     mHalOutBufferPtr.store(mOutBuffer->getHalBuffer(), std::memory_order_release);
+    // The chain follows the input buffer, which the client shares between the effects it
+    // processes in place.
+    if (mChain != nullptr && mChain->getBufferId() != inBuffer.id) {
+        mChain->leave(this);
+        mChain.clear();
+    }
+    if (mChain == nullptr) {
+        mChain = EffectChain::join(this, inBuffer.id);
+    }
     return Result::OK;
 }
 
+int32_t Effect::processRequest(bool reverse) {
+    if (mChain != nullptr && !reverse) {
+        return mChain->process(this);
+    }
+    return processBuffers(mHalInBufferPtr.load(std::memory_order_relaxed),
+                          mHalOutBufferPtr.load(std::memory_order_relaxed), reverse);
+}
+
+int32_t Effect::processBuffers(audio_buffer_t* inBuffer, audio_buffer_t* outBuffer, bool reverse) {
+    if (inBuffer == nullptr || outBuffer == nullptr) {
+        ALOGE("processing buffers were not set before calling 'process'");
+        return -ENODEV;
+    }
+    const nsecs_t start = systemTime();
+    int32_t processResult = reverse ? (*mHandle)->process_reverse(mHandle, inBuffer, outBuffer)
+                                    : (*mHandle)->process(mHandle, inBuffer, outBuffer);
+    const uint64_t elapsedNs = systemTime() - start;
+    mProcessStatistics.count.fetch_add(1, std::memory_order_relaxed);
+    mProcessStatistics.totalNs.fetch_add(elapsedNs, std::memory_order_relaxed);
+    if (elapsedNs > mProcessStatistics.maxNs.load(std::memory_order_relaxed)) {
+        mProcessStatistics.maxNs.store(elapsedNs, std::memory_order_relaxed);
+    }
+    return processResult;
+}
+
 Result Effect::sendCommand(int commandCode, const char* commandName) {
     return sendCommand(commandCode, commandName, 0, NULL);
 }
@@ -473,8 +503,20 @@ Result Effect::setConfigImpl(int commandCode, const char* commandName, const Eff
     if (outputBufferProvider != 0) {
         LOG_FATAL("Using output buffer provider is not supported");
     }
-    return sendCommandReturningStatus(commandCode, commandName, sizeof(effect_config_t),
-                                      &halConfig);
+    Result retval = sendCommandReturningStatus(commandCode, commandName, sizeof(effect_config_t),
+                                               &halConfig);
+    if (retval == Result::OK && commandCode == EFFECT_CMD_SET_CONFIG) {
+        // An effect that overwrites its output with the same layout as its input can process
+        // the chain buffer in place.
+        const buffer_config_t& in = halConfig.inputCfg;
+        const buffer_config_t& out = halConfig.outputCfg;
+        mInPlaceCapable = in.channels == out.channels && in.format == out.format &&
+                          out.accessMode == EFFECT_BUFFER_ACCESS_WRITE;
+        mOutputFrameSize =
+                audio_bytes_per_sample(static_cast<audio_format_t>(out.format)) *
+                audio_channel_count_from_out_mask(static_cast<audio_channel_mask_t>(out.channels));
+    }
+    return retval;
 }
 
 Result Effect::setParameterImpl(uint32_t paramSize, const void* paramData, uint32_t valueSize,
@@ -502,11 +544,19 @@ Return<Result> Effect::reset() {
 }
 
 Return<Result> Effect::enable() {
-    return sendCommandReturningStatus(EFFECT_CMD_ENABLE, "ENABLE");
+    Result retval = sendCommandReturningStatus(EFFECT_CMD_ENABLE, "ENABLE");
+    if (retval == Result::OK) {
+        mEnabled = true;
+    }
+    return retval;
 }
 
 Return<Result> Effect::disable() {
-    return sendCommandReturningStatus(EFFECT_CMD_DISABLE, "DISABLE");
+    Result retval = sendCommandReturningStatus(EFFECT_CMD_DISABLE, "DISABLE");
+    if (retval == Result::OK) {
+        mEnabled = false;
+    }
+    return retval;
 }
 
 Return<Result> Effect::setDevice(AudioDeviceBitfield device) {
@@ -708,6 +758,9 @@ Return<Result> Effect::close() {
     if (mEfGroup) {
         mEfGroup->wake(static_cast<uint32_t>(MessageQueueFlagBits::REQUEST_QUIT));
     }
+    if (mChain != nullptr) {
+        mChain->leave(this);
+    }
 #if MAJOR_VERSION <= 5
     return Result::OK;
 #elif MAJOR_VERSION >= 6
@@ -715,6 +768,7 @@ Return<Result> Effect::close() {
     // must finish processing before closing the effect.
     Result retval =
             analyzeStatus("EffectRelease", "", sContextCallFunction, EffectRelease(mHandle));
+    EffectChain::clearSession(mHandle);
     EffectMap::getInstance().remove(mHandle);
     return retval;
 #endif
@@ -722,6 +776,16 @@ Return<Result> Effect::close() {
 
 Return<void> Effect::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
     if (fd.getNativeHandle() != nullptr && fd->numFds == 1) {
+        const uint64_t count = mProcessStatistics.count.load(std::memory_order_relaxed);
+        const uint64_t totalNs = mProcessStatistics.totalNs.load(std::memory_order_relaxed);
+        const uint64_t maxNs = mProcessStatistics.maxNs.load(std::memory_order_relaxed);
+        dprintf(fd->data[0],
+                "Effect %p processing: %" PRIu64 " calls, average %.1f us, max %.1f us\n", mHandle,
+                count, count != 0 ? totalNs / 1000.0 / count : 0.0, maxNs / 1000.0);
+        if (mChain != nullptr) {
+            dprintf(fd->data[0], "  Chained processing in session %d, %s\n", mChain->getSession(),
+                    mChain->isHead(this) ? "head of the chain" : "member of the chain");
+        }
         uint32_t cmdData = fd->data[0];
         (void)sendCommand(EFFECT_CMD_DUMP, "DUMP", sizeof(cmdData), &cmdData);
     }
@@ -20,6 +20,7 @@
 #include PATH(android/hardware/audio/effect/FILE_VERSION/IEffect.h)
 
 #include "AudioBufferManager.h"
+#include "EffectChain.h"
 
 #include <atomic>
 #include <memory>
@@ -156,10 +157,23 @@ struct Effect : public IEffect {
     Result setParameterImpl(uint32_t paramSize, const void* paramData, uint32_t valueSize,
                             const void* valueData);
 
+    // Runs the HAL effect on the given buffers and accounts the time spent for 'debug'.
+    // Called from the processing thread only.
+    int32_t processBuffers(audio_buffer_t* inBuffer, audio_buffer_t* outBuffer, bool reverse);
+    // Serves a processing request from the client, either directly or through the effect chain.
+    int32_t processRequest(bool reverse);
+
    private:
+    friend class EffectChain;         // to process the members of a chain
     friend struct VirtualizerEffect;  // for getParameterImpl
     friend struct VisualizerEffect;   // to allow executing commands
 
+    struct ProcessStatistics {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> totalNs{0};
+        std::atomic<uint64_t> maxNs{0};
+    };
+
     using CommandSuccessCallback = std::function<void()>;
     using GetConfigCallback = std::function<void(Result retval, const EffectConfig& config)>;
     using GetCurrentConfigSuccessCallback = std::function<void(void* configData)>;
@@ -179,6 +193,15 @@ struct Effect : public IEffect {
     EventFlag* mEfGroup;
     std::atomic<bool> mStopProcessThread;
     sp<Thread> mProcessThread;
+    ProcessStatistics mProcessStatistics;
+
+    // State used in chained processing mode, see EffectChain.
+    sp<EffectChain> mChain;
+    std::atomic<bool> mEnabled;
+    std::atomic<bool> mInPlaceCapable;
+    std::atomic<size_t> mOutputFrameSize;
+    std::atomic<bool> mProcessedByChain;
+    std::atomic<int32_t> mChainResult;
 
     virtual ~Effect();
 
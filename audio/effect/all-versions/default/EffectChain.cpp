@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EffectChainHAL"
+
+#include "EffectChain.h"
+#include "Effect.h"
+
+#include <errno.h>
+#include <memory.h>
+
+#include <algorithm>
+
+#include <android/log.h>
+#include <cutils/properties.h>
+
+namespace android {
+namespace hardware {
+namespace audio {
+namespace effect {
+namespace CPP_VERSION {
+namespace implementation {
+
+// static
+std::mutex EffectChain::sLock;
+std::map<effect_handle_t, int32_t> EffectChain::sSessions;
+std::map<uint64_t, wp<EffectChain>> EffectChain::sChains;
+
+// static
+bool EffectChain::isEnabled() {
+    static const bool enabled =
+            property_get_bool("ro.vendor.audio.effect.chained_processing", false /*default*/);
+    return enabled;
+}
+
+// static
+void EffectChain::setSession(effect_handle_t handle, int32_t session, uint32_t flags) {
+    if (!isEnabled()) return;
+    // Only the sessions of a single stream are chained. The output mix and output stage sessions
+    // are global, and auxiliary effects don't process the session buffer.
+    if (session <= AUDIO_SESSION_OUTPUT_MIX ||
+        (flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_AUXILIARY) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(sLock);
+    sSessions[handle] = session;
+}
+
+// static
+void EffectChain::clearSession(effect_handle_t handle) {
+    if (!isEnabled()) return;
+    std::lock_guard<std::mutex> lock(sLock);
+    sSessions.erase(handle);
+}
+
+// static
+sp<EffectChain> EffectChain::join(Effect* effect, uint64_t inBufferId) {
+    if (!isEnabled()) return nullptr;
+    std::lock_guard<std::mutex> sessionsLock(sLock);
+    auto session = sSessions.find(effect->mHandle);
+    if (session == sSessions.end()) return nullptr;
+    sp<EffectChain> chain = sChains[inBufferId].promote();
+    if (chain == nullptr) {
+        chain = new EffectChain(session->second, inBufferId);
+        sChains[inBufferId] = chain;
+    } else if (chain->mSession != session->second) {
+        ALOGW("effect %p of session %d shares its input buffer with session %d, not chaining it",
+              effect->mHandle, session->second, chain->mSession);
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(chain->mLock);
+    chain->mMembers.push_back(effect);
+    chain->resetOrder_l();
+    return chain;
+}
+
+EffectChain::EffectChain(int32_t session, uint64_t bufferId)
+    : mSession(session), mBufferId(bufferId) {}
+
+void EffectChain::leave(Effect* effect) {
+    // Lock order is sLock then mLock, so an emptied chain can not be joined concurrently.
+    std::lock_guard<std::mutex> sessionsLock(sLock);
+    std::lock_guard<std::mutex> lock(mLock);
+    mMembers.erase(std::remove(mMembers.begin(), mMembers.end(), effect), mMembers.end());
+    resetOrder_l();
+    if (mMembers.empty()) {
+        auto chain = sChains.find(mBufferId);
+        if (chain != sChains.end() && chain->second == this) {
+            sChains.erase(chain);
+        }
+    }
+}
+
+bool EffectChain::isHead(const Effect* effect) {
+    std::lock_guard<std::mutex> lock(mLock);
+    return !mOrder.empty() && mOrder.front() == effect;
+}
+
+void EffectChain::resetOrder_l() {
+    mOrder.clear();
+    mRound.clear();
+    for (Effect* member : mMembers) {
+        member->mProcessedByChain.store(false, std::memory_order_relaxed);
+    }
+}
+
+int32_t EffectChain::process(Effect* effect) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (effect->mProcessedByChain.exchange(false, std::memory_order_acq_rel)) {
+        return effect->mChainResult.load(std::memory_order_relaxed);
+    }
+    if (!mOrder.empty()) {
+        if (mOrder.front() == effect) {
+            return processChain_l(effect);
+        }
+        // The chain didn't process this effect before its request came, so the client doesn't
+        // follow the learned order anymore.
+        resetOrder_l();
+    }
+
+    // Learn the order: a round ends when its first effect requests processing again.
+    if (std::find(mRound.begin(), mRound.end(), effect) != mRound.end()) {
+        if (mRound.front() == effect && mRound.size() > 1) {
+            mOrder.swap(mRound);
+            mRound.clear();
+            return processChain_l(effect);
+        }
+        mRound.clear();
+    }
+    mRound.push_back(effect);
+    return effect->processBuffers(effect->mHalInBufferPtr.load(std::memory_order_relaxed),
+                                  effect->mHalOutBufferPtr.load(std::memory_order_relaxed),
+                                  false /*reverse*/);
+}
+
+int32_t EffectChain::processChain_l(Effect* head) {
+    int32_t headResult = -ENODEV;
+    audio_buffer_t* current = head->mHalInBufferPtr.load(std::memory_order_relaxed);
+    audio_buffer_t* finalOutput = nullptr;
+    size_t finalFrameSize = 0;
+    for (Effect* member : mOrder) {
+        // The head is processed because the client asked for it, the others only when enabled.
+        if (member != head && !member->mEnabled.load(std::memory_order_relaxed)) continue;
+        audio_buffer_t* output = member->mHalOutBufferPtr.load(std::memory_order_relaxed);
+        int32_t result;
+        if (current == nullptr || output == nullptr) {
+            ALOGE("processing buffers were not set before calling 'process'");
+            result = -ENODEV;
+        } else {
+            audio_buffer_t* target = member->mInPlaceCapable ? current : output;
+            result = member->processBuffers(current, target, false /*reverse*/);
+            current = target;
+            finalOutput = output;
+            finalFrameSize = member->mOutputFrameSize;
+        }
+        if (member == head) {
+            headResult = result;
+        } else {
+            member->mChainResult.store(result, std::memory_order_relaxed);
+            member->mProcessedByChain.store(true, std::memory_order_release);
+        }
+    }
+    // If the last effects processed in place, move the data to where the client expects it.
+    if (finalOutput != nullptr && current->raw != finalOutput->raw && finalFrameSize != 0) {
+        memcpy(finalOutput->raw, current->raw,
+               std::min(current->frameCount, finalOutput->frameCount) * finalFrameSize);
+    }
+    return headResult;
+}
+
+}  // namespace implementation
+}  // namespace CPP_VERSION
+}  // namespace effect
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUDIO_EFFECT_EFFECT_CHAIN_H
+#define ANDROID_HARDWARE_AUDIO_EFFECT_EFFECT_CHAIN_H
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <hardware/audio_effect.h>
+#include <utils/RefBase.h>
+
+namespace android {
+namespace hardware {
+namespace audio {
+namespace effect {
+namespace CPP_VERSION {
+namespace implementation {
+
+struct Effect;
+
+// Chained processing mode. When enabled with the "ro.vendor.audio.effect.chained_processing"
+// property, the insert effects of an audio session that process the same input buffer form a
+// chain. That is how the framework lays out the effect chain of a session: each effect processes
+// the session buffer in place, and the last one writes to the output. Global sessions, which can
+// be shared by several outputs, and auxiliary effects, which have their own input, are never
+// chained.
+//
+// The chain learns the order of its members from the processing requests of the client, which
+// processes them one after the other. Once a full round of requests has been seen, a request on
+// the first effect of that round (the head) runs every enabled effect of the chain in the same
+// order on the head's processing thread. The output of each effect is the input of the next one,
+// and effects whose input and output configurations match process in place. The result ends up
+// in the output buffer of the last processed effect. The requests that follow on the other
+// effects return the stored result without processing the data again.
+//
+// A request that doesn't fit the learned order, because the client changed the order or enabled
+// or disabled an effect, is served by the effect alone, and the order is learned again. So is
+// every request while the order is being learned, so an effect is never processed twice in a
+// round.
+class EffectChain : public RefBase {
+   public:
+    static bool isEnabled();
+
+    // Remembers the session an effect handle has been created on, if its effects can be chained.
+    static void setSession(effect_handle_t handle, int32_t session, uint32_t flags);
+    static void clearSession(effect_handle_t handle);
+
+    // Adds the effect to the chain of the input buffer it processes. Returns nullptr if chained
+    // processing is disabled or the effect can not be chained.
+    static sp<EffectChain> join(Effect* effect, uint64_t inBufferId);
+    void leave(Effect* effect);
+
+    // Called from the processing thread of 'effect' when the client requests processing.
+    int32_t process(Effect* effect);
+
+    bool isHead(const Effect* effect);
+    int32_t getSession() const { return mSession; }
+    uint64_t getBufferId() const { return mBufferId; }
+
+   private:
+    EffectChain(int32_t session, uint64_t bufferId);
+
+    void resetOrder_l();
+    int32_t processChain_l(Effect* head);
+
+    static std::mutex sLock;
+    static std::map<effect_handle_t, int32_t> sSessions;
+    static std::map<uint64_t, wp<EffectChain>> sChains;
+
+    const int32_t mSession;
+    const uint64_t mBufferId;
+    // Membership changes are rare and never happen while the client is processing, so the
+    // processing threads, which run one at a time, are not expected to contend on this lock.
+    std::mutex mLock;
+    std::vector<Effect*> mMembers;
+    // The members in the order the client processes them, empty while it is being learned.
+    std::vector<Effect*> mOrder;
+    // The members that requested processing in the current round while learning the order.
+    std::vector<Effect*> mRound;
+};
+
+}  // namespace implementation
+}  // namespace CPP_VERSION
+}  // namespace effect
+}  // namespace audio
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_AUDIO_EFFECT_EFFECT_CHAIN_H
@@ -186,6 +186,9 @@ Return<void> EffectsFactory::createEffectImpl(const Uuid& uuid, int32_t session,
         memset(&halDescriptor, 0, sizeof(effect_descriptor_t));
         status = (*handle)->get_descriptor(handle, &halDescriptor);
         if (status == OK) {
+            if (session != AUDIO_SESSION_DEVICE) {
+                EffectChain::setSession(handle, session, halDescriptor.flags);
+            }
             effect = dispatchEffectInstanceCreation(halDescriptor, handle);
             effectId = EffectMap::getInstance().add(handle);
         } else {
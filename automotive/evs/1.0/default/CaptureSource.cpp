@@ -0,0 +1,537 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.automotive.evs@1.0-service"
+
+#include "CaptureSource.h"
+#include "EvsCamera.h"
+#include "TestPattern.h"
+
+#include <log/log.h>
+#include <ui/GraphicBufferAllocator.h>
+#include <ui/GraphicBufferMapper.h>
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Arbitrary limits on the number of graphics buffers, matching EvsCamera
+static const unsigned kMaxBuffersPerConsumer = 100;
+static const unsigned kMaxBuffers = 256;
+
+// Buffers beyond the consumers' frames in flight: one being filled, and one more so the
+// producer doesn't wait on a consumer that is just about to return a frame
+static const unsigned kSpareBuffers = 2;
+
+// How long the capture thread waits for a device frame before checking whether to stop
+static const int kCapturePollTimeoutMs = 100;
+
+
+CaptureSource::CaptureSource(const char *id, nsecs_t framePeriod) :
+        mFramePeriod(framePeriod) {
+    ALOGD("CaptureSource instantiated for %s", id);
+
+    mDescription.cameraId = id;
+
+    if (EvsCamera::isCaptureDeviceId(id)) {
+        if (mVideo.open(id)) {
+            mWidth  = mVideo.getWidth();
+            mHeight = mVideo.getHeight();
+        }
+        mFormat = HAL_PIXEL_FORMAT_YCBCR_422_I;
+        mUsage  = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_CAMERA_WRITE |
+                  GRALLOC_USAGE_SW_READ_RARELY;
+        return;
+    }
+
+    // Same test data as the exclusive EvsCamera
+    if (mDescription.cameraId == EvsCamera::kCameraName_Backup) {
+        mWidth  = 640;
+        mHeight = 480;
+        mDescription.vendorFlags = 0xFFFFFFFF;
+    } else {
+        mWidth  = 320;
+        mHeight = 240;
+    }
+    mFormat = HAL_PIXEL_FORMAT_RGBA_8888;
+    mUsage  = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_CAMERA_WRITE |
+              GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_RARELY;
+}
+
+
+CaptureSource::~CaptureSource() {
+    ALOGD("CaptureSource for %s being destroyed", mDescription.cameraId.c_str());
+
+    std::unique_lock<std::mutex> lock(mLock);
+    mRunning = false;
+    mDeliveryDone.notify_all();
+    std::thread thread = std::move(mCaptureThread);
+    lock.unlock();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    lock.lock();
+
+    GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
+    for (auto&& buffer : mBuffers) {
+        if (buffer.refs > 0) {
+            ALOGE("Error - releasing buffer despite remote ownership");
+        }
+        alloc.free(buffer.handle);
+    }
+    mBuffers.clear();
+}
+
+
+uint32_t CaptureSource::addConsumer() {
+    std::lock_guard<std::mutex> lock(mLock);
+    uint32_t consumerId = mNextConsumerId++;
+    mConsumers.emplace(consumerId, Consumer());
+    return consumerId;
+}
+
+
+void CaptureSource::removeConsumer(uint32_t consumerId) {
+    std::unique_lock<std::mutex> lock(mLock);
+    stopStream_Locked(lock, consumerId);
+
+    auto it = mConsumers.find(consumerId);
+    if (it != mConsumers.end()) {
+        releaseConsumerFrames_Locked(it->second);
+        mConsumers.erase(it);
+    }
+}
+
+
+EvsResult CaptureSource::setMaxFramesInFlight(uint32_t consumerId, uint32_t bufferCount) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto it = mConsumers.find(consumerId);
+    if (it == mConsumers.end()) {
+        return EvsResult::OWNERSHIP_LOST;
+    }
+    if (bufferCount < 1 || bufferCount > kMaxBuffersPerConsumer) {
+        ALOGE("Rejecting request for %u frames in flight", bufferCount);
+        return bufferCount < 1 ? EvsResult::INVALID_ARG : EvsResult::BUFFER_NOT_AVAILABLE;
+    }
+
+    // Synthetic frames grow the buffer pool as needed.  A capture device got its buffers
+    // when the stream started, so a larger limit only takes full effect on the next start.
+    it->second.maxFramesInFlight = bufferCount;
+    return EvsResult::OK;
+}
+
+
+EvsResult CaptureSource::startStream(uint32_t consumerId, const sp<IEvsCameraStream>& stream) {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    auto it = mConsumers.find(consumerId);
+    if (it == mConsumers.end()) {
+        return EvsResult::OWNERSHIP_LOST;
+    }
+    if (it->second.stream != nullptr) {
+        ALOGE("ignoring startVideoStream call when a stream is already running.");
+        return EvsResult::STREAM_ALREADY_RUNNING;
+    }
+    if (EvsCamera::isCaptureDeviceId(mDescription.cameraId.c_str()) && !mVideo.isOpen()) {
+        ALOGE("Capture device %s is not available", mDescription.cameraId.c_str());
+        return EvsResult::UNDERLYING_SERVICE_ERROR;
+    }
+
+    // Let a capture thread that is stopping finish first, so it can't undo our start.
+    // One that stopped on its own, after a device error, is reaped here.
+    mDeliveryDone.wait(lock, [this]() { return mRunning || !mThreadActive; });
+    if (!mRunning && mCaptureThread.joinable()) {
+        mCaptureThread.join();
+    }
+
+    it = mConsumers.find(consumerId);
+    if (it == mConsumers.end()) {
+        return EvsResult::OWNERSHIP_LOST;
+    }
+    it->second.stream = stream;
+    mStreamingConsumers++;
+
+    if (!mRunning) {
+        if (mVideo.isOpen() && !startCapture_Locked()) {
+            it->second.stream = nullptr;
+            mStreamingConsumers--;
+            return EvsResult::UNDERLYING_SERVICE_ERROR;
+        }
+
+        mRunning = true;
+        mThreadActive = true;
+        mNextFrameTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        mCaptureThread = std::thread([this](){ captureThread(); });
+    }
+
+    return EvsResult::OK;
+}
+
+
+void CaptureSource::stopStream(uint32_t consumerId) {
+    std::unique_lock<std::mutex> lock(mLock);
+    stopStream_Locked(lock, consumerId);
+}
+
+
+void CaptureSource::stopStream_Locked(std::unique_lock<std::mutex>& lock, uint32_t consumerId) {
+    auto it = mConsumers.find(consumerId);
+    if (it == mConsumers.end() || it->second.stream == nullptr) {
+        return;
+    }
+
+    sp<IEvsCameraStream> stream = it->second.stream;
+    it->second.stream = nullptr;
+    mStreamingConsumers--;
+
+    // The capture thread might be delivering a frame to this consumer right now.  Once
+    // that round is over, no frame can follow the end of stream marker.
+    const uint64_t round = mDeliveryRound;
+    mDeliveryDone.wait(lock, [this, round](){ return !mDelivering || mDeliveryRound != round; });
+
+    std::thread thread;
+    if (mStreamingConsumers == 0) {
+        mRunning = false;
+        thread = std::move(mCaptureThread);
+        mDeliveryDone.notify_all();
+    }
+
+    lock.unlock();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    // Send one last NULL frame to signal the actual end of stream
+    BufferDesc nullBuff = {};
+    auto result = stream->deliverFrame(nullBuff);
+    if (!result.isOk()) {
+        ALOGE("Error delivering end of stream marker");
+    }
+    lock.lock();
+}
+
+
+void CaptureSource::doneWithFrame(uint32_t consumerId, const BufferDesc& buffer) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto it = mConsumers.find(consumerId);
+    if (it == mConsumers.end()) {
+        return;
+    }
+    Consumer& consumer = it->second;
+    if (buffer.bufferId >= consumer.held.size() || !consumer.held[buffer.bufferId]) {
+        ALOGE("ignoring doneWithFrame called on frame %u which is not held", buffer.bufferId);
+        return;
+    }
+
+    consumer.held[buffer.bufferId] = false;
+    consumer.framesInFlight--;
+    releaseBuffer_Locked(buffer.bufferId);
+}
+
+
+CaptureSource::ConsumerStats CaptureSource::getStats(uint32_t consumerId) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mConsumers.find(consumerId);
+    return it == mConsumers.end() ? ConsumerStats() : it->second.stats;
+}
+
+
+unsigned CaptureSource::targetBufferCount_Locked() const {
+    unsigned count = kSpareBuffers;
+    for (const auto& entry : mConsumers) {
+        count += entry.second.maxFramesInFlight;
+    }
+    if (mVideo.isOpen()) {
+        count = std::max(count, mVideo.getMinBufferCount());
+    }
+    return std::min(count, kMaxBuffers);
+}
+
+
+bool CaptureSource::allocateBuffer_Locked() {
+    buffer_handle_t handle = nullptr;
+    status_t result = GraphicBufferAllocator::get().allocate(
+            mWidth, mHeight, mFormat, 1, mUsage, &handle, &mStride, 0, "EvsCaptureSource");
+    if (result != NO_ERROR || handle == nullptr) {
+        ALOGE("Error %d allocating %d x %d graphics buffer", result, mWidth, mHeight);
+        return false;
+    }
+
+    mBuffers.emplace_back();
+    mBuffers.back().handle = handle;
+    return true;
+}
+
+
+bool CaptureSource::startCapture_Locked() {
+    while (mBuffers.size() < targetBufferCount_Locked()) {
+        if (!allocateBuffer_Locked()) {
+            break;
+        }
+    }
+
+    // Frames still held from a previous stream stay out of the device until it restarts
+    std::vector<int> dmabufFds;
+    mCaptureSlots.clear();
+    for (unsigned idx = 0; idx < mBuffers.size(); idx++) {
+        Buffer& buffer = mBuffers[idx];
+        if (buffer.refs > 0 || buffer.handle->numFds < 1) {
+            continue;
+        }
+        buffer.captureSlot = mCaptureSlots.size();
+        dmabufFds.push_back(buffer.handle->data[0]);
+        mCaptureSlots.push_back(idx);
+    }
+
+    // YUYV uses two bytes per pixel, and gralloc reports the stride in pixels
+    const uint32_t strideBytes = mStride * 2;
+    if (dmabufFds.empty() ||
+        !mVideo.startStream(dmabufFds, strideBytes, strideBytes * mHeight)) {
+        ALOGE("Failed to start capturing from %s", mDescription.cameraId.c_str());
+        for (auto&& buffer : mBuffers) {
+            buffer.captureSlot = -1;
+        }
+        mCaptureSlots.clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+void CaptureSource::releaseBuffer_Locked(unsigned idx) {
+    Buffer& buffer = mBuffers[idx];
+    if (--buffer.refs > 0) {
+        return;
+    }
+
+    if (buffer.captureSlot >= 0 && mVideo.isStreaming()) {
+        mVideo.returnFrame(buffer.captureSlot);
+    } else {
+        // A synthetic frame might be waiting for this buffer
+        mDeliveryDone.notify_all();
+    }
+}
+
+
+void CaptureSource::releaseConsumerFrames_Locked(Consumer& consumer) {
+    for (unsigned idx = 0; idx < consumer.held.size(); idx++) {
+        if (consumer.held[idx]) {
+            consumer.held[idx] = false;
+            releaseBuffer_Locked(idx);
+        }
+    }
+    consumer.framesInFlight = 0;
+}
+
+
+BufferDesc CaptureSource::describeBuffer_Locked(unsigned idx) const {
+    BufferDesc buff = {};
+    buff.width      = mWidth;
+    buff.height     = mHeight;
+    buff.stride     = mStride;
+    buff.format     = mFormat;
+    buff.usage      = mUsage;
+    buff.bufferId   = idx;
+    buff.memHandle  = mBuffers[idx].handle;
+    return buff;
+}
+
+
+bool CaptureSource::acquireFrame(unsigned* idx) {
+    if (mVideo.isOpen()) {
+        while (true) {
+            uint32_t slot = 0;
+            nsecs_t timestamp = 0;
+            VideoCapture::FrameResult frame =
+                    mVideo.waitForFrame(kCapturePollTimeoutMs, &slot, &timestamp);
+
+            std::lock_guard<std::mutex> lock(mLock);
+            if (!mRunning || frame == VideoCapture::FRAME_ERROR) {
+                return false;
+            }
+            if (frame == VideoCapture::FRAME_READY) {
+                *idx = mCaptureSlots[slot];
+                mBuffers[*idx].refs = 1;
+                return true;
+            }
+        }
+    }
+
+    // Pace synthetic frames, without trying to catch up on frames we were too slow for
+    if (mFramePeriod > 0) {
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (mNextFrameTime > now) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(mNextFrameTime - now));
+            mNextFrameTime += mFramePeriod;
+        } else {
+            mNextFrameTime = now + mFramePeriod;
+        }
+    }
+
+    buffer_handle_t handle = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        auto findFreeBuffer = [this, idx]() {
+            for (unsigned i = 0; i < mBuffers.size(); i++) {
+                if (mBuffers[i].refs == 0) {
+                    *idx = i;
+                    return true;
+                }
+            }
+            if (mBuffers.size() < targetBufferCount_Locked() && allocateBuffer_Locked()) {
+                *idx = mBuffers.size() - 1;
+                return true;
+            }
+            return false;
+        };
+        mDeliveryDone.wait(lock, [&]() { return !mRunning || findFreeBuffer(); });
+        if (!mRunning) {
+            return false;
+        }
+        mBuffers[*idx].refs = 1;
+        handle = mBuffers[*idx].handle;
+    }
+
+    // Write test data into the image buffer
+    uint32_t *pixels = nullptr;
+    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
+    mapper.lock(handle, GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                android::Rect(mWidth, mHeight), (void **) &pixels);
+    if (pixels) {
+        fillTestPattern(pixels, mWidth, mHeight, mStride, mFrameTicker++ & 0xFF);
+    } else {
+        ALOGE("Camera failed to gain access to image buffer for writing");
+    }
+    mapper.unlock(handle);
+    return true;
+}
+
+
+// This is the thread producing frames for all the consumers of this source
+void CaptureSource::captureThread() {
+    ALOGD("Shared capture loop started for %s", mDescription.cameraId.c_str());
+
+    std::vector<std::pair<uint32_t, sp<IEvsCameraStream>>> targets;
+    while (true) {
+        unsigned idx = 0;
+        if (!acquireFrame(&idx)) {
+            break;
+        }
+
+        // Hand the frame to every consumer with room for it
+        BufferDesc buff;
+        targets.clear();
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (!mRunning) {
+                releaseBuffer_Locked(idx);
+                break;
+            }
+
+            for (auto&& entry : mConsumers) {
+                Consumer& consumer = entry.second;
+                if (consumer.stream == nullptr) {
+                    continue;
+                }
+                if (consumer.framesInFlight >= consumer.maxFramesInFlight) {
+                    consumer.stats.framesDropped++;
+                    continue;
+                }
+                if (consumer.held.size() <= idx) {
+                    consumer.held.resize(mBuffers.size());
+                }
+                consumer.held[idx] = true;
+                consumer.framesInFlight++;
+                mBuffers[idx].refs++;
+                targets.emplace_back(entry.first, consumer.stream);
+            }
+            buff = describeBuffer_Locked(idx);
+            mDelivering = true;
+        }
+
+        // Issue the (asynchronous) callbacks -- can't be holding the lock
+        for (auto&& target : targets) {
+            auto result = target.second->deliverFrame(buff);
+
+            std::lock_guard<std::mutex> lock(mLock);
+            auto it = mConsumers.find(target.first);
+            if (it == mConsumers.end()) {
+                continue;
+            }
+            Consumer& consumer = it->second;
+            if (result.isOk()) {
+                consumer.stats.framesDelivered++;
+                continue;
+            }
+
+            // This can happen if the client dies.  Stop sending it frames, and since we
+            // didn't actually deliver this one, take it back.
+            ALOGE("Frame delivery call failed in the transport layer.");
+            if (consumer.held[idx]) {
+                consumer.held[idx] = false;
+                consumer.framesInFlight--;
+                releaseBuffer_Locked(idx);
+            }
+            if (consumer.stream != nullptr) {
+                consumer.stream = nullptr;
+                mStreamingConsumers--;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mDelivering = false;
+            mDeliveryRound++;
+            releaseBuffer_Locked(idx);
+            if (mStreamingConsumers == 0) {
+                mRunning = false;
+            }
+        }
+        mDeliveryDone.notify_all();
+    }
+
+    // Take back the buffers still queued to the device
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mVideo.isStreaming()) {
+        mVideo.stopStream();
+        for (auto&& buffer : mBuffers) {
+            buffer.captureSlot = -1;
+        }
+        mCaptureSlots.clear();
+    }
+    mThreadActive = false;
+    mDeliveryDone.notify_all();
+    ALOGD("Shared capture loop ended for %s", mDescription.cameraId.c_str());
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
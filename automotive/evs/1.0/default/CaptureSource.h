@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTURESOURCE_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTURESOURCE_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+#include <android/hardware/automotive/evs/1.0/IEvsCameraStream.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "VideoCapture.h"
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// One physical (or synthetic) camera shared by several clients.
+//
+// A single capture thread produces each frame once, into a pool of graphics buffers, and
+// hands the same buffer to every streaming consumer.  A buffer is reference counted and
+// only reused once all the consumers it went to have returned it.  Each consumer has
+// its own frames in flight limit: a consumer at its limit simply misses the frame while
+// the others still receive it, so a slow client never holds back the rest.
+class CaptureSource : public RefBase {
+public:
+    // Frame rate of synthetic cameras; we arbitrarily choose 12 fps to pass the 10fps test
+    static constexpr nsecs_t kDefaultFramePeriod = 1000000000LL / 12;
+
+    // A framePeriod of zero generates synthetic frames as fast as the consumers take them
+    explicit CaptureSource(const char *id, nsecs_t framePeriod = kDefaultFramePeriod);
+    virtual ~CaptureSource();
+
+    const CameraDesc& getDesc() const { return mDescription; }
+
+    // Consumers are identified by the value returned from addConsumer()
+    uint32_t addConsumer();
+    void removeConsumer(uint32_t consumerId);
+
+    EvsResult setMaxFramesInFlight(uint32_t consumerId, uint32_t bufferCount);
+    EvsResult startStream(uint32_t consumerId, const sp<IEvsCameraStream>& stream);
+    void stopStream(uint32_t consumerId);
+    void doneWithFrame(uint32_t consumerId, const BufferDesc& buffer);
+
+    struct ConsumerStats {
+        uint64_t framesDelivered = 0;
+        uint64_t framesDropped = 0;     // Frames skipped because the consumer was at its limit
+    };
+    ConsumerStats getStats(uint32_t consumerId);
+
+private:
+    struct Buffer {
+        buffer_handle_t handle = nullptr;
+        unsigned refs = 0;              // The capture thread and each consumer holding it
+        int captureSlot = -1;           // Index of the buffer in the capture device, if any
+    };
+
+    struct Consumer {
+        sp<IEvsCameraStream> stream;    // Set while streaming
+        unsigned maxFramesInFlight = 1;
+        unsigned framesInFlight = 0;
+        std::vector<bool> held;         // By buffer index
+        ConsumerStats stats;
+    };
+
+    // These are expected to be called while mLock is held
+    unsigned targetBufferCount_Locked() const;
+    bool allocateBuffer_Locked();
+    bool startCapture_Locked();
+    void releaseBuffer_Locked(unsigned idx);
+    void releaseConsumerFrames_Locked(Consumer& consumer);
+    void stopStream_Locked(std::unique_lock<std::mutex>& lock, uint32_t consumerId);
+    BufferDesc describeBuffer_Locked(unsigned idx) const;
+
+    void captureThread();
+    bool acquireFrame(unsigned* idx);   // Blocks until a buffer holds a new frame
+
+    CameraDesc mDescription = {};
+    uint32_t mWidth  = 0;
+    uint32_t mHeight = 0;
+    uint32_t mFormat = 0;
+    uint32_t mUsage  = 0;
+    uint32_t mStride = 0;
+    const nsecs_t mFramePeriod;
+
+    VideoCapture mVideo;                // Open only for sources backed by a V4L2 device
+    std::vector<unsigned> mCaptureSlots;
+
+    std::mutex mLock;
+    std::condition_variable mDeliveryDone;  // Signaled on any change the thread waits for
+    std::vector<Buffer> mBuffers;
+    std::map<uint32_t, Consumer> mConsumers;
+    uint32_t mNextConsumerId = 1;
+    unsigned mStreamingConsumers = 0;
+    bool mRunning = false;              // The capture thread should keep going
+    bool mThreadActive = false;         // The capture thread hasn't finished yet
+    bool mDelivering = false;           // The capture thread is calling deliverFrame()
+    uint64_t mDeliveryRound = 0;        // Counts the frames handed to the consumers
+    nsecs_t mNextFrameTime = 0;         // Only used by the capture thread from here on
+    uint32_t mFrameTicker = 0;
+    std::thread mCaptureThread;
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTURESOURCE_H
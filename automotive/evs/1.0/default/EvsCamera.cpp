@@ -18,10 +18,16 @@
 
 #include "EvsCamera.h"
 #include "EvsEnumerator.h"
+#include "TestPattern.h"
 
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 
+#include <algorithm>
+
+#include <string.h>
+#include <time.h>
+
 
 namespace android {
 namespace hardware {
@@ -39,6 +45,14 @@ const char EvsCamera::kCameraName_Backup[]    = "backup";
 // Safeguards against unreasonable resource consumption and provides a testable limit
 const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
 
+// How long the capture thread waits for a frame before checking whether it should stop
+const int kCapturePollTimeoutMs = 100;
+
+
+bool EvsCamera::isCaptureDeviceId(const char *id) {
+    return strncmp(id, "/dev/video", strlen("/dev/video")) == 0;
+}
+
 
 EvsCamera::EvsCamera(const char *id) :
         mFramesAllowed(0),
@@ -49,6 +63,19 @@ EvsCamera::EvsCamera(const char *id) :
 
     mDescription.cameraId = id;
 
+    if (isCaptureDeviceId(id)) {
+        // Frames come straight from the device into our graphics buffers, so they are
+        // laid out the way the driver produces them.
+        if (mVideo.open(id)) {
+            mWidth  = mVideo.getWidth();
+            mHeight = mVideo.getHeight();
+        }
+        mFormat = HAL_PIXEL_FORMAT_YCBCR_422_I;
+        mUsage  = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_CAMERA_WRITE |
+                  GRALLOC_USAGE_SW_READ_RARELY;
+        return;
+    }
+
     // Set up dummy data for testing
     if (mDescription.cameraId == kCameraName_Backup) {
         mWidth  = 640;          // full NTSC/VGA
@@ -130,6 +157,12 @@ Return<EvsResult> EvsCamera::setMaxFramesInFlight(uint32_t bufferCount) {
         return EvsResult::INVALID_ARG;
     }
 
+    // The capture device was handed the buffers when the stream started
+    if (mVideo.isStreaming()) {
+        ALOGE("Cannot change the buffer count of a capture device while streaming");
+        return EvsResult::BUFFER_NOT_AVAILABLE;
+    }
+
     // Update our internal state
     if (setAvailableFrames_Locked(bufferCount)) {
         return EvsResult::OK;
@@ -153,10 +186,17 @@ Return<EvsResult> EvsCamera::startVideoStream(const ::android::sp<IEvsCameraStre
         return EvsResult::STREAM_ALREADY_RUNNING;
     }
 
-    // If the client never indicated otherwise, configure ourselves for a single streaming buffer
-    if (mFramesAllowed < 1) {
-        if (!setAvailableFrames_Locked(1)) {
-            ALOGE("Failed to start stream because we couldn't get a graphics buffer");
+    // If the client never indicated otherwise, configure ourselves for a single streaming buffer.
+    // A capture device can't stream with fewer buffers than its driver needs in rotation, so
+    // give it at least that many.
+    unsigned framesNeeded = std::max(mFramesAllowed, 1u);
+    if (mVideo.isOpen()) {
+        framesNeeded = std::max(framesNeeded, mVideo.getMinBufferCount());
+    }
+    if (mFramesAllowed < framesNeeded) {
+        if (!setAvailableFrames_Locked(framesNeeded)) {
+            ALOGE("Failed to start stream because we couldn't get %u graphics buffers",
+                  framesNeeded);
             return EvsResult::BUFFER_NOT_AVAILABLE;
         }
     }
@@ -164,6 +204,21 @@ Return<EvsResult> EvsCamera::startVideoStream(const ::android::sp<IEvsCameraStre
     // Record the user's callback for use when we have a frame ready
     mStream = stream;
 
+    if (mVideo.isOpen()) {
+        if (!startCapture_Locked()) {
+            mStream = nullptr;
+            return EvsResult::UNDERLYING_SERVICE_ERROR;
+        }
+
+        mStreamState = RUNNING;
+        mCaptureThread = std::thread([this](){ captureFrames(); });
+        return EvsResult::OK;
+    } else if (isCaptureDeviceId(mDescription.cameraId.c_str())) {
+        ALOGE("Capture device %s is not available", mDescription.cameraId.c_str());
+        mStream = nullptr;
+        return EvsResult::UNDERLYING_SERVICE_ERROR;
+    }
+
     // Start the frame generation thread
     mStreamState = RUNNING;
     mCaptureThread = std::thread([this](){ generateFrames(); });
@@ -190,6 +245,16 @@ Return<void> EvsCamera::doneWithFrame(const BufferDesc& buffer)  {
             mBuffers[buffer.bufferId].inUse = false;
             mFramesInUse--;
 
+            // Give it back to the capture device to be filled again
+            if (mVideo.isStreaming()) {
+                for (unsigned slot = 0; slot < mCaptureSlots.size(); slot++) {
+                    if (mCaptureSlots[slot] == buffer.bufferId) {
+                        mVideo.returnFrame(slot);
+                        break;
+                    }
+                }
+            }
+
             // If this frame's index is high in the array, try to move it down
             // to improve locality after mFramesAllowed has been reduced.
             if (buffer.bufferId >= mFramesAllowed) {
@@ -474,6 +539,130 @@ void EvsCamera::generateFrames() {
 }
 
 
+bool EvsCamera::startCapture_Locked() {
+    // Every graphics buffer not held by the client is handed to the driver.  The dmabuf
+    // backing a gralloc buffer is the first fd of its handle.
+    std::vector<int> dmabufFds;
+    mCaptureSlots.clear();
+    for (unsigned idx = 0; idx < mBuffers.size(); idx++) {
+        const BufferRecord& rec = mBuffers[idx];
+        if (rec.handle == nullptr || rec.inUse) {
+            continue;
+        }
+        if (rec.handle->numFds < 1) {
+            ALOGE("Graphics buffer %u has no dmabuf to capture into", idx);
+            mCaptureSlots.clear();
+            return false;
+        }
+        dmabufFds.push_back(rec.handle->data[0]);
+        mCaptureSlots.push_back(idx);
+    }
+
+    // YUYV uses two bytes per pixel, and gralloc reports the stride in pixels
+    const uint32_t strideBytes = mStride * 2;
+    if (!mVideo.startStream(dmabufFds, strideBytes, strideBytes * mHeight)) {
+        ALOGE("Failed to start capturing from %s", mDescription.cameraId.c_str());
+        mCaptureSlots.clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+static nsecs_t threadCpuTime() {
+    timespec ts = {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return seconds_to_nanoseconds(ts.tv_sec) + ts.tv_nsec;
+}
+
+
+// This is the capture thread used instead of generateFrames() for cameras backed by a
+// capture device.  Frames are delivered as soon as the driver completes them.
+void EvsCamera::captureFrames() {
+    ALOGD("Frame capture loop started");
+
+    const nsecs_t cpuTimeAtStart = threadCpuTime();
+    unsigned framesDelivered = 0;
+    nsecs_t totalLatency = 0;
+    nsecs_t maxLatency = 0;
+
+    while (true) {
+        uint32_t slot = 0;
+        nsecs_t timestamp = 0;
+        VideoCapture::FrameResult frame =
+                mVideo.waitForFrame(kCapturePollTimeoutMs, &slot, &timestamp);
+
+        unsigned idx = 0;
+        {
+            std::lock_guard<std::mutex> lock(mAccessLock);
+
+            if (mStreamState != RUNNING || frame == VideoCapture::FRAME_ERROR) {
+                // Break out of our main thread loop
+                break;
+            }
+            if (frame == VideoCapture::FRAME_TIMEOUT) {
+                continue;
+            }
+
+            // Buffers are only queued to the driver while the client doesn't hold them
+            idx = mCaptureSlots[slot];
+            mBuffers[idx].inUse = true;
+            mFramesInUse++;
+        }
+
+        BufferDesc buff = {};
+        buff.width      = mWidth;
+        buff.height     = mHeight;
+        buff.stride     = mStride;
+        buff.format     = mFormat;
+        buff.usage      = mUsage;
+        buff.bufferId   = idx;
+        buff.memHandle  = mBuffers[idx].handle;
+
+        // Issue the (asynchronous) callback to the client -- can't be holding the lock
+        auto result = mStream->deliverFrame(buff);
+        if (!result.isOk()) {
+            ALOGE("Frame delivery call failed in the transport layer.");
+
+            // Since we didn't actually deliver it, mark the frame as available
+            std::lock_guard<std::mutex> lock(mAccessLock);
+            mBuffers[idx].inUse = false;
+            mFramesInUse--;
+
+            break;
+        }
+
+        const nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - timestamp;
+        totalLatency += latency;
+        maxLatency = std::max(maxLatency, latency);
+        framesDelivered++;
+    }
+
+    // Take back the buffers still queued to the driver.  Buffers the client holds are
+    // returned to our pool by doneWithFrame() as usual.
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        mVideo.stopStream();
+        mCaptureSlots.clear();
+    }
+
+    if (framesDelivered > 0) {
+        ALOGI("%s delivered %u frames, glass-to-callback latency %.2f ms average, "
+              "%.2f ms max, %.1f us CPU per frame", mDescription.cameraId.c_str(),
+              framesDelivered, totalLatency / 1e6 / framesDelivered, maxLatency / 1e6,
+              (threadCpuTime() - cpuTimeAtStart) / 1e3 / framesDelivered);
+    }
+
+    // Send one last NULL frame to signal the actual end of stream
+    BufferDesc nullBuff = {};
+    auto result = mStream->deliverFrame(nullBuff);
+    if (!result.isOk()) {
+        ALOGE("Error delivering end of stream marker");
+    }
+}
+
+
 void EvsCamera::fillTestFrame(const BufferDesc& buff) {
     // Lock our output buffer for writing
     uint32_t *pixels = nullptr;
@@ -483,33 +672,17 @@ void EvsCamera::fillTestFrame(const BufferDesc& buff) {
                 android::Rect(buff.width, buff.height),
                 (void **) &pixels);
 
-    // If we failed to lock the pixel buffer, we're about to crash, but log it first
+    // If we failed to lock the pixel buffer, log it and skip the pixels
     if (!pixels) {
         ALOGE("Camera failed to gain access to image buffer for writing");
     }
 
     // Fill in the test pixels
-    for (unsigned row = 0; row < buff.height; row++) {
-        for (unsigned col = 0; col < buff.width; col++) {
-            // Index into the row to check the pixel at this column.
-            // We expect 0xFF in the LSB channel, a vertical gradient in the
-            // second channel, a horitzontal gradient in the third channel, and
-            // 0xFF in the MSB.
-            // The exception is the very first 32 bits which is used for the
-            // time varying frame signature to avoid getting fooled by a static image.
-            uint32_t expectedPixel = 0xFF0000FF           | // MSB and LSB
-                                     ((row & 0xFF) <<  8) | // vertical gradient
-                                     ((col & 0xFF) << 16);  // horizontal gradient
-            if ((row | col) == 0) {
-                static uint32_t sFrameTicker = 0;
-                expectedPixel = (sFrameTicker) & 0xFF;
-                sFrameTicker++;
-            }
-            pixels[col] = expectedPixel;
-        }
-        // Point to the next row
-        // NOTE:  stride retrieved from gralloc is in units of pixels
-        pixels = pixels + buff.stride;
+    // NOTE:  stride retrieved from gralloc is in units of pixels
+    if (pixels) {
+        static uint32_t sFrameTicker = 0;
+        fillTestPattern(pixels, buff.width, buff.height, buff.stride, sFrameTicker & 0xFF);
+        sFrameTicker++;
     }
 
     // Release our output buffer
@@ -23,6 +23,8 @@
 
 #include <thread>
 
+#include "VideoCapture.h"
+
 
 namespace android {
 namespace hardware {
@@ -56,6 +58,9 @@ public:
 
     static const char kCameraName_Backup[];
 
+    // Camera ids of this form name a V4L2 capture device node rather than test data
+    static bool isCaptureDeviceId(const char *id);
+
 private:
     // These three functions are expected to be called while mAccessLock is held
     bool setAvailableFrames_Locked(unsigned bufferCount);
@@ -65,6 +70,10 @@ private:
     void generateFrames();
     void fillTestFrame(const BufferDesc& buff);
 
+    // Used instead of generateFrames() when the camera is backed by a capture device
+    bool startCapture_Locked();
+    void captureFrames();
+
     sp<EvsEnumerator> mEnumerator;  // The enumerator object that created this camera
 
     CameraDesc mDescription = {};   // The properties of this camera
@@ -98,6 +107,9 @@ private:
     };
     StreamStateValues mStreamState;
 
+    VideoCapture mVideo;                    // Open only for cameras backed by a V4L2 device
+    std::vector<unsigned> mCaptureSlots;    // mBuffers index of each capture buffer
+
     // Synchronization necessary to deconflict mCaptureThread from the main service thread
     std::mutex mAccessLock;
 };
@@ -18,6 +18,7 @@
 
 #include "EvsDisplay.h"
 
+#include <android-base/properties.h>
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 
@@ -30,7 +31,12 @@ namespace V1_0 {
 namespace implementation {
 
 
-EvsDisplay::EvsDisplay() {
+// Set to N > 1 to only verify every Nth row of each returned frame, for long soak runs
+static const char kVerifyRowStepProperty[] = "vendor.evs.display.verify_row_step";
+
+
+EvsDisplay::EvsDisplay() :
+        mPatternChecker(android::base::GetUintProperty(kVerifyRowStepProperty, 1u)) {
     ALOGD("EvsDisplay instantiated");
 
     // Set up our self description
@@ -262,48 +268,22 @@ Return<EvsResult> EvsDisplay::returnTargetBufferForDisplay(const BufferDesc& buf
                     android::Rect(mBuffer.width, mBuffer.height),
                     (void **)&pixels);
 
-        // If we failed to lock the pixel buffer, we're about to crash, but log it first
+        // If we failed to lock the pixel buffer, log it and skip the pixels
         if (!pixels) {
             ALOGE("Display failed to gain access to image buffer for reading");
         }
 
         // Check the test pixels
-        bool frameLooksGood = true;
-        for (unsigned row = 0; row < mBuffer.height; row++) {
-            for (unsigned col = 0; col < mBuffer.width; col++) {
-                // Index into the row to check the pixel at this column.
-                // We expect 0xFF in the LSB channel, a vertical gradient in the
-                // second channel, a horitzontal gradient in the third channel, and
-                // 0xFF in the MSB.
-                // The exception is the very first 32 bits which is used for the
-                // time varying frame signature to avoid getting fooled by a static image.
-                uint32_t expectedPixel = 0xFF0000FF           | // MSB and LSB
-                                         ((row & 0xFF) <<  8) | // vertical gradient
-                                         ((col & 0xFF) << 16);  // horizontal gradient
-                if ((row | col) == 0) {
-                    // we'll check the "uniqueness" of the frame signature below
-                    continue;
-                }
-                // Walk across this row (we'll step rows below)
-                uint32_t receivedPixel = pixels[col];
-                if (receivedPixel != expectedPixel) {
-                    ALOGE("Pixel check mismatch in frame buffer");
-                    frameLooksGood = false;
-                    break;
-                }
-            }
-
-            if (!frameLooksGood) {
-                break;
-            }
-
-            // Point to the next row (NOTE:  gralloc reports stride in units of pixels)
-            pixels = pixels + mBuffer.stride;
+        // NOTE:  gralloc reports stride in units of pixels
+        bool frameLooksGood = pixels != nullptr &&
+                mPatternChecker.check(pixels, mBuffer.width, mBuffer.height, mBuffer.stride);
+        if (pixels && !frameLooksGood) {
+            ALOGE("Pixel check mismatch in frame buffer");
         }
 
         // Ensure we don't see the same buffer twice without it being rewritten
         static uint32_t prevSignature = ~0;
-        uint32_t signature = pixels[0] & 0xFF;
+        uint32_t signature = pixels ? (pixels[0] & 0xFF) : prevSignature;
         if (prevSignature == signature) {
             frameLooksGood = false;
             ALOGE("Duplicate, likely stale frame buffer detected");
@@ -20,6 +20,8 @@
 #include <android/hardware/automotive/evs/1.0/IEvsDisplay.h>
 #include <ui/GraphicBuffer.h>
 
+#include "TestPattern.h"
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -50,6 +52,8 @@ private:
     bool            mFrameBusy      = false;    // A flag telling us our buffer is in use
     DisplayState    mRequestedState = DisplayState::NOT_VISIBLE;
 
+    TestPatternChecker mPatternChecker;         // Validates the frames returned to us
+
     std::mutex      mAccessLock;
 };
 
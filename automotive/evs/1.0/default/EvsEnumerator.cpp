@@ -19,6 +19,15 @@
 #include "EvsEnumerator.h"
 #include "EvsCamera.h"
 #include "EvsDisplay.h"
+#include "EvsSharedCamera.h"
+#include "VideoCapture.h"
+
+#include <android-base/properties.h>
+#include <dirent.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
 
 namespace android {
 namespace hardware {
@@ -33,16 +42,41 @@ namespace implementation {
 //        constructs a new instance for each client.
 std::list<EvsEnumerator::CameraRecord>   EvsEnumerator::sCameraList;
 wp<EvsDisplay>                           EvsEnumerator::sActiveDisplay;
+bool                                     EvsEnumerator::sSharedCapture = false;
 
 
 EvsEnumerator::EvsEnumerator() {
     ALOGD("EvsEnumerator created");
 
+    sSharedCapture = android::base::GetBoolProperty("ro.vendor.evs.shared_capture", false);
+    if (sSharedCapture) {
+        ALOGI("Cameras may be shared by several clients");
+    }
+
     // Add sample camera data to our list of cameras
     // In a real driver, this would be expected to can the available hardware
     sCameraList.emplace_back(EvsCamera::kCameraName_Backup);
     sCameraList.emplace_back("LaneView");
     sCameraList.emplace_back("right turn");
+
+    // Add the V4L2 capture devices present, named by their device node
+    std::vector<std::string> deviceNames;
+    DIR* dir = opendir("/dev");
+    if (dir != nullptr) {
+        while (dirent* entry = readdir(dir)) {
+            std::string path = std::string("/dev/") + entry->d_name;
+            if (EvsCamera::isCaptureDeviceId(path.c_str()) &&
+                VideoCapture::isCaptureDevice(path.c_str())) {
+                deviceNames.push_back(path);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(deviceNames.begin(), deviceNames.end());
+    for (const auto& name : deviceNames) {
+        ALOGI("Found capture device %s", name.c_str());
+        sCameraList.emplace_back(name.c_str());
+    }
 }
 
 
@@ -91,6 +125,20 @@ Return<sp<IEvsCamera>> EvsEnumerator::openCamera(const hidl_string& cameraId) {
         return nullptr;
     }
 
+    // In shared mode, every client gets its own view of the one capture source
+    if (sSharedCapture) {
+        sp<CaptureSource> source = pRecord->source.promote();
+        if (source == nullptr) {
+            source = new CaptureSource(cameraId.c_str());
+            pRecord->source = source;
+        }
+        sp<EvsSharedCamera> pSharedCamera = new EvsSharedCamera(source);
+        pRecord->sharedInstances.remove_if(
+                [](const wp<EvsSharedCamera>& instance) { return instance.promote() == nullptr; });
+        pRecord->sharedInstances.emplace_back(pSharedCamera);
+        return pSharedCamera;
+    }
+
     // Has this camera already been instantiated by another caller?
     sp<EvsCamera> pActiveCamera = pRecord->activeInstance.promote();
     if (pActiveCamera != nullptr) {
@@ -139,6 +187,24 @@ Return<void> EvsEnumerator::closeCamera(const ::android::sp<IEvsCamera>& pCamera
     // Is the display being destroyed actually the one we think is active?
     if (!pRecord) {
         ALOGE("Asked to close a camera who's name isn't recognized");
+    } else if (sSharedCapture) {
+        // Drop this client only, the others keep streaming
+        bool found = false;
+        for (auto it = pRecord->sharedInstances.begin(); it != pRecord->sharedInstances.end(); ) {
+            sp<EvsSharedCamera> instance = it->promote();
+            if (instance != nullptr && instance == pCamera) {
+                instance->forceShutdown();
+                found = true;
+            }
+            if (instance == nullptr || instance == pCamera) {
+                it = pRecord->sharedInstances.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (!found) {
+            ALOGW("Ignoring close of a camera that is not open");
+        }
     } else {
         sp<EvsCamera> pActiveCamera = pRecord->activeInstance.promote();
 
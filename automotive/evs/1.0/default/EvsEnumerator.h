@@ -31,7 +31,9 @@ namespace V1_0 {
 namespace implementation {
 
 
-class EvsCamera;    // from EvsCamera.h
+class CaptureSource;        // from CaptureSource.h
+class EvsCamera;            // from EvsCamera.h
+class EvsSharedCamera;      // from EvsSharedCamera.h
 class EvsDisplay;   // from EvsDisplay.h
 
 
@@ -56,10 +58,18 @@ private:
         CameraDesc          desc;
         wp<EvsCamera>       activeInstance;
 
+        // Used instead of activeInstance in shared capture mode
+        wp<CaptureSource>               source;
+        std::list<wp<EvsSharedCamera>>  sharedInstances;
+
         CameraRecord(const char *cameraId) : desc() { desc.cameraId = cameraId; }
     };
     static std::list<CameraRecord> sCameraList;
 
+    // When set, a camera may be opened by several clients at once instead of the last
+    // one taking it over
+    static bool                    sSharedCapture;
+
     static wp<EvsDisplay>          sActiveDisplay; // Weak pointer. Object destructs if client dies.
 };
 
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.automotive.evs@1.0-service"
+
+#include "EvsSharedCamera.h"
+
+#include <log/log.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+EvsSharedCamera::EvsSharedCamera(const sp<CaptureSource>& source) :
+        mDescription(source->getDesc()),
+        mSource(source),
+        mConsumerId(source->addConsumer()) {
+    ALOGD("EvsSharedCamera instantiated for %s", mDescription.cameraId.c_str());
+}
+
+
+EvsSharedCamera::~EvsSharedCamera() {
+    ALOGD("EvsSharedCamera being destroyed");
+    forceShutdown();
+}
+
+
+void EvsSharedCamera::forceShutdown() {
+    ALOGD("EvsSharedCamera forceShutdown");
+
+    // Stops our stream and gives back any frames we still hold
+    sp<CaptureSource> source;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        source = std::move(mSource);
+    }
+    if (source != nullptr) {
+        source->removeConsumer(mConsumerId);
+    }
+}
+
+
+CaptureSource::ConsumerStats EvsSharedCamera::getStats() {
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    return mSource != nullptr ? mSource->getStats(mConsumerId) : CaptureSource::ConsumerStats();
+}
+
+
+// Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
+Return<void> EvsSharedCamera::getCameraInfo(getCameraInfo_cb _hidl_cb) {
+    ALOGD("getCameraInfo");
+
+    // Send back our self description
+    _hidl_cb(mDescription);
+    return Void();
+}
+
+
+Return<EvsResult> EvsSharedCamera::setMaxFramesInFlight(uint32_t bufferCount) {
+    ALOGD("setMaxFramesInFlight");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    if (mSource == nullptr) {
+        ALOGE("ignoring setMaxFramesInFlight call when camera has been lost.");
+        return EvsResult::OWNERSHIP_LOST;
+    }
+    return mSource->setMaxFramesInFlight(mConsumerId, bufferCount);
+}
+
+
+Return<EvsResult> EvsSharedCamera::startVideoStream(const ::android::sp<IEvsCameraStream>& stream) {
+    ALOGD("startVideoStream");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    if (mSource == nullptr) {
+        ALOGE("ignoring startVideoStream call when camera has been lost.");
+        return EvsResult::OWNERSHIP_LOST;
+    }
+    return mSource->startStream(mConsumerId, stream);
+}
+
+
+Return<void> EvsSharedCamera::doneWithFrame(const BufferDesc& buffer) {
+    ALOGD("doneWithFrame");
+
+    sp<CaptureSource> source;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        source = mSource;
+    }
+
+    if (buffer.memHandle == nullptr) {
+        ALOGE("ignoring doneWithFrame called with null handle");
+    } else if (source != nullptr) {
+        source->doneWithFrame(mConsumerId, buffer);
+    }
+    return Void();
+}
+
+
+Return<void> EvsSharedCamera::stopVideoStream() {
+    ALOGD("stopVideoStream");
+    sp<CaptureSource> source;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        source = mSource;
+    }
+
+    // This waits for a frame being delivered to us, which may return frames meanwhile
+    if (source != nullptr) {
+        source->stopStream(mConsumerId);
+    }
+    return Void();
+}
+
+
+Return<int32_t> EvsSharedCamera::getExtendedInfo(uint32_t opaqueIdentifier) {
+    ALOGD("getExtendedInfo");
+
+    // For any single digit value, return the index itself as a test value
+    if (opaqueIdentifier <= 9) {
+        return opaqueIdentifier;
+    }
+
+    // Return zero by default as required by the spec
+    return 0;
+}
+
+
+Return<EvsResult> EvsSharedCamera::setExtendedInfo(uint32_t /*opaqueIdentifier*/,
+                                                   int32_t /*opaqueValue*/) {
+    ALOGD("setExtendedInfo");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    if (mSource == nullptr) {
+        ALOGE("ignoring setExtendedInfo call when camera has been lost.");
+        return EvsResult::OWNERSHIP_LOST;
+    }
+
+    // We don't store any device specific information in this implementation
+    return EvsResult::INVALID_ARG;
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
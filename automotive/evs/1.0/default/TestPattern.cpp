@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TestPattern.h"
+
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Each row is its vertical gradient base ORed with the horizontal gradient, which
+// repeats every 256 columns.  The vector paths generate four columns at a time from a
+// running column counter, so neither filling nor checking needs a reference image.
+
+static void fillRow(uint32_t* pixels, unsigned width, uint32_t rowBase) {
+    unsigned col = 0;
+#if defined(__ARM_NEON)
+    const uint32_t firstCols[4] = { 0, 1, 2, 3 };
+    uint32x4_t cols = vld1q_u32(firstCols);
+    const uint32x4_t step = vdupq_n_u32(4);
+    const uint32x4_t mask = vdupq_n_u32(0xFF);
+    const uint32x4_t base = vdupq_n_u32(rowBase);
+    for (; col + 4 <= width; col += 4) {
+        vst1q_u32(pixels + col, vorrq_u32(base, vshlq_n_u32(vandq_u32(cols, mask), 16)));
+        cols = vaddq_u32(cols, step);
+    }
+#elif defined(__SSE2__)
+    __m128i cols = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i step = _mm_set1_epi32(4);
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128i base = _mm_set1_epi32(rowBase);
+    for (; col + 4 <= width; col += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + col),
+                         _mm_or_si128(base, _mm_slli_epi32(_mm_and_si128(cols, mask), 16)));
+        cols = _mm_add_epi32(cols, step);
+    }
+#endif
+    for (; col < width; col++) {
+        pixels[col] = rowBase | ((col & 0xFF) << 16);
+    }
+}
+
+
+// Returns true if columns [firstCol, width) of the row match the pattern
+static bool checkRow(const uint32_t* pixels, unsigned firstCol, unsigned width,
+                     uint32_t rowBase) {
+    unsigned col = firstCol;
+#if defined(__ARM_NEON)
+    const uint32_t firstCols[4] = { col, col + 1, col + 2, col + 3 };
+    uint32x4_t cols = vld1q_u32(firstCols);
+    const uint32x4_t step = vdupq_n_u32(4);
+    const uint32x4_t mask = vdupq_n_u32(0xFF);
+    const uint32x4_t base = vdupq_n_u32(rowBase);
+    uint32x4_t allEqual = vdupq_n_u32(~0u);
+    for (; col + 4 <= width; col += 4) {
+        uint32x4_t expected = vorrq_u32(base, vshlq_n_u32(vandq_u32(cols, mask), 16));
+        allEqual = vandq_u32(allEqual, vceqq_u32(vld1q_u32(pixels + col), expected));
+        cols = vaddq_u32(cols, step);
+    }
+    uint32x2_t folded = vand_u32(vget_low_u32(allEqual), vget_high_u32(allEqual));
+    if ((vget_lane_u32(folded, 0) & vget_lane_u32(folded, 1)) != ~0u) {
+        return false;
+    }
+#elif defined(__SSE2__)
+    __m128i cols = _mm_setr_epi32(col, col + 1, col + 2, col + 3);
+    const __m128i step = _mm_set1_epi32(4);
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    const __m128i base = _mm_set1_epi32(rowBase);
+    __m128i allEqual = _mm_set1_epi32(-1);
+    for (; col + 4 <= width; col += 4) {
+        __m128i expected = _mm_or_si128(base, _mm_slli_epi32(_mm_and_si128(cols, mask), 16));
+        __m128i received = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + col));
+        allEqual = _mm_and_si128(allEqual, _mm_cmpeq_epi32(received, expected));
+        cols = _mm_add_epi32(cols, step);
+    }
+    if (_mm_movemask_epi8(allEqual) != 0xFFFF) {
+        return false;
+    }
+#endif
+    for (; col < width; col++) {
+        if (pixels[col] != (rowBase | ((col & 0xFF) << 16))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// CRC-32C, using the CRC instructions when the target has them
+#if !defined(__ARM_FEATURE_CRC32) && !defined(__SSE4_2__)
+static const uint32_t* crc32cTable() {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+            }
+            t[i] = crc;
+        }
+        return t;
+    }();
+    return table.data();
+}
+#endif
+
+static uint32_t crc32c(const uint32_t* words, unsigned count) {
+    uint32_t crc = ~0u;
+#if defined(__ARM_FEATURE_CRC32)
+    for (unsigned i = 0; i < count; i++) {
+        crc = __crc32cw(crc, words[i]);
+    }
+#elif defined(__SSE4_2__)
+    for (unsigned i = 0; i < count; i++) {
+        crc = _mm_crc32_u32(crc, words[i]);
+    }
+#else
+    const uint32_t* table = crc32cTable();
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(words);
+    for (unsigned i = 0; i < count * sizeof(uint32_t); i++) {
+        crc = (crc >> 8) ^ table[(crc ^ bytes[i]) & 0xFF];
+    }
+#endif
+    return ~crc;
+}
+
+
+void fillTestPattern(uint32_t* pixels, unsigned width, unsigned height, unsigned stride,
+                     uint32_t signature) {
+    for (unsigned row = 0; row < height; row++) {
+        fillRow(pixels + row * stride, width, testPatternPixel(row, 0));
+    }
+    if (width > 0 && height > 0) {
+        pixels[0] = signature;
+    }
+}
+
+
+bool TestPatternChecker::check(const uint32_t* pixels, unsigned width, unsigned height,
+                               unsigned stride) {
+    if (mRowStep > 1) {
+        return checkSampledRows(pixels, width, height, stride);
+    }
+
+    for (unsigned row = 0; row < height; row++) {
+        // The first pixel is the frame signature
+        if (!checkRow(pixels + row * stride, row == 0 ? 1 : 0, width,
+                      testPatternPixel(row, 0))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool TestPatternChecker::checkSampledRows(const uint32_t* pixels, unsigned width,
+                                          unsigned height, unsigned stride) {
+    if (mCrcWidth != width) {
+        // Only the vertical gradient differs between rows, so there are 256 distinct ones
+        std::vector<uint32_t> expectedRow(width);
+        for (unsigned row = 0; row < 256; row++) {
+            fillRow(expectedRow.data(), width, testPatternPixel(row, 0));
+            mExpectedCrcs[row] = crc32c(expectedRow.data(), width);
+            if (row == 0) {
+                mExpectedFirstRowCrc = width > 1 ? crc32c(expectedRow.data() + 1, width - 1) : 0;
+            }
+        }
+        mCrcWidth = width;
+    }
+
+    const unsigned firstRow = mFrameCount++ % mRowStep;
+    for (unsigned row = firstRow; row < height; row += mRowStep) {
+        const uint32_t* rowPixels = pixels + row * stride;
+        bool rowMatches;
+        if (row == 0) {
+            rowMatches = width < 2 || crc32c(rowPixels + 1, width - 1) == mExpectedFirstRowCrc;
+        } else {
+            rowMatches = crc32c(rowPixels, width) == mExpectedCrcs[row & 0xFF];
+        }
+        if (!rowMatches) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
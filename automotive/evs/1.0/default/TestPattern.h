@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_TESTPATTERN_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_TESTPATTERN_H
+
+#include <stdint.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// The RGBA test image passed from the mock camera to the mock display.  Each pixel has
+// 0xFF in the LSB channel, a vertical gradient in the second channel, a horizontal
+// gradient in the third channel, and 0xFF in the MSB.  The exception is the very first
+// pixel, which holds a time varying frame signature to avoid getting fooled by a static
+// image.
+inline uint32_t testPatternPixel(unsigned row, unsigned col) {
+    return 0xFF0000FF           |   // MSB and LSB
+           ((row & 0xFF) <<  8) |   // vertical gradient
+           ((col & 0xFF) << 16);    // horizontal gradient
+}
+
+// Writes the pattern into an image whose stride is in pixels
+void fillTestPattern(uint32_t* pixels, unsigned width, unsigned height, unsigned stride,
+                     uint32_t signature);
+
+
+// Validates frames written by fillTestPattern(), except for the signature pixel.
+//
+// With a row step of 1 every pixel is compared.  A larger step is meant for long soak
+// runs: each frame only verifies every rowStep-th row, starting one row further down
+// than the previous frame, so the whole image is still covered every rowStep frames.
+// The sampled rows are verified by CRC against the expected rows.
+class TestPatternChecker {
+public:
+    explicit TestPatternChecker(unsigned rowStep = 1) : mRowStep(rowStep ? rowStep : 1) {}
+
+    bool check(const uint32_t* pixels, unsigned width, unsigned height, unsigned stride);
+
+private:
+    bool checkSampledRows(const uint32_t* pixels, unsigned width, unsigned height,
+                          unsigned stride);
+
+    const unsigned mRowStep;
+    unsigned mFrameCount = 0;
+
+    // CRC of each distinct expected row at mCrcWidth.  The first row is recorded
+    // without its signature pixel.
+    unsigned mCrcWidth = 0;
+    uint32_t mExpectedCrcs[256] = {};
+    uint32_t mExpectedFirstRowCrc = 0;
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_TESTPATTERN_H
@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.automotive.evs@1.0-service"
+
+#include "VideoCapture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include <algorithm>
+
+#include <log/log.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+static int xioctl(int fd, unsigned long request, void* arg) {
+    int result;
+    do {
+        result = ioctl(fd, request, arg);
+    } while (result == -1 && errno == EINTR);
+    return result;
+}
+
+
+bool VideoCapture::isCaptureDevice(const char* deviceName) {
+    android::base::unique_fd fd(::open(deviceName, O_RDWR | O_NONBLOCK | O_CLOEXEC));
+    if (fd.get() < 0) {
+        return false;
+    }
+
+    v4l2_capability caps = {};
+    if (xioctl(fd.get(), VIDIOC_QUERYCAP, &caps) < 0) {
+        return false;
+    }
+
+    // Multi function devices report the capabilities of this node separately
+    uint32_t nodeCaps = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps
+                                                                   : caps.capabilities;
+    const uint32_t required = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+    return (nodeCaps & required) == required;
+}
+
+
+bool VideoCapture::open(const char* deviceName) {
+    mDeviceFd.reset(::open(deviceName, O_RDWR | O_NONBLOCK | O_CLOEXEC));
+    if (mDeviceFd.get() < 0) {
+        ALOGE("Failed to open %s: %s", deviceName, strerror(errno));
+        return false;
+    }
+
+    v4l2_capability caps = {};
+    if (xioctl(mDeviceFd.get(), VIDIOC_QUERYCAP, &caps) < 0) {
+        ALOGE("VIDIOC_QUERYCAP failed on %s: %s", deviceName, strerror(errno));
+        close();
+        return false;
+    }
+    ALOGI("Opened %s (driver %s, card %s)", deviceName, caps.driver, caps.card);
+
+    // Keep the native frame size, but ask for packed YUYV which gralloc can describe
+    // as HAL_PIXEL_FORMAT_YCBCR_422_I.
+    mFormat = {};
+    mFormat.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(mDeviceFd.get(), VIDIOC_G_FMT, &mFormat) < 0) {
+        ALOGE("VIDIOC_G_FMT failed on %s: %s", deviceName, strerror(errno));
+        close();
+        return false;
+    }
+    mFormat.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    mFormat.fmt.pix.field = V4L2_FIELD_NONE;
+    if (xioctl(mDeviceFd.get(), VIDIOC_S_FMT, &mFormat) < 0 ||
+        mFormat.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV) {
+        ALOGE("%s does not support YUYV capture", deviceName);
+        close();
+        return false;
+    }
+
+    // Drivers that hold several frames internally say so; the rest get by with the default
+    mMinBufferCount = kMinBufferCount;
+    v4l2_control minBuffers = {};
+    minBuffers.id = V4L2_CID_MIN_BUFFERS_FOR_CAPTURE;
+    if (xioctl(mDeviceFd.get(), VIDIOC_G_CTRL, &minBuffers) == 0 && minBuffers.value > 0) {
+        mMinBufferCount = std::max(mMinBufferCount, static_cast<uint32_t>(minBuffers.value));
+    }
+
+    ALOGI("%s capturing %ux%u YUYV with at least %u buffers", deviceName,
+          mFormat.fmt.pix.width, mFormat.fmt.pix.height, mMinBufferCount);
+    return true;
+}
+
+
+void VideoCapture::close() {
+    if (mStreaming) {
+        stopStream();
+    }
+    mDeviceFd.reset();
+}
+
+
+bool VideoCapture::startStream(const std::vector<int>& dmabufFds, uint32_t strideBytes,
+                               uint32_t bufferSize) {
+    if (!isOpen() || mStreaming || dmabufFds.empty()) {
+        return false;
+    }
+
+    // Match the line pitch the buffers were allocated with, so the driver writes
+    // straight into them in the layout gralloc reports to the clients.
+    v4l2_format format = mFormat;
+    format.fmt.pix.bytesperline = strideBytes;
+    if (xioctl(mDeviceFd.get(), VIDIOC_S_FMT, &format) < 0) {
+        ALOGE("VIDIOC_S_FMT failed: %s", strerror(errno));
+        return false;
+    }
+    if (format.fmt.pix.bytesperline != strideBytes || format.fmt.pix.sizeimage > bufferSize) {
+        ALOGE("Driver needs %u bytes per line and %u per image, buffers have %u and %u",
+              format.fmt.pix.bytesperline, format.fmt.pix.sizeimage, strideBytes, bufferSize);
+        return false;
+    }
+    mFormat = format;
+
+    v4l2_requestbuffers request = {};
+    request.count = dmabufFds.size();
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_DMABUF;
+    if (xioctl(mDeviceFd.get(), VIDIOC_REQBUFS, &request) < 0) {
+        ALOGE("VIDIOC_REQBUFS failed: %s", strerror(errno));
+        return false;
+    }
+    // The driver may round the count up to what it needs; the extra slots simply stay empty
+    // since only the buffers we were given are ever queued.
+    if (request.count < dmabufFds.size()) {
+        ALOGE("Driver accepted %u of %zu buffers", request.count, dmabufFds.size());
+        request.count = 0;
+        xioctl(mDeviceFd.get(), VIDIOC_REQBUFS, &request);
+        return false;
+    }
+
+    mDmabufFds = dmabufFds;
+    mBufferSize = bufferSize;
+    mStreaming = true;
+    for (uint32_t i = 0; i < mDmabufFds.size(); i++) {
+        if (!returnFrame(i)) {
+            stopStream();
+            return false;
+        }
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(mDeviceFd.get(), VIDIOC_STREAMON, &type) < 0) {
+        ALOGE("VIDIOC_STREAMON failed: %s", strerror(errno));
+        stopStream();
+        return false;
+    }
+
+    return true;
+}
+
+
+void VideoCapture::stopStream() {
+    mStreaming = false;
+
+    // Turning the stream off returns every queued buffer to us
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(mDeviceFd.get(), VIDIOC_STREAMOFF, &type) < 0) {
+        ALOGE("VIDIOC_STREAMOFF failed: %s", strerror(errno));
+    }
+
+    v4l2_requestbuffers request = {};
+    request.count = 0;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_DMABUF;
+    if (xioctl(mDeviceFd.get(), VIDIOC_REQBUFS, &request) < 0) {
+        ALOGE("Failed to release the driver's buffers: %s", strerror(errno));
+    }
+
+    mDmabufFds.clear();
+}
+
+
+VideoCapture::FrameResult VideoCapture::waitForFrame(int timeoutMs, uint32_t* index,
+                                                     nsecs_t* timestamp) {
+    pollfd pfd = { .fd = mDeviceFd.get(), .events = POLLIN, .revents = 0 };
+    int result = poll(&pfd, 1, timeoutMs);
+    if (result == 0 || (result < 0 && errno == EINTR)) {
+        return FRAME_TIMEOUT;
+    }
+    if (result < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+        ALOGE("Capture device poll failed: %s", result < 0 ? strerror(errno) : "device error");
+        return FRAME_ERROR;
+    }
+
+    v4l2_buffer buf = {};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_DMABUF;
+    if (xioctl(mDeviceFd.get(), VIDIOC_DQBUF, &buf) < 0) {
+        if (errno == EAGAIN) {
+            return FRAME_TIMEOUT;
+        }
+        ALOGE("VIDIOC_DQBUF failed: %s", strerror(errno));
+        return FRAME_ERROR;
+    }
+
+    *index = buf.index;
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        *timestamp = seconds_to_nanoseconds(buf.timestamp.tv_sec) +
+                     microseconds_to_nanoseconds(buf.timestamp.tv_usec);
+    } else {
+        // The driver doesn't say when the frame was captured, so the best we know is now
+        *timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+    return FRAME_READY;
+}
+
+
+bool VideoCapture::returnFrame(uint32_t index) {
+    if (!mStreaming || index >= mDmabufFds.size()) {
+        return false;
+    }
+
+    v4l2_buffer buf = {};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_DMABUF;
+    buf.index = index;
+    buf.m.fd = mDmabufFds[index];
+    buf.length = mBufferSize;
+    if (xioctl(mDeviceFd.get(), VIDIOC_QBUF, &buf) < 0) {
+        ALOGE("VIDIOC_QBUF of buffer %u failed: %s", index, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_VIDEOCAPTURE_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_VIDEOCAPTURE_H
+
+#include <android-base/unique_fd.h>
+#include <utils/Timers.h>
+
+#include <linux/videodev2.h>
+
+#include <atomic>
+#include <vector>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// A V4L2 capture device streaming into caller provided dmabufs.  The driver writes
+// each frame straight into the buffer that is handed to the client, so no pixel is
+// touched by the CPU between the sensor and the consumer.
+//
+// waitForFrame() is expected to be called from a single capture thread.  returnFrame()
+// may be called from any thread, but must not race with startStream() or stopStream().
+class VideoCapture {
+public:
+    // One buffer is being filled while the previous one is with the consumer
+    static constexpr uint32_t kMinBufferCount = 2;
+
+    enum FrameResult {
+        FRAME_READY,
+        FRAME_TIMEOUT,
+        FRAME_ERROR,
+    };
+
+    // Returns true if the device can stream video frames
+    static bool isCaptureDevice(const char* deviceName);
+
+    bool open(const char* deviceName);
+    void close();
+    bool isOpen() const { return mDeviceFd.get() >= 0; }
+
+    uint32_t getWidth() const  { return mFormat.fmt.pix.width; }
+    uint32_t getHeight() const { return mFormat.fmt.pix.height; }
+    uint32_t getV4LFormat() const { return mFormat.fmt.pix.pixelformat; }
+
+    // The fewest buffers startStream() must be given for the driver to keep streaming
+    uint32_t getMinBufferCount() const { return mMinBufferCount; }
+
+    // Queues the given dmabufs, each at least bufferSize bytes with rows of strideBytes,
+    // and starts streaming.  Frame indices refer to positions in dmabufFds.
+    bool startStream(const std::vector<int>& dmabufFds, uint32_t strideBytes,
+                     uint32_t bufferSize);
+    void stopStream();
+    bool isStreaming() const { return mStreaming; }
+
+    // Waits up to timeoutMs for the next filled buffer.  On FRAME_READY the buffer
+    // belongs to the caller until it is given back with returnFrame().  The timestamp
+    // is the CLOCK_MONOTONIC time the driver captured the frame at.
+    FrameResult waitForFrame(int timeoutMs, uint32_t* index, nsecs_t* timestamp);
+    bool returnFrame(uint32_t index);
+
+private:
+    android::base::unique_fd mDeviceFd;
+    v4l2_format mFormat = {};
+    uint32_t mMinBufferCount = kMinBufferCount;
+
+    std::vector<int> mDmabufFds;    // Not owned, the buffers belong to the caller
+    uint32_t mBufferSize = 0;
+    std::atomic<bool> mStreaming{false};
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_VIDEOCAPTURE_H
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Aggregate frame throughput of synthetic cameras in shared capture mode.  Each camera
+// feeds a display client, which returns frames right away, and an ADAS client, which
+// holds every frame for a while.  The ADAS client should miss frames without slowing
+// down the display client.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "CaptureSource.h"
+#include "EvsSharedCamera.h"
+
+using namespace android::hardware::automotive::evs::V1_0;
+using namespace android::hardware::automotive::evs::V1_0::implementation;
+using ::android::sp;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+
+namespace {
+
+constexpr auto kAdasProcessingTime = std::chrono::milliseconds(5);
+constexpr auto kMeasurementTime = std::chrono::milliseconds(200);
+
+// Hands every frame back to the camera, either right away or after a processing delay
+class ClientStream : public IEvsCameraStream {
+  public:
+    ClientStream(const sp<EvsSharedCamera>& camera, bool slow) : mCamera(camera), mSlow(slow) {
+        if (mSlow) {
+            mWorker = std::thread([this]() { returnFrames(); });
+        }
+    }
+
+    ~ClientStream() {
+        if (mSlow) {
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                mExit = true;
+            }
+            mFrameReady.notify_one();
+            mWorker.join();
+        }
+    }
+
+    Return<void> deliverFrame(const BufferDesc& buffer) override {
+        if (buffer.memHandle == nullptr) {
+            return Void();  // End of stream
+        }
+        mFrames++;
+        if (!mSlow) {
+            mCamera->doneWithFrame(buffer);
+            return Void();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mPending.push_back(buffer);
+        }
+        mFrameReady.notify_one();
+        return Void();
+    }
+
+    uint64_t frames() const { return mFrames; }
+
+  private:
+    void returnFrames() {
+        std::unique_lock<std::mutex> lock(mLock);
+        while (true) {
+            mFrameReady.wait(lock, [this]() { return mExit || !mPending.empty(); });
+            if (mPending.empty()) {
+                return;
+            }
+            BufferDesc buffer = mPending.front();
+            mPending.pop_front();
+            lock.unlock();
+            std::this_thread::sleep_for(kAdasProcessingTime);
+            mCamera->doneWithFrame(buffer);
+            lock.lock();
+        }
+    }
+
+    sp<EvsSharedCamera> mCamera;
+    const bool mSlow;
+    std::atomic<uint64_t> mFrames{0};
+
+    std::mutex mLock;
+    std::condition_variable mFrameReady;
+    std::deque<BufferDesc> mPending;
+    bool mExit = false;
+    std::thread mWorker;
+};
+
+struct Client {
+    sp<EvsSharedCamera> camera;
+    sp<ClientStream> stream;
+};
+
+}  // namespace
+
+static void BM_SharedCaptureThroughput(benchmark::State& state) {
+    const int numCameras = state.range(0);
+
+    std::vector<sp<CaptureSource>> sources;
+    std::vector<Client> displayClients;
+    std::vector<Client> adasClients;
+    for (int i = 0; i < numCameras; i++) {
+        // Unthrottled, so the cameras run as fast as the pipeline allows
+        std::string id = "surround_" + std::to_string(i);
+        sources.push_back(new CaptureSource(id.c_str(), 0));
+
+        for (bool slow : {false, true}) {
+            Client client;
+            client.camera = new EvsSharedCamera(sources.back());
+            client.stream = new ClientStream(client.camera, slow);
+            client.camera->setMaxFramesInFlight(slow ? 1 : 2);
+            if (client.camera->startVideoStream(client.stream) != EvsResult::OK) {
+                state.SkipWithError("failed to start stream");
+                return;
+            }
+            (slow ? adasClients : displayClients).push_back(client);
+        }
+    }
+
+    uint64_t displayFrames = 0;
+    uint64_t adasFrames = 0;
+    uint64_t adasDropped = 0;
+    for (auto _ : state) {
+        auto countFrames = [&]() {
+            uint64_t display = 0, adas = 0, dropped = 0;
+            for (auto& client : displayClients) display += client.stream->frames();
+            for (auto& client : adasClients) {
+                adas += client.stream->frames();
+                dropped += client.camera->getStats().framesDropped;
+            }
+            return std::make_tuple(display, adas, dropped);
+        };
+        auto [displayBefore, adasBefore, droppedBefore] = countFrames();
+        std::this_thread::sleep_for(kMeasurementTime);
+        auto [displayAfter, adasAfter, droppedAfter] = countFrames();
+        displayFrames += displayAfter - displayBefore;
+        adasFrames += adasAfter - adasBefore;
+        adasDropped += droppedAfter - droppedBefore;
+    }
+
+    for (auto& client : displayClients) client.camera->forceShutdown();
+    for (auto& client : adasClients) client.camera->forceShutdown();
+
+    using benchmark::Counter;
+    state.counters["display_fps"] = Counter(displayFrames, Counter::kIsRate);
+    state.counters["adas_fps"] = Counter(adasFrames, Counter::kIsRate);
+    state.counters["adas_dropped_fps"] = Counter(adasDropped, Counter::kIsRate);
+    state.counters["display_fps_per_camera"] =
+            Counter(static_cast<double>(displayFrames) / numCameras, Counter::kIsRate);
+}
+BENCHMARK(BM_SharedCaptureThroughput)->Arg(1)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "TestPattern.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+// Odd sizes so the scalar tails of the vector loops are exercised
+constexpr unsigned kWidth = 643;
+constexpr unsigned kHeight = 481;
+constexpr unsigned kStride = 656;
+
+std::vector<uint32_t> makeFrame(uint32_t signature) {
+    std::vector<uint32_t> frame(kStride * kHeight, 0xDEADBEEF);
+    fillTestPattern(frame.data(), kWidth, kHeight, kStride, signature);
+    return frame;
+}
+
+}  // namespace
+
+TEST(TestPatternTest, FillMatchesReferencePixels) {
+    std::vector<uint32_t> frame = makeFrame(0x42);
+    EXPECT_EQ(0x42u, frame[0]);
+    for (unsigned row = 0; row < kHeight; row++) {
+        for (unsigned col = 0; col < kWidth; col++) {
+            if ((row | col) == 0) continue;
+            ASSERT_EQ(testPatternPixel(row, col), frame[row * kStride + col])
+                    << "row " << row << " col " << col;
+        }
+        // The padding past the width is left alone
+        for (unsigned col = kWidth; col < kStride; col++) {
+            ASSERT_EQ(0xDEADBEEFu, frame[row * kStride + col]);
+        }
+    }
+}
+
+TEST(TestPatternTest, FullCheckAcceptsAnySignature) {
+    TestPatternChecker checker;
+    for (uint32_t signature = 0; signature < 4; signature++) {
+        std::vector<uint32_t> frame = makeFrame(signature);
+        EXPECT_TRUE(checker.check(frame.data(), kWidth, kHeight, kStride));
+    }
+}
+
+TEST(TestPatternTest, FullCheckFindsEveryBadPixel) {
+    TestPatternChecker checker;
+    std::vector<uint32_t> frame = makeFrame(0);
+    const unsigned positions[][2] = {
+        {0, 1}, {0, kWidth - 1}, {1, 0}, {255, 256}, {kHeight - 1, 3}, {kHeight - 1, kWidth - 1},
+    };
+    for (const auto& pos : positions) {
+        uint32_t& pixel = frame[pos[0] * kStride + pos[1]];
+        const uint32_t good = pixel;
+        pixel ^= 0x00010000;
+        EXPECT_FALSE(checker.check(frame.data(), kWidth, kHeight, kStride))
+                << "row " << pos[0] << " col " << pos[1];
+        pixel = good;
+    }
+    EXPECT_TRUE(checker.check(frame.data(), kWidth, kHeight, kStride));
+}
+
+TEST(TestPatternTest, SampledCheckCoversEveryRowOverItsPeriod) {
+    constexpr unsigned kRowStep = 8;
+    TestPatternChecker checker(kRowStep);
+    std::vector<uint32_t> frame = makeFrame(7);
+    EXPECT_TRUE(checker.check(frame.data(), kWidth, kHeight, kStride));
+
+    // A damaged row is caught within one period of frames
+    for (unsigned badRow : {0u, 5u, 300u, kHeight - 1}) {
+        TestPatternChecker rollingChecker(kRowStep);
+        frame[badRow * kStride + kWidth / 2] ^= 0xFF00;
+        unsigned failures = 0;
+        for (unsigned i = 0; i < kRowStep; i++) {
+            if (!rollingChecker.check(frame.data(), kWidth, kHeight, kStride)) failures++;
+        }
+        EXPECT_EQ(1u, failures) << "row " << badRow;
+        frame[badRow * kStride + kWidth / 2] ^= 0xFF00;
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace evs
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Streams from a vivid (virtual video test driver) device into gralloc buffers and
+// reports the latency from capture to delivery and the CPU time spent per frame.
+// Load the driver with "modprobe vivid" first; the tests are skipped without it.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+#include <gtest/gtest.h>
+#include <ui/GraphicBufferAllocator.h>
+
+#include "VideoCapture.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+constexpr unsigned kNumBuffers = 4;
+constexpr unsigned kNumFrames = 120;
+constexpr int kFrameTimeoutMs = 1000;
+
+std::string findVividDevice() {
+    std::vector<std::string> candidates;
+    DIR* dir = opendir("/dev");
+    if (dir == nullptr) {
+        return "";
+    }
+    while (dirent* entry = readdir(dir)) {
+        if (strncmp(entry->d_name, "video", strlen("video")) == 0) {
+            candidates.push_back(std::string("/dev/") + entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(candidates.begin(), candidates.end());
+
+    for (const auto& path : candidates) {
+        android::base::unique_fd fd(open(path.c_str(), O_RDWR | O_CLOEXEC));
+        v4l2_capability caps = {};
+        if (fd.get() >= 0 && ioctl(fd.get(), VIDIOC_QUERYCAP, &caps) == 0 &&
+            strcmp(reinterpret_cast<const char*>(caps.driver), "vivid") == 0 &&
+            VideoCapture::isCaptureDevice(path.c_str())) {
+            return path;
+        }
+    }
+    return "";
+}
+
+nsecs_t processCpuTime() {
+    timespec ts = {};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return seconds_to_nanoseconds(ts.tv_sec) + ts.tv_nsec;
+}
+
+class VideoCaptureTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mDeviceName = findVividDevice();
+        if (mDeviceName.empty()) {
+            GTEST_SKIP() << "No vivid capture device";
+        }
+        ASSERT_TRUE(mVideo.open(mDeviceName.c_str()));
+
+        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
+        for (unsigned i = 0; i < kNumBuffers; i++) {
+            buffer_handle_t handle = nullptr;
+            ASSERT_EQ(NO_ERROR,
+                      alloc.allocate(mVideo.getWidth(), mVideo.getHeight(),
+                                     HAL_PIXEL_FORMAT_YCBCR_422_I, 1,
+                                     GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_CAMERA_WRITE |
+                                     GRALLOC_USAGE_SW_READ_RARELY,
+                                     &handle, &mStride, 0, "VideoCaptureTest"));
+            mHandles.push_back(handle);
+            ASSERT_GE(handle->numFds, 1);
+            mDmabufFds.push_back(handle->data[0]);
+        }
+    }
+
+    void TearDown() override {
+        mVideo.close();
+        for (auto handle : mHandles) {
+            GraphicBufferAllocator::get().free(handle);
+        }
+    }
+
+    VideoCapture::FrameResult waitForFrame(uint32_t* index, nsecs_t* timestamp) {
+        VideoCapture::FrameResult result = VideoCapture::FRAME_TIMEOUT;
+        for (int attempt = 0; attempt < 3 && result == VideoCapture::FRAME_TIMEOUT; attempt++) {
+            result = mVideo.waitForFrame(kFrameTimeoutMs, index, timestamp);
+        }
+        return result;
+    }
+
+    std::string mDeviceName;
+    VideoCapture mVideo;
+    std::vector<buffer_handle_t> mHandles;
+    std::vector<int> mDmabufFds;
+    uint32_t mStride = 0;
+};
+
+}  // namespace
+
+TEST_F(VideoCaptureTest, StreamsIntoGraphicBuffers) {
+    const uint32_t strideBytes = mStride * 2;
+    ASSERT_TRUE(mVideo.startStream(mDmabufFds, strideBytes, strideBytes * mVideo.getHeight()));
+    EXPECT_TRUE(mVideo.isStreaming());
+
+    nsecs_t previousTimestamp = 0;
+    nsecs_t totalLatency = 0;
+    nsecs_t maxLatency = 0;
+    const nsecs_t cpuTimeAtStart = processCpuTime();
+    for (unsigned frame = 0; frame < kNumFrames; frame++) {
+        uint32_t index = 0;
+        nsecs_t timestamp = 0;
+        ASSERT_EQ(VideoCapture::FRAME_READY, waitForFrame(&index, &timestamp));
+        const nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - timestamp;
+
+        ASSERT_LT(index, kNumBuffers);
+        EXPECT_GT(timestamp, previousTimestamp);
+        EXPECT_GE(latency, 0);
+        previousTimestamp = timestamp;
+        totalLatency += latency;
+        maxLatency = std::max(maxLatency, latency);
+
+        ASSERT_TRUE(mVideo.returnFrame(index));
+    }
+    const nsecs_t cpuPerFrame = (processCpuTime() - cpuTimeAtStart) / kNumFrames;
+
+    mVideo.stopStream();
+    EXPECT_FALSE(mVideo.isStreaming());
+
+    RecordProperty("avgLatencyUs", std::to_string(totalLatency / kNumFrames / 1000));
+    RecordProperty("maxLatencyUs", std::to_string(maxLatency / 1000));
+    RecordProperty("cpuPerFrameUs", std::to_string(cpuPerFrame / 1000));
+    printf("%s %ux%u: glass-to-callback latency %.2f ms average, %.2f ms max, "
+           "%.1f us CPU per frame\n", mDeviceName.c_str(), mVideo.getWidth(),
+           mVideo.getHeight(), totalLatency / 1e6 / kNumFrames, maxLatency / 1e6,
+           cpuPerFrame / 1e3);
+}
+
+TEST_F(VideoCaptureTest, RestartsStream) {
+    const uint32_t strideBytes = mStride * 2;
+    for (int i = 0; i < 2; i++) {
+        ASSERT_TRUE(mVideo.startStream(mDmabufFds, strideBytes,
+                                       strideBytes * mVideo.getHeight()));
+        uint32_t index = 0;
+        nsecs_t timestamp = 0;
+        EXPECT_EQ(VideoCapture::FRAME_READY, waitForFrame(&index, &timestamp));
+        mVideo.stopStream();
+    }
+}
+
+TEST_F(VideoCaptureTest, StreamsWithDriverMinimumBuffers) {
+    const uint32_t minBuffers = mVideo.getMinBufferCount();
+    EXPECT_GE(minBuffers, VideoCapture::kMinBufferCount);
+    ASSERT_LE(minBuffers, kNumBuffers);
+
+    const std::vector<int> fds(mDmabufFds.begin(), mDmabufFds.begin() + minBuffers);
+    const uint32_t strideBytes = mStride * 2;
+    ASSERT_TRUE(mVideo.startStream(fds, strideBytes, strideBytes * mVideo.getHeight()));
+    for (unsigned frame = 0; frame < 2 * minBuffers; frame++) {
+        uint32_t index = 0;
+        nsecs_t timestamp = 0;
+        ASSERT_EQ(VideoCapture::FRAME_READY, waitForFrame(&index, &timestamp));
+        ASSERT_LT(index, minBuffers);
+        ASSERT_TRUE(mVideo.returnFrame(index));
+    }
+    mVideo.stopStream();
+}
+
+TEST_F(VideoCaptureTest, RejectsUndersizedBuffers) {
+    const uint32_t strideBytes = mStride * 2;
+    EXPECT_FALSE(mVideo.startStream(mDmabufFds, strideBytes, strideBytes));
+    EXPECT_FALSE(mVideo.isStreaming());
+    EXPECT_FALSE(mVideo.returnFrame(0));
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace evs
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
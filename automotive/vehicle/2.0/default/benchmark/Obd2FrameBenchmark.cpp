@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how many OBD2 frames per second the emulator can produce: rebuilding every frame
+// from a sensor store, refilling one reused frame, and the live frame generator.
+
+#include <benchmark/benchmark.h>
+
+#include <vhal_v2_0/Obd2SensorStore.h>
+#include <vhal_v2_0/VehicleUtils.h>
+
+#include "vhal_v2_0/Obd2LiveFrameGenerator.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+namespace {
+
+constexpr size_t kNumVendorSensors = 16;
+
+std::unique_ptr<Obd2SensorStore> makeSensorStore() {
+    auto store = std::make_unique<Obd2SensorStore>(kNumVendorSensors, kNumVendorSensors);
+    store->setIntegerSensor(DiagnosticIntegerSensorIndex::INTAKE_AIR_TEMPERATURE, 35);
+    store->setIntegerSensor(DiagnosticIntegerSensorIndex::RUNTIME_SINCE_ENGINE_START, 500);
+    store->setIntegerSensor(DiagnosticIntegerSensorIndex::AMBIENT_AIR_TEMPERATURE, 18);
+    store->setFloatSensor(DiagnosticFloatSensorIndex::CALCULATED_ENGINE_LOAD, 0.153);
+    store->setFloatSensor(DiagnosticFloatSensorIndex::ENGINE_RPM, 1250.);
+    store->setFloatSensor(DiagnosticFloatSensorIndex::VEHICLE_SPEED, 40.);
+    store->setFloatSensor(DiagnosticFloatSensorIndex::THROTTLE_POSITION, 19.75);
+    store->setFloatSensor(DiagnosticFloatSensorIndex::FUEL_TANK_LEVEL_INPUT, 0.824);
+    return store;
+}
+
+void setFramesCounter(benchmark::State& state) {
+    state.counters["frames_per_second"] = benchmark::Counter(
+            static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+
+}  // namespace
+
+// What producing a live frame used to take: a new store and a new frame every time
+static void BM_Obd2RebuildFrame(benchmark::State& state) {
+    for (auto _ : state) {
+        auto store = makeSensorStore();
+        VehiclePropValue frame;
+        store->fillPropValue("", &frame);
+        benchmark::DoNotOptimize(frame);
+    }
+    setFramesCounter(state);
+}
+BENCHMARK(BM_Obd2RebuildFrame);
+
+static void BM_Obd2FillReusedFrame(benchmark::State& state) {
+    auto store = makeSensorStore();
+    VehiclePropValue frame;
+    for (auto _ : state) {
+        store->fillPropValue("P0070", &frame);
+        benchmark::DoNotOptimize(frame);
+    }
+    setFramesCounter(state);
+}
+BENCHMARK(BM_Obd2FillReusedFrame);
+
+// Includes the copy made when the frame is handed to the HAL as an event
+static void BM_Obd2LiveFrameGenerator(benchmark::State& state) {
+    auto store = makeSensorStore();
+    Obd2LiveFrameGenerator generator(*store, toInt(VehicleProperty::OBD2_LIVE_FRAME));
+    int64_t timestamp = 0;
+    for (auto _ : state) {
+        VehiclePropValue event = generator.nextFrame(timestamp);
+        benchmark::DoNotOptimize(event);
+        timestamp += 10000000;
+    }
+    setFramesCounter(state);
+}
+BENCHMARK(BM_Obd2LiveFrameGenerator);
+
+static void BM_Obd2NonZeroSensorsBitmask(benchmark::State& state) {
+    VehiclePropValue frame;
+    makeSensorStore()->fillPropValue("", &frame);
+    const size_t numIntegerSensors = frame.value.int32Values.size();
+    hidl_vec<uint8_t> bitmask;
+    bitmask.resize((numIntegerSensors + frame.value.floatValues.size() + 7) / 8);
+    for (auto _ : state) {
+        Obd2SensorStore::fillNonZeroSensorsBitmask(frame.value.int32Values,
+                                                   frame.value.floatValues, numIntegerSensors,
+                                                   &bitmask);
+        benchmark::DoNotOptimize(bitmask);
+    }
+    setFramesCounter(state);
+}
+BENCHMARK(BM_Obd2NonZeroSensorsBitmask);
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how many property updates a SocketConn takes in and answers per second, with a
+// host simulator on the other end of a socketpair sending bursts of SET_PROPERTY_CMD messages.
+
+#include <arpa/inet.h>
+#include <benchmark/benchmark.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "vhal_v2_0/SocketComm.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+namespace {
+
+// Answers like VehicleEmulator does for a successful set, without a HAL behind it
+class SetPropertyResponder : public MessageProcessor {
+   public:
+    void processMessage(emulator::EmulatorMessage const& rxMsg,
+                        emulator::EmulatorMessage& respMsg) override {
+        respMsg.set_msg_type(emulator::SET_PROPERTY_RESP);
+        respMsg.set_status(rxMsg.value_size() > 0 ? emulator::RESULT_OK
+                                                  : emulator::ERROR_INVALID_PROPERTY);
+    }
+};
+
+// Serializes a burst of single value updates, each framed the way the host sends them
+std::vector<uint8_t> makeBurst(int numMessages) {
+    std::vector<uint8_t> burst;
+    for (int i = 0; i < numMessages; i++) {
+        emulator::EmulatorMessage msg;
+        msg.set_msg_type(emulator::SET_PROPERTY_CMD);
+        emulator::VehiclePropValue* value = msg.add_value();
+        value->set_prop(0x11600207);  // PERF_VEHICLE_SPEED
+        value->set_area_id(0);
+        value->set_timestamp(1000000LL * i);
+        value->add_float_values(i * 0.25f);
+
+        std::string body;
+        msg.SerializeToString(&body);
+        uint32_t msgLen = htonl(static_cast<uint32_t>(body.size()));
+        const uint8_t* header = reinterpret_cast<const uint8_t*>(&msgLen);
+        burst.insert(burst.end(), header, header + sizeof(msgLen));
+        burst.insert(burst.end(), body.begin(), body.end());
+    }
+    return burst;
+}
+
+bool writeAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(::write(fd, data, size));
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Reads until the given number of framed responses have arrived, leaving any extra bytes in
+// the buffer for the next call
+bool readResponses(int fd, int count, std::vector<uint8_t>* buffer) {
+    size_t parsed = 0;
+    int received = 0;
+    uint8_t chunk[16 * 1024];
+    while (true) {
+        while (received < count && buffer->size() - parsed >= sizeof(uint32_t)) {
+            uint32_t msgLen;
+            memcpy(&msgLen, buffer->data() + parsed, sizeof(msgLen));
+            msgLen = ntohl(msgLen);
+            if (buffer->size() - parsed - sizeof(msgLen) < msgLen) {
+                break;
+            }
+            parsed += sizeof(msgLen) + msgLen;
+            received++;
+        }
+        if (received == count) {
+            buffer->erase(buffer->begin(), buffer->begin() + parsed);
+            return true;
+        }
+
+        ssize_t numRead = TEMP_FAILURE_RETRY(::read(fd, chunk, sizeof(chunk)));
+        if (numRead <= 0) {
+            return false;
+        }
+        buffer->insert(buffer->end(), chunk, chunk + numRead);
+    }
+}
+
+}  // namespace
+
+static void BM_SocketConnSetProperty(benchmark::State& state) {
+    const int burstSize = static_cast<int>(state.range(0));
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        state.SkipWithError("socketpair failed");
+        return;
+    }
+
+    SetPropertyResponder responder;
+    SocketConn conn(&responder, fds[0]);
+    conn.start();
+
+    const std::vector<uint8_t> burst = makeBurst(burstSize);
+    std::vector<uint8_t> responses;
+    for (auto _ : state) {
+        if (!writeAll(fds[1], burst.data(), burst.size()) ||
+            !readResponses(fds[1], burstSize, &responses)) {
+            state.SkipWithError("Connection closed");
+            break;
+        }
+    }
+
+    conn.stop();
+    close(fds[1]);
+
+    state.SetBytesProcessed(state.iterations() * burst.size());
+    state.counters["messages_per_second"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * burstSize, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_SocketConnSetProperty)->Arg(1)->Arg(16)->Arg(256)->UseRealTime();
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares how a publisher with a large layer catalog tracks subscriptions: parsing every
+// subscriptions state message with getSubscribedLayers(), or keeping a VmsSubscriptionsIndex
+// up to date and querying it.
+
+#include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "vhal_v2_0/VehicleUtils.h"
+#include "vhal_v2_0/VmsUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace vms {
+
+namespace {
+
+constexpr int kPublisherId = 123;
+constexpr int kNumLayerTypes = 16;
+
+VmsLayer catalogLayer(int i) {
+    return VmsLayer(i % kNumLayerTypes, i / kNumLayerTypes, 1);
+}
+
+// The publisher offers every layer in the catalog
+VmsOffers makeOffers(int numLayers) {
+    std::vector<VmsLayerOffering> offerings;
+    for (int i = 0; i < numLayers; i++) {
+        offerings.emplace_back(catalogLayer(i));
+    }
+    return VmsOffers(kPublisherId, std::move(offerings));
+}
+
+// Half of the catalog is subscribed to from any publisher.  A quarter is subscribed to as
+// associated layers, accepting four publishers of which every other layer lists ours.
+std::unique_ptr<VehiclePropValue> makeSubscriptionsState(int numLayers, int sequenceNumber) {
+    std::vector<int32_t> values = {toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE), sequenceNumber,
+                                   numLayers / 2, numLayers / 4};
+    for (int i = 0; i < numLayers / 2; i++) {
+        VmsLayer layer = catalogLayer(2 * i);
+        values.insert(values.end(), {layer.type, layer.subtype, layer.version});
+    }
+    for (int i = 0; i < numLayers / 4; i++) {
+        VmsLayer layer = catalogLayer(4 * i + 1);
+        int ourId = i % 2 == 0 ? kPublisherId : 1000;
+        values.insert(values.end(),
+                      {layer.type, layer.subtype, layer.version, 4, 1001, 1002, 1003, ourId});
+    }
+    auto message = createBaseVmsMessage(values.size());
+    message->value.int32Values = values;
+    return message;
+}
+
+}  // namespace
+
+static void BM_GetSubscribedLayers(benchmark::State& state) {
+    const int numLayers = static_cast<int>(state.range(0));
+    const VmsOffers offers = makeOffers(numLayers);
+    const auto message = makeSubscriptionsState(numLayers, 1);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(getSubscribedLayers(*message, offers));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetSubscribedLayers)->Arg(1000)->Arg(5000);
+
+static void BM_SubscriptionsIndexUpdate(benchmark::State& state) {
+    const int numLayers = static_cast<int>(state.range(0));
+    auto message = makeSubscriptionsState(numLayers, 1);
+    VmsSubscriptionsIndex index;
+    int32_t sequenceNumber = 1;
+    for (auto _ : state) {
+        message->value.int32Values[toInt(VmsSubscriptionsStateIntegerValuesIndex::SEQUENCE_NUMBER)] =
+                sequenceNumber++;
+        benchmark::DoNotOptimize(index.update(*message));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SubscriptionsIndexUpdate)->Arg(1000)->Arg(5000);
+
+// One query per offered layer, as a publisher deciding what to publish would do
+static void BM_SubscriptionsIndexIsSubscribed(benchmark::State& state) {
+    const int numLayers = static_cast<int>(state.range(0));
+    const VmsOffers offers = makeOffers(numLayers);
+    VmsSubscriptionsIndex index;
+    index.update(*makeSubscriptionsState(numLayers, 1));
+    for (auto _ : state) {
+        int subscribed = 0;
+        for (const auto& offering : offers.offerings) {
+            subscribed += index.isSubscribed(offering.layer, offers.publisher_id);
+        }
+        benchmark::DoNotOptimize(subscribed);
+    }
+    state.SetItemsProcessed(state.iterations() * numLayers);
+}
+BENCHMARK(BM_SubscriptionsIndexIsSubscribed)->Arg(1000)->Arg(5000);
+
+}  // namespace vms
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -53,9 +53,17 @@ class Obd2SensorStore {
     // Returns a vector that contains a bitmask for all stored sensors.
     const std::vector<uint8_t>& getSensorsBitmask() const;
 
-    // Given a stringValue, fill in a VehiclePropValue
+    // Given a stringValue, fill in a VehiclePropValue. Vectors of propValue that already have
+    // the right size are overwritten in place, so refilling the same frame doesn't allocate.
     void fillPropValue(const std::string& dtc, VehiclePropValue* propValue) const;
 
+    // Fills a bitmask that flags every non-zero sensor of a frame, for frames that come with
+    // sensor values but no bitmask. Float sensors start at bit numIntegerSensors. The bitmask
+    // must already have its final size, bits past its end are ignored.
+    static void fillNonZeroSensorsBitmask(const hidl_vec<int32_t>& integerSensors,
+                                          const hidl_vec<float>& floatSensors,
+                                          size_t numIntegerSensors, hidl_vec<uint8_t>* bitmask);
+
    private:
     class BitmaskInVector {
        public:
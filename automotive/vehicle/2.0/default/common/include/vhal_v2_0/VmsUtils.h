@@ -53,8 +53,10 @@ struct VmsLayer {
       public:
         // Hash of the variables is returned.
         size_t operator()(const VmsLayer& layer) const {
-            return std::hash<int>()(layer.type) ^ std::hash<int>()(layer.type) ^
-                   std::hash<int>()(layer.type);
+            size_t hash = std::hash<int>()(layer.type);
+            hash = hash * 31 + std::hash<int>()(layer.subtype);
+            hash = hash * 31 + std::hash<int>()(layer.version);
+            return hash;
         }
     };
 };
@@ -64,6 +66,20 @@ struct VmsLayerAndPublisher {
         : layer(std::move(layer)), publisher_id(publisher_id) {}
     VmsLayer layer;
     int publisher_id;
+    bool operator==(const VmsLayerAndPublisher& layer_and_publisher) const {
+        return this->layer == layer_and_publisher.layer &&
+               this->publisher_id == layer_and_publisher.publisher_id;
+    }
+
+    // Class for hash function
+    class VmsLayerAndPublisherHashFunction {
+      public:
+        // Hash of the variables is returned.
+        size_t operator()(const VmsLayerAndPublisher& layer_and_publisher) const {
+            return VmsLayer::VmsLayerHashFunction()(layer_and_publisher.layer) * 31 +
+                   std::hash<int>()(layer_and_publisher.publisher_id);
+        }
+    };
 };
 
 // A VmsAssociatedLayer is used by subscribers to specify which publisher IDs
@@ -221,6 +237,43 @@ int32_t getSequenceNumberForSubscriptionsState(const VehiclePropValue& subscript
 std::vector<VmsLayer> getSubscribedLayers(const VehiclePropValue& subscriptions_state,
                                           const VmsOffers& offers);
 
+// Keeps the subscriptions reported by the latest subscriptions state message, so that a
+// publisher can check whether a layer has subscribers without parsing the message again.
+//
+// Every subscriptions state message carries the complete state, so update() replaces the
+// contents of the index. It reuses the storage of the previous state and ignores messages
+// that are not newer than the last one applied. When the service restarts its sequence
+// numbers start over, so the index should be cleared once hasServiceNewlyStarted() or a new
+// session says so.
+class VmsSubscriptionsIndex {
+  public:
+    // Applies a subscriptions change or response message. Returns false, leaving the index
+    // unchanged, if the message is malformed or its sequence number isn't newer than the
+    // current one.
+    bool update(const VehiclePropValue& subscriptions_state);
+
+    // Forgets the current state and sequence number.
+    void clear();
+
+    // Sequence number of the state in the index, or -1 if there is none.
+    int32_t getSequenceNumber() const { return mSequenceNumber; }
+
+    // Returns true if the layer has subscribers for any publisher, or for the given one.
+    bool isSubscribed(const VmsLayer& layer, int publisher_id) const {
+        return mLayers.count(layer) > 0 ||
+               mAssociatedLayers.count(VmsLayerAndPublisher(layer, publisher_id)) > 0;
+    }
+
+    // Returns the layers in offers that have subscribers, in the order they are offered.
+    std::vector<VmsLayer> getSubscribedLayers(const VmsOffers& offers) const;
+
+  private:
+    int32_t mSequenceNumber = -1;
+    std::unordered_set<VmsLayer, VmsLayer::VmsLayerHashFunction> mLayers;
+    std::unordered_set<VmsLayerAndPublisher, VmsLayerAndPublisher::VmsLayerAndPublisherHashFunction>
+            mAssociatedLayers;
+};
+
 // Takes an availability change message and returns true if the parsed message implies that
 // the service has newly started or restarted.
 // If the message has a sequence number 0, it means that the service
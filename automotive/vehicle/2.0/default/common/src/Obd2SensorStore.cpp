@@ -16,6 +16,10 @@
 
 #include "Obd2SensorStore.h"
 
+#include <string.h>
+
+#include <algorithm>
+
 #include <utils/SystemClock.h>
 #include "VehicleUtils.h"
 
@@ -25,6 +29,43 @@ namespace automotive {
 namespace vehicle {
 namespace V2_0 {
 
+template <typename T>
+static void copyToHidlVec(const std::vector<T>& src, hidl_vec<T>* dest) {
+    if (dest->size() != src.size()) {
+        dest->resize(src.size());
+    }
+    std::copy(src.begin(), src.end(), dest->begin());
+}
+
+// Sets the bits for the non-zero values, starting at bit firstBit. Whole bytes are built
+// eight values at a time: the 0/1 flags are gathered into a 64-bit word and a multiply
+// moves bit 0 of each flag byte into the top byte, instead of a read-modify-write per bit.
+template <typename T>
+static void setNonZeroBits(const hidl_vec<T>& values, size_t firstBit, hidl_vec<uint8_t>* bitmask) {
+    const size_t numBits = bitmask->size() * 8;
+    if (firstBit >= numBits) {
+        return;
+    }
+    uint8_t* bytes = bitmask->data();
+    const size_t count = std::min(values.size(), numBits - firstBit);
+    size_t i = 0;
+    for (; i < count && (firstBit + i) % 8 != 0; i++) {
+        bytes[(firstBit + i) / 8] |= (values[i] != 0) << ((firstBit + i) % 8);
+    }
+    for (; i + 8 <= count; i += 8) {
+        uint8_t flags[8];
+        for (size_t bit = 0; bit < 8; bit++) {
+            flags[bit] = values[i + bit] != 0;
+        }
+        uint64_t word;
+        memcpy(&word, flags, sizeof(word));
+        bytes[(firstBit + i) / 8] |= static_cast<uint8_t>((word * 0x0102040810204080ULL) >> 56);
+    }
+    for (; i < count; i++) {
+        bytes[(firstBit + i) / 8] |= (values[i] != 0) << ((firstBit + i) % 8);
+    }
+}
+
 Obd2SensorStore::BitmaskInVector::BitmaskInVector(size_t numBits) {
     resize(numBits);
 }
@@ -95,12 +136,21 @@ const std::vector<uint8_t>& Obd2SensorStore::getSensorsBitmask() const {
 
 void Obd2SensorStore::fillPropValue(const std::string& dtc, VehiclePropValue* propValue) const {
     propValue->timestamp = elapsedRealtimeNano();
-    propValue->value.int32Values = getIntegerSensors();
-    propValue->value.floatValues = getFloatSensors();
-    propValue->value.bytes = getSensorsBitmask();
+    copyToHidlVec(getIntegerSensors(), &propValue->value.int32Values);
+    copyToHidlVec(getFloatSensors(), &propValue->value.floatValues);
+    copyToHidlVec(getSensorsBitmask(), &propValue->value.bytes);
     propValue->value.stringValue = dtc;
 }
 
+void Obd2SensorStore::fillNonZeroSensorsBitmask(const hidl_vec<int32_t>& integerSensors,
+                                                const hidl_vec<float>& floatSensors,
+                                                size_t numIntegerSensors,
+                                                hidl_vec<uint8_t>* bitmask) {
+    std::fill(bitmask->begin(), bitmask->end(), 0);
+    setNonZeroBits(integerSensors, 0, bitmask);
+    setNonZeroBits(floatSensors, numIntegerSensors, bitmask);
+}
+
 }  // namespace V2_0
 }  // namespace vehicle
 }  // namespace automotive
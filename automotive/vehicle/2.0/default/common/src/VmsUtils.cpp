@@ -283,6 +283,85 @@ std::vector<VmsLayer> getSubscribedLayers(const VehiclePropValue& subscriptions_
     return {};
 }
 
+bool VmsSubscriptionsIndex::update(const VehiclePropValue& subscriptions_state) {
+    if (!isSequenceNumberNewer(subscriptions_state, mSequenceNumber)) {
+        return false;
+    }
+    const auto& values = subscriptions_state.value.int32Values;
+    const int64_t subscriptions_state_int_size = values.size();
+    if (subscriptions_state_int_size <=
+        toInt(VmsSubscriptionsStateIntegerValuesIndex::NUMBER_OF_LAYERS)) {
+        return false;
+    }
+    const int32_t num_of_layers =
+            values[toInt(VmsSubscriptionsStateIntegerValuesIndex::NUMBER_OF_LAYERS)];
+    const int32_t num_of_associated_layers =
+            subscriptions_state_int_size >
+                            toInt(VmsSubscriptionsStateIntegerValuesIndex::
+                                          NUMBER_OF_ASSOCIATED_LAYERS)
+                    ? values[toInt(
+                              VmsSubscriptionsStateIntegerValuesIndex::NUMBER_OF_ASSOCIATED_LAYERS)]
+                    : 0;
+    if (num_of_layers < 0 || num_of_associated_layers < 0) {
+        return false;
+    }
+
+    // Make sure the whole message is there before dropping the current state.
+    const int64_t subscriptions_start =
+            toInt(VmsSubscriptionsStateIntegerValuesIndex::SUBSCRIPTIONS_START);
+    int64_t current_index = subscriptions_start + int64_t{num_of_layers} * kLayerSize;
+    for (int i = 0; i < num_of_associated_layers && current_index <= subscriptions_state_int_size;
+         i++) {
+        if (subscriptions_state_int_size < current_index + kLayerSize + 1) {
+            return false;
+        }
+        const int32_t num_of_publisher_ids = values[current_index + kLayerSize];
+        if (num_of_publisher_ids < 0) {
+            return false;
+        }
+        current_index += kLayerSize + 1 + num_of_publisher_ids;
+    }
+    if (current_index > subscriptions_state_int_size) {
+        return false;
+    }
+
+    mLayers.clear();
+    mAssociatedLayers.clear();
+    current_index = subscriptions_start;
+    for (int i = 0; i < num_of_layers; i++) {
+        mLayers.emplace(values[current_index], values[current_index + 1],
+                        values[current_index + 2]);
+        current_index += kLayerSize;
+    }
+    for (int i = 0; i < num_of_associated_layers; i++) {
+        const VmsLayer layer(values[current_index], values[current_index + 1],
+                             values[current_index + 2]);
+        current_index += kLayerSize;
+        const int32_t num_of_publisher_ids = values[current_index++];
+        for (int j = 0; j < num_of_publisher_ids; j++) {
+            mAssociatedLayers.emplace(layer, values[current_index++]);
+        }
+    }
+    mSequenceNumber = values[kSubscriptionStateSequenceNumberIndex];
+    return true;
+}
+
+void VmsSubscriptionsIndex::clear() {
+    mSequenceNumber = -1;
+    mLayers.clear();
+    mAssociatedLayers.clear();
+}
+
+std::vector<VmsLayer> VmsSubscriptionsIndex::getSubscribedLayers(const VmsOffers& offers) const {
+    std::vector<VmsLayer> subscribed_layers;
+    for (const auto& offer : offers.offerings) {
+        if (isSubscribed(offer.layer, offers.publisher_id)) {
+            subscribed_layers.push_back(offer.layer);
+        }
+    }
+    return subscribed_layers;
+}
+
 bool hasServiceNewlyStarted(const VehiclePropValue& availability_change) {
     return (isValidVmsMessage(availability_change) &&
             parseMessageType(availability_change) == VmsMessageType::AVAILABILITY_CHANGE &&
@@ -31,42 +31,97 @@ namespace V2_0 {
 
 namespace impl {
 
+// Most messages to answer in one write, so a long burst still gets timely replies
+static constexpr size_t kMaxBatchedResponses = 64;
+
 void CommConn::start() {
     mReadThread = std::make_unique<std::thread>(std::bind(&CommConn::readThread, this));
 }
 
 void CommConn::stop() {
-    if (mReadThread->joinable()) {
+    if (mReadThread && mReadThread->joinable()) {
         mReadThread->join();
     }
 }
 
+int CommConn::write(const std::vector<iovec>& messages) {
+    int total = 0;
+    for (const iovec& msg : messages) {
+        int retVal = write(static_cast<const uint8_t*>(msg.iov_base), msg.iov_len);
+        if (retVal < 0) {
+            return retVal;
+        }
+        total += retVal;
+    }
+    return total;
+}
+
 void CommConn::sendMessage(emulator::EmulatorMessage const& msg) {
-    int numBytes = msg.ByteSize();
-    std::vector<uint8_t> buffer(static_cast<size_t>(numBytes));
-    if (!msg.SerializeToArray(buffer.data(), numBytes)) {
-        ALOGE("%s: SerializeToString failed!", __func__);
-        return;
+    sendMessages(&msg, 1);
+}
+
+void CommConn::sendMessages(emulator::EmulatorMessage const* msgs, size_t count) {
+    std::lock_guard<std::mutex> lock(mTxLock);
+
+    // Serialize everything back to back into the reused buffer, using the sizes cached by
+    // ByteSize() rather than computing them again in SerializeToArray().
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (msgs[i].IsInitialized()) {
+            totalBytes += static_cast<size_t>(msgs[i].ByteSize());
+        } else {
+            ALOGE("%s: SerializeToString failed!", __func__);
+        }
+    }
+    if (mTxBuffer.size() < totalBytes) {
+        mTxBuffer.resize(totalBytes);
     }
 
-    write(buffer);
+    mTxMessages.clear();
+    uint8_t* next = mTxBuffer.data();
+    for (size_t i = 0; i < count; i++) {
+        if (!msgs[i].IsInitialized()) {
+            continue;
+        }
+        uint8_t* end = msgs[i].SerializeWithCachedSizesToArray(next);
+        mTxMessages.push_back({next, static_cast<size_t>(end - next)});
+        next = end;
+    }
+
+    if (mTxMessages.size() == 1) {
+        write(mTxBuffer.data(), mTxMessages[0].iov_len);
+    } else if (mTxMessages.size() > 1) {
+        write(mTxMessages);
+    }
 }
 
 void CommConn::readThread() {
-    std::vector<uint8_t> buffer;
+    emulator::EmulatorMessage rxMsg;
+    std::vector<emulator::EmulatorMessage> responses;
+    size_t numResponses = 0;
     while (isOpen()) {
-        buffer = read();
-        if (buffer.size() == 0) {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        if (!read(&data, &size)) {
             ALOGI("%s: Read returned empty message, exiting read loop.", __func__);
             break;
         }
 
-        emulator::EmulatorMessage rxMsg;
-        if (rxMsg.ParseFromArray(buffer.data(), static_cast<int32_t>(buffer.size()))) {
-            emulator::EmulatorMessage respMsg;
+        if (rxMsg.ParseFromArray(data, static_cast<int32_t>(size))) {
+            // Response messages are reused to keep the allocations of their repeated fields
+            if (numResponses == responses.size()) {
+                responses.emplace_back();
+            }
+            emulator::EmulatorMessage& respMsg = responses[numResponses++];
+            respMsg.Clear();
             mMessageProcessor->processMessage(rxMsg, respMsg);
+        }
 
-            sendMessage(respMsg);
+        // Reply once every message that arrived together has been processed
+        if (numResponses > 0 &&
+            (numResponses == kMaxBatchedResponses || !hasBufferedMessage())) {
+            sendMessages(responses.data(), numResponses);
+            numResponses = 0;
         }
     }
 }
@@ -18,6 +18,8 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_CommBase_H_
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+#include <sys/uio.h>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -74,31 +76,61 @@ class CommConn {
     virtual bool isOpen() = 0;
 
     /**
-     * Blocking call to read data from the connection.
+     * Blocking call to read the next message from the connection.
      *
-     * @return std::vector<uint8_t> Serialized protobuf data received from emulator.  This will be
-     *              an empty vector if the connection was closed or some other error occurred.
+     * @param data Set to the serialized protobuf data received from emulator.  It points into a
+     *              buffer owned by the connection, which stays valid until the next call.
+     * @param size Set to the size of the message.
+     *
+     * @return bool False if the connection was closed or some other error occurred.
+     */
+    virtual bool read(const uint8_t** data, size_t* size) = 0;
+
+    /**
+     * Returns true if a complete message has already been received, so that the next read() won't
+     * block.  The read thread uses it to answer a burst of messages with a single write.
      */
-    virtual std::vector<uint8_t> read() = 0;
+    virtual bool hasBufferedMessage() { return false; }
 
     /**
-     * Transmits a string of data to the emulator.
+     * Transmits a string of data to the emulator.  Only called with the transmit lock held.
      *
      * @param data Serialized protobuf data to transmit.
+     * @param size Size of the data.
+     *
+     * @return int Number of bytes transmitted, or -1 if failed.
+     */
+    virtual int write(const uint8_t* data, size_t size) = 0;
+
+    /**
+     * Transmits several messages, in order, as if write() was called for each of them.
+     *
+     * @param messages Serialized protobuf data of each message.
      *
      * @return int Number of bytes transmitted, or -1 if failed.
      */
-    virtual int write(const std::vector<uint8_t>& data) = 0;
+    virtual int write(const std::vector<iovec>& messages);
 
     /**
      * Serialized and send the given message to the other side.
      */
     void sendMessage(emulator::EmulatorMessage const& msg);
 
+    /**
+     * Serialize and send several messages to the other side, in a single write if the connection
+     * supports it.
+     */
+    void sendMessages(emulator::EmulatorMessage const* msgs, size_t count);
+
    protected:
     std::unique_ptr<std::thread> mReadThread;
     MessageProcessor* mMessageProcessor;
 
+    // Guards the transmit buffers and keeps concurrent senders from interleaving their messages
+    std::mutex mTxLock;
+    std::vector<uint8_t> mTxBuffer;
+    std::vector<iovec> mTxMessages;
+
     /**
      * A thread that reads messages in a loop, and responds. You can stop this thread by calling
      * stop().
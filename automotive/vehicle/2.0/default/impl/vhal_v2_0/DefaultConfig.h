@@ -134,6 +134,15 @@ enum class FakeDataCommand : int32_t {
      */
     StopJson = 3,
 
+    /**
+     * Starts generating OBD2 live frames that simulate the car driving. Caller must provide:
+     *     int64Values[0] - periodic interval in nanoseconds
+     */
+    StartObd2LiveFrame = 4,
+
+    /** Stops OBD2 live frame generation that was triggered by StartObd2LiveFrame. */
+    StopObd2LiveFrame = 5,
+
     /**
      * Injects key press event (HAL incorporates UP/DOWN acction and triggers 2 HAL events for every
      * key-press). We set the enum with high number to leave space for future start/stop commands.
@@ -281,6 +281,15 @@ void EmulatedVehicleHal::onContinuousPropertyTimer(const std::vector<int32_t>& p
     auto& pool = *getValuePool();
 
     for (int32_t property : properties) {
+        if (property == OBD2_LIVE_FRAME && mObd2LiveFrameGenerator) {
+            static constexpr bool shouldUpdateStatus = true;
+            const VehiclePropValue& frame =
+                    mObd2LiveFrameGenerator->nextFrame(elapsedRealtimeNano());
+            mPropStore->writeValue(frame, shouldUpdateStatus);
+            doHalEvent(pool.obtain(frame));
+            continue;
+        }
+
         if (isContinuousProperty(property)) {
             auto internalPropValue = mPropStore->readValueOrNull(property);
             if (internalPropValue != nullptr) {
@@ -407,6 +416,21 @@ StatusCode EmulatedVehicleHal::handleGenerateFakeDataRequest(const VehiclePropVa
             mGeneratorHub.unregisterGenerator(cookie);
             break;
         }
+        case FakeDataCommand::StartObd2LiveFrame: {
+            ALOGI("%s, FakeDataCommand::StartObd2LiveFrame", __func__);
+            if (!v.int64Values.size() || v.int64Values[0] <= 0) {
+                ALOGE("%s: interval is not provided in int64Values", __func__);
+                return StatusCode::INVALID_ARG;
+            }
+            mRecurrentTimer.registerRecurrentEvent(std::chrono::nanoseconds(v.int64Values[0]),
+                                                   OBD2_LIVE_FRAME);
+            break;
+        }
+        case FakeDataCommand::StopObd2LiveFrame: {
+            ALOGI("%s, FakeDataCommand::StopObd2LiveFrame", __func__);
+            mRecurrentTimer.unregisterRecurrentEvent(OBD2_LIVE_FRAME);
+            break;
+        }
         case FakeDataCommand::KeyPress: {
             ALOGI("%s, FakeDataCommand::KeyPress", __func__);
             int32_t keyCode = request.value.int32Values[2];
@@ -495,6 +519,8 @@ void EmulatedVehicleHal::initObd2LiveFrame(const VehiclePropConfig& propConfig)
     liveObd2Frame->prop = OBD2_LIVE_FRAME;
 
     mPropStore->writeValue(*liveObd2Frame, shouldUpdateStatus);
+    mObd2LiveFrameGenerator = std::make_unique<Obd2LiveFrameGenerator>(*sensorStore,
+                                                                       OBD2_LIVE_FRAME);
 }
 
 void EmulatedVehicleHal::initObd2FreezeFrame(const VehiclePropConfig& propConfig) {
@@ -506,10 +532,13 @@ void EmulatedVehicleHal::initObd2FreezeFrame(const VehiclePropConfig& propConfig
     static std::vector<std::string> sampleDtcs = {"P0070",
                                                   "P0102"
                                                   "P0123"};
+    // The sensors are the same for every DTC, so the frame is only built once
+    auto freezeFrame = createVehiclePropValue(VehiclePropertyType::MIXED, 0);
+    sensorStore->fillPropValue("", freezeFrame.get());
+    freezeFrame->prop = OBD2_FREEZE_FRAME;
     for (auto&& dtc : sampleDtcs) {
-        auto freezeFrame = createVehiclePropValue(VehiclePropertyType::MIXED, 0);
-        sensorStore->fillPropValue(dtc, freezeFrame.get());
-        freezeFrame->prop = OBD2_FREEZE_FRAME;
+        freezeFrame->timestamp = elapsedRealtimeNano();
+        freezeFrame->value.stringValue = dtc;
 
         mPropStore->writeValue(*freezeFrame, shouldUpdateStatus);
     }
@@ -31,6 +31,7 @@
 
 #include "DefaultConfig.h"
 #include "GeneratorHub.h"
+#include "Obd2LiveFrameGenerator.h"
 #include "VehicleEmulator.h"
 
 namespace android {
@@ -86,6 +87,8 @@ private:
     std::unordered_set<int32_t> mHvacPowerProps;
     RecurrentTimer mRecurrentTimer;
     GeneratorHub mGeneratorHub;
+    // Only used from the recurrent timer thread once constructed
+    std::unique_ptr<Obd2LiveFrameGenerator> mObd2LiveFrameGenerator;
 };
 
 }  // impl
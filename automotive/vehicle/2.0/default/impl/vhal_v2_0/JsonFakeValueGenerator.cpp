@@ -21,6 +21,7 @@
 #include <typeinfo>
 
 #include <log/log.h>
+#include <vhal_v2_0/Obd2SensorStore.h>
 #include <vhal_v2_0/VehicleUtils.h>
 
 #include "JsonFakeValueGenerator.h"
@@ -173,28 +174,12 @@ hidl_vec<uint8_t> JsonFakeValueGenerator::generateDiagnosticBytes(
     size_t byteSize = ((size_t)DiagnosticIntegerSensorIndex::LAST_SYSTEM_INDEX +
                        (size_t)DiagnosticFloatSensorIndex::LAST_SYSTEM_INDEX + 2);
     hidl_vec<uint8_t> bytes(byteSize % 8 == 0 ? byteSize / 8 : byteSize / 8 + 1);
-
-    auto& int32Values = diagnosticValue.int32Values;
-    for (size_t i = 0; i < int32Values.size(); i++) {
-        if (int32Values[i] != 0) {
-            setBit(bytes, i);
-        }
-    }
-
-    auto& floatValues = diagnosticValue.floatValues;
-    for (size_t i = 0; i < floatValues.size(); i++) {
-        if (floatValues[i] != 0.0) {
-            setBit(bytes, i + (size_t)DiagnosticIntegerSensorIndex::LAST_SYSTEM_INDEX + 1);
-        }
-    }
+    Obd2SensorStore::fillNonZeroSensorsBitmask(
+            diagnosticValue.int32Values, diagnosticValue.floatValues,
+            (size_t)DiagnosticIntegerSensorIndex::LAST_SYSTEM_INDEX + 1, &bytes);
     return bytes;
 }
 
-void JsonFakeValueGenerator::setBit(hidl_vec<uint8_t>& bytes, size_t idx) {
-    uint8_t mask = 1 << (idx % 8);
-    bytes[idx / 8] |= mask;
-}
-
 }  // namespace impl
 
 }  // namespace V2_0
@@ -56,7 +56,6 @@ private:
 
     bool isDiagnosticProperty(int32_t prop);
     hidl_vec<uint8_t> generateDiagnosticBytes(const VehiclePropValue::RawValue& diagnosticValue);
-    void setBit(hidl_vec<uint8_t>& bytes, size_t idx);
 
 private:
     GeneratorCfg mGenCfg;
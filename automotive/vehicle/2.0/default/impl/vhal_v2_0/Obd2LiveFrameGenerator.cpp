@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vhal_v2_0/VehicleUtils.h>
+
+#include "Obd2LiveFrameGenerator.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+// Length of one acceleration and braking cycle, in frames
+static constexpr uint32_t kCycleFrames = 200;
+
+Obd2LiveFrameGenerator::Obd2LiveFrameGenerator(const Obd2SensorStore& frameTemplate,
+                                               int32_t prop) {
+    frameTemplate.fillPropValue("", &mFrame);
+    mFrame.prop = prop;
+    mInitialRuntime = frameTemplate.getIntegerSensors()[toInt(
+            DiagnosticIntegerSensorIndex::RUNTIME_SINCE_ENGINE_START)];
+}
+
+const VehiclePropValue& Obd2LiveFrameGenerator::nextFrame(int64_t timestamp) {
+    if (mFirstTimestamp < 0) {
+        mFirstTimestamp = timestamp;
+    }
+
+    // Ramp up to speed and back down, with the engine following along
+    const uint32_t phase = mFrameCount++ % kCycleFrames;
+    const float load = (phase < kCycleFrames / 2 ? phase : kCycleFrames - phase) /
+                       static_cast<float>(kCycleFrames / 2);
+
+    auto& floatSensors = mFrame.value.floatValues;
+    floatSensors[toInt(DiagnosticFloatSensorIndex::VEHICLE_SPEED)] = 20.f + 80.f * load;
+    floatSensors[toInt(DiagnosticFloatSensorIndex::ENGINE_RPM)] = 900.f + 2600.f * load;
+    floatSensors[toInt(DiagnosticFloatSensorIndex::THROTTLE_POSITION)] = 5.f + 60.f * load;
+    floatSensors[toInt(DiagnosticFloatSensorIndex::CALCULATED_ENGINE_LOAD)] =
+            0.1f + 0.7f * load;
+
+    mFrame.value.int32Values[toInt(DiagnosticIntegerSensorIndex::RUNTIME_SINCE_ENGINE_START)] =
+            mInitialRuntime + static_cast<int32_t>((timestamp - mFirstTimestamp) / 1000000000LL);
+    mFrame.timestamp = timestamp;
+    return mFrame;
+}
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_impl_Obd2LiveFrameGenerator_H_
+#define android_hardware_automotive_vehicle_V2_0_impl_Obd2LiveFrameGenerator_H_
+
+#include <android/hardware/automotive/vehicle/2.0/types.h>
+
+#include <vhal_v2_0/Obd2SensorStore.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+/**
+ * Produces a stream of OBD2 live frames that simulate a car driving around.
+ *
+ * The frame is built once from a template sensor store, and each new frame only rewrites the
+ * few sensors that change while driving. The sensors written are all present in the template,
+ * so the bitmask never needs updating.
+ */
+class Obd2LiveFrameGenerator {
+public:
+    Obd2LiveFrameGenerator(const Obd2SensorStore& frameTemplate, int32_t prop);
+
+    /**
+     * Advances the simulation by one frame. The returned frame is reused by the next call.
+     */
+    const VehiclePropValue& nextFrame(int64_t timestamp);
+
+private:
+    VehiclePropValue mFrame;
+    uint32_t mFrameCount = 0;
+    int32_t mInitialRuntime;
+    int64_t mFirstTimestamp = -1;
+};
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_impl_Obd2LiveFrameGenerator_H_
@@ -20,14 +20,28 @@
 #include <android/log.h>
 #include <arpa/inet.h>
 #include <log/log.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 #include "SocketComm.h"
 
 // Socket to use when communicating with Host PC
 static constexpr int DEBUG_SOCKET = 33452;
 
+// Each message is preceded by its length
+static constexpr size_t MSG_HEADER_LEN = sizeof(uint32_t);
+
+// Largest message accepted from a client, anything bigger means the stream is corrupted
+static constexpr uint32_t MAX_RX_MSG_LEN = 16 * 1024 * 1024;
+
+// Initial size of the receive buffer, enough for a few hundred property updates
+static constexpr size_t RX_BUFFER_LEN = 64 * 1024;
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -139,78 +153,121 @@ void SocketComm::removeClosedConnections() {
 SocketConn::SocketConn(MessageProcessor* messageProcessor, int sfd)
     : CommConn(messageProcessor), mSockFd(sfd) {}
 
-/**
- * Reads, in a loop, exactly numBytes from the given fd. If the connection is closed, returns
- * an empty buffer, otherwise will return exactly the given number of bytes.
- */
-std::vector<uint8_t> readExactly(int fd, int numBytes) {
-    std::vector<uint8_t> buffer(numBytes);
-    int totalRead = 0;
-    int offset = 0;
-    while (totalRead < numBytes) {
-        int numRead = ::read(fd, &buffer.data()[offset], numBytes - offset);
-        if (numRead == 0) {
-            buffer.resize(0);
-            return buffer;
-        }
-
-        totalRead += numRead;
-    }
-    return buffer;
+static uint32_t readMsgLen(const uint8_t* header) {
+    uint32_t msgLen;
+    memcpy(&msgLen, header, MSG_HEADER_LEN);
+    return ntohl(msgLen);
 }
 
-/**
- * Reads an int, guaranteed to be non-zero, from the given fd. If the connection is closed, returns
- * -1.
- */
-int32_t readInt(int fd) {
-    std::vector<uint8_t> buffer = readExactly(fd, sizeof(int32_t));
-    if (buffer.size() == 0) {
-        return -1;
+bool SocketConn::read(const uint8_t** data, size_t* size) {
+    if (mRxBuffer.empty()) {
+        mRxBuffer.resize(RX_BUFFER_LEN);
     }
 
-    int32_t value = *reinterpret_cast<int32_t*>(buffer.data());
-    return ntohl(value);
-}
+    while (true) {
+        size_t available = mRxEnd - mRxStart;
+        if (available == 0) {
+            mRxStart = mRxEnd = 0;
+        }
 
-std::vector<uint8_t> SocketConn::read() {
-    int32_t msgSize = readInt(mSockFd);
-    if (msgSize <= 0) {
-        ALOGD("%s: Connection terminated on socket %d", __FUNCTION__, mSockFd);
-        return std::vector<uint8_t>();
+        size_t needed = MSG_HEADER_LEN;
+        if (available >= MSG_HEADER_LEN) {
+            uint32_t msgLen = readMsgLen(&mRxBuffer[mRxStart]);
+            if (msgLen == 0 || msgLen > MAX_RX_MSG_LEN) {
+                ALOGD("%s: Connection terminated on socket %d", __FUNCTION__, mSockFd);
+                return false;
+            }
+
+            needed += msgLen;
+            if (available >= needed) {
+                *data = &mRxBuffer[mRxStart + MSG_HEADER_LEN];
+                *size = msgLen;
+                mRxStart += needed;
+                return true;
+            }
+        }
+
+        // Make room for the rest of the message, which may also bring in the following ones
+        if (mRxStart + needed > mRxBuffer.size()) {
+            memmove(mRxBuffer.data(), &mRxBuffer[mRxStart], available);
+            mRxStart = 0;
+            mRxEnd = available;
+            if (needed > mRxBuffer.size()) {
+                mRxBuffer.resize(needed);
+            }
+        }
+
+        ssize_t numRead = TEMP_FAILURE_RETRY(
+                ::read(mSockFd, &mRxBuffer[mRxEnd], mRxBuffer.size() - mRxEnd));
+        if (numRead <= 0) {
+            ALOGD("%s: Connection terminated on socket %d", __FUNCTION__, mSockFd);
+            return false;
+        }
+        mRxEnd += static_cast<size_t>(numRead);
     }
+}
 
-    return readExactly(mSockFd, msgSize);
+bool SocketConn::hasBufferedMessage() {
+    size_t available = mRxEnd - mRxStart;
+    return available >= MSG_HEADER_LEN &&
+           available - MSG_HEADER_LEN >= readMsgLen(&mRxBuffer[mRxStart]);
 }
 
 void SocketConn::stop() {
     if (mSockFd > 0) {
+        // Unlike close(), this wakes up the read thread if it is blocked on the socket
+        shutdown(mSockFd, SHUT_RDWR);
+        CommConn::stop();
         close(mSockFd);
         mSockFd = -1;
     }
 }
 
-int SocketConn::write(const std::vector<uint8_t>& data) {
-    static constexpr int MSG_HEADER_LEN = 4;
-    int retVal = 0;
-    union {
-        uint32_t msgLen;
-        uint8_t msgLenBytes[MSG_HEADER_LEN];
-    };
+int SocketConn::write(const uint8_t* data, size_t size) {
+    uint32_t msgLen = htonl(static_cast<uint32_t>(size));
+    iovec iov[2] = {{&msgLen, MSG_HEADER_LEN}, {const_cast<uint8_t*>(data), size}};
+    return writeIov(iov, 2);
+}
 
-    // Prepare header for the message
-    msgLen = static_cast<uint32_t>(data.size());
-    msgLen = htonl(msgLen);
+int SocketConn::write(const std::vector<iovec>& messages) {
+    mTxHeaders.resize(messages.size());
+    mTxIov.clear();
+    for (size_t i = 0; i < messages.size(); i++) {
+        mTxHeaders[i] = htonl(static_cast<uint32_t>(messages[i].iov_len));
+        mTxIov.push_back({&mTxHeaders[i], MSG_HEADER_LEN});
+        mTxIov.push_back(messages[i]);
+    }
+    return writeIov(mTxIov.data(), mTxIov.size());
+}
 
-    if (mSockFd > 0) {
-        retVal = ::write(mSockFd, msgLenBytes, MSG_HEADER_LEN);
+int SocketConn::writeIov(iovec* iov, size_t count) {
+    if (mSockFd <= 0) {
+        return 0;
+    }
 
-        if (retVal == MSG_HEADER_LEN) {
-            retVal = ::write(mSockFd, data.data(), data.size());
+    int total = 0;
+    while (count > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(
+                ::writev(mSockFd, iov, static_cast<int>(std::min<size_t>(count, IOV_MAX))));
+        if (written < 0) {
+            ALOGE("%s: writev failed on socket %d, errno=%d", __FUNCTION__, mSockFd, errno);
+            return -1;
+        }
+        total += static_cast<int>(written);
+
+        // Skip over what was sent, which may end in the middle of an entry
+        size_t remaining = static_cast<size_t>(written);
+        while (count > 0 && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (remaining > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + remaining;
+            iov->iov_len -= remaining;
         }
     }
-
-    return retVal;
+    return total;
 }
 
 }  // impl
@@ -79,6 +79,11 @@ class SocketComm {
 
 /**
  * SocketConn represents a single connection to a client.
+ *
+ * Each message is sent as a 4 byte length in network order followed by the serialized protobuf.
+ * Reads go through a buffer that is reused for the life of the connection and may pick up several
+ * messages with one system call, and the length and body of outgoing messages are written
+ * together with writev().
  */
 class SocketConn : public CommConn {
    public:
@@ -86,12 +91,17 @@ class SocketConn : public CommConn {
     virtual ~SocketConn() = default;
 
     /**
-     * Blocking call to read data from the connection.
+     * Blocking call to read the next message from the connection.
+     *
+     * @param data Set to the serialized protobuf data received from emulator, which stays valid
+     *              until the next call.
+     * @param size Set to the size of the message.
      *
-     * @return std::vector<uint8_t> Serialized protobuf data received from emulator.  This will be
-     *              an empty vector if the connection was closed or some other error occurred.
+     * @return bool False if the connection was closed or some other error occurred.
      */
-    std::vector<uint8_t> read() override;
+    bool read(const uint8_t** data, size_t* size) override;
+
+    bool hasBufferedMessage() override;
 
     /**
      * Closes a connection if it is open.
@@ -102,15 +112,32 @@ class SocketConn : public CommConn {
      * Transmits a string of data to the emulator.
      *
      * @param data Serialized protobuf data to transmit.
+     * @param size Size of the data.
      *
      * @return int Number of bytes transmitted, or -1 if failed.
      */
-    int write(const std::vector<uint8_t>& data) override;
+    int write(const uint8_t* data, size_t size) override;
+
+    /**
+     * Transmits several messages with as few system calls as possible.
+     */
+    int write(const std::vector<iovec>& messages) override;
 
     inline bool isOpen() override { return mSockFd > 0; }
 
    private:
     int mSockFd;
+
+    // Received bytes not consumed yet are mRxBuffer[mRxStart, mRxEnd)
+    std::vector<uint8_t> mRxBuffer;
+    size_t mRxStart = 0;
+    size_t mRxEnd = 0;
+
+    // Message headers and the header/body pairs handed to writev(), reused across writes
+    std::vector<uint32_t> mTxHeaders;
+    std::vector<iovec> mTxIov;
+
+    int writeIov(iovec* iov, size_t count);
 };
 
 }  // impl
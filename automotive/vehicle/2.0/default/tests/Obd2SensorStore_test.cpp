@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "vhal_v2_0/Obd2SensorStore.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+// A bit at a time, the way the bitmask is defined
+hidl_vec<uint8_t> naiveBitmask(const hidl_vec<int32_t>& integerSensors,
+                               const hidl_vec<float>& floatSensors, size_t numIntegerSensors,
+                               size_t bitmaskSize) {
+    hidl_vec<uint8_t> bitmask;
+    bitmask.resize(bitmaskSize);
+    std::fill(bitmask.begin(), bitmask.end(), 0);
+    auto setBit = [&bitmask](size_t bit, bool value) {
+        if (value && bit / 8 < bitmask.size()) {
+            bitmask[bit / 8] |= 1 << (bit % 8);
+        }
+    };
+    for (size_t i = 0; i < integerSensors.size(); i++) {
+        setBit(i, integerSensors[i] != 0);
+    }
+    for (size_t i = 0; i < floatSensors.size(); i++) {
+        setBit(numIntegerSensors + i, floatSensors[i] != 0);
+    }
+    return bitmask;
+}
+
+void expectMatchesNaive(const hidl_vec<int32_t>& integerSensors,
+                        const hidl_vec<float>& floatSensors, size_t bitmaskSize) {
+    hidl_vec<uint8_t> bitmask;
+    bitmask.resize(bitmaskSize);
+    // Stale bits must be cleared
+    std::fill(bitmask.begin(), bitmask.end(), 0xa5);
+    Obd2SensorStore::fillNonZeroSensorsBitmask(integerSensors, floatSensors,
+                                               integerSensors.size(), &bitmask);
+
+    hidl_vec<uint8_t> expected =
+            naiveBitmask(integerSensors, floatSensors, integerSensors.size(), bitmaskSize);
+    ASSERT_EQ(expected.size(), bitmask.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(expected[i], bitmask[i]) << "byte " << i << " of " << integerSensors.size()
+                                           << " integer and " << floatSensors.size()
+                                           << " float sensors";
+    }
+}
+
+hidl_vec<int32_t> integerPattern(size_t count, bool (*nonZero)(size_t)) {
+    hidl_vec<int32_t> values;
+    values.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        values[i] = nonZero(i) ? static_cast<int32_t>(i) + 1 : 0;
+    }
+    return values;
+}
+
+hidl_vec<float> floatPattern(size_t count, bool (*nonZero)(size_t)) {
+    hidl_vec<float> values;
+    values.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        values[i] = nonZero(i) ? 0.5f * (i + 1) : 0.f;
+    }
+    return values;
+}
+
+bool none(size_t) { return false; }
+bool all(size_t) { return true; }
+bool even(size_t i) { return i % 2 == 0; }
+bool sparse(size_t i) { return i % 13 == 5; }
+bool lastOfByte(size_t i) { return i % 8 == 7; }
+
+const size_t kSensorCounts[] = {0, 1, 7, 8, 9, 31, 32, 33, 64, 71};
+
+}  // namespace
+
+TEST(Obd2SensorStoreTest, nonZeroBitmaskMatchesNaiveLoop) {
+    bool (*const patterns[])(size_t) = {none, all, even, sparse, lastOfByte};
+    for (auto integerPatternFn : patterns) {
+        for (auto floatPatternFn : patterns) {
+            for (size_t numIntegers : kSensorCounts) {
+                for (size_t numFloats : kSensorCounts) {
+                    auto integers = integerPattern(numIntegers, integerPatternFn);
+                    auto floats = floatPattern(numFloats, floatPatternFn);
+                    expectMatchesNaive(integers, floats, (numIntegers + numFloats + 7) / 8);
+                }
+            }
+        }
+    }
+}
+
+TEST(Obd2SensorStoreTest, nonZeroBitmaskMatchesNaiveLoopOnRandomFrames) {
+    std::mt19937 random(42);
+    for (int frame = 0; frame < 200; frame++) {
+        hidl_vec<int32_t> integers;
+        integers.resize(random() % 48);
+        for (auto& value : integers) {
+            value = random() % 3 == 0 ? 0 : static_cast<int32_t>(random());
+        }
+        hidl_vec<float> floats;
+        floats.resize(random() % 96);
+        for (auto& value : floats) {
+            value = random() % 3 == 0 ? 0.f : 1.f / (1 + random() % 100);
+        }
+        expectMatchesNaive(integers, floats, (integers.size() + floats.size() + 7) / 8);
+    }
+}
+
+TEST(Obd2SensorStoreTest, nonZeroBitmaskIgnoresBitsPastItsEnd) {
+    auto integers = integerPattern(20, all);
+    auto floats = floatPattern(30, all);
+    // Shorter than the 50 sensors, and longer
+    expectMatchesNaive(integers, floats, 3);
+    expectMatchesNaive(integers, floats, 10);
+    expectMatchesNaive(integers, floats, 0);
+}
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -393,6 +393,92 @@ TEST(VmsUtilsTest, subscribedLayersWithDifferentPublisherIdForResponse) {
     subscribedLayersWithDifferentPublisherId(VmsMessageType::SUBSCRIPTIONS_RESPONSE);
 }
 
+std::unique_ptr<VehiclePropValue> createSubscriptionsStateForIndex(int sequence_number) {
+    auto message = createBaseVmsMessage(16);
+    message->value.int32Values =
+            hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE),
+                              sequence_number,
+                              2,  // number of layers
+                              1,  // number of associated layers
+                              1,  // layer 1
+                              0,
+                              1,
+                              4,  // layer 2
+                              1,
+                              1,
+                              2,  // associated layer
+                              0,
+                              1,
+                              2,  // number of publisher IDs
+                              111,  // publisher IDs
+                              123};
+    return message;
+}
+
+TEST(VmsUtilsTest, subscriptionsIndexMatchesGetSubscribedLayers) {
+    VmsOffers offers = {123,
+                        {VmsLayerOffering(VmsLayer(1, 0, 1), {VmsLayer(4, 1, 1)}),
+                         VmsLayerOffering(VmsLayer(2, 0, 1)),
+                         VmsLayerOffering(VmsLayer(3, 0, 1))}};
+    auto message = createSubscriptionsStateForIndex(1234);
+
+    VmsSubscriptionsIndex index;
+    EXPECT_EQ(index.getSequenceNumber(), -1);
+    ASSERT_TRUE(index.update(*message));
+    EXPECT_EQ(index.getSequenceNumber(), 1234);
+
+    auto result = index.getSubscribedLayers(offers);
+    EXPECT_EQ(result.size(), getSubscribedLayers(*message, offers).size());
+    ASSERT_EQ(result.size(), 2u);
+    EXPECT_EQ(result.at(0), VmsLayer(1, 0, 1));
+    EXPECT_EQ(result.at(1), VmsLayer(2, 0, 1));
+}
+
+TEST(VmsUtilsTest, subscriptionsIndexChecksPublisher) {
+    VmsSubscriptionsIndex index;
+    ASSERT_TRUE(index.update(*createSubscriptionsStateForIndex(1)));
+
+    EXPECT_TRUE(index.isSubscribed(VmsLayer(4, 1, 1), 999));
+    EXPECT_TRUE(index.isSubscribed(VmsLayer(2, 0, 1), 111));
+    EXPECT_TRUE(index.isSubscribed(VmsLayer(2, 0, 1), 123));
+    EXPECT_FALSE(index.isSubscribed(VmsLayer(2, 0, 1), 234));
+    EXPECT_FALSE(index.isSubscribed(VmsLayer(2, 0, 2), 123));
+}
+
+TEST(VmsUtilsTest, subscriptionsIndexIgnoresOlderState) {
+    VmsSubscriptionsIndex index;
+    ASSERT_TRUE(index.update(*createSubscriptionsStateForIndex(10)));
+
+    auto older = createBaseVmsMessage(4);
+    older->value.int32Values =
+            hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE), 9, 0, 0};
+    EXPECT_FALSE(index.update(*older));
+    EXPECT_EQ(index.getSequenceNumber(), 10);
+    EXPECT_TRUE(index.isSubscribed(VmsLayer(1, 0, 1), 123));
+
+    auto newer = createBaseVmsMessage(4);
+    newer->value.int32Values =
+            hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_RESPONSE), 11, 0, 0};
+    EXPECT_TRUE(index.update(*newer));
+    EXPECT_EQ(index.getSequenceNumber(), 11);
+    EXPECT_FALSE(index.isSubscribed(VmsLayer(1, 0, 1), 123));
+
+    index.clear();
+    EXPECT_EQ(index.getSequenceNumber(), -1);
+    EXPECT_TRUE(index.update(*older));
+}
+
+TEST(VmsUtilsTest, subscriptionsIndexKeepsStateOnMalformedMessage) {
+    VmsSubscriptionsIndex index;
+    ASSERT_TRUE(index.update(*createSubscriptionsStateForIndex(1)));
+
+    auto truncated = createSubscriptionsStateForIndex(2);
+    truncated->value.int32Values.resize(15);  // Missing the last publisher ID
+    EXPECT_FALSE(index.update(*truncated));
+    EXPECT_EQ(index.getSequenceNumber(), 1);
+    EXPECT_TRUE(index.isSubscribed(VmsLayer(2, 0, 1), 123));
+}
+
 TEST(VmsUtilsTest, serviceNewlyStarted) {
     auto message = createBaseVmsMessage(2);
     message->value.int32Values = hidl_vec<int32_t>{toInt(VmsMessageType::AVAILABILITY_CHANGE), 0};
@@ -27,13 +27,16 @@
 #include <thread>
 #include <vector>
 #include "fcntl.h"
-#include "sys/select.h"
+#include "sys/epoll.h"
 #include "unistd.h"
 
 static const int INVALID_FD = -1;
 
 static const int BT_RT_PRIORITY = 1;
 
+// Maximum number of ready file descriptors handled per wakeup
+static const int MAX_EPOLL_EVENTS = 8;
+
 namespace android {
 namespace hardware {
 namespace bluetooth {
@@ -44,7 +47,14 @@ int AsyncFdWatcher::WatchFdForNonBlockingReads(
   // Add file descriptor and callback
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
+    bool already_watched = watched_fds_.count(file_descriptor) != 0;
     watched_fds_[file_descriptor] = on_read_fd_ready_callback;
+    // The file descriptor is added to the epoll set when the thread starts
+    if (epoll_fd_ != INVALID_FD && !already_watched &&
+        addFdToEpoll(file_descriptor) != 0) {
+      watched_fds_.erase(file_descriptor);
+      return -1;
+    }
   }
 
   // Start the thread if not started yet
@@ -81,6 +91,27 @@ int AsyncFdWatcher::tryStartThread() {
   notification_listen_fd_ = pipe_fds[0];
   notification_write_fd_ = pipe_fds[1];
 
+  // Register the notification channel and the file descriptors watched so far
+  {
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    bool registered =
+        epoll_fd_ != INVALID_FD && addFdToEpoll(notification_listen_fd_) == 0;
+    for (auto it = watched_fds_.begin(); registered && it != watched_fds_.end();
+         ++it) {
+      registered = addFdToEpoll(it->first) == 0;
+    }
+    if (!registered) {
+      ALOGE("%s unable to set up epoll: %s", __func__, strerror(errno));
+      if (epoll_fd_ != INVALID_FD) close(epoll_fd_);
+      epoll_fd_ = INVALID_FD;
+      close(notification_listen_fd_);
+      close(notification_write_fd_);
+      running_ = false;
+      return -1;
+    }
+  }
+
   thread_ = std::thread([this]() { ThreadRoutine(); });
   if (!thread_.joinable()) return -1;
 
@@ -98,6 +129,8 @@ int AsyncFdWatcher::stopThread() {
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
     watched_fds_.clear();
+    close(epoll_fd_);
+    epoll_fd_ = INVALID_FD;
   }
 
   {
@@ -111,6 +144,18 @@ int AsyncFdWatcher::stopThread() {
   return 0;
 }
 
+int AsyncFdWatcher::addFdToEpoll(int file_descriptor) {
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = file_descriptor;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, file_descriptor, &event) != 0) {
+    ALOGE("%s unable to watch fd %d: %s", __func__, file_descriptor,
+          strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
 int AsyncFdWatcher::notifyThread() {
   uint8_t buffer[] = {0};
   if (TEMP_FAILURE_RETRY(write(notification_write_fd_, &buffer, 1)) < 0) {
@@ -129,26 +174,14 @@ void AsyncFdWatcher::ThreadRoutine() {
   }
 
   while (running_) {
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(notification_listen_fd_, &read_fds);
-    int max_read_fd = INVALID_FD;
-    for (auto& it : watched_fds_) {
-      FD_SET(it.first, &read_fds);
-      max_read_fd = std::max(max_read_fd, it.first);
-    }
-
-    struct timeval timeout;
-    struct timeval* timeout_ptr = NULL;
+    int timeout = -1;
     if (timeout_ms_ > std::chrono::milliseconds(0)) {
-      timeout.tv_sec = timeout_ms_.count() / 1000;
-      timeout.tv_usec = (timeout_ms_.count() % 1000) * 1000;
-      timeout_ptr = &timeout;
+      timeout = timeout_ms_.count();
     }
 
     // Wait until there is data available to read on some FD.
-    int nfds = std::max(notification_listen_fd_, max_read_fd);
-    int retval = select(nfds + 1, &read_fds, NULL, NULL, timeout_ptr);
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int retval = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, timeout);
 
     // There was some error.
     if (retval < 0) continue;
@@ -165,10 +198,17 @@ void AsyncFdWatcher::ThreadRoutine() {
       continue;
     }
 
-    // Read data from the notification FD.
-    if (FD_ISSET(notification_listen_fd_, &read_fds)) {
-      char buffer[] = {0};
-      TEMP_FAILURE_RETRY(read(notification_listen_fd_, buffer, 1));
+    // Read data from the notification FD. The watched FDs are level
+    // triggered, so they are reported again on the next wait.
+    bool notified = false;
+    for (int i = 0; i < retval; i++) {
+      if (events[i].data.fd == notification_listen_fd_) notified = true;
+    }
+    if (notified) {
+      char buffer[16];
+      while (TEMP_FAILURE_RETRY(
+                 read(notification_listen_fd_, buffer, sizeof(buffer))) > 0) {
+      }
       continue;
     }
 
@@ -176,9 +216,10 @@ void AsyncFdWatcher::ThreadRoutine() {
     {
       // Hold the mutex to make sure that the callbacks are still valid.
       std::unique_lock<std::mutex> guard(internal_mutex_);
-      for (auto& it : watched_fds_) {
-        if (FD_ISSET(it.first, &read_fds)) {
-          it.second(it.first);
+      for (int i = 0; i < retval; i++) {
+        auto it = watched_fds_.find(events[i].data.fd);
+        if (it != watched_fds_.end()) {
+          it->second(it->first);
         }
       }
     }
@@ -44,6 +44,7 @@ class AsyncFdWatcher {
   AsyncFdWatcher& operator=(const AsyncFdWatcher&) = delete;
 
   int tryStartThread();
+  int addFdToEpoll(int file_descriptor);
   int stopThread();
   int notifyThread();
   void ThreadRoutine();
@@ -54,10 +55,11 @@ class AsyncFdWatcher {
   std::mutex timeout_mutex_;
 
   std::map<int, ReadCallback> watched_fds_;
+  int epoll_fd_{-1};
   int notification_listen_fd_;
   int notification_write_fd_;
   TimeoutCallback timeout_cb_;
-  std::chrono::milliseconds timeout_ms_;
+  std::chrono::milliseconds timeout_ms_{0};
 };
 
 }  // namespace async
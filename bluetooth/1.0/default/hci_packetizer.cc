@@ -21,6 +21,7 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 #include <utils/Log.h>
 
@@ -28,15 +29,32 @@ namespace {
 
 const size_t preamble_size_for_type[] = {
     0, HCI_COMMAND_PREAMBLE_SIZE, HCI_ACL_PREAMBLE_SIZE, HCI_SCO_PREAMBLE_SIZE,
-    HCI_EVENT_PREAMBLE_SIZE};
+    HCI_EVENT_PREAMBLE_SIZE, HCI_ISO_PREAMBLE_SIZE};
 const size_t packet_length_offset_for_type[] = {
     0, HCI_LENGTH_OFFSET_CMD, HCI_LENGTH_OFFSET_ACL, HCI_LENGTH_OFFSET_SCO,
-    HCI_LENGTH_OFFSET_EVT};
+    HCI_LENGTH_OFFSET_EVT, HCI_LENGTH_OFFSET_ISO};
+
+// Initial size of the read buffer. It grows when a packet does not fit.
+const size_t kReadBufferSize = 16 * 1024;
+// Unparsed data is moved to the front of the buffer when less room is left
+// for the next read.
+const size_t kMinReadSize = 2 * 1024;
 
 size_t HciGetPacketLengthForType(HciPacketType type, const uint8_t* preamble) {
   size_t offset = packet_length_offset_for_type[type];
-  if (type != HCI_PACKET_TYPE_ACL_DATA) return preamble[offset];
-  return (((preamble[offset + 1]) << 8) | preamble[offset]);
+  if (type == HCI_PACKET_TYPE_ACL_DATA) {
+    return (((preamble[offset + 1]) << 8) | preamble[offset]);
+  }
+  if (type == HCI_PACKET_TYPE_ISO_DATA) {
+    // The upper two bits are reserved (Volume 4, Part E, 5.4.5)
+    return ((((preamble[offset + 1]) & 0x3f) << 8) | preamble[offset]);
+  }
+  return preamble[offset];
+}
+
+bool IsIncomingPacketType(HciPacketType type) {
+  return type == HCI_PACKET_TYPE_ACL_DATA || type == HCI_PACKET_TYPE_SCO_DATA ||
+         type == HCI_PACKET_TYPE_EVENT || type == HCI_PACKET_TYPE_ISO_DATA;
 }
 
 }  // namespace
@@ -48,59 +66,87 @@ namespace hci {
 
 const hidl_vec<uint8_t>& HciPacketizer::GetPacket() const { return packet_; }
 
+HciPacketType HciPacketizer::GetPacketType() const { return packet_type_; }
+
 void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
-  switch (state_) {
-    case HCI_PREAMBLE: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(
-          read(fd, preamble_ + bytes_read_,
-               preamble_size_for_type[packet_type] - bytes_read_));
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the header!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      }
-      if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read header error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_read_ += bytes_read;
-      if (bytes_read_ == preamble_size_for_type[packet_type]) {
-        size_t packet_length =
-            HciGetPacketLengthForType(packet_type, preamble_);
-        packet_.resize(preamble_size_for_type[packet_type] + packet_length);
-        memcpy(packet_.data(), preamble_, preamble_size_for_type[packet_type]);
-        bytes_remaining_ = packet_length;
-        state_ = HCI_PAYLOAD;
-        bytes_read_ = 0;
+  if (!IsIncomingPacketType(packet_type)) {
+    LOG_ALWAYS_FATAL("%s: Unimplemented packet type %d", __func__,
+                     static_cast<int>(packet_type));
+  }
+  ReadPackets(fd, packet_type);
+}
+
+void HciPacketizer::OnDataReady(int fd) {
+  ReadPackets(fd, HCI_PACKET_TYPE_UNKNOWN);
+}
+
+void HciPacketizer::CompactBuffer() {
+  if (buffer_head_ == 0) return;
+  memmove(buffer_.data(), buffer_.data() + buffer_head_,
+          buffer_tail_ - buffer_head_);
+  buffer_tail_ -= buffer_head_;
+  buffer_head_ = 0;
+}
+
+void HciPacketizer::ReadPackets(int fd, HciPacketType packet_type) {
+  if (buffer_.empty()) buffer_.resize(kReadBufferSize);
+  if (buffer_.size() - buffer_tail_ < kMinReadSize) CompactBuffer();
+
+  ssize_t bytes_read =
+      TEMP_FAILURE_RETRY(read(fd, buffer_.data() + buffer_tail_,
+                              buffer_.size() - buffer_tail_));
+  if (bytes_read == 0) {
+    // This is only expected if the UART got closed when shutting down.
+    ALOGE("%s: Unexpected EOF reading from the UART!", __func__);
+    sleep(5);  // Expect to be shut down within 5 seconds.
+    return;
+  }
+  if (bytes_read < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+    LOG_ALWAYS_FATAL("%s: Read error: %s", __func__, strerror(errno));
+  }
+  buffer_tail_ += bytes_read;
+
+  // Report every complete packet, and stop at the first partial one.
+  while (buffer_tail_ > buffer_head_) {
+    uint8_t* data = buffer_.data() + buffer_head_;
+    size_t available = buffer_tail_ - buffer_head_;
+    HciPacketType type = packet_type;
+    size_t type_size = 0;
+    if (type == HCI_PACKET_TYPE_UNKNOWN) {
+      type = static_cast<HciPacketType>(data[0]);
+      if (!IsIncomingPacketType(type)) {
+        LOG_ALWAYS_FATAL("%s: Unimplemented packet type %d", __func__,
+                         static_cast<int>(type));
       }
-      break;
+      type_size = 1;
     }
 
-    case HCI_PAYLOAD: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(read(
-          fd,
-          packet_.data() + preamble_size_for_type[packet_type] + bytes_read_,
-          bytes_remaining_));
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the payload!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      }
-      if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read payload error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_remaining_ -= bytes_read;
-      bytes_read_ += bytes_read;
-      if (bytes_remaining_ == 0) {
-        packet_ready_cb_();
-        state_ = HCI_PREAMBLE;
-        bytes_read_ = 0;
+    size_t preamble_size = preamble_size_for_type[type];
+    if (available < type_size + preamble_size) break;
+    size_t packet_size =
+        preamble_size + HciGetPacketLengthForType(type, data + type_size);
+    if (available < type_size + packet_size) {
+      // Make sure the rest of the packet fits in the buffer.
+      if (buffer_head_ + type_size + packet_size > buffer_.size()) {
+        CompactBuffer();
+        if (type_size + packet_size > buffer_.size()) {
+          buffer_.resize(type_size + packet_size);
+        }
       }
       break;
     }
+
+    packet_type_ = type;
+    packet_.setToExternal(data + type_size, packet_size);
+    buffer_head_ += type_size + packet_size;
+    packet_ready_cb_();
+  }
+  packet_.setToExternal(nullptr, 0);
+
+  if (buffer_head_ == buffer_tail_) {
+    buffer_head_ = 0;
+    buffer_tail_ = 0;
   }
 }
 
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <functional>
+#include <vector>
 
 #include <hidl/HidlSupport.h>
 
@@ -30,20 +31,31 @@ namespace hci {
 using ::android::hardware::hidl_vec;
 using HciPacketReadyCallback = std::function<void(void)>;
 
+// Reads the incoming data in large chunks into a buffer and splits it into
+// HCI packets. All the packets completed by a read are reported back to back,
+// so a burst of packets costs a single read() instead of two per packet.
 class HciPacketizer {
  public:
   HciPacketizer(HciPacketReadyCallback packet_cb)
       : packet_ready_cb_(packet_cb){};
+  // For transports with one channel per packet type.
   void OnDataReady(int fd, HciPacketType packet_type);
+  // For H4 transports, where every packet is preceded by its type.
+  void OnDataReady(int fd);
+  // The packet and its type are only valid during the packet ready callback.
   const hidl_vec<uint8_t>& GetPacket() const;
+  HciPacketType GetPacketType() const;
 
  protected:
-  enum State { HCI_PREAMBLE, HCI_PAYLOAD };
-  State state_{HCI_PREAMBLE};
-  uint8_t preamble_[HCI_PREAMBLE_SIZE_MAX];
+  void ReadPackets(int fd, HciPacketType packet_type);
+  void CompactBuffer();
+
+  std::vector<uint8_t> buffer_;
+  // Unparsed data is in [buffer_head_, buffer_tail_)
+  size_t buffer_head_{0};
+  size_t buffer_tail_{0};
   hidl_vec<uint8_t> packet_;
-  size_t bytes_remaining_{0};
-  size_t bytes_read_{0};
+  HciPacketType packet_type_{HCI_PACKET_TYPE_UNKNOWN};
   HciPacketReadyCallback packet_ready_cb_;
 };
 
@@ -19,15 +19,22 @@
 #include "h4_protocol.h"
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <cstring>
 #include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include <fcntl.h>
 #include <log/log.h>
+#include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <termios.h>
 #include <unistd.h>
 
 namespace android {
@@ -189,9 +196,11 @@ class H4ProtocolTest : public ::testing::Test {
   }
 
   void WriteAndExpectInboundIsoData(char* payload) {
-    // h4 type[1] + handle[2] + size[1]
-    char preamble[4] = {HCI_PACKET_TYPE_ISO_DATA, 20, 17, 0};
-    preamble[3] = strlen(payload) & 0xFF;
+    // h4 type[1] + handle[2] + size[2]
+    char preamble[5] = {HCI_PACKET_TYPE_ISO_DATA, 20, 17, 0, 0};
+    int length = strlen(payload);
+    preamble[3] = length & 0xFF;
+    preamble[4] = (length >> 8) & 0x3F;
 
     ALOGD("%s writing", __func__);
     TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
@@ -238,6 +247,134 @@ TEST_F(H4ProtocolTest, TestReads) {
   WriteAndExpectInboundIsoData(iso_data);
 }
 
+// Ensure several packets delivered by a single read are all parsed
+TEST_F(H4ProtocolTest, TestBatchedReads) {
+  // h4 type[1] + event_code[1] + size[1]
+  char event_preamble[3] = {HCI_PACKET_TYPE_EVENT, 9, 0};
+  event_preamble[2] = strlen(event_data) & 0xFF;
+  // h4 type[1] + handle[2] + size[2]
+  char acl_preamble[5] = {HCI_PACKET_TYPE_ACL_DATA, 19, 92, 0, 0};
+  acl_preamble[3] = strlen(acl_data) & 0xFF;
+
+  std::string burst;
+  burst.append(event_preamble, sizeof(event_preamble));
+  burst.append(event_data);
+  burst.append(acl_preamble, sizeof(acl_preamble));
+  burst.append(acl_data);
+  burst.append(acl_preamble, sizeof(acl_preamble));
+  burst.append(acl_data);
+
+  std::mutex mutex;
+  std::condition_variable done;
+  EXPECT_CALL(event_cb_, Call(HidlVecMatches(event_preamble + 1,
+                                             sizeof(event_preamble) - 1,
+                                             event_data)))
+      .Times(1);
+  EXPECT_CALL(acl_cb_, Call(HidlVecMatches(acl_preamble + 1,
+                                           sizeof(acl_preamble) - 1, acl_data)))
+      .WillOnce(::testing::Return())
+      .WillOnce(Notify(&mutex, &done));
+
+  ALOGD("%s writing", __func__);
+  std::unique_lock<std::mutex> lock(mutex);
+  TEMP_FAILURE_RETRY(write(fake_uart_, burst.data(), burst.size()));
+
+  // Fail if it takes longer than 100 ms.
+  done.wait_for(lock, std::chrono::milliseconds(100));
+}
+
+// Streams ACL packets through a pseudo terminal, like a UART would, and
+// reports the number of packets per second the H4 transport can parse.
+class H4ProtocolPtyTest : public ::testing::Test {
+ protected:
+  static constexpr int kPacketCount = 20000;
+  // LE Data Length Extension maximum payload
+  static constexpr size_t kPayloadSize = 251;
+
+  void SetUp() override {
+    controller_fd_ = posix_openpt(O_RDWR | O_NOCTTY);
+    ASSERT_GE(controller_fd_, 0);
+    ASSERT_EQ(0, grantpt(controller_fd_));
+    ASSERT_EQ(0, unlockpt(controller_fd_));
+    host_fd_ = open(ptsname(controller_fd_), O_RDWR | O_NOCTTY);
+    ASSERT_GE(host_fd_, 0);
+
+    struct termios terminal;
+    ASSERT_EQ(0, tcgetattr(host_fd_, &terminal));
+    cfmakeraw(&terminal);
+    ASSERT_EQ(0, tcsetattr(host_fd_, TCSANOW, &terminal));
+
+    auto acl_cb = [this](const hidl_vec<uint8_t>& packet) {
+      EXPECT_EQ(packet.size(), HCI_ACL_PREAMBLE_SIZE + kPayloadSize);
+      if (++packets_received_ == kPacketCount) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.notify_one();
+      }
+    };
+    auto unexpected_cb = [](const hidl_vec<uint8_t>&) {
+      ADD_FAILURE() << "Unexpected packet type";
+    };
+    protocol_ = new H4Protocol(host_fd_, unexpected_cb, acl_cb, unexpected_cb,
+                               unexpected_cb);
+    fd_watcher_.WatchFdForNonBlockingReads(
+        host_fd_, [this](int fd) { protocol_->OnDataReady(fd); });
+  }
+
+  void TearDown() override {
+    fd_watcher_.StopWatchingFileDescriptors();
+    delete protocol_;
+    close(host_fd_);
+    close(controller_fd_);
+  }
+
+  async::AsyncFdWatcher fd_watcher_;
+  H4Protocol* protocol_ = nullptr;
+  int controller_fd_ = -1;
+  int host_fd_ = -1;
+  std::atomic<int> packets_received_{0};
+  std::mutex mutex_;
+  std::condition_variable done_;
+};
+
+TEST_F(H4ProtocolPtyTest, AclThroughput) {
+  // h4 type[1] + handle[2] + size[2]
+  std::vector<uint8_t> packet = {HCI_PACKET_TYPE_ACL_DATA, 0x01, 0x20,
+                                 kPayloadSize & 0xFF, kPayloadSize >> 8};
+  for (size_t i = 0; i < kPayloadSize; i++) {
+    packet.push_back(static_cast<uint8_t>(i));
+  }
+  std::vector<uint8_t> stream;
+  for (int i = 0; i < kPacketCount; i++) {
+    stream.insert(stream.end(), packet.begin(), packet.end());
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::thread controller([this, &stream]() {
+    size_t written = 0;
+    while (written < stream.size()) {
+      ssize_t ret = TEMP_FAILURE_RETRY(write(
+          controller_fd_, stream.data() + written, stream.size() - written));
+      if (ret <= 0) break;
+      written += ret;
+    }
+  });
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait_for(lock, std::chrono::seconds(30),
+                   [this]() { return packets_received_ == kPacketCount; });
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  controller.join();
+
+  ASSERT_EQ(kPacketCount, packets_received_);
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  int packets_per_second = static_cast<int>(kPacketCount / seconds);
+  ALOGI("%s: %d packets in %.3f s, %d packets/s", __func__, kPacketCount,
+        seconds, packets_per_second);
+  RecordProperty("packets_per_second", packets_per_second);
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace bluetooth
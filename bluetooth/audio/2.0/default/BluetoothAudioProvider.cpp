@@ -135,6 +135,16 @@ Return<void> BluetoothAudioProvider::endSession() {
   return Void();
 }
 
+Return<void> BluetoothAudioProvider::debug(
+    const hidl_handle& fd, const hidl_vec<hidl_string>& /*options*/) {
+  if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+    LOG(ERROR) << __func__ << " - Invalid dump file descriptor";
+    return Void();
+  }
+  BluetoothAudioSessionReport::DebugDump(session_type_, fd->data[0]);
+  return Void();
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace audio
@@ -48,6 +48,9 @@ class BluetoothAudioProvider : public IBluetoothAudioProvider {
   Return<void> streamSuspended(BluetoothAudioStatus status) override;
   Return<void> endSession() override;
 
+  Return<void> debug(const hidl_handle& fd,
+                     const hidl_vec<hidl_string>& options) override;
+
  protected:
   sp<BluetoothAudioDeathRecipient> death_recipient_;
 
@@ -18,6 +18,13 @@
 
 #include "BluetoothAudioSession.h"
 
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
@@ -43,7 +50,86 @@ AudioConfiguration BluetoothAudioSession::invalidSoftwareAudioConfiguration =
 AudioConfiguration BluetoothAudioSession::invalidOffloadAudioConfiguration = {};
 
 static constexpr int kFmqSendTimeoutMs = 1000;  // 1000 ms timeout for sending
-static constexpr int kWritePollMs = 1;          // polled non-blocking interval
+// The writer waits for the reader to free up a quarter of the FMQ, or the rest
+// of its data if smaller, instead of trickling data in as soon as bytes free up
+static constexpr size_t kDataMqWatermarkDivisor = 4;
+// Bounds of the shortest wait for the reader, and of the wait when the PCM rate
+// is unknown
+static constexpr int64_t kMinDrainWaitNs = 100000;       // 100 us
+static constexpr int64_t kDefaultDrainWaitNs = 1000000;  // 1 ms
+// Upper bounds of the write latency histogram buckets
+static constexpr uint64_t kWriteLatencyBoundsUs[kWriteLatencyBuckets - 1] = {
+    500, 1000, 2000, 5000, 10000, 20000, 50000};
+
+// The PCM parameters are bit flags, these give the values they stand for
+static constexpr int64_t SampleRateToHz(SampleRate sample_rate) {
+  switch (sample_rate) {
+    case SampleRate::RATE_16000:
+      return 16000;
+    case SampleRate::RATE_24000:
+      return 24000;
+    case SampleRate::RATE_44100:
+      return 44100;
+    case SampleRate::RATE_48000:
+      return 48000;
+    case SampleRate::RATE_88200:
+      return 88200;
+    case SampleRate::RATE_96000:
+      return 96000;
+    case SampleRate::RATE_176400:
+      return 176400;
+    case SampleRate::RATE_192000:
+      return 192000;
+    default:
+      return 0;
+  }
+}
+
+static constexpr int64_t ChannelModeToChannelCount(ChannelMode channel_mode) {
+  switch (channel_mode) {
+    case ChannelMode::MONO:
+      return 1;
+    case ChannelMode::STEREO:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+static constexpr int64_t BitsPerSampleToBits(BitsPerSample bits_per_sample) {
+  switch (bits_per_sample) {
+    case BitsPerSample::BITS_16:
+      return 16;
+    case BitsPerSample::BITS_24:
+      return 24;
+    case BitsPerSample::BITS_32:
+      return 32;
+    default:
+      return 0;
+  }
+}
+
+static constexpr int64_t PcmBytesPerSecond(SampleRate sample_rate,
+                                           ChannelMode channel_mode,
+                                           BitsPerSample bits_per_sample) {
+  return SampleRateToHz(sample_rate) * ChannelModeToChannelCount(channel_mode) *
+         BitsPerSampleToBits(bits_per_sample) / 8;
+}
+
+static constexpr int64_t PcmDrainTimeNs(size_t bytes,
+                                        int64_t bytes_per_second) {
+  return static_cast<int64_t>(bytes) * 1000000000 / bytes_per_second;
+}
+
+// 10 ms of 44.1 kHz 16-bit stereo is 1764 bytes
+static_assert(PcmBytesPerSecond(SampleRate::RATE_44100, ChannelMode::STEREO,
+                                BitsPerSample::BITS_16) == 176400,
+              "Wrong PCM byte rate");
+static_assert(PcmDrainTimeNs(1764, PcmBytesPerSecond(SampleRate::RATE_44100,
+                                                     ChannelMode::STEREO,
+                                                     BitsPerSample::BITS_16)) ==
+                  10000000,
+              "Wrong PCM drain time");
 
 static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
   return {.tv_sec = static_cast<long>(TS.tvSec),
@@ -51,7 +137,11 @@ static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
 }
 
 BluetoothAudioSession::BluetoothAudioSession(const SessionType& session_type)
-    : session_type_(session_type), stack_iface_(nullptr), mDataMQ(nullptr) {
+    : session_type_(session_type),
+      stack_iface_(nullptr),
+      mDataMQ(nullptr),
+      data_mq_event_flag_(nullptr),
+      data_path_stats_{} {
   invalidSoftwareAudioConfiguration.pcmConfig(kInvalidPcmParameters);
   invalidOffloadAudioConfiguration.codecConfig(kInvalidCodecConfiguration);
 }
@@ -79,6 +169,7 @@ void BluetoothAudioSession::OnSessionStarted(
              : kInvalidSoftwareAudioConfiguration);
   } else {
     stack_iface_ = stack_iface;
+    data_path_stats_ = {};
     LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
               << ", AudioConfiguration=" << toString(audio_config);
     ReportSessionStatus();
@@ -152,21 +243,51 @@ bool BluetoothAudioSession::IsSessionReady() {
 }
 
 bool BluetoothAudioSession::UpdateDataPath(const DataMQ::Descriptor* dataMQ) {
+  data_mq_event_flag_ = nullptr;
   if (dataMQ == nullptr) {
     // usecase of reset by nullptr
     mDataMQ = nullptr;
     return true;
   }
-  std::unique_ptr<DataMQ> tempDataMQ;
-  tempDataMQ.reset(new DataMQ(*dataMQ));
+  std::shared_ptr<DataMQ> tempDataMQ = std::make_shared<DataMQ>(*dataMQ);
   if (!tempDataMQ || !tempDataMQ->isValid()) {
     mDataMQ = nullptr;
     return false;
   }
+  // Without an event flag the writer still works, it waits for the estimated
+  // drain time instead of being woken up by the reader.
+  EventFlag* event_flag = nullptr;
+  if (tempDataMQ->getEventFlagWord() != nullptr &&
+      EventFlag::createEventFlag(tempDataMQ->getEventFlagWord(),
+                                 &event_flag) == ::android::OK) {
+    data_mq_event_flag_ = std::shared_ptr<EventFlag>(
+        event_flag, [tempDataMQ](EventFlag* flag) {
+          EventFlag::deleteEventFlag(&flag);
+        });
+  } else {
+    LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
+                 << " DataMQ has no EventFlag";
+  }
   mDataMQ = std::move(tempDataMQ);
   return true;
 }
 
+int64_t BluetoothAudioSession::DataPathDrainTimeNs(size_t bytes) {
+  // This is locked already by OutWritePcmData
+  if (audio_config_.getDiscriminator() !=
+      AudioConfiguration::hidl_discriminator::pcmConfig) {
+    return kDefaultDrainWaitNs;
+  }
+  const PcmParameters& pcm_config = audio_config_.pcmConfig();
+  int64_t bytes_per_second =
+      PcmBytesPerSecond(pcm_config.sampleRate, pcm_config.channelMode,
+                        pcm_config.bitsPerSample);
+  if (bytes_per_second <= 0) {
+    return kDefaultDrainWaitNs;
+  }
+  return std::max(kMinDrainWaitNs, PcmDrainTimeNs(bytes, bytes_per_second));
+}
+
 bool BluetoothAudioSession::UpdateAudioConfig(
     const AudioConfiguration& audio_config) {
   bool is_software_session =
@@ -370,36 +491,116 @@ void BluetoothAudioSession::UpdateTracksMetadata(
 size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
                                               size_t bytes) {
   if (buffer == nullptr || !bytes) return 0;
+  const auto start_time = std::chrono::steady_clock::now();
+  const auto deadline =
+      start_time + std::chrono::milliseconds(kFmqSendTimeoutMs);
   size_t totalWritten = 0;
-  int ms_timeout = kFmqSendTimeoutMs;
+  bool first_pass = true;
+  bool overrun = false;
   do {
     std::unique_lock<std::recursive_mutex> lock(mutex_);
     if (!IsSessionReady()) break;
+    if (first_pass && mDataMQ->availableToRead() == 0) {
+      ++data_path_stats_.underruns;
+    }
+    first_pass = false;
+
+    size_t remaining = bytes - totalWritten;
+    size_t watermark = std::max<size_t>(
+        1, std::min(remaining,
+                    mDataMQ->getQuantumCount() / kDataMqWatermarkDivisor));
     size_t availableToWrite = mDataMQ->availableToWrite();
-    if (availableToWrite) {
-      if (availableToWrite > (bytes - totalWritten)) {
-        availableToWrite = bytes - totalWritten;
+    if (availableToWrite >= watermark) {
+      if (availableToWrite > remaining) {
+        availableToWrite = remaining;
       }
 
       if (!mDataMQ->write(static_cast<const uint8_t*>(buffer) + totalWritten,
                           availableToWrite)) {
         ALOGE("FMQ datapath writting %zu/%zu failed", totalWritten, bytes);
-        return totalWritten;
+        break;
       }
       totalWritten += availableToWrite;
-    } else if (ms_timeout >= kWritePollMs) {
-      lock.unlock();
-      usleep(kWritePollMs * 1000);
-      ms_timeout -= kWritePollMs;
-    } else {
+      if (data_mq_event_flag_ != nullptr) {
+        data_mq_event_flag_->wake(kDataMqNotEmpty);
+      }
+      continue;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
       ALOGD("data %zu/%zu overflow %d ms", totalWritten, bytes,
-            (kFmqSendTimeoutMs - ms_timeout));
-      return totalWritten;
+            kFmqSendTimeoutMs);
+      overrun = true;
+      break;
+    }
+    // Block until the reader has freed up the watermark, either woken up by
+    // the reader or after the time it needs to consume that much data
+    int64_t wait_ns = std::min<int64_t>(
+        DataPathDrainTimeNs(watermark - availableToWrite),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now)
+            .count());
+    std::shared_ptr<EventFlag> event_flag = data_mq_event_flag_;
+    lock.unlock();
+    if (event_flag != nullptr) {
+      uint32_t ef_state = 0;
+      event_flag->wait(kDataMqNotFull, &ef_state, wait_ns);
+    } else {
+      usleep(wait_ns / 1000);
     }
   } while (totalWritten < bytes);
+
+  uint64_t latency_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start_time)
+          .count();
+  size_t bucket =
+      std::upper_bound(std::begin(kWriteLatencyBoundsUs),
+                       std::end(kWriteLatencyBoundsUs), latency_us) -
+      std::begin(kWriteLatencyBoundsUs);
+  std::lock_guard<std::recursive_mutex> guard(mutex_);
+  ++data_path_stats_.writes;
+  data_path_stats_.bytes += totalWritten;
+  if (overrun) ++data_path_stats_.overruns;
+  data_path_stats_.max_write_latency_us =
+      std::max(data_path_stats_.max_write_latency_us, latency_us);
+  ++data_path_stats_.write_latency_histogram[bucket];
   return totalWritten;
 }
 
+// The function dumps the state and the data path statistics of this session
+void BluetoothAudioSession::DebugDump(int fd) {
+  std::lock_guard<std::recursive_mutex> guard(mutex_);
+  dprintf(fd, "SessionType=%s, ready=%d, observers=%zu\n",
+          toString(session_type_).c_str(), IsSessionReady(), observers_.size());
+  if (session_type_ == SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH) {
+    return;
+  }
+  if (mDataMQ != nullptr) {
+    dprintf(fd, "  DataMQ: size=%zu, availableToRead=%zu, eventFlag=%d\n",
+            mDataMQ->getQuantumCount(), mDataMQ->availableToRead(),
+            data_mq_event_flag_ != nullptr);
+  }
+  dprintf(fd,
+          "  writes=%" PRIu64 ", bytes=%" PRIu64 ", underruns=%" PRIu64
+          ", overruns=%" PRIu64 ", maxWriteLatency=%" PRIu64 " us\n",
+          data_path_stats_.writes, data_path_stats_.bytes,
+          data_path_stats_.underruns, data_path_stats_.overruns,
+          data_path_stats_.max_write_latency_us);
+  dprintf(fd, "  write latency histogram:\n");
+  for (size_t i = 0; i < kWriteLatencyBuckets; ++i) {
+    if (i < kWriteLatencyBuckets - 1) {
+      dprintf(fd, "    < %6" PRIu64 " us: %" PRIu64 "\n",
+              kWriteLatencyBoundsUs[i],
+              data_path_stats_.write_latency_histogram[i]);
+    } else {
+      dprintf(fd, "    >= %5" PRIu64 " us: %" PRIu64 "\n",
+              kWriteLatencyBoundsUs[i - 1],
+              data_path_stats_.write_latency_histogram[i]);
+    }
+  }
+}
+
 std::unique_ptr<BluetoothAudioSessionInstance>
     BluetoothAudioSessionInstance::instance_ptr =
         std::unique_ptr<BluetoothAudioSessionInstance>(
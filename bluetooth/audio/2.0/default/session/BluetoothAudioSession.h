@@ -16,10 +16,13 @@
 
 #pragma once
 
+#include <array>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 
 #include <android/hardware/bluetooth/audio/2.0/IBluetoothAudioPort.h>
+#include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
 #include <hardware/audio.h>
 #include <hidl/MQDescriptor.h>
@@ -29,6 +32,7 @@ namespace bluetooth {
 namespace audio {
 
 using ::android::sp;
+using ::android::hardware::EventFlag;
 using ::android::hardware::kSynchronizedReadWrite;
 using ::android::hardware::MessageQueue;
 using ::android::hardware::bluetooth::audio::V2_0::AudioConfiguration;
@@ -45,6 +49,16 @@ using BluetoothAudioStatus =
 
 using DataMQ = MessageQueue<uint8_t, kSynchronizedReadWrite>;
 
+// The event flag bits of the software data path. They are the default bits of
+// the FMQ blocking calls, so a reader using readBlocking() wakes up the writer
+// as soon as it frees up space.
+static constexpr uint32_t kDataMqNotEmpty = 1 << 0;
+static constexpr uint32_t kDataMqNotFull = 1 << 1;
+
+// Number of buckets of the write latency histogram, the last one collects
+// everything above the largest bound
+static constexpr size_t kWriteLatencyBuckets = 8;
+
 static constexpr uint16_t kObserversCookieSize = 0x0010;  // 0x0000 ~ 0x000f
 constexpr uint16_t kObserversCookieUndefined =
     (static_cast<uint16_t>(SessionType::UNKNOWN) << 8 & 0xff00);
@@ -87,7 +101,10 @@ class BluetoothAudioSession {
   // audio control path to use for both software and offloading
   sp<IBluetoothAudioPort> stack_iface_;
   // audio data path (FMQ) for software encoding
-  std::unique_ptr<DataMQ> mDataMQ;
+  std::shared_ptr<DataMQ> mDataMQ;
+  // event flag of the FMQ. It holds a reference to mDataMQ, so the flag word
+  // stays mapped while a writer is waiting on it without holding the lock.
+  std::shared_ptr<EventFlag> data_mq_event_flag_;
   // audio data configuration for both software and offloading
   AudioConfiguration audio_config_;
 
@@ -98,10 +115,24 @@ class BluetoothAudioSession {
   std::unordered_map<uint16_t, std::shared_ptr<struct PortStatusCallbacks>>
       observers_;
 
+  // statistics of the software data path, reset when the session starts
+  struct DataPathStats {
+    uint64_t writes;
+    uint64_t bytes;
+    // the reader had drained the FMQ before the data of a write arrived
+    uint64_t underruns;
+    // a write timed out before all its data could be queued
+    uint64_t overruns;
+    uint64_t max_write_latency_us;
+    std::array<uint64_t, kWriteLatencyBuckets> write_latency_histogram;
+  } data_path_stats_;
+
   bool UpdateDataPath(const DataMQ::Descriptor* dataMQ);
   bool UpdateAudioConfig(const AudioConfiguration& audio_config);
   // invoking the registered session_changed_cb_
   void ReportSessionStatus();
+  // estimates how long the reader takes to consume the given bytes
+  int64_t DataPathDrainTimeNs(size_t bytes);
 
  public:
   BluetoothAudioSession(const SessionType& session_type);
@@ -154,6 +185,9 @@ class BluetoothAudioSession {
   // The control function writes stream to FMQ
   size_t OutWritePcmData(const void* buffer, size_t bytes);
 
+  // The function dumps the state and the data path statistics of this session
+  void DebugDump(int fd);
+
   static constexpr PcmParameters kInvalidPcmParameters = {
       .sampleRate = SampleRate::RATE_UNKNOWN,
       .channelMode = ChannelMode::UNKNOWN,
@@ -56,6 +56,14 @@ class BluetoothAudioSessionReport {
       session_ptr->ReportControlStatus(start_resp, status);
     }
   }
+  // The API dumps the state and the data path statistics of the session
+  static void DebugDump(const SessionType& session_type, int fd) {
+    std::shared_ptr<BluetoothAudioSession> session_ptr =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+    if (session_ptr != nullptr) {
+      session_ptr->DebugDump(fd);
+    }
+  }
 };
 
 }  // namespace audio
@@ -43,9 +43,13 @@ static constexpr auto seek = 200ms;
 static constexpr auto step = 100ms;
 static constexpr auto tune = 150ms;
 static constexpr auto list = 1s;
+static constexpr auto listRefresh = 10s;
 
 }  // namespace delay
 
+// Keeps onProgramListUpdated transactions small, even for DAB ensembles with hundreds of services.
+static constexpr size_t kMaxProgramsPerChunk = 64;
+
 TunerSession::TunerSession(BroadcastRadio& module, const sp<ITunerCallback>& callback)
     : mCallback(callback), mModule(module) {
     auto&& ranges = module.getAmFmConfig().ranges;
@@ -234,30 +238,93 @@ Return<Result> TunerSession::startProgramListUpdates(const ProgramFilter& filter
     lock_guard<mutex> lk(mMut);
     if (mIsClosed) return Result::INVALID_STATE;
 
-    auto list = virtualRadio().getProgramList();
-    vector<VirtualProgram> filteredList;
-    auto filterCb = [&filter](const VirtualProgram& program) {
-        return utils::satisfies(filter, program.selector);
-    };
-    std::copy_if(list.begin(), list.end(), std::back_inserter(filteredList), filterCb);
+    // Replaces the previous updates stream, the client starts over with an empty list.
+    cancelProgramListUpdatesLocked();
+    mProgramListFilter = filter;
+    mProgramListPurgePending = true;
 
-    auto task = [this, list]() {
-        lock_guard<mutex> lk(mMut);
+    auto generation = mProgramListGeneration;
+    auto task = [this, generation]() { refreshProgramList(generation); };
+    mProgramListThread.schedule(task, delay::list);
 
-        ProgramListChunk chunk = {};
-        chunk.purge = true;
-        chunk.complete = true;
-        chunk.modified = hidl_vec<ProgramInfo>(list.begin(), list.end());
+    return Result::OK;
+}
 
-        mCallback->onProgramListUpdated(chunk);
-    };
-    mThread.schedule(task, delay::list);
+void TunerSession::cancelProgramListUpdatesLocked() {
+    mProgramListThread.cancelAll();
+    // A task that is already running may be waiting for the lock, it will see this has changed.
+    mProgramListGeneration++;
+    mProgramListFilter.reset();
+    mProgramListSent.clear();
+}
 
-    return Result::OK;
+void TunerSession::refreshProgramList(uint64_t generation) {
+    lock_guard<mutex> lk(mMut);
+    if (mIsClosed || generation != mProgramListGeneration || !mProgramListFilter) return;
+    auto& filter = *mProgramListFilter;
+
+    utils::ProgramInfoSet current;
+    for (auto&& program : virtualRadio().getProgramList()) {
+        if (!utils::satisfies(filter, program.selector)) continue;
+        current.insert(static_cast<ProgramInfo>(program));
+    }
+
+    // Only send what changed since the last update.
+    vector<ProgramInfo> modified;
+    for (auto&& info : current) {
+        auto sent = mProgramListSent.find(info);
+        if (sent == mProgramListSent.end() || (!filter.excludeModifications && *sent != info)) {
+            modified.push_back(info);
+        }
+    }
+    vector<ProgramIdentifier> removed;
+    for (auto&& info : mProgramListSent) {
+        if (current.count(info) == 0) removed.push_back(info.selector.primaryId);
+    }
+
+    sendProgramListUpdateLocked(move(modified), move(removed));
+
+    auto task = [this, generation]() { refreshProgramList(generation); };
+    mProgramListThread.schedule(task, delay::listRefresh);
+}
+
+void TunerSession::sendProgramListUpdateLocked(vector<ProgramInfo>&& modified,
+                                               vector<ProgramIdentifier>&& removed) {
+    bool purge = mProgramListPurgePending;
+    if (!purge && modified.empty() && removed.empty()) return;
+    mProgramListPurgePending = false;
+
+    auto nextModified = modified.begin();
+    auto nextRemoved = removed.begin();
+    bool complete = false;
+    while (!complete) {
+        auto modifiedCount = std::min<size_t>(modified.end() - nextModified, kMaxProgramsPerChunk);
+        auto removedCount = std::min<size_t>(removed.end() - nextRemoved,
+                                             kMaxProgramsPerChunk - modifiedCount);
+
+        ProgramListChunk chunk = {};
+        chunk.purge = purge;
+        auto modifiedEnd = nextModified + modifiedCount;
+        chunk.modified = hidl_vec<ProgramInfo>(std::make_move_iterator(nextModified),
+                                               std::make_move_iterator(modifiedEnd));
+        chunk.removed = hidl_vec<ProgramIdentifier>(nextRemoved, nextRemoved + removedCount);
+        nextModified = modifiedEnd;
+        nextRemoved += removedCount;
+        complete = nextModified == modified.end() && nextRemoved == removed.end();
+        chunk.complete = complete;
+        purge = false;
+
+        utils::updateProgramList(mProgramListSent, chunk);
+        mCallback->onProgramListUpdated(chunk);
+    }
 }
 
 Return<void> TunerSession::stopProgramListUpdates() {
     LOG(DEBUG) << "requested program list updates to stop";
+    lock_guard<mutex> lk(mMut);
+    if (mIsClosed) return {};
+
+    cancelProgramListUpdatesLocked();
     return {};
 }
 
@@ -293,6 +360,7 @@ Return<void> TunerSession::close() {
 
     mIsClosed = true;
     mThread.cancelAll();
+    cancelProgramListUpdatesLocked();
     return {};
 }
 
@@ -20,6 +20,7 @@
 
 #include <android/hardware/broadcastradio/2.0/ITunerCallback.h>
 #include <android/hardware/broadcastradio/2.0/ITunerSession.h>
+#include <broadcastradio-utils-2x/Utils.h>
 #include <broadcastradio-utils/WorkerThread.h>
 
 #include <optional>
@@ -63,7 +64,18 @@ struct TunerSession : public ITunerSession {
     bool mIsTuneCompleted = false;
     ProgramSelector mCurrentProgram = {};
 
+    // Program list updates run on their own thread, so that tuning doesn't cancel them.
+    std::optional<ProgramFilter> mProgramListFilter;
+    uint64_t mProgramListGeneration = 0;
+    bool mProgramListPurgePending = false;
+    utils::ProgramInfoSet mProgramListSent;  // the program list as known by the client
+    WorkerThread mProgramListThread;
+
     void cancelLocked();
+    void cancelProgramListUpdatesLocked();
+    void refreshProgramList(uint64_t generation);
+    void sendProgramListUpdateLocked(std::vector<ProgramInfo>&& modified,
+                                     std::vector<ProgramIdentifier>&& removed);
     void tuneInternalLocked(const ProgramSelector& sel);
     const VirtualRadio& virtualRadio() const;
     const BroadcastRadio& module() const;
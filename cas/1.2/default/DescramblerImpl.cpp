@@ -23,6 +23,15 @@
 #include <media/stagefright/foundation/AUtils.h>
 #include <utils/Log.h>
 
+#include <inttypes.h>
+#include <linux/kcmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 #include "DescramblerImpl.h"
 #include "SharedLibrary.h"
 #include "TypeConvert.h"
@@ -47,6 +56,9 @@ namespace implementation {
 CHECK_SUBSAMPLE_DEF(DescramblerPlugin);
 CHECK_SUBSAMPLE_DEF(CryptoPlugin);
 
+// A client typically descrambles into a single heap, or a few for several tracks.
+static constexpr size_t kMaxCachedHeaps = 4;
+
 DescramblerImpl::DescramblerImpl(const sp<SharedLibrary>& library, DescramblerPlugin* plugin)
     : mLibrary(library), mPluginHolder(plugin) {
     ALOGV("CTOR: plugin=%p", mPluginHolder.get());
@@ -98,7 +110,7 @@ Return<void> DescramblerImpl::descramble(ScramblingControl scramblingControl,
         return Void();
     }
 
-    sp<IMemory> srcMem = mapMemory(srcBuffer.heapBase);
+    sp<IMemory> srcMem = mapHeap(srcBuffer.heapBase);
 
     // Validate if the offset and size in the SharedBuffer is consistent with the
     // mapped ashmem, since the offset and size is controlled by client.
@@ -179,15 +191,94 @@ Return<void> DescramblerImpl::descramble(ScramblingControl scramblingControl,
     return Void();
 }
 
+// Returns 0 if both fds refer to the same open file, 1 if not, -1 if they can't be compared.
+static int compareFiles(int fd1, int fd2) {
+    pid_t pid = getpid();
+    int result = syscall(SYS_kcmp, pid, pid, KCMP_FILE, fd1, fd2);
+    if (result < 0) {
+        return -1;
+    }
+    return result == 0 ? 0 : 1;
+}
+
+sp<IMemory> DescramblerImpl::mapHeap(const hidl_memory& heap) {
+    const native_handle_t* handle = heap.handle();
+    if (handle == nullptr || handle->numFds < 1) {
+        return mapMemory(heap);
+    }
+    int fd = handle->data[0];
+
+    {
+        std::lock_guard<std::mutex> lock(mHeapLock);
+        if (!mHeapCacheEnabled) {
+            return mapMemory(heap);
+        }
+        for (auto it = mHeaps.begin(); it != mHeaps.end(); ++it) {
+            if (it->size != heap.size()) {
+                continue;
+            }
+            int compare = compareFiles(fd, it->fd.get());
+            if (compare < 0) {
+                ALOGW("%s: can't compare heap fds (%s), not caching mappings", __FUNCTION__,
+                      strerror(errno));
+                mHeapCacheEnabled = false;
+                mHeaps.clear();
+                return mapMemory(heap);
+            }
+            if (compare == 0) {
+                mHeapHits++;
+                std::rotate(mHeaps.begin(), it, it + 1);
+                return mHeaps.front().memory;
+            }
+        }
+        mHeapMisses++;
+    }
+
+    base::unique_fd heapFd(dup(fd));
+    sp<IMemory> memory = mapMemory(heap);
+    if (memory == nullptr || heapFd.get() < 0) {
+        return memory;
+    }
+
+    std::lock_guard<std::mutex> lock(mHeapLock);
+    if (mHeaps.size() >= kMaxCachedHeaps) {
+        mHeaps.pop_back();
+    }
+    mHeaps.insert(mHeaps.begin(), CachedHeap{std::move(heapFd), heap.size(), memory});
+    return memory;
+}
+
 Return<Status> DescramblerImpl::release() {
     ALOGV("%s: plugin=%p", __FUNCTION__, mPluginHolder.get());
 
     std::shared_ptr<DescramblerPlugin> holder(nullptr);
     std::atomic_store(&mPluginHolder, holder);
 
+    // The client is done with its heaps, don't keep them mapped.
+    std::lock_guard<std::mutex> lock(mHeapLock);
+    mHeaps.clear();
+
     return Status::OK;
 }
 
+Return<void> DescramblerImpl::debug(const hidl_handle& fd,
+                                    const hidl_vec<hidl_string>& /* args */) {
+    if (fd == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+
+    std::lock_guard<std::mutex> lock(mHeapLock);
+    uint64_t lookups = mHeapHits + mHeapMisses;
+    dprintf(fd->data[0],
+            "Heap mappings: %zu cached, %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate)\n",
+            mHeaps.size(), mHeapHits, mHeapMisses,
+            lookups > 0 ? 100.0 * mHeapHits / lookups : 0.0);
+    for (const auto& heap : mHeaps) {
+        dprintf(fd->data[0], "  fd %d size %" PRIu64 "\n", heap.fd.get(), heap.size);
+    }
+    return Void();
+}
+
 }  // namespace implementation
 }  // namespace V1_1
 }  // namespace cas
@@ -18,7 +18,13 @@
 #define ANDROID_HARDWARE_CAS_V1_1_DESCRAMBLER_IMPL_H_
 
 #include <android/hardware/cas/native/1.0/IDescrambler.h>
+#include <android-base/unique_fd.h>
+#include <android/hidl/memory/1.0/IMemory.h>
 #include <media/stagefright/foundation/ABase.h>
+#include <sys/types.h>
+
+#include <mutex>
+#include <vector>
 
 namespace android {
 struct DescramblerPlugin;
@@ -51,10 +57,31 @@ class DescramblerImpl : public IDescrambler {
 
     virtual Return<Status> release() override;
 
+    virtual Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
   private:
+    // Each transaction carries a new fd for the heap, so a cached mapping keeps its own dup of
+    // the fd and is matched by comparing the open files behind the two fds.
+    struct CachedHeap {
+        base::unique_fd fd;
+        uint64_t size;
+        sp<::android::hidl::memory::V1_0::IMemory> memory;
+    };
+
     sp<SharedLibrary> mLibrary;
     std::shared_ptr<DescramblerPlugin> mPluginHolder;
 
+    // Mappings of the heaps recently used as source buffers, most recently used first.  Clients
+    // keep descrambling into the same few heaps, so this saves a mapping per sample.
+    std::mutex mHeapLock;
+    std::vector<CachedHeap> mHeaps;
+    uint64_t mHeapHits = 0;
+    uint64_t mHeapMisses = 0;
+    // Cleared if the open files can't be compared, then every heap is mapped on each use.
+    bool mHeapCacheEnabled = true;
+
+    sp<::android::hidl::memory::V1_0::IMemory> mapHeap(const hidl_memory& heap);
+
     DISALLOW_EVIL_CONSTRUCTORS(DescramblerImpl);
 };
 
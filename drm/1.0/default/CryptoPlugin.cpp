@@ -32,6 +32,36 @@ namespace drm {
 namespace V1_0 {
 namespace implementation {
 
+    // Borrows the legacy subsample array kept by a plugin and hands it back
+    // when it goes out of scope, so the next decrypt reuses the allocation.
+    // A concurrent decrypt just gets an empty one.
+    class ScratchSubSamples {
+    public:
+        ScratchSubSamples(std::mutex& lock,
+                std::vector<android::CryptoPlugin::SubSample>& cache)
+            : mLock(lock), mCache(cache) {
+            std::lock_guard<std::mutex> guard(mLock);
+            mSubSamples.swap(mCache);
+        }
+
+        ~ScratchSubSamples() {
+            std::lock_guard<std::mutex> guard(mLock);
+            if (mSubSamples.capacity() > mCache.capacity()) {
+                mCache.swap(mSubSamples);
+            }
+        }
+
+        std::vector<android::CryptoPlugin::SubSample>& get() { return mSubSamples; }
+
+    private:
+        std::mutex& mLock;
+        std::vector<android::CryptoPlugin::SubSample>& mCache;
+        std::vector<android::CryptoPlugin::SubSample> mSubSamples;
+
+        ScratchSubSamples(const ScratchSubSamples &) = delete;
+        void operator=(const ScratchSubSamples &) = delete;
+    };
+
     // Methods from ::android::hardware::drm::V1_0::ICryptoPlugin follow
     Return<bool> CryptoPlugin::requiresSecureDecoderComponent(
             const hidl_string& mime) {
@@ -66,14 +96,17 @@ namespace implementation {
             const DestinationBuffer& destination,
             decrypt_cb _hidl_cb) {
 
-        if (mSharedBufferMap.find(source.bufferId) == mSharedBufferMap.end()) {
+        auto sourceEntry = mSharedBufferMap.find(source.bufferId);
+        if (sourceEntry == mSharedBufferMap.end()) {
             _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "source decrypt buffer base not set");
             return Void();
         }
 
+        auto destEntry = mSharedBufferMap.end();
         if (destination.type == BufferType::SHARED_MEMORY) {
             const SharedBuffer& dest = destination.nonsecureMemory;
-            if (mSharedBufferMap.find(dest.bufferId) == mSharedBufferMap.end()) {
+            destEntry = mSharedBufferMap.find(dest.bufferId);
+            if (destEntry == mSharedBufferMap.end()) {
                 _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "destination decrypt buffer base not set");
                 return Void();
             }
@@ -98,8 +131,9 @@ namespace implementation {
         legacyPattern.mEncryptBlocks = pattern.encryptBlocks;
         legacyPattern.mSkipBlocks = pattern.skipBlocks;
 
-        std::unique_ptr<android::CryptoPlugin::SubSample[]> legacySubSamples =
-                std::make_unique<android::CryptoPlugin::SubSample[]>(subSamples.size());
+        ScratchSubSamples scratch(mScratchLock, mScratchSubSamples);
+        std::vector<android::CryptoPlugin::SubSample>& legacySubSamples = scratch.get();
+        legacySubSamples.resize(subSamples.size());
 
         size_t destSize = 0;
         for (size_t i = 0; i < subSamples.size(); i++) {
@@ -118,7 +152,7 @@ namespace implementation {
         }
 
         AString detailMessage;
-        sp<IMemory> sourceBase = mSharedBufferMap[source.bufferId];
+        const sp<IMemory>& sourceBase = sourceEntry->second;
         if (sourceBase == nullptr) {
             _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "source is a nullptr");
             return Void();
@@ -136,7 +170,7 @@ namespace implementation {
         void *destPtr = NULL;
         if (destination.type == BufferType::SHARED_MEMORY) {
             const SharedBuffer& destBuffer = destination.nonsecureMemory;
-            sp<IMemory> destBase = mSharedBufferMap[destBuffer.bufferId];
+            const sp<IMemory>& destBase = destEntry->second;
             if (destBase == nullptr) {
                 _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "destination is a nullptr");
                 return Void();
@@ -167,7 +201,7 @@ namespace implementation {
             return Void();
         }
         ssize_t result = mLegacyPlugin->decrypt(secure, keyId.data(), iv.data(),
-                legacyMode, legacyPattern, srcPtr, legacySubSamples.get(),
+                legacyMode, legacyPattern, srcPtr, legacySubSamples.data(),
                 subSamples.size(), destPtr, &detailMessage);
 
         uint32_t status;
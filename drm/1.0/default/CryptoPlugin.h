@@ -22,6 +22,10 @@
 #include <hidl/Status.h>
 #include <media/hardware/CryptoAPI.h>
 
+#include <map>
+#include <mutex>
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace drm {
@@ -70,6 +74,10 @@ private:
     android::CryptoPlugin *mLegacyPlugin;
     std::map<uint32_t, sp<IMemory> > mSharedBufferMap;
 
+    // Legacy subsamples of the last decrypt, kept to reuse the allocation.
+    std::mutex mScratchLock;
+    std::vector<android::CryptoPlugin::SubSample> mScratchSubSamples;
+
     CryptoPlugin() = delete;
     CryptoPlugin(const CryptoPlugin &) = delete;
     void operator=(const CryptoPlugin &) = delete;
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures ICryptoPlugin::decrypt of the passthrough implementation on
+// ClearKey AES-CTR samples the size of 1080p and 4k video frames.
+
+#include <android/hardware/drm/1.0/ICryptoFactory.h>
+#include <android/hardware/drm/1.0/IDrmFactory.h>
+#include <android/hidl/allocator/1.0/IAllocator.h>
+#include <android/hidl/memory/1.0/IMemory.h>
+#include <benchmark/benchmark.h>
+#include <hidlmemory/mapping.h>
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+using ::android::sp;
+using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_memory;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::drm::V1_0::BufferType;
+using ::android::hardware::drm::V1_0::DestinationBuffer;
+using ::android::hardware::drm::V1_0::ICryptoFactory;
+using ::android::hardware::drm::V1_0::ICryptoPlugin;
+using ::android::hardware::drm::V1_0::IDrmFactory;
+using ::android::hardware::drm::V1_0::IDrmPlugin;
+using ::android::hardware::drm::V1_0::Mode;
+using ::android::hardware::drm::V1_0::Pattern;
+using ::android::hardware::drm::V1_0::SharedBuffer;
+using ::android::hardware::drm::V1_0::Status;
+using ::android::hardware::drm::V1_0::SubSample;
+using ::android::hidl::allocator::V1_0::IAllocator;
+using ::android::hidl::memory::V1_0::IMemory;
+
+static const uint8_t kClearKeyUuid[16] = {
+    0xe2, 0x71, 0x9d, 0x58, 0xa9, 0x85, 0xb3, 0xc9,
+    0x78, 0x1a, 0xb0, 0x30, 0xaf, 0x78, 0xd3, 0x0e
+};
+
+// Key id 00..0f and key 10..1f, base64url encoded in the license.
+static const uint8_t kKeyId[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+static const char kKeyResponse[] =
+        "{\"keys\":[{\"kty\":\"oct\",\"kid\":\"AAECAwQFBgcICQoLDA0ODw\","
+        "\"k\":\"EBESExQVFhcYGRobHB0eHw\"}]}";
+
+static constexpr size_t kMaxSampleSize = 2 * 1024 * 1024;
+static constexpr uint32_t kSubSampleSize = 16 * 1024;
+static constexpr uint32_t kClearBytesPerSubSample = 112;
+static constexpr uint32_t kBufferId = 0;
+
+class ClearKeyDecrypt {
+  public:
+    // Returns an error message, or nullptr once the crypto plugin is ready.
+    const char* init() {
+        sp<IDrmFactory> drmFactory = IDrmFactory::getService("default", true);
+        sp<ICryptoFactory> cryptoFactory = ICryptoFactory::getService("default", true);
+        if (drmFactory == nullptr || cryptoFactory == nullptr) {
+            return "passthrough drm@1.0 implementation not available";
+        }
+        hidl_array<uint8_t, 16> uuid(kClearKeyUuid);
+        if (!cryptoFactory->isCryptoSchemeSupported(uuid)) {
+            return "ClearKey legacy plugin not available";
+        }
+
+        drmFactory->createPlugin(uuid, "android.hardware.drm.benchmark",
+                [&](Status status, const sp<IDrmPlugin>& plugin) {
+                    if (status == Status::OK) mDrmPlugin = plugin;
+                });
+        if (mDrmPlugin == nullptr) {
+            return "failed to create ClearKey drm plugin";
+        }
+        mDrmPlugin->openSession([&](Status status, const hidl_vec<uint8_t>& sessionId) {
+            if (status == Status::OK) mSessionId = sessionId;
+        });
+        if (mSessionId.size() == 0) {
+            return "failed to open session";
+        }
+
+        hidl_vec<uint8_t> response;
+        response.setToExternal(
+                reinterpret_cast<uint8_t*>(const_cast<char*>(kKeyResponse)),
+                strlen(kKeyResponse));
+        Status keyStatus = Status::ERROR_DRM_UNKNOWN;
+        mDrmPlugin->provideKeyResponse(mSessionId, response,
+                [&](Status status, const hidl_vec<uint8_t>&) { keyStatus = status; });
+        if (keyStatus != Status::OK) {
+            return "failed to provide key response";
+        }
+
+        cryptoFactory->createPlugin(uuid, mSessionId,
+                [&](Status status, const sp<ICryptoPlugin>& plugin) {
+                    if (status == Status::OK) mCryptoPlugin = plugin;
+                });
+        if (mCryptoPlugin == nullptr) {
+            return "failed to create ClearKey crypto plugin";
+        }
+        Status sessionStatus = mCryptoPlugin->setMediaDrmSession(mSessionId);
+        if (sessionStatus != Status::OK) {
+            return "failed to set media drm session";
+        }
+
+        // Source samples at the start of the heap, decrypted output after them.
+        sp<IAllocator> allocator = IAllocator::getService("ashmem");
+        if (allocator == nullptr) {
+            return "ashmem allocator not available";
+        }
+        hidl_memory hidlMemory;
+        allocator->allocate(2 * kMaxSampleSize, [&](bool success, const hidl_memory& memory) {
+            if (success) hidlMemory = memory;
+        });
+        mMemory = android::hardware::mapMemory(hidlMemory);
+        if (mMemory == nullptr) {
+            return "failed to map shared memory";
+        }
+        memset(mMemory->getPointer(), 0xa5, mMemory->getSize());
+        mCryptoPlugin->setSharedBufferBase(hidlMemory, kBufferId);
+        return nullptr;
+    }
+
+    ~ClearKeyDecrypt() {
+        if (mSessionId.size() != 0) {
+            mDrmPlugin->closeSession(mSessionId);
+        }
+    }
+
+    bool decrypt(size_t sampleSize, const hidl_vec<SubSample>& subSamples) {
+        const SharedBuffer source = {.bufferId = kBufferId, .offset = 0, .size = sampleSize};
+        const DestinationBuffer destination = {
+                .type = BufferType::SHARED_MEMORY,
+                {.bufferId = kBufferId, .offset = kMaxSampleSize, .size = sampleSize},
+                .secureMemory = nullptr};
+        hidl_array<uint8_t, 16> keyId(kKeyId);
+        hidl_array<uint8_t, 16> iv;
+        memset(iv.data(), 0, 16);
+        const Pattern noPattern = {.encryptBlocks = 0, .skipBlocks = 0};
+
+        bool ok = false;
+        mCryptoPlugin->decrypt(false, keyId, iv, Mode::AES_CTR, noPattern, subSamples, source, 0,
+                destination, [&](Status status, uint32_t bytesWritten, const hidl_string&) {
+                    ok = status == Status::OK && bytesWritten == sampleSize;
+                });
+        return ok;
+    }
+
+  private:
+    sp<IDrmPlugin> mDrmPlugin;
+    sp<ICryptoPlugin> mCryptoPlugin;
+    hidl_vec<uint8_t> mSessionId;
+    sp<IMemory> mMemory;
+};
+
+static void BM_DecryptAesCtr(benchmark::State& state, size_t sampleSize) {
+    ClearKeyDecrypt clearKey;
+    const char* error = clearKey.init();
+    if (error != nullptr) {
+        state.SkipWithError(error);
+        return;
+    }
+
+    // Video frames are split into many subsamples, each with a small clear header.
+    std::vector<SubSample> subSamples;
+    for (size_t offset = 0; offset < sampleSize; offset += kSubSampleSize) {
+        subSamples.push_back({.numBytesOfClearData = kClearBytesPerSubSample,
+                              .numBytesOfEncryptedData =
+                                      kSubSampleSize - kClearBytesPerSubSample});
+    }
+    hidl_vec<SubSample> hidlSubSamples(subSamples);
+
+    for (auto _ : state) {
+        if (!clearKey.decrypt(sampleSize, hidlSubSamples)) {
+            state.SkipWithError("decrypt failed");
+            return;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * sampleSize);
+}
+BENCHMARK_CAPTURE(BM_DecryptAesCtr, 1080p, 512 * 1024)->UseRealTime();
+BENCHMARK_CAPTURE(BM_DecryptAesCtr, 4k, kMaxSampleSize)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -6,6 +6,7 @@
 #include "Gnss.h"
 #include "GnssDebug.h"
 #include "GnssMeasurement.h"
+#include "GnssReplay.h"
 #include "Utils.h"
 
 namespace android {
@@ -14,13 +15,16 @@ namespace gnss {
 namespace V1_1 {
 namespace implementation {
 
+using ::android::hardware::gnss::common::GnssReplay;
+using ::android::hardware::gnss::common::GnssScheduler;
 using ::android::hardware::gnss::common::Utils;
 using GnssSvFlags = IGnssCallback::GnssSvFlags;
 
 const uint32_t MIN_INTERVAL_MILLIS = 100;
 sp<::android::hardware::gnss::V1_1::IGnssCallback> Gnss::sGnssCallback = nullptr;
 
-Gnss::Gnss() : mMinIntervalMs(1000), mGnssConfiguration{new GnssConfiguration()} {}
+Gnss::Gnss()
+    : mMinIntervalMs(1000), mGnssConfiguration{new GnssConfiguration()}, mLocationTask(0) {}
 
 Gnss::~Gnss() {
     stop();
@@ -39,25 +43,28 @@ Return<bool> Gnss::start() {
     }
 
     mIsActive = true;
-    mThread = std::thread([this]() {
-        while (mIsActive == true) {
-            auto svStatus = this->getMockSvStatus();
-            this->reportSvStatus(svStatus);
-
-            auto location = Utils::getMockLocation();
-            this->reportLocation(location);
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(mMinIntervalMs));
-        }
-    });
+    GnssScheduler::TaskId task = GnssScheduler::getInstance().schedule(
+            [this]() {
+                auto svStatus = this->getMockSvStatus();
+                this->reportSvStatus(svStatus);
+
+                auto location = GnssReplay::getInstance().getLocation();
+                this->reportLocation(location);
+            },
+            mMinIntervalMs);
+    GnssScheduler::TaskId previous = mLocationTask.exchange(task);
+    if (previous != 0) {
+        GnssScheduler::getInstance().cancel(previous);
+    }
 
     return true;
 }
 
 Return<bool> Gnss::stop() {
     mIsActive = false;
-    if (mThread.joinable()) {
-        mThread.join();
+    GnssScheduler::TaskId task = mLocationTask.exchange(0);
+    if (task != 0) {
+        GnssScheduler::getInstance().cancel(task);
     }
     return true;
 }
@@ -175,7 +182,7 @@ Return<bool> Gnss::setPositionMode_1_1(
     ::android::hardware::gnss::V1_0::IGnss::GnssPositionMode,
     ::android::hardware::gnss::V1_0::IGnss::GnssPositionRecurrence, uint32_t minIntervalMs,
     uint32_t, uint32_t, bool) {
-    mMinIntervalMs = (minIntervalMs < MIN_INTERVAL_MILLIS) ? MIN_INTERVAL_MILLIS : minIntervalMs;
+    setMinInterval(minIntervalMs);
     return true;
 }
 
@@ -224,6 +231,14 @@ Return<GnssSvStatus> Gnss::getMockSvStatus() const {
     return svStatus;
 }
 
+void Gnss::setMinInterval(uint32_t minIntervalMs) {
+    mMinIntervalMs = (minIntervalMs < MIN_INTERVAL_MILLIS) ? MIN_INTERVAL_MILLIS : minIntervalMs;
+    GnssScheduler::TaskId task = mLocationTask;
+    if (task != 0) {
+        GnssScheduler::getInstance().setInterval(task, mMinIntervalMs);
+    }
+}
+
 Return<void> Gnss::reportLocation(const GnssLocation& location) const {
     std::unique_lock<std::mutex> lock(mMutex);
     if (sGnssCallback == nullptr) {
@@ -6,8 +6,8 @@
 #include <hidl/Status.h>
 #include <atomic>
 #include <mutex>
-#include <thread>
 #include "GnssConfiguration.h"
+#include "GnssScheduler.h"
 
 namespace android {
 namespace hardware {
@@ -87,12 +87,14 @@ struct Gnss : public IGnss {
     Return<GnssSvStatus> getMockSvStatus() const;
     Return<void> reportLocation(const GnssLocation&) const;
     Return<void> reportSvStatus(const GnssSvStatus&) const;
+    void setMinInterval(uint32_t minIntervalMs);
 
     static sp<IGnssCallback> sGnssCallback;
     std::atomic<long> mMinIntervalMs;
     sp<GnssConfiguration> mGnssConfiguration;
     std::atomic<bool> mIsActive;
-    std::thread mThread;
+    // Swapped rather than assigned, so racing start()/stop() calls never leak a task
+    std::atomic<common::GnssScheduler::TaskId> mLocationTask;
     mutable std::mutex mMutex;
 };
 
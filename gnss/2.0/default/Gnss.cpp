@@ -27,11 +27,12 @@
 #include "GnssConfiguration.h"
 #include "GnssMeasurement.h"
 #include "GnssMeasurementCorrections.h"
+#include "GnssReplay.h"
 #include "GnssVisibilityControl.h"
-#include "Utils.h"
 
 using ::android::hardware::Status;
-using ::android::hardware::gnss::common::Utils;
+using ::android::hardware::gnss::common::GnssReplay;
+using ::android::hardware::gnss::common::GnssScheduler;
 using ::android::hardware::gnss::measurement_corrections::V1_0::implementation::
         GnssMeasurementCorrections;
 using ::android::hardware::gnss::visibility_control::V1_0::implementation::GnssVisibilityControl;
@@ -44,12 +45,17 @@ namespace implementation {
 
 using GnssSvFlags = IGnssCallback::GnssSvFlags;
 
+const uint32_t MIN_INTERVAL_MILLIS = 100;
 sp<V2_0::IGnssCallback> Gnss::sGnssCallback_2_0 = nullptr;
 sp<V1_1::IGnssCallback> Gnss::sGnssCallback_1_1 = nullptr;
 
-namespace {
+Gnss::Gnss() : mMinIntervalMs(1000), mLocationTask(0) {}
 
-V2_0::GnssLocation getMockLocationV2_0() {
+Gnss::~Gnss() {
+    stop();
+}
+
+V2_0::GnssLocation Gnss::getMockLocationV2_0() {
     const ElapsedRealtime timestamp = {
             .flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
                      ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
@@ -59,18 +65,11 @@ V2_0::GnssLocation getMockLocationV2_0() {
             // or don't set the field.
             .timeUncertaintyNs = 1000000};
 
-    V2_0::GnssLocation location = {.v1_0 = Utils::getMockLocation(), .elapsedRealtime = timestamp};
+    V2_0::GnssLocation location = {.v1_0 = GnssReplay::getInstance().getLocation(),
+                                   .elapsedRealtime = timestamp};
     return location;
 }
 
-}  // namespace
-
-Gnss::Gnss() : mMinIntervalMs(1000) {}
-
-Gnss::~Gnss() {
-    stop();
-}
-
 // Methods from V1_0::IGnss follow.
 Return<bool> Gnss::setCallback(const sp<V1_0::IGnssCallback>&) {
     // TODO(b/124012850): Implement function.
@@ -84,21 +83,24 @@ Return<bool> Gnss::start() {
     }
 
     mIsActive = true;
-    mThread = std::thread([this]() {
-        while (mIsActive == true) {
-            const auto location = getMockLocationV2_0();
-            this->reportLocation(location);
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(mMinIntervalMs));
-        }
-    });
+    GnssScheduler::TaskId task = GnssScheduler::getInstance().schedule(
+            [this]() {
+                const auto location = getMockLocationV2_0();
+                this->reportLocation(location);
+            },
+            mMinIntervalMs);
+    GnssScheduler::TaskId previous = mLocationTask.exchange(task);
+    if (previous != 0) {
+        GnssScheduler::getInstance().cancel(previous);
+    }
     return true;
 }
 
 Return<bool> Gnss::stop() {
     mIsActive = false;
-    if (mThread.joinable()) {
-        mThread.join();
+    GnssScheduler::TaskId task = mLocationTask.exchange(0);
+    if (task != 0) {
+        GnssScheduler::getInstance().cancel(task);
     }
     return true;
 }
@@ -124,8 +126,9 @@ Return<void> Gnss::deleteAidingData(V1_0::IGnss::GnssAidingData) {
 }
 
 Return<bool> Gnss::setPositionMode(V1_0::IGnss::GnssPositionMode,
-                                   V1_0::IGnss::GnssPositionRecurrence, uint32_t, uint32_t,
-                                   uint32_t) {
+                                   V1_0::IGnss::GnssPositionRecurrence, uint32_t minIntervalMs,
+                                   uint32_t, uint32_t) {
+    setMinInterval(minIntervalMs);
     return true;
 }
 
@@ -212,8 +215,9 @@ Return<bool> Gnss::setCallback_1_1(const sp<V1_1::IGnssCallback>& callback) {
 }
 
 Return<bool> Gnss::setPositionMode_1_1(V1_0::IGnss::GnssPositionMode,
-                                       V1_0::IGnss::GnssPositionRecurrence, uint32_t, uint32_t,
-                                       uint32_t, bool) {
+                                       V1_0::IGnss::GnssPositionRecurrence,
+                                       uint32_t minIntervalMs, uint32_t, uint32_t, bool) {
+    setMinInterval(minIntervalMs);
     return true;
 }
 
@@ -303,6 +307,14 @@ Return<bool> Gnss::setCallback_2_0(const sp<V2_0::IGnssCallback>& callback) {
     return true;
 }
 
+void Gnss::setMinInterval(uint32_t minIntervalMs) {
+    mMinIntervalMs = (minIntervalMs < MIN_INTERVAL_MILLIS) ? MIN_INTERVAL_MILLIS : minIntervalMs;
+    GnssScheduler::TaskId task = mLocationTask;
+    if (task != 0) {
+        GnssScheduler::getInstance().setInterval(task, mMinIntervalMs);
+    }
+}
+
 Return<void> Gnss::reportLocation(const V2_0::GnssLocation& location) const {
     std::unique_lock<std::mutex> lock(mMutex);
     if (sGnssCallback_2_0 == nullptr) {
@@ -22,7 +22,7 @@
 #include <hidl/Status.h>
 #include <atomic>
 #include <mutex>
-#include <thread>
+#include "GnssScheduler.h"
 
 namespace android {
 namespace hardware {
@@ -95,13 +95,18 @@ struct Gnss : public IGnss {
     Return<sp<V2_0::IGnssBatching>> getExtensionGnssBatching_2_0() override;
     Return<bool> injectBestLocation_2_0(const V2_0::GnssLocation& location) override;
 
+    // The location to report now, shared with the batching
+    static V2_0::GnssLocation getMockLocationV2_0();
+
   private:
     Return<void> reportLocation(const V2_0::GnssLocation&) const;
+    void setMinInterval(uint32_t minIntervalMs);
     static sp<V2_0::IGnssCallback> sGnssCallback_2_0;
     static sp<V1_1::IGnssCallback> sGnssCallback_1_1;
     std::atomic<long> mMinIntervalMs;
     std::atomic<bool> mIsActive;
-    std::thread mThread;
+    // Swapped rather than assigned, so racing start()/stop() calls never leak a task
+    std::atomic<common::GnssScheduler::TaskId> mLocationTask;
     mutable std::mutex mMutex;
 };
 
@@ -18,51 +18,151 @@
 
 #include "GnssBatching.h"
 
+#include <log/log.h>
+
+#include "Gnss.h"
+
+using ::android::hardware::gnss::common::GnssScheduler;
+
 namespace android {
 namespace hardware {
 namespace gnss {
 namespace V2_0 {
 namespace implementation {
 
+const uint16_t BATCH_SIZE = 300;
+const int64_t MIN_PERIOD_MILLIS = 100;
+sp<V1_0::IGnssBatchingCallback> GnssBatching::sCallback_1_0 = nullptr;
 sp<V2_0::IGnssBatchingCallback> GnssBatching::sCallback = nullptr;
 
+GnssBatching::GnssBatching()
+    : mBatch(BATCH_SIZE), mBatchStart(0), mBatchCount(0), mWakeUpOnFifoFull(false),
+      mBatchTask(0) {}
+
+GnssBatching::~GnssBatching() {
+    stop();
+}
+
 // Methods from ::android::hardware::gnss::V1_0::IGnssBatching follow.
-Return<bool> GnssBatching::init(const sp<V1_0::IGnssBatchingCallback>&) {
-    // TODO implement
-    return bool{};
+Return<bool> GnssBatching::init(const sp<V1_0::IGnssBatchingCallback>& callback) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    sCallback_1_0 = callback;
+    return true;
 }
 
 Return<uint16_t> GnssBatching::getBatchSize() {
-    // TODO implement
-    return uint16_t{};
+    return BATCH_SIZE;
 }
 
-Return<bool> GnssBatching::start(const V1_0::IGnssBatching::Options&) {
-    // TODO implement
-    return bool{};
+Return<bool> GnssBatching::start(const V1_0::IGnssBatching::Options& options) {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (sCallback == nullptr && sCallback_1_0 == nullptr) {
+            ALOGE("%s: init() has not been called", __func__);
+            return false;
+        }
+    }
+
+    stop();
+
+    int64_t periodMs = options.periodNanos / 1000000;
+    if (periodMs < MIN_PERIOD_MILLIS) {
+        periodMs = MIN_PERIOD_MILLIS;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mWakeUpOnFifoFull = (options.flags & V1_0::IGnssBatching::Flag::WAKEUP_ON_FIFO_FULL) != 0;
+    }
+    GnssScheduler::TaskId task = GnssScheduler::getInstance().schedule(
+            [this]() { this->batchLocation(Gnss::getMockLocationV2_0()); }, periodMs);
+    GnssScheduler::TaskId previous = mBatchTask.exchange(task);
+    if (previous != 0) {
+        GnssScheduler::getInstance().cancel(previous);
+    }
+    return true;
 }
 
 Return<void> GnssBatching::flush() {
-    // TODO implement
+    std::unique_lock<std::mutex> lock(mMutex);
+    reportBatch(lock);
     return Void();
 }
 
 Return<bool> GnssBatching::stop() {
-    // TODO implement
-    return bool{};
+    // The batched locations are kept until they are flushed
+    GnssScheduler::TaskId task = mBatchTask.exchange(0);
+    if (task != 0) {
+        GnssScheduler::getInstance().cancel(task);
+    }
+    return true;
 }
 
 Return<void> GnssBatching::cleanup() {
-    // TODO implement
+    stop();
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mBatchStart = 0;
+    mBatchCount = 0;
+    sCallback_1_0 = nullptr;
+    sCallback = nullptr;
     return Void();
 }
 
 // Methods from V2_0::IGnssBatching follow.
 Return<bool> GnssBatching::init_2_0(const sp<V2_0::IGnssBatchingCallback>& callback) {
+    std::unique_lock<std::mutex> lock(mMutex);
     sCallback = callback;
     return true;
 }
 
+void GnssBatching::batchLocation(const V2_0::GnssLocation& location) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (mBatchCount == BATCH_SIZE) {
+        // Drop the oldest location
+        mBatchStart = (mBatchStart + 1) % BATCH_SIZE;
+        mBatchCount--;
+    }
+    mBatch[(mBatchStart + mBatchCount) % BATCH_SIZE] = location;
+    mBatchCount++;
+
+    if (mBatchCount == BATCH_SIZE && mWakeUpOnFifoFull) {
+        reportBatch(lock);
+    }
+}
+
+void GnssBatching::reportBatch(std::unique_lock<std::mutex>& lock) {
+    hidl_vec<V2_0::GnssLocation> locations(mBatchCount);
+    for (size_t i = 0; i < mBatchCount; i++) {
+        locations[i] = mBatch[(mBatchStart + i) % BATCH_SIZE];
+    }
+    mBatchStart = 0;
+    mBatchCount = 0;
+    sp<IGnssBatchingCallback> callback = sCallback;
+    sp<V1_0::IGnssBatchingCallback> callback_1_0 = sCallback_1_0;
+
+    // The client may call back into the HAL from the callback, and the scheduler thread that
+    // batches is shared with the location and measurement reports.
+    lock.unlock();
+
+    if (callback != nullptr) {
+        auto ret = callback->gnssLocationBatchCb(locations);
+        if (!ret.isOk()) {
+            ALOGE("%s: Unable to invoke callback", __func__);
+        }
+    } else if (callback_1_0 != nullptr) {
+        hidl_vec<V1_0::GnssLocation> locations_1_0(locations.size());
+        for (size_t i = 0; i < locations.size(); i++) {
+            locations_1_0[i] = locations[i].v1_0;
+        }
+        auto ret = callback_1_0->gnssLocationBatchCb(locations_1_0);
+        if (!ret.isOk()) {
+            ALOGE("%s: Unable to invoke callback", __func__);
+        }
+    } else {
+        ALOGE("%s: batching callback is null.", __func__);
+    }
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace gnss
@@ -19,6 +19,10 @@
 #include <android/hardware/gnss/2.0/IGnssBatching.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "GnssScheduler.h"
 
 namespace android {
 namespace hardware {
@@ -35,6 +39,9 @@ using ::android::hardware::Return;
 using ::android::hardware::Void;
 
 struct GnssBatching : public IGnssBatching {
+    GnssBatching();
+    ~GnssBatching();
+
     // Methods from ::android::hardware::gnss::V1_0::IGnssBatching follow.
     Return<bool> init(const sp<V1_0::IGnssBatchingCallback>& callback) override;
     Return<uint16_t> getBatchSize() override;
@@ -47,7 +54,24 @@ struct GnssBatching : public IGnssBatching {
     Return<bool> init_2_0(const sp<V2_0::IGnssBatchingCallback>& callback) override;
 
   private:
+    friend class GnssBatchingTest;
+
+    void batchLocation(const V2_0::GnssLocation& location);
+    // Empties the batch and reports it. Must be called with mMutex held through lock, which is
+    // released before the callback runs.
+    void reportBatch(std::unique_lock<std::mutex>& lock);
+
+    static sp<V1_0::IGnssBatchingCallback> sCallback_1_0;
     static sp<IGnssBatchingCallback> sCallback;
+
+    // FIFO of mBatchCount locations from mBatchStart, wrapping around the fixed size buffer
+    std::vector<V2_0::GnssLocation> mBatch;
+    size_t mBatchStart;
+    size_t mBatchCount;
+    bool mWakeUpOnFifoFull;
+    // Swapped rather than assigned, so racing start()/stop() calls never leak a task
+    std::atomic<common::GnssScheduler::TaskId> mBatchTask;
+    std::mutex mMutex;
 };
 
 }  // namespace implementation
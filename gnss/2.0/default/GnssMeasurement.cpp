@@ -20,6 +20,8 @@
 #include <log/log.h>
 #include <utils/SystemClock.h>
 
+using ::android::hardware::gnss::common::GnssScheduler;
+
 namespace android {
 namespace hardware {
 namespace gnss {
@@ -32,7 +34,38 @@ using GnssMeasurementState = V2_0::IGnssMeasurementCallback::GnssMeasurementStat
 
 sp<V2_0::IGnssMeasurementCallback> GnssMeasurement::sCallback = nullptr;
 
-GnssMeasurement::GnssMeasurement() : mMinIntervalMillis(1000) {}
+namespace {
+
+struct MockSatellite {
+    int16_t svid;
+    GnssConstellationType constellation;
+    float cN0DbHz;
+    double pseudorangeRateMps;
+};
+
+// The satellites in view, each of them measured in every report
+const MockSatellite kMockSatellites[] = {
+        {3, GnssConstellationType::GPS, 32.5, -484.137},
+        {5, GnssConstellationType::GPS, 27.0, 312.645},
+        {17, GnssConstellationType::GPS, 30.5, -125.304},
+        {26, GnssConstellationType::GPS, 24.1, 602.813},
+        {5, GnssConstellationType::GLONASS, 20.5, -220.436},
+        {17, GnssConstellationType::GLONASS, 21.5, 418.927},
+        {18, GnssConstellationType::GLONASS, 28.3, -57.218},
+        {10, GnssConstellationType::GLONASS, 25.0, 135.702}};
+
+const int64_t NANOS_PER_DAY = 86400LL * 1000000000LL;
+const int64_t NANOS_PER_WEEK = 7 * NANOS_PER_DAY;
+// GLONASS time is UTC(SU), 3 hours ahead of UTC, which is 18 leap seconds behind GPS time
+const int64_t GLONASS_OFFSET_FROM_GPS_NS = (3LL * 3600 - 18) * 1000000000LL;
+// Typical signal travel time from a satellite in view
+const int64_t SIGNAL_TRAVEL_TIME_NS = 72000000;
+const double GPS_L1_CARRIER_FREQUENCY_HZ = 1.57542e+09;
+const double GLONASS_G1_CARRIER_FREQUENCY_HZ = 1.59975e+09;
+
+}  // namespace
+
+GnssMeasurement::GnssMeasurement() : mMinIntervalMillis(1000), mMeasurementTask(0) {}
 
 GnssMeasurement::~GnssMeasurement() {
     stop();
@@ -47,8 +80,9 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
 
 Return<void> GnssMeasurement::close() {
     ALOGD("close");
-    std::unique_lock<std::mutex> lock(mMutex);
+    // Stopped before taking mMutex, which a running report holds
     stop();
+    std::unique_lock<std::mutex> lock(mMutex);
     sCallback = nullptr;
     return Void();
 }
@@ -64,13 +98,15 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
 Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallback_2_0(
     const sp<V2_0::IGnssMeasurementCallback>& callback, bool) {
     ALOGD("setCallback_2_0");
-    std::unique_lock<std::mutex> lock(mMutex);
-    sCallback = callback;
-
     if (mIsActive) {
         ALOGW("GnssMeasurement callback already set. Resetting the callback...");
         stop();
     }
+
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        sCallback = callback;
+    }
     start();
 
     return V1_0::IGnssMeasurement::GnssMeasurementStatus::SUCCESS;
@@ -79,63 +115,83 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
 void GnssMeasurement::start() {
     ALOGD("start");
     mIsActive = true;
-    mThread = std::thread([this]() {
-        while (mIsActive == true) {
-            auto measurement = this->getMockMeasurement();
-            this->reportMeasurement(measurement);
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(mMinIntervalMillis));
-        }
-    });
+    GnssScheduler::TaskId task = GnssScheduler::getInstance().schedule(
+            [this]() {
+                auto measurement = this->getMockMeasurement();
+                this->reportMeasurement(measurement);
+            },
+            mMinIntervalMillis);
+    GnssScheduler::TaskId previous = mMeasurementTask.exchange(task);
+    if (previous != 0) {
+        GnssScheduler::getInstance().cancel(previous);
+    }
 }
 
 void GnssMeasurement::stop() {
     ALOGD("stop");
     mIsActive = false;
-    if (mThread.joinable()) {
-        mThread.join();
+    GnssScheduler::TaskId task = mMeasurementTask.exchange(0);
+    if (task != 0) {
+        GnssScheduler::getInstance().cancel(task);
     }
 }
 
 GnssData GnssMeasurement::getMockMeasurement() {
-    V1_0::IGnssMeasurementCallback::GnssMeasurement measurement_1_0 = {
-            .flags = (uint32_t)GnssMeasurementFlags::HAS_CARRIER_FREQUENCY,
-            .svid = (int16_t)6,
-            .constellation = V1_0::GnssConstellationType::UNKNOWN,
-            .timeOffsetNs = 0.0,
-            .receivedSvTimeInNs = 8195997131077,
-            .receivedSvTimeUncertaintyInNs = 15,
-            .cN0DbHz = 30.0,
-            .pseudorangeRateMps = -484.13739013671875,
-            .pseudorangeRateUncertaintyMps = 1.0379999876022339,
-            .accumulatedDeltaRangeState = (uint32_t)V1_0::IGnssMeasurementCallback::
-                    GnssAccumulatedDeltaRangeState::ADR_STATE_UNKNOWN,
-            .accumulatedDeltaRangeM = 0.0,
-            .accumulatedDeltaRangeUncertaintyM = 0.0,
-            .carrierFrequencyHz = 1.59975e+09,
-            .multipathIndicator =
-                    V1_0::IGnssMeasurementCallback::GnssMultipathIndicator::INDICATOR_UNKNOWN};
-    V1_1::IGnssMeasurementCallback::GnssMeasurement measurement_1_1 = {.v1_0 = measurement_1_0};
-    V2_0::IGnssMeasurementCallback::GnssMeasurement measurement_2_0 = {
-            .v1_1 = measurement_1_1,
-            .codeType = "C",
-            .state = GnssMeasurementState::STATE_CODE_LOCK | GnssMeasurementState::STATE_BIT_SYNC |
-                     GnssMeasurementState::STATE_SUBFRAME_SYNC |
-                     GnssMeasurementState::STATE_TOW_DECODED |
-                     GnssMeasurementState::STATE_GLO_STRING_SYNC |
-                     GnssMeasurementState::STATE_GLO_TOD_DECODED,
-            .constellation = GnssConstellationType::GLONASS,
-    };
-
-    hidl_vec<IGnssMeasurementCallback::GnssMeasurement> measurements(1);
-    measurements[0] = measurement_2_0;
-    V1_0::IGnssMeasurementCallback::GnssClock clock = {.timeNs = 2713545000000,
-                                                       .fullBiasNs = -1226701900521857520,
-                                                       .biasNs = 0.59689998626708984,
-                                                       .biasUncertaintyNs = 47514.989972114563,
-                                                       .driftNsps = -51.757811607455452,
-                                                       .driftUncertaintyNsps = 310.64968328491528,
-                                                       .hwClockDiscontinuityCount = 1};
+    V1_0::IGnssMeasurementCallback::GnssClock clock = {
+            .timeNs = ::android::elapsedRealtimeNano(),
+            .fullBiasNs = -1226701900521857520,
+            .biasNs = 0.59689998626708984,
+            .biasUncertaintyNs = 47514.989972114563,
+            .driftNsps = -51.757811607455452,
+            .driftUncertaintyNsps = 310.64968328491528,
+            .hwClockDiscontinuityCount = 1};
+    const int64_t gpsTimeNs = clock.timeNs - clock.fullBiasNs;
+
+    hidl_vec<IGnssMeasurementCallback::GnssMeasurement> measurements(
+            sizeof(kMockSatellites) / sizeof(kMockSatellites[0]));
+    for (size_t i = 0; i < measurements.size(); i++) {
+        const MockSatellite& satellite = kMockSatellites[i];
+        const bool isGps = satellite.constellation == GnssConstellationType::GPS;
+
+        V1_0::IGnssMeasurementCallback::GnssMeasurement measurement_1_0 = {
+                .flags = (uint32_t)GnssMeasurementFlags::HAS_CARRIER_FREQUENCY,
+                .svid = satellite.svid,
+                .constellation = V1_0::GnssConstellationType::UNKNOWN,
+                .timeOffsetNs = 0.0,
+                // Time of week for GPS, time of day for GLONASS
+                .receivedSvTimeInNs =
+                        isGps ? (gpsTimeNs - SIGNAL_TRAVEL_TIME_NS) % NANOS_PER_WEEK
+                              : (gpsTimeNs + GLONASS_OFFSET_FROM_GPS_NS - SIGNAL_TRAVEL_TIME_NS) %
+                                        NANOS_PER_DAY,
+                .receivedSvTimeUncertaintyInNs = 15,
+                .cN0DbHz = satellite.cN0DbHz,
+                .pseudorangeRateMps = satellite.pseudorangeRateMps,
+                .pseudorangeRateUncertaintyMps = 1.0379999876022339,
+                .accumulatedDeltaRangeState = (uint32_t)V1_0::IGnssMeasurementCallback::
+                        GnssAccumulatedDeltaRangeState::ADR_STATE_UNKNOWN,
+                .accumulatedDeltaRangeM = 0.0,
+                .accumulatedDeltaRangeUncertaintyM = 0.0,
+                .carrierFrequencyHz =
+                        isGps ? GPS_L1_CARRIER_FREQUENCY_HZ : GLONASS_G1_CARRIER_FREQUENCY_HZ,
+                .multipathIndicator = V1_0::IGnssMeasurementCallback::GnssMultipathIndicator::
+                        INDICATOR_UNKNOWN};
+        V1_1::IGnssMeasurementCallback::GnssMeasurement measurement_1_1 = {
+                .v1_0 = measurement_1_0};
+        V2_0::IGnssMeasurementCallback::GnssMeasurement measurement_2_0 = {
+                .v1_1 = measurement_1_1,
+                .codeType = "C",
+                .state = isGps ? GnssMeasurementState::STATE_CODE_LOCK |
+                                         GnssMeasurementState::STATE_BIT_SYNC |
+                                         GnssMeasurementState::STATE_SUBFRAME_SYNC |
+                                         GnssMeasurementState::STATE_TOW_DECODED
+                               : GnssMeasurementState::STATE_CODE_LOCK |
+                                         GnssMeasurementState::STATE_BIT_SYNC |
+                                         GnssMeasurementState::STATE_GLO_STRING_SYNC |
+                                         GnssMeasurementState::STATE_GLO_TOD_DECODED,
+                .constellation = satellite.constellation,
+        };
+        measurements[i] = measurement_2_0;
+    }
 
     ElapsedRealtime timestamp = {
             .flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
@@ -22,7 +22,7 @@
 #include <hidl/Status.h>
 #include <atomic>
 #include <mutex>
-#include <thread>
+#include "GnssScheduler.h"
 
 namespace android {
 namespace hardware {
@@ -65,7 +65,8 @@ struct GnssMeasurement : public IGnssMeasurement {
     static sp<IGnssMeasurementCallback> sCallback;
     std::atomic<long> mMinIntervalMillis;
     std::atomic<bool> mIsActive;
-    std::thread mThread;
+    // Swapped rather than assigned, so racing start()/stop() calls never leak a task
+    std::atomic<common::GnssScheduler::TaskId> mMeasurementTask;
     mutable std::mutex mMutex;
 };
 
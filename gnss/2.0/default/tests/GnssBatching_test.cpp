@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GnssBatching.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+namespace {
+
+const uint16_t kBatchSize = 300;
+
+struct BatchingCallback : public IGnssBatchingCallback {
+    Return<void> gnssLocationBatchCb(const hidl_vec<V2_0::GnssLocation>& locations) override {
+        batches.push_back(locations);
+        return Void();
+    }
+
+    std::vector<std::vector<V2_0::GnssLocation>> batches;
+};
+
+struct BatchingCallback_1_0 : public V1_0::IGnssBatchingCallback {
+    Return<void> gnssLocationBatchCb(const hidl_vec<V1_0::GnssLocation>& locations) override {
+        batches.push_back(locations);
+        return Void();
+    }
+
+    std::vector<std::vector<V1_0::GnssLocation>> batches;
+};
+
+}  // namespace
+
+class GnssBatchingTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mBatching = new GnssBatching();
+        mCallback = new BatchingCallback();
+        ASSERT_TRUE(mBatching->init_2_0(mCallback));
+    }
+
+    void TearDown() override { mBatching->cleanup(); }
+
+    // Starts and stops a batch with the given flags, leaving it empty
+    void configure(uint8_t flags) {
+        ASSERT_TRUE(mBatching->start({.periodNanos = 1000000000, .flags = flags}));
+        ASSERT_TRUE(mBatching->stop());
+        mBatching->flush();
+        mCallback->batches.clear();
+    }
+
+    // Adds a location tagged with its sequence number
+    void batch(int sequence) {
+        V2_0::GnssLocation location = {};
+        location.v1_0.latitudeDegrees = sequence;
+        mBatching->batchLocation(location);
+    }
+
+    static int sequenceOf(const V2_0::GnssLocation& location) {
+        return location.v1_0.latitudeDegrees;
+    }
+
+    sp<GnssBatching> mBatching;
+    sp<BatchingCallback> mCallback;
+};
+
+TEST_F(GnssBatchingTest, HoldsFixedSizeBatch) {
+    EXPECT_EQ(kBatchSize, mBatching->getBatchSize());
+}
+
+TEST_F(GnssBatchingTest, FlushReportsBatchInOrder) {
+    configure(0);
+    for (int i = 0; i < 3; i++) {
+        batch(i);
+    }
+    EXPECT_TRUE(mCallback->batches.empty());
+
+    mBatching->flush();
+    ASSERT_EQ(1u, mCallback->batches.size());
+    ASSERT_EQ(3u, mCallback->batches[0].size());
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(i, sequenceOf(mCallback->batches[0][i]));
+    }
+
+    // The flushed locations are not reported again
+    mBatching->flush();
+    ASSERT_EQ(2u, mCallback->batches.size());
+    EXPECT_TRUE(mCallback->batches[1].empty());
+}
+
+TEST_F(GnssBatchingTest, DropsOldestWhenFull) {
+    configure(0);
+    const int count = kBatchSize + 10;
+    for (int i = 0; i < count; i++) {
+        batch(i);
+    }
+    EXPECT_TRUE(mCallback->batches.empty());
+
+    mBatching->flush();
+    ASSERT_EQ(1u, mCallback->batches.size());
+    const auto& locations = mCallback->batches[0];
+    ASSERT_EQ(kBatchSize, locations.size());
+    for (size_t i = 0; i < locations.size(); i++) {
+        EXPECT_EQ(static_cast<int>(count - kBatchSize + i), sequenceOf(locations[i]));
+    }
+}
+
+TEST_F(GnssBatchingTest, WakesUpOnFifoFull) {
+    configure(static_cast<uint8_t>(V1_0::IGnssBatching::Flag::WAKEUP_ON_FIFO_FULL));
+    for (int i = 0; i < kBatchSize - 1; i++) {
+        batch(i);
+    }
+    EXPECT_TRUE(mCallback->batches.empty());
+
+    batch(kBatchSize - 1);
+    ASSERT_EQ(1u, mCallback->batches.size());
+    ASSERT_EQ(kBatchSize, mCallback->batches[0].size());
+    EXPECT_EQ(0, sequenceOf(mCallback->batches[0].front()));
+    EXPECT_EQ(kBatchSize - 1, sequenceOf(mCallback->batches[0].back()));
+
+    // Batching starts over after the report
+    batch(kBatchSize);
+    mBatching->flush();
+    ASSERT_EQ(2u, mCallback->batches.size());
+    ASSERT_EQ(1u, mCallback->batches[1].size());
+    EXPECT_EQ(kBatchSize, sequenceOf(mCallback->batches[1][0]));
+}
+
+TEST_F(GnssBatchingTest, StopKeepsBatch) {
+    configure(0);
+    batch(1);
+    batch(2);
+    ASSERT_TRUE(mBatching->stop());
+
+    mBatching->flush();
+    ASSERT_EQ(1u, mCallback->batches.size());
+    EXPECT_EQ(2u, mCallback->batches[0].size());
+}
+
+TEST_F(GnssBatchingTest, CleanupDropsBatch) {
+    configure(0);
+    batch(1);
+    batch(2);
+    mBatching->cleanup();
+
+    ASSERT_TRUE(mBatching->init_2_0(mCallback));
+    mBatching->flush();
+    ASSERT_EQ(1u, mCallback->batches.size());
+    EXPECT_TRUE(mCallback->batches[0].empty());
+}
+
+TEST_F(GnssBatchingTest, StartNeedsCallback) {
+    mBatching->cleanup();
+    EXPECT_FALSE(mBatching->start({.periodNanos = 1000000000, .flags = 0}));
+}
+
+TEST_F(GnssBatchingTest, ReportsToV1_0Callback) {
+    mBatching->cleanup();
+    sp<BatchingCallback_1_0> callback = new BatchingCallback_1_0();
+    ASSERT_TRUE(mBatching->init(callback));
+
+    batch(7);
+    mBatching->flush();
+    ASSERT_EQ(1u, callback->batches.size());
+    ASSERT_EQ(1u, callback->batches[0].size());
+    EXPECT_EQ(7, callback->batches[0][0].latitudeDegrees);
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
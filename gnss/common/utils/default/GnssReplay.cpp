@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GnssReplay"
+
+#include <GnssReplay.h>
+#include <Utils.h>
+
+#include <cutils/properties.h>
+#include <log/log.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdlib>
+#include <fstream>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace common {
+
+namespace {
+
+const char* const kReplayFileProperty = "vendor.gnss.replay_file";
+const int64_t kMillisPerDay = 24 * 3600 * 1000;
+const double kMetersPerSecPerKnot = 0.514444;
+// Typical user equivalent range error, to turn the HDOP of a fix into an accuracy estimate
+const float kUereMeters = 5;
+
+std::vector<std::string> split(const std::string& line, char delimiter) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find(delimiter, start);
+        if (end == std::string::npos) {
+            fields.push_back(line.substr(start));
+            return fields;
+        }
+        fields.push_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+std::string trim(const std::string& line) {
+    const char* const whitespace = " \t\r\n";
+    size_t start = line.find_first_not_of(whitespace);
+    if (start == std::string::npos) {
+        return "";
+    }
+    return line.substr(start, line.find_last_not_of(whitespace) - start + 1);
+}
+
+bool parseDouble(const std::string& field, double* value) {
+    if (field.empty()) {
+        return false;
+    }
+    char* end;
+    *value = strtod(field.c_str(), &end);
+    return *end == '\0';
+}
+
+// Strips the "*hh" checksum off a "$...*hh" sentence, returns false if it doesn't match
+bool stripNmeaChecksum(std::string* sentence) {
+    size_t star = sentence->rfind('*');
+    if (star == std::string::npos) {
+        sentence->erase(0, 1);
+        return true;
+    }
+
+    uint8_t checksum = 0;
+    for (size_t i = 1; i < star; i++) {
+        checksum ^= static_cast<uint8_t>((*sentence)[i]);
+    }
+    char* end;
+    long expected = strtol(sentence->c_str() + star + 1, &end, 16);
+    if (*end != '\0' || expected != checksum) {
+        return false;
+    }
+
+    *sentence = sentence->substr(1, star - 1);
+    return true;
+}
+
+// Parses hhmmss[.sss]
+bool parseNmeaTime(const std::string& field, int64_t* timeOfDayMs) {
+    double value;
+    if (field.size() < 6 || !parseDouble(field, &value)) {
+        return false;
+    }
+    int64_t hhmmss = static_cast<int64_t>(value);
+    int64_t millis = static_cast<int64_t>((value - hhmmss) * 1000 + 0.5);
+    *timeOfDayMs = ((hhmmss / 10000) * 3600 + (hhmmss / 100 % 100) * 60 + hhmmss % 100) * 1000 +
+                   millis;
+    return true;
+}
+
+// Parses [d]ddmm.mmmm with its N/S or E/W hemisphere
+bool parseNmeaCoordinate(const std::string& field, const std::string& hemisphere,
+                         double* degrees) {
+    double value;
+    if (!parseDouble(field, &value)) {
+        return false;
+    }
+    int wholeDegrees = static_cast<int>(value / 100);
+    *degrees = wholeDegrees + (value - wholeDegrees * 100) / 60;
+    if (hemisphere == "S" || hemisphere == "W") {
+        *degrees = -*degrees;
+    } else if (hemisphere != "N" && hemisphere != "E") {
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+GnssReplay& GnssReplay::getInstance() {
+    static GnssReplay instance;
+    return instance;
+}
+
+GnssReplay::GnssReplay() : mStartTime(std::chrono::steady_clock::now()) {
+    char path[PROPERTY_VALUE_MAX];
+    if (property_get(kReplayFileProperty, path, "") > 0) {
+        load(path);
+    }
+}
+
+bool GnssReplay::load(const std::string& path) {
+    std::ifstream input(path);
+    if (!input.is_open()) {
+        ALOGE("%s: failed to open %s", __func__, path.c_str());
+        return false;
+    }
+
+    std::vector<Fix> fixes;
+    bool loaded;
+    if ((input >> std::ws).peek() == '$') {
+        loaded = parseNmea(input, &fixes);
+    } else {
+        loaded = parseTrajectory(input, &fixes);
+    }
+    if (!loaded) {
+        ALOGE("%s: no fix found in %s", __func__, path.c_str());
+        return false;
+    }
+
+    ALOGI("%s: replaying %zu fixes over %" PRId64 " ms from %s", __func__, fixes.size(),
+          fixes.back().timeMs, path.c_str());
+    std::unique_lock<std::mutex> lock(mMutex);
+    mFixes = std::move(fixes);
+    mStartTime = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool GnssReplay::isReplaying() const {
+    std::unique_lock<std::mutex> lock(mMutex);
+    return !mFixes.empty();
+}
+
+GnssLocation GnssReplay::getLocation() const {
+    std::chrono::steady_clock::time_point startTime;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        startTime = mStartTime;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return getLocationAt(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+}
+
+GnssLocation GnssReplay::getLocationAt(int64_t elapsedMs) const {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (mFixes.empty()) {
+        return Utils::getMockLocation();
+    }
+
+    int64_t durationMs = mFixes.back().timeMs;
+    int64_t timeMs = durationMs > 0 ? elapsedMs % durationMs : 0;
+    auto next = std::upper_bound(mFixes.begin(), mFixes.end(), timeMs,
+                                 [](int64_t time, const Fix& fix) { return time < fix.timeMs; });
+
+    GnssLocation location;
+    if (next == mFixes.end()) {
+        location = mFixes.back().location;
+    } else {
+        const GnssLocation& from = (next - 1)->location;
+        const GnssLocation& to = next->location;
+        double fraction = static_cast<double>(timeMs - (next - 1)->timeMs) /
+                          (next->timeMs - (next - 1)->timeMs);
+
+        // The bearing is kept from the last fix rather than interpolated across the 0/360 wrap
+        location = from;
+        location.latitudeDegrees += (to.latitudeDegrees - from.latitudeDegrees) * fraction;
+        location.longitudeDegrees += (to.longitudeDegrees - from.longitudeDegrees) * fraction;
+        location.altitudeMeters += (to.altitudeMeters - from.altitudeMeters) * fraction;
+        location.speedMetersPerSec += (to.speedMetersPerSec - from.speedMetersPerSec) * fraction;
+        location.horizontalAccuracyMeters +=
+                (to.horizontalAccuracyMeters - from.horizontalAccuracyMeters) * fraction;
+    }
+
+    location.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+    return location;
+}
+
+bool GnssReplay::parseNmea(std::istream& input, std::vector<Fix>* fixes) {
+    // GGA and RMC sentences of the same epoch are merged into one fix
+    int64_t lastTimeOfDayMs = -1;
+    int64_t dayOffsetMs = 0;
+    std::string line;
+    while (std::getline(input, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] != '$' || !stripNmeaChecksum(&line)) {
+            continue;
+        }
+
+        std::vector<std::string> fields = split(line, ',');
+        const std::string& type = fields[0];
+        bool isGga = type.size() == 5 && type.compare(2, 3, "GGA") == 0 && fields.size() >= 10;
+        bool isRmc = type.size() == 5 && type.compare(2, 3, "RMC") == 0 && fields.size() >= 9;
+        if (!isGga && !isRmc) {
+            continue;
+        }
+
+        int64_t timeOfDayMs;
+        if (!parseNmeaTime(fields[1], &timeOfDayMs)) {
+            continue;
+        }
+        // Skip sentences without a valid fix
+        if ((isGga && (fields[6].empty() || fields[6] == "0")) || (isRmc && fields[2] != "A")) {
+            continue;
+        }
+        size_t latitudeField = isGga ? 2 : 3;
+        double latitude;
+        double longitude;
+        if (!parseNmeaCoordinate(fields[latitudeField], fields[latitudeField + 1], &latitude) ||
+            !parseNmeaCoordinate(fields[latitudeField + 2], fields[latitudeField + 3],
+                                 &longitude)) {
+            continue;
+        }
+
+        if (timeOfDayMs != lastTimeOfDayMs) {
+            if (timeOfDayMs < lastTimeOfDayMs) {
+                dayOffsetMs += kMillisPerDay;
+            }
+            lastTimeOfDayMs = timeOfDayMs;
+            fixes->push_back({.timeMs = dayOffsetMs + timeOfDayMs,
+                              .location = Utils::getMockLocation()});
+        }
+
+        GnssLocation& location = fixes->back().location;
+        location.latitudeDegrees = latitude;
+        location.longitudeDegrees = longitude;
+
+        double value;
+        if (isGga) {
+            if (parseDouble(fields[9], &value)) {
+                location.altitudeMeters = value;
+            }
+            if (parseDouble(fields[8], &value) && value > 0) {
+                location.horizontalAccuracyMeters = value * kUereMeters;
+            }
+        } else {
+            if (parseDouble(fields[7], &value)) {
+                location.speedMetersPerSec = value * kMetersPerSecPerKnot;
+            }
+            if (parseDouble(fields[8], &value)) {
+                location.bearingDegrees = value;
+            }
+        }
+    }
+
+    if (fixes->empty()) {
+        return false;
+    }
+    int64_t startMs = fixes->front().timeMs;
+    for (Fix& fix : *fixes) {
+        fix.timeMs -= startMs;
+    }
+    return true;
+}
+
+bool GnssReplay::parseTrajectory(std::istream& input, std::vector<Fix>* fixes) {
+    std::string line;
+    while (std::getline(input, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::vector<std::string> fields = split(line, ',');
+        double values[7];
+        size_t count = std::min(fields.size(), sizeof(values) / sizeof(values[0]));
+        size_t parsed = 0;
+        while (parsed < count && parseDouble(trim(fields[parsed]), &values[parsed])) {
+            parsed++;
+        }
+        // Also skips a header line
+        if (parsed < 3) {
+            continue;
+        }
+
+        int64_t timeMs = static_cast<int64_t>(values[0]);
+        if (!fixes->empty() && timeMs <= fixes->back().timeMs) {
+            ALOGW("%s: skipping out of order fix at %" PRId64 " ms", __func__, timeMs);
+            continue;
+        }
+
+        GnssLocation location = Utils::getMockLocation();
+        location.latitudeDegrees = values[1];
+        location.longitudeDegrees = values[2];
+        if (parsed > 3) location.altitudeMeters = values[3];
+        if (parsed > 4) location.speedMetersPerSec = values[4];
+        if (parsed > 5) location.bearingDegrees = values[5];
+        if (parsed > 6) location.horizontalAccuracyMeters = values[6];
+        fixes->push_back({.timeMs = timeMs, .location = location});
+    }
+
+    if (fixes->empty()) {
+        return false;
+    }
+    int64_t startMs = fixes->front().timeMs;
+    for (Fix& fix : *fixes) {
+        fix.timeMs -= startMs;
+    }
+    return true;
+}
+
+}  // namespace common
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
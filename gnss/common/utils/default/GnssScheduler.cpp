@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <GnssScheduler.h>
+
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace common {
+
+GnssScheduler& GnssScheduler::getInstance() {
+    static GnssScheduler instance;
+    return instance;
+}
+
+GnssScheduler::~GnssScheduler() {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mExit = true;
+    }
+    mCondition.notify_all();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+GnssScheduler::TaskId GnssScheduler::schedule(std::function<void()> task, long intervalMs) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (!mThread.joinable()) {
+        mThread = std::thread([this]() { threadLoop(); });
+    }
+
+    TaskId id = mNextId++;
+    mTasks.push_back({.id = id,
+                      .run = std::move(task),
+                      .interval = std::chrono::milliseconds(intervalMs),
+                      .next = std::chrono::steady_clock::now()});
+    mCondition.notify_all();
+    return id;
+}
+
+void GnssScheduler::setInterval(TaskId id, long intervalMs) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (Task& task : mTasks) {
+        if (task.id == id) {
+            // Apply the new interval from the last run on
+            task.next += std::chrono::milliseconds(intervalMs) - task.interval;
+            task.interval = std::chrono::milliseconds(intervalMs);
+        }
+    }
+    mCondition.notify_all();
+}
+
+void GnssScheduler::cancel(TaskId id) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTasks.erase(std::remove_if(mTasks.begin(), mTasks.end(),
+                                [id](const Task& task) { return task.id == id; }),
+                 mTasks.end());
+    if (std::this_thread::get_id() != mThread.get_id()) {
+        mCondition.wait(lock, [this, id]() { return mRunningId != id; });
+    }
+    mCondition.notify_all();
+}
+
+void GnssScheduler::threadLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mExit) {
+        if (mTasks.empty()) {
+            mCondition.wait(lock);
+            continue;
+        }
+
+        auto task = std::min_element(
+                mTasks.begin(), mTasks.end(),
+                [](const Task& a, const Task& b) { return a.next < b.next; });
+        auto now = std::chrono::steady_clock::now();
+        if (task->next > now) {
+            mCondition.wait_until(lock, task->next);
+            continue;
+        }
+
+        task->next += task->interval;
+        if (task->next < now) {
+            task->next = now + task->interval;
+        }
+        std::function<void()> run = task->run;
+        mRunningId = task->id;
+
+        lock.unlock();
+        run();
+        lock.lock();
+
+        mRunningId = 0;
+        mCondition.notify_all();
+    }
+}
+
+}  // namespace common
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
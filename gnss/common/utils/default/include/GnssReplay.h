@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_gnss_common_default_GnssReplay_H_
+#define android_hardware_gnss_common_default_GnssReplay_H_
+
+#include <android/hardware/gnss/1.0/IGnss.h>
+
+#include <chrono>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using GnssLocation = ::android::hardware::gnss::V1_0::GnssLocation;
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace common {
+
+/**
+ * Plays back a recorded trajectory as the source of the mock locations.
+ *
+ * The recording is read from the file named by the vendor.gnss.replay_file property, either
+ * NMEA sentences (GGA and RMC) or a CSV trajectory with one fix per line:
+ *
+ *   timeMs,latitudeDegrees,longitudeDegrees[,altitudeMeters[,speedMps[,bearingDegrees
+ *   [,horizontalAccuracyMeters]]]]
+ *
+ * Locations are interpolated between the recorded fixes, so a 1 Hz recording can be reported at
+ * any rate, and the playback loops at the end of the recording. Without a recording the fixed
+ * mock location is reported.
+ */
+class GnssReplay {
+  public:
+    static GnssReplay& getInstance();
+
+    // Replaces the recording, returns false if the file has no usable fix
+    bool load(const std::string& path);
+
+    bool isReplaying() const;
+
+    // The location at the current point of the playback
+    GnssLocation getLocation() const;
+
+    // The location elapsedMs into the playback
+    GnssLocation getLocationAt(int64_t elapsedMs) const;
+
+  private:
+    struct Fix {
+        // Time from the start of the recording
+        int64_t timeMs;
+        GnssLocation location;
+    };
+
+    GnssReplay();
+
+    static bool parseNmea(std::istream& input, std::vector<Fix>* fixes);
+    static bool parseTrajectory(std::istream& input, std::vector<Fix>* fixes);
+
+    mutable std::mutex mMutex;
+    std::vector<Fix> mFixes;
+    std::chrono::steady_clock::time_point mStartTime;
+};
+
+}  // namespace common
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_gnss_common_default_GnssReplay_H_
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_gnss_common_default_GnssScheduler_H_
+#define android_hardware_gnss_common_default_GnssScheduler_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace common {
+
+/**
+ * Runs the periodic work of the mock HAL (location fixes, measurements, batching) on a single
+ * shared thread, instead of a sleeping thread per report.
+ *
+ * Tasks run one at a time. A task that falls behind runs once and then keeps its interval from
+ * there, rather than catching up in a burst.
+ */
+class GnssScheduler {
+  public:
+    using TaskId = int;
+
+    static GnssScheduler& getInstance();
+
+    /**
+     * Runs the task every intervalMs, the first time right away. Returns the id to change or
+     * cancel it with.
+     */
+    TaskId schedule(std::function<void()> task, long intervalMs);
+
+    void setInterval(TaskId id, long intervalMs);
+
+    /**
+     * Cancels the task. If it is running, waits for it to finish unless called from the task
+     * itself, so that whatever it references can be released afterwards.
+     */
+    void cancel(TaskId id);
+
+  private:
+    struct Task {
+        TaskId id;
+        std::function<void()> run;
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point next;
+    };
+
+    GnssScheduler() = default;
+    ~GnssScheduler();
+
+    void threadLoop();
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::vector<Task> mTasks;
+    TaskId mNextId = 1;
+    // The task being run, 0 if none
+    TaskId mRunningId = 0;
+    bool mExit = false;
+    std::thread mThread;
+};
+
+}  // namespace common
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_gnss_common_default_GnssScheduler_H_
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <GnssReplay.h>
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace common {
+
+namespace {
+
+// Completes "GPGGA,..." into "$GPGGA,...*hh"
+std::string nmea(const std::string& body) {
+    uint8_t checksum = 0;
+    for (char c : body) {
+        checksum ^= static_cast<uint8_t>(c);
+    }
+    char suffix[4];
+    snprintf(suffix, sizeof(suffix), "*%02X", checksum);
+    return "$" + body + suffix;
+}
+
+class GnssReplayTest : public ::testing::Test {
+  protected:
+    bool load(const std::string& contents) {
+        std::string path = ::testing::TempDir() + "gnss_replay_test";
+        std::ofstream(path) << contents;
+        bool loaded = GnssReplay::getInstance().load(path);
+        std::remove(path.c_str());
+        return loaded;
+    }
+
+    GnssLocation at(int64_t elapsedMs) {
+        return GnssReplay::getInstance().getLocationAt(elapsedMs);
+    }
+};
+
+}  // namespace
+
+TEST_F(GnssReplayTest, MergesGgaAndRmcOfOneEpoch) {
+    ASSERT_TRUE(load(nmea("GPGGA,123519.00,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,") +
+                     "\n" +
+                     nmea("GPRMC,123519.00,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W") +
+                     "\n" +
+                     nmea("GNGGA,123520.00,4807.138,S,01131.100,W,1,08,1.0,547.4,M,46.9,M,,") +
+                     "\n"));
+    EXPECT_TRUE(GnssReplay::getInstance().isReplaying());
+
+    GnssLocation first = at(0);
+    EXPECT_NEAR(48.1173, first.latitudeDegrees, 1e-6);
+    EXPECT_NEAR(11.516667, first.longitudeDegrees, 1e-6);
+    EXPECT_DOUBLE_EQ(545.4, first.altitudeMeters);
+    EXPECT_FLOAT_EQ(0.9f * 5, first.horizontalAccuracyMeters);
+    EXPECT_NEAR(22.4 * 0.514444, first.speedMetersPerSec, 1e-4);
+    EXPECT_FLOAT_EQ(84.4f, first.bearingDegrees);
+
+    // The southern and western hemispheres are negative
+    GnssLocation last = at(999);
+    EXPECT_LT(last.latitudeDegrees, 0);
+    EXPECT_LT(last.longitudeDegrees, 0);
+}
+
+TEST_F(GnssReplayTest, SkipsSentencesWithBadChecksums) {
+    std::string corrupted =
+            nmea("GPGGA,123520.00,4807.138,N,01131.100,E,1,08,1.0,600.0,M,46.9,M,,");
+    corrupted[corrupted.size() - 1] = corrupted.back() == '0' ? '1' : '0';
+    ASSERT_TRUE(load(nmea("GPGGA,123519.00,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,") +
+                     "\n" + corrupted + "\n" +
+                     // A sentence without a checksum is taken as is
+                     "$GPGGA,123521.00,4807.238,N,01131.200,E,1,08,1.0,549.4,M,46.9,M,,\n"));
+
+    // The corrupted epoch at 1 s is missing, so the fixes 2 s apart are interpolated
+    EXPECT_DOUBLE_EQ(547.4, at(1000).altitudeMeters);
+}
+
+TEST_F(GnssReplayTest, SkipsSentencesWithoutFix) {
+    EXPECT_FALSE(load(nmea("GPGGA,123519.00,4807.038,N,01131.000,E,0,00,,,M,,M,,") + "\n" +
+                      nmea("GPRMC,123519.00,V,4807.038,N,01131.000,E,,,230394,,") + "\n"));
+}
+
+TEST_F(GnssReplayTest, ContinuesThroughMidnight) {
+    ASSERT_TRUE(load(nmea("GPGGA,235959.00,4807.038,N,01131.000,E,1,08,0.9,100.0,M,46.9,M,,") +
+                     "\n" +
+                     nmea("GPGGA,000001.00,4807.038,N,01131.000,E,1,08,0.9,300.0,M,46.9,M,,") +
+                     "\n"));
+
+    // Two seconds apart, not a day backwards
+    EXPECT_DOUBLE_EQ(200.0, at(1000).altitudeMeters);
+}
+
+TEST_F(GnssReplayTest, InterpolatesTrajectory) {
+    ASSERT_TRUE(load("# recorded trajectory\n"
+                     "timeMs,latitude,longitude,altitude,speed,bearing,accuracy\n"
+                     "1000,10,20,5,1,90,4\n"
+                     "2000,11,22,15,3,180,8\n"));
+
+    GnssLocation location = at(250);
+    EXPECT_DOUBLE_EQ(10.25, location.latitudeDegrees);
+    EXPECT_DOUBLE_EQ(20.5, location.longitudeDegrees);
+    EXPECT_DOUBLE_EQ(7.5, location.altitudeMeters);
+    EXPECT_FLOAT_EQ(1.5f, location.speedMetersPerSec);
+    EXPECT_FLOAT_EQ(5.f, location.horizontalAccuracyMeters);
+    // Kept from the previous fix rather than interpolated across the 0/360 wrap
+    EXPECT_FLOAT_EQ(90.f, location.bearingDegrees);
+}
+
+TEST_F(GnssReplayTest, SkipsOutOfOrderFixes) {
+    ASSERT_TRUE(load("1000,10,20\n"
+                     "2000,11,22\n"
+                     "1500,0,0\n"
+                     "3000,12,24\n"));
+    EXPECT_DOUBLE_EQ(10.5, at(500).latitudeDegrees);
+    EXPECT_DOUBLE_EQ(11.5, at(1500).latitudeDegrees);
+}
+
+TEST_F(GnssReplayTest, LoopsAtEndOfRecording) {
+    ASSERT_TRUE(load("0,10,20\n"
+                     "1000,11,20\n"
+                     "2000,12,20\n"));
+    EXPECT_DOUBLE_EQ(at(500).latitudeDegrees, at(2500).latitudeDegrees);
+    EXPECT_DOUBLE_EQ(at(1500).latitudeDegrees, at(2 * 2000 + 1500).latitudeDegrees);
+    EXPECT_DOUBLE_EQ(10.0, at(2000).latitudeDegrees);
+}
+
+TEST_F(GnssReplayTest, KeepsRecordingWhenLoadFails) {
+    ASSERT_TRUE(load("0,10,20\n"
+                     "1000,11,20\n"));
+    EXPECT_FALSE(load("timeMs,latitude,longitude\n"));
+    EXPECT_FALSE(GnssReplay::getInstance().load(::testing::TempDir() + "missing_replay_file"));
+    EXPECT_DOUBLE_EQ(10.5, at(500).latitudeDegrees);
+}
+
+}  // namespace common
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
@@ -31,6 +31,8 @@
 #include <inttypes.h>
 #include <unistd.h>
 
+#include <functional>
+
 template <typename PFN, typename T>
 static gralloc1_function_pointer_t asFP(T function)
 {
@@ -75,6 +77,9 @@ Gralloc1On0Adapter::~Gralloc1On0Adapter()
         ALOGV("Closing gralloc0 device %p", mDevice);
         ::gralloc_close(mDevice);
     }
+
+    // Another adapter may be constructed at the same address
+    sBufferGeneration++;
 }
 
 void Gralloc1On0Adapter::doGetCapabilities(uint32_t* outCount,
@@ -202,8 +207,7 @@ gralloc1_error_t Gralloc1On0Adapter::createDescriptor(
         gralloc1_buffer_descriptor_t* outDescriptor)
 {
     auto descriptorId = sNextBufferDescriptorId++;
-    std::lock_guard<std::mutex> lock(mDescriptorMutex);
-    mDescriptors.emplace(descriptorId, std::make_shared<Descriptor>());
+    mDescriptors.insert(descriptorId, std::make_shared<Descriptor>());
 
     ALOGV("Created descriptor %" PRIu64, descriptorId);
 
@@ -216,12 +220,10 @@ gralloc1_error_t Gralloc1On0Adapter::destroyDescriptor(
 {
     ALOGV("Destroying descriptor %" PRIu64, descriptor);
 
-    std::lock_guard<std::mutex> lock(mDescriptorMutex);
-    if (mDescriptors.count(descriptor) == 0) {
+    if (!mDescriptors.erase(descriptor)) {
         return GRALLOC1_ERROR_BAD_DESCRIPTOR;
     }
 
-    mDescriptors.erase(descriptor);
     return GRALLOC1_ERROR_NONE;
 }
 
@@ -279,8 +281,7 @@ gralloc1_error_t Gralloc1On0Adapter::allocate(
     auto buffer = std::make_shared<Buffer>(handle, backingStore,
             *descriptor, stride, numFlexPlanes, true);
 
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    mBuffers.emplace(handle, std::move(buffer));
+    mBuffers.insert(handle, std::move(buffer));
 
     return GRALLOC1_ERROR_NONE;
 }
@@ -331,35 +332,40 @@ int32_t Gralloc1On0Adapter::allocateHook(gralloc1_device* device,
 gralloc1_error_t Gralloc1On0Adapter::retain(
         const std::shared_ptr<Buffer>& buffer)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    buffer->retain();
+    mBuffers.withShard(buffer->getHandle(),
+            [&](BufferRegistry::Map&) {
+        buffer->retain();
+    });
     return GRALLOC1_ERROR_NONE;
 }
 
 gralloc1_error_t Gralloc1On0Adapter::release(
         const std::shared_ptr<Buffer>& buffer)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    if (!buffer->release()) {
-        return GRALLOC1_ERROR_NONE;
-    }
-
     buffer_handle_t handle = buffer->getHandle();
-    if (buffer->wasAllocated()) {
-        ALOGV("Calling free(%p)", handle);
-        int result = mDevice->free(mDevice, handle);
-        if (result != 0) {
-            ALOGE("gralloc0 free failed: %d", result);
+    mBuffers.withShard(handle,
+            [&](BufferRegistry::Map& buffers) {
+        if (!buffer->release()) {
+            return;
         }
-    } else {
-        ALOGV("Calling unregisterBuffer(%p)", handle);
-        int result = mModule->unregisterBuffer(mModule, handle);
-        if (result != 0) {
-            ALOGE("gralloc0 unregister failed: %d", result);
+
+        if (buffer->wasAllocated()) {
+            ALOGV("Calling free(%p)", handle);
+            int result = mDevice->free(mDevice, handle);
+            if (result != 0) {
+                ALOGE("gralloc0 free failed: %d", result);
+            }
+        } else {
+            ALOGV("Calling unregisterBuffer(%p)", handle);
+            int result = mModule->unregisterBuffer(mModule, handle);
+            if (result != 0) {
+                ALOGE("gralloc0 unregister failed: %d", result);
+            }
         }
-    }
 
-    mBuffers.erase(handle);
+        buffers.erase(handle);
+        sBufferGeneration++;
+    });
     return GRALLOC1_ERROR_NONE;
 }
 
@@ -367,13 +373,22 @@ gralloc1_error_t Gralloc1On0Adapter::retain(buffer_handle_t bufferHandle)
 {
     ALOGV("retain(%p)", bufferHandle);
 
-    std::lock_guard<std::mutex> lock(mBufferMutex);
+    return mBuffers.withShard(bufferHandle,
+            [&](BufferRegistry::Map& buffers) {
+        auto iter = buffers.find(bufferHandle);
+        if (iter != buffers.end()) {
+            iter->second->retain();
+            return GRALLOC1_ERROR_NONE;
+        }
 
-    if (mBuffers.count(bufferHandle) != 0) {
-        mBuffers[bufferHandle]->retain();
-        return GRALLOC1_ERROR_NONE;
-    }
+        return registerBuffer(bufferHandle, buffers);
+    });
+}
 
+gralloc1_error_t Gralloc1On0Adapter::registerBuffer(
+        buffer_handle_t bufferHandle,
+        BufferRegistry::Map& buffers)
+{
     ALOGV("Calling registerBuffer(%p)", bufferHandle);
     int result = mModule->registerBuffer(mModule, bufferHandle);
     if (result != 0) {
@@ -417,7 +432,7 @@ gralloc1_error_t Gralloc1On0Adapter::retain(buffer_handle_t bufferHandle)
 
     auto buffer = std::make_shared<Buffer>(bufferHandle, backingStore,
             descriptor, stride, numFlexPlanes, false);
-    mBuffers.emplace(bufferHandle, std::move(buffer));
+    buffers.emplace(bufferHandle, std::move(buffer));
     return GRALLOC1_ERROR_NONE;
 }
 
@@ -541,27 +556,50 @@ gralloc1_error_t Gralloc1On0Adapter::unlock(
 std::shared_ptr<Gralloc1On0Adapter::Descriptor>
 Gralloc1On0Adapter::getDescriptor(gralloc1_buffer_descriptor_t descriptorId)
 {
-    std::lock_guard<std::mutex> lock(mDescriptorMutex);
-    if (mDescriptors.count(descriptorId) == 0) {
-        return nullptr;
-    }
-
-    return mDescriptors[descriptorId];
+    return mDescriptors.get(descriptorId);
 }
 
+struct Gralloc1On0Adapter::BufferCache {
+    static constexpr size_t kNumEntries = 8;
+
+    struct Entry {
+        const Gralloc1On0Adapter* adapter = nullptr;
+        buffer_handle_t handle = nullptr;
+        uint64_t generation = 0;
+        std::shared_ptr<Buffer> buffer;
+    };
+    Entry entries[kNumEntries];
+};
+
 std::shared_ptr<Gralloc1On0Adapter::Buffer> Gralloc1On0Adapter::getBuffer(
         buffer_handle_t bufferHandle)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    if (mBuffers.count(bufferHandle) == 0) {
-        return nullptr;
+    static thread_local BufferCache cache;
+
+    // The generation is read before the registry lookup, so an entry filled
+    // with a buffer that is released concurrently is never trusted
+    const uint64_t generation =
+            sBufferGeneration.load(std::memory_order_acquire);
+    auto& entry = cache.entries[std::hash<buffer_handle_t>()(bufferHandle) %
+            BufferCache::kNumEntries];
+    if (entry.adapter == this && entry.handle == bufferHandle &&
+            entry.generation == generation) {
+        return entry.buffer;
     }
 
-    return mBuffers[bufferHandle];
+    auto buffer = mBuffers.get(bufferHandle);
+    if (buffer) {
+        entry.adapter = this;
+        entry.handle = bufferHandle;
+        entry.generation = generation;
+        entry.buffer = buffer;
+    }
+    return buffer;
 }
 
 std::atomic<gralloc1_buffer_descriptor_t>
         Gralloc1On0Adapter::sNextBufferDescriptorId(1);
+std::atomic<uint64_t> Gralloc1On0Adapter::sBufferGeneration(1);
 
 } // namespace hardware
 } // namespace android
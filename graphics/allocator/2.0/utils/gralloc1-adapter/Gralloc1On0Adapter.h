@@ -22,11 +22,11 @@
 
 #include <atomic>
 #include <memory>
-#include <mutex>
 #include <string>
-#include <unordered_map>
 #include <utility>
 
+#include "ShardedMap.h"
+
 struct gralloc_module_t;
 struct alloc_device_t;
 
@@ -201,6 +201,8 @@ private:
 
         buffer_handle_t getHandle() const { return mHandle; }
 
+        // The reference count is protected by the lock of the registry shard
+        // holding the buffer
         void retain() { ++mReferenceCount; }
 
         // Returns true if the reference count has dropped to 0, indicating that
@@ -270,6 +272,8 @@ private:
         const bool mWasAllocated;
     };
 
+    using BufferRegistry = ShardedMap<buffer_handle_t, Buffer>;
+
     template <typename ...Args>
     static int32_t callBufferFunction(gralloc1_device_t* device,
             buffer_handle_t bufferHandle,
@@ -324,6 +328,10 @@ private:
 
     gralloc1_error_t retain(const std::shared_ptr<Buffer>& buffer);
     gralloc1_error_t retain(buffer_handle_t bufferHandle);
+    // Registers a buffer imported from another process. Called with the
+    // registry shard of bufferHandle locked.
+    gralloc1_error_t registerBuffer(buffer_handle_t bufferHandle,
+            BufferRegistry::Map& buffers);
     static int32_t retainHook(gralloc1_device_t* device,
             buffer_handle_t bufferHandle)
     {
@@ -445,11 +453,16 @@ private:
     std::shared_ptr<Buffer> getBuffer(buffer_handle_t bufferHandle);
 
     static std::atomic<gralloc1_buffer_descriptor_t> sNextBufferDescriptorId;
-    std::mutex mDescriptorMutex;
-    std::unordered_map<gralloc1_buffer_descriptor_t,
-            std::shared_ptr<Descriptor>> mDescriptors;
-    std::mutex mBufferMutex;
-    std::unordered_map<buffer_handle_t, std::shared_ptr<Buffer>> mBuffers;
+    ShardedMap<gralloc1_buffer_descriptor_t, Descriptor> mDescriptors;
+    BufferRegistry mBuffers;
+
+    // Recently used buffers of the calling thread, so that the lock and
+    // unlock paths don't need to take a registry lock
+    struct BufferCache;
+
+    // Incremented whenever a buffer is removed from the registry of any
+    // adapter, which invalidates all the per-thread buffer caches
+    static std::atomic<uint64_t> sBufferGeneration;
 };
 
 } // namespace hardware
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_GRALLOC_1_ON_0_SHARDED_MAP_H
+#define ANDROID_HARDWARE_GRALLOC_1_ON_0_SHARDED_MAP_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace android {
+namespace hardware {
+
+// A map from keys to shared objects, split into independently locked
+// shards so that threads working on different keys rarely contend.
+template <typename Key, typename Value>
+class ShardedMap
+{
+public:
+    using Map = std::unordered_map<Key, std::shared_ptr<Value>>;
+
+    std::shared_ptr<Value> get(const Key& key) {
+        Shard& shard = getShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto iter = shard.map.find(key);
+        if (iter == shard.map.end()) {
+            return nullptr;
+        }
+        return iter->second;
+    }
+
+    void insert(const Key& key, std::shared_ptr<Value> value) {
+        Shard& shard = getShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.map.emplace(key, std::move(value));
+    }
+
+    // Returns false if key was not in the map
+    bool erase(const Key& key) {
+        Shard& shard = getShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.map.erase(key) != 0;
+    }
+
+    // Calls function with the shard holding key locked, and returns its
+    // result. function is passed the map of that shard.
+    template <typename Function>
+    auto withShard(const Key& key, Function&& function)
+            -> decltype(function(std::declval<Map&>())) {
+        Shard& shard = getShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return function(shard.map);
+    }
+
+private:
+    static constexpr size_t kNumShards = 16;
+
+    // Each shard sits on its own cache line
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        Map map;
+    };
+
+    Shard& getShard(const Key& key) {
+        return mShards[std::hash<Key>()(key) % kNumShards];
+    }
+
+    Shard mShards[kNumShards];
+};
+
+} // namespace hardware
+} // namespace android
+
+#endif // ANDROID_HARDWARE_GRALLOC_1_ON_0_SHARDED_MAP_H
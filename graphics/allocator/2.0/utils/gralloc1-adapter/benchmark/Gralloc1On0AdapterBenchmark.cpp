@@ -0,0 +1,191 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the lock/unlock throughput of Gralloc1On0Adapter when several
+// threads lock their own buffers concurrently, the way camera and video
+// pipelines do. The gralloc0 module underneath is a stub, so the numbers
+// reflect the cost of the adapter itself.
+
+#define LOG_TAG "Gralloc1On0AdapterBenchmark"
+
+#include "gralloc1-adapter.h"
+
+#include <benchmark/benchmark.h>
+#include <cutils/native_handle.h>
+#include <hardware/gralloc.h>
+#include <hardware/gralloc1.h>
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <vector>
+
+namespace {
+
+// Each thread cycles through the buffers of its own stream
+constexpr int kMaxThreads = 16;
+constexpr int kBuffersPerThread = 4;
+
+uint8_t gPixels[64];
+
+int stubPerform(const gralloc_module_t* /*module*/, int operation, ...) {
+    if (operation == GRALLOC1_ADAPTER_PERFORM_GET_REAL_MODULE_API_VERSION_MINOR) {
+        va_list args;
+        va_start(args, operation);
+        *va_arg(args, int*) = 0;
+        va_end(args);
+    }
+    return 0;
+}
+
+int stubRegisterBuffer(const gralloc_module_t* /*module*/, buffer_handle_t /*handle*/) {
+    return 0;
+}
+
+int stubUnregisterBuffer(const gralloc_module_t* /*module*/, buffer_handle_t /*handle*/) {
+    return 0;
+}
+
+int stubLock(const gralloc_module_t* /*module*/, buffer_handle_t /*handle*/, int /*usage*/,
+             int /*l*/, int /*t*/, int /*w*/, int /*h*/, void** vaddr) {
+    *vaddr = gPixels;
+    return 0;
+}
+
+int stubUnlock(const gralloc_module_t* /*module*/, buffer_handle_t /*handle*/) {
+    return 0;
+}
+
+int stubAlloc(alloc_device_t* /*dev*/, int /*w*/, int /*h*/, int /*format*/, int /*usage*/,
+              buffer_handle_t* /*handle*/, int* /*stride*/) {
+    return -ENOMEM;
+}
+
+int stubFree(alloc_device_t* /*dev*/, buffer_handle_t /*handle*/) {
+    return 0;
+}
+
+int stubCloseDevice(hw_device_t* device) {
+    delete reinterpret_cast<alloc_device_t*>(device);
+    return 0;
+}
+
+int stubOpen(const hw_module_t* module, const char* /*id*/, hw_device_t** device) {
+    auto* allocDevice = new alloc_device_t{};
+    allocDevice->common.module = const_cast<hw_module_t*>(module);
+    allocDevice->common.close = stubCloseDevice;
+    allocDevice->alloc = stubAlloc;
+    allocDevice->free = stubFree;
+    *device = &allocDevice->common;
+    return 0;
+}
+
+hw_module_methods_t gStubMethods = {stubOpen};
+
+struct Harness {
+    Harness() {
+        module.common.tag = HARDWARE_MODULE_TAG;
+        module.common.module_api_version = GRALLOC1_ADAPTER_MODULE_API_VERSION_1_0;
+        module.common.id = GRALLOC_HARDWARE_MODULE_ID;
+        module.common.methods = &gStubMethods;
+        module.registerBuffer = stubRegisterBuffer;
+        module.unregisterBuffer = stubUnregisterBuffer;
+        module.lock = stubLock;
+        module.unlock = stubUnlock;
+        module.perform = stubPerform;
+
+        hw_device_t* hwDevice = nullptr;
+        gralloc1_adapter_device_open(&module.common, GRALLOC_HARDWARE_MODULE_ID, &hwDevice);
+        device = reinterpret_cast<gralloc1_device_t*>(hwDevice);
+
+        auto retain = reinterpret_cast<GRALLOC1_PFN_RETAIN>(
+                device->getFunction(device, GRALLOC1_FUNCTION_RETAIN));
+        lock = reinterpret_cast<GRALLOC1_PFN_LOCK>(
+                device->getFunction(device, GRALLOC1_FUNCTION_LOCK));
+        unlock = reinterpret_cast<GRALLOC1_PFN_UNLOCK>(
+                device->getFunction(device, GRALLOC1_FUNCTION_UNLOCK));
+
+        for (int i = 0; i < kMaxThreads * kBuffersPerThread; i++) {
+            native_handle_t* handle = native_handle_create(0, 0);
+            retain(device, handle);
+            buffers.push_back(handle);
+        }
+    }
+
+    gralloc_module_t module{};
+    gralloc1_device_t* device = nullptr;
+    GRALLOC1_PFN_LOCK lock = nullptr;
+    GRALLOC1_PFN_UNLOCK unlock = nullptr;
+    std::vector<native_handle_t*> buffers;
+};
+
+// The adapter and its buffers live for the whole run, so that every thread
+// count measures the same steady state
+Harness& getHarness() {
+    static Harness* harness = new Harness();
+    return *harness;
+}
+
+}  // namespace
+
+static void BM_LockUnlock(benchmark::State& state) {
+    Harness& harness = getHarness();
+    gralloc1_device_t* device = harness.device;
+    const gralloc1_rect_t accessRegion = {0, 0, 4, 4};
+    const int firstBuffer = (state.thread_index % kMaxThreads) * kBuffersPerThread;
+
+    int next = 0;
+    for (auto _ : state) {
+        buffer_handle_t buffer = harness.buffers[firstBuffer + next];
+        next = (next + 1) % kBuffersPerThread;
+
+        void* data = nullptr;
+        int32_t releaseFence = -1;
+        if (harness.lock(device, buffer, GRALLOC1_PRODUCER_USAGE_CPU_WRITE,
+                         GRALLOC1_CONSUMER_USAGE_NONE, &accessRegion, &data, -1) !=
+                    GRALLOC1_ERROR_NONE ||
+            harness.unlock(device, buffer, &releaseFence) != GRALLOC1_ERROR_NONE) {
+            state.SkipWithError("lock/unlock failed");
+            break;
+        }
+        benchmark::DoNotOptimize(data);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LockUnlock)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+static void BM_GetStride(benchmark::State& state) {
+    Harness& harness = getHarness();
+    gralloc1_device_t* device = harness.device;
+    auto getStride = reinterpret_cast<GRALLOC1_PFN_GET_STRIDE>(
+            device->getFunction(device, GRALLOC1_FUNCTION_GET_STRIDE));
+    const int firstBuffer = (state.thread_index % kMaxThreads) * kBuffersPerThread;
+
+    int next = 0;
+    for (auto _ : state) {
+        uint32_t stride = 0;
+        getStride(device, harness.buffers[firstBuffer + next], &stride);
+        next = (next + 1) % kBuffersPerThread;
+        benchmark::DoNotOptimize(stride);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetStride)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+BENCHMARK_MAIN();
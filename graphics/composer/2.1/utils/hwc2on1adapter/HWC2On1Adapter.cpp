@@ -25,8 +25,10 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <sstream>
 
 #include <hardware/hwcomposer.h>
@@ -528,6 +530,12 @@ HWC2On1Adapter::Display::Display(HWC2On1Adapter& device, HWC2::DisplayType type)
     mHwc1LayerMap(),
     mNumAvailableRects(0),
     mNextAvailableRect(nullptr),
+    mHwc1LayerCapacity(0),
+    mHwc1RectCapacity(0),
+    mLayersChanged(true),
+    mNumContentsAllocations(0),
+    mNumLayersRewritten(0),
+    mNumLayersReused(0),
     mGeometryChanged(false)
     {}
 
@@ -562,7 +570,8 @@ Error HWC2On1Adapter::Display::acceptChanges() {
 Error HWC2On1Adapter::Display::createLayer(hwc2_layer_t* outLayerId) {
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
-    auto layer = *mLayers.emplace(std::make_shared<Layer>(*this));
+    auto layer = std::make_shared<Layer>(*this);
+    insertLayer(layer);
     mDevice.mLayers.emplace(std::make_pair(layer->getId(), layer));
     *outLayerId = layer->getId();
     ALOGV("[%" PRIu64 "] created layer %" PRIu64, mId, *outLayerId);
@@ -581,13 +590,7 @@ Error HWC2On1Adapter::Display::destroyLayer(hwc2_layer_t layerId) {
     }
     const auto layer = mapLayer->second;
     mDevice.mLayers.erase(mapLayer);
-    const auto zRange = mLayers.equal_range(layer);
-    for (auto current = zRange.first; current != zRange.second; ++current) {
-        if (**current == *layer) {
-            current = mLayers.erase(current);
-            break;
-        }
-    }
+    removeLayer(layer);
     ALOGV("[%" PRIu64 "] destroyed layer %" PRIu64, mId, layerId);
     markGeometryChanged();
     return Error::None;
@@ -1001,33 +1004,44 @@ Error HWC2On1Adapter::Display::updateLayerZ(hwc2_layer_t layerId, uint32_t z) {
     }
 
     const auto layer = mapLayer->second;
-    const auto zRange = mLayers.equal_range(layer);
-    bool layerOnDisplay = false;
-    for (auto current = zRange.first; current != zRange.second; ++current) {
-        if (**current == *layer) {
-            if ((*current)->getZ() == z) {
-                // Don't change anything if the Z hasn't changed
-                return Error::None;
-            }
-            current = mLayers.erase(current);
-            layerOnDisplay = true;
-            break;
-        }
+    if (layer->getZ() == z) {
+        // Don't change anything if the Z hasn't changed
+        return Error::None;
     }
 
-    if (!layerOnDisplay) {
+    if (!removeLayer(layer)) {
         ALOGE("[%" PRIu64 "] updateLayerZ failed to find layer on display",
                 mId);
         return Error::BadLayer;
     }
 
     layer->setZ(z);
-    mLayers.emplace(std::move(layer));
+    insertLayer(layer);
     markGeometryChanged();
 
     return Error::None;
 }
 
+void HWC2On1Adapter::Display::insertLayer(std::shared_ptr<Layer> layer) {
+    auto position = std::upper_bound(mLayers.begin(), mLayers.end(), layer,
+            SortLayersByZ());
+    mLayers.insert(position, std::move(layer));
+    mLayersChanged = true;
+}
+
+bool HWC2On1Adapter::Display::removeLayer(
+        const std::shared_ptr<Layer>& layer) {
+    auto zRange = std::equal_range(mLayers.begin(), mLayers.end(), layer,
+            SortLayersByZ());
+    auto current = std::find(zRange.first, zRange.second, layer);
+    if (current == zRange.second) {
+        return false;
+    }
+    mLayers.erase(current);
+    mLayersChanged = true;
+    return true;
+}
+
 Error HWC2On1Adapter::Display::getClientTargetSupport(uint32_t width, uint32_t height,
                                       int32_t format, int32_t dataspace){
     if (mActiveConfig == nullptr) {
@@ -1214,8 +1228,26 @@ bool HWC2On1Adapter::Display::prepare() {
         return false;
     }
 
-    allocateRequestedContents();
-    assignHwc1LayerIds();
+    // The layout of the contents, i.e. the slot of each layer and the place of
+    // its rects in the pool, is only rebuilt when it changed. Otherwise the
+    // layers whose state did not change keep what was written last frame.
+    bool relayout = allocateRequestedContents() || mLayersChanged;
+    for (auto it = mLayers.cbegin(); !relayout && it != mLayers.cend(); ++it) {
+        const auto& hwc1Layer =
+                mHwc1RequestedContents->hwLayers[(*it)->getHwc1Id()];
+        relayout = hwc1Layer.visibleRegionScreen.numRects !=
+                (*it)->getNumVisibleRegions();
+    }
+    if (relayout) {
+        // +1 is for framebuffer target layer.
+        memset(mHwc1RequestedContents->hwLayers, 0,
+                sizeof(hwc_layer_1_t) * (mLayers.size() + 1));
+        mNextAvailableRect = reinterpret_cast<hwc_rect_t*>(
+                &mHwc1RequestedContents->hwLayers[mHwc1LayerCapacity]);
+        mNumAvailableRects = mHwc1RectCapacity;
+        assignHwc1LayerIds();
+        mLayersChanged = false;
+    }
 
     mHwc1RequestedContents->retireFenceFd = -1;
     mHwc1RequestedContents->flags = 0;
@@ -1231,8 +1263,15 @@ bool HWC2On1Adapter::Display::prepare() {
         auto& hwc1Layer = mHwc1RequestedContents->hwLayers[layer->getHwc1Id()];
         hwc1Layer.releaseFenceFd = -1;
         hwc1Layer.acquireFenceFd = -1;
+        // HWC1 writes its hints during prepare()
+        hwc1Layer.hints = 0;
+        if (relayout || layer->hasStateChanged()) {
+            ++mNumLayersRewritten;
+        } else {
+            ++mNumLayersReused;
+        }
         ALOGV("Applying states for layer %" PRIu64 " ", layer->getId());
-        layer->applyState(hwc1Layer);
+        layer->applyState(hwc1Layer, relayout);
     }
 
     prepareFramebufferTarget();
@@ -1250,7 +1289,7 @@ void HWC2On1Adapter::Display::generateChanges() {
     size_t numLayers = mHwc1RequestedContents->numHwLayers;
     for (size_t hwc1Id = 0; hwc1Id < numLayers; ++hwc1Id) {
         const auto& receivedLayer = mHwc1RequestedContents->hwLayers[hwc1Id];
-        if (mHwc1LayerMap.count(hwc1Id) == 0) {
+        if (hwc1Id >= mHwc1LayerMap.size()) {
             ALOGE_IF(receivedLayer.compositionType != HWC_FRAMEBUFFER_TARGET,
                     "generateChanges: HWC1 layer %zd doesn't have a"
                     " matching HWC2 layer, and isn't the framebuffer target",
@@ -1317,7 +1356,7 @@ void HWC2On1Adapter::Display::addReleaseFences(
     size_t numLayers = hwcContents.numHwLayers;
     for (size_t hwc1Id = 0; hwc1Id < numLayers; ++hwc1Id) {
         const auto& receivedLayer = hwcContents.hwLayers[hwc1Id];
-        if (mHwc1LayerMap.count(hwc1Id) == 0) {
+        if (hwc1Id >= mHwc1LayerMap.size()) {
             if (receivedLayer.compositionType != HWC_FRAMEBUFFER_TARGET) {
                 ALOGE("addReleaseFences: HWC1 layer %zd doesn't have a"
                         " matching HWC2 layer, and isn't the framebuffer"
@@ -1550,6 +1589,11 @@ std::string HWC2On1Adapter::Display::dump() const {
         output << "    Output buffer: " << mOutputBuffer.getBuffer() << '\n';
     }
 
+    output << "    HWC1 contents: " << mNumContentsAllocations <<
+            " allocations, capacity " << mHwc1LayerCapacity << " layers/" <<
+            mHwc1RectCapacity << " rects, " << mNumLayersRewritten <<
+            " layers rewritten, " << mNumLayersReused << " reused\n";
+
     if (mHwc1RequestedContents) {
         output << "    Last requested HWC1 state\n";
         output << to_string(*mHwc1RequestedContents, mDevice.mHwc1MinorVersion);
@@ -1780,44 +1824,47 @@ void HWC2On1Adapter::Display::initializeActiveConfig() {
 
 }
 
-void HWC2On1Adapter::Display::allocateRequestedContents() {
+bool HWC2On1Adapter::Display::allocateRequestedContents() {
     // What needs to be allocated:
     // 1 hwc_display_contents_1_t
     // 1 hwc_layer_1_t for each layer
-    // 1 hwc_rect_t for each layer's surfaceDamage
     // 1 hwc_rect_t for each layer's visibleRegion
     // 1 hwc_layer_1_t for the framebuffer
     // 1 hwc_rect_t for the framebuffer's visibleRegion
 
-    // Count # of surfaceDamage
-    size_t numSurfaceDamages = 0;
-    for (const auto& layer : mLayers) {
-        numSurfaceDamages += layer->getNumSurfaceDamages();
-    }
-
     // Count # of visibleRegions (start at 1 for mandatory framebuffer target
     // region)
-    size_t numVisibleRegion = 1;
+    size_t numRects = 1;
     for (const auto& layer : mLayers) {
-        numVisibleRegion += layer->getNumVisibleRegions();
+        numRects += layer->getNumVisibleRegions();
     }
 
-    size_t numRects = numVisibleRegion + numSurfaceDamages;
     auto numLayers = mLayers.size() + 1;
+    if (mHwc1RequestedContents && numLayers <= mHwc1LayerCapacity &&
+            numRects <= mHwc1RectCapacity) {
+        return false;
+    }
+
+    // Leave some headroom so that a few more layers or rects do not cause a
+    // reallocation on the next frame.
+    mHwc1LayerCapacity = numLayers + numLayers / 2 + 4;
+    mHwc1RectCapacity = numRects + numRects / 2 + 16;
     size_t size = sizeof(hwc_display_contents_1_t) +
-            sizeof(hwc_layer_1_t) * numLayers +
-            sizeof(hwc_rect_t) * numRects;
+            sizeof(hwc_layer_1_t) * mHwc1LayerCapacity +
+            sizeof(hwc_rect_t) * mHwc1RectCapacity;
     auto contents = static_cast<hwc_display_contents_1_t*>(std::calloc(size, 1));
     mHwc1RequestedContents.reset(contents);
-    mNextAvailableRect = reinterpret_cast<hwc_rect_t*>(&contents->hwLayers[numLayers]);
-    mNumAvailableRects = numRects;
+    mNextAvailableRect = reinterpret_cast<hwc_rect_t*>(
+            &contents->hwLayers[mHwc1LayerCapacity]);
+    mNumAvailableRects = mHwc1RectCapacity;
+    ++mNumContentsAllocations;
+    return true;
 }
 
 void HWC2On1Adapter::Display::assignHwc1LayerIds() {
-    mHwc1LayerMap.clear();
+    mHwc1LayerMap = mLayers;
     size_t nextHwc1Id = 0;
     for (auto& layer : mLayers) {
-        mHwc1LayerMap[nextHwc1Id] = layer;
         layer->setHwc1Id(nextHwc1Id++);
     }
 }
@@ -1886,13 +1933,17 @@ void HWC2On1Adapter::Display::prepareFramebufferTarget() {
     hwc1Target.displayFrame = {0, 0, width, height};
     hwc1Target.planeAlpha = 255;
 
-    hwc1Target.visibleRegionScreen.numRects = 1;
-    hwc_rect_t* rects = GetRects(1);
+    // The rect is allocated when the contents are laid out and reused after
+    auto& hwc1TargetRegion = hwc1Target.visibleRegionScreen;
+    if (hwc1TargetRegion.rects == nullptr) {
+        hwc1TargetRegion.numRects = 1;
+        hwc1TargetRegion.rects = GetRects(1);
+    }
+    hwc_rect_t* rects = const_cast<hwc_rect_t*>(hwc1TargetRegion.rects);
     rects[0].left = 0;
     rects[0].top = 0;
     rects[0].right = width;
     rects[0].bottom = height;
-    hwc1Target.visibleRegionScreen.rects = rects;
 
     // We will set this to the correct value in set
     hwc1Target.acquireFenceFd = -1;
@@ -1919,7 +1970,8 @@ HWC2On1Adapter::Layer::Layer(Display& display)
     mZ(0),
     mReleaseFence(),
     mHwc1Id(0),
-    mHasUnsupportedPlaneAlpha(false) {}
+    mHasUnsupportedPlaneAlpha(false),
+    mStateChanged(true) {}
 
 bool HWC2On1Adapter::SortLayersByZ::operator()(const std::shared_ptr<Layer>& lhs,
                                                const std::shared_ptr<Layer>& rhs) const {
@@ -1963,19 +2015,19 @@ Error HWC2On1Adapter::Layer::setSurfaceDamage(hwc_region_t damage) {
 
 Error HWC2On1Adapter::Layer::setBlendMode(BlendMode mode) {
     mBlendMode = mode;
-    mDisplay.markGeometryChanged();
+    markStateChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setColor(hwc_color_t color) {
     mColor = color;
-    mDisplay.markGeometryChanged();
+    markStateChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setCompositionType(Composition type) {
     mCompositionType = type;
-    mDisplay.markGeometryChanged();
+    markStateChanged();
     return Error::None;
 }
 
@@ -1985,31 +2037,31 @@ Error HWC2On1Adapter::Layer::setDataspace(android_dataspace_t) {
 
 Error HWC2On1Adapter::Layer::setDisplayFrame(hwc_rect_t frame) {
     mDisplayFrame = frame;
-    mDisplay.markGeometryChanged();
+    markStateChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setPlaneAlpha(float alpha) {
     mPlaneAlpha = alpha;
-    mDisplay.markGeometryChanged();
+    markStateChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setSidebandStream(const native_handle_t* stream) {
     mSidebandStream = stream;
-    mDisplay.markGeometryChanged();
+    markStateChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setSourceCrop(hwc_frect_t crop) {
     mSourceCrop = crop;
-    mDisplay.markGeometryChanged();
+    markStateChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setTransform(Transform transform) {
     mTransform = transform;
-    mDisplay.markGeometryChanged();
+    markStateChanged();
     return Error::None;
 }
 
@@ -2026,7 +2078,7 @@ Error HWC2On1Adapter::Layer::setVisibleRegion(hwc_region_t visible) {
                     compareRects)) {
         mVisibleRegion.resize(visible.numRects);
         std::copy_n(visible.rects, visible.numRects, mVisibleRegion.begin());
-        mDisplay.markGeometryChanged();
+        markStateChanged();
     }
     return Error::None;
 }
@@ -2045,8 +2097,12 @@ const sp<MiniFence>& HWC2On1Adapter::Layer::getReleaseFence() const {
     return mReleaseFence.get();
 }
 
-void HWC2On1Adapter::Layer::applyState(hwc_layer_1_t& hwc1Layer) {
-    applyCommonState(hwc1Layer);
+void HWC2On1Adapter::Layer::applyState(hwc_layer_1_t& hwc1Layer,
+        bool applyAll) {
+    if (applyAll || mStateChanged) {
+        applyCommonState(hwc1Layer);
+        mStateChanged = false;
+    }
     applyCompositionType(hwc1Layer);
     switch (mCompositionType) {
         case Composition::SolidColor : applySolidColorState(hwc1Layer); break;
@@ -2151,10 +2207,14 @@ void HWC2On1Adapter::Layer::applyCommonState(hwc_layer_1_t& hwc1Layer) {
 
     hwc1Layer.transform = static_cast<uint32_t>(mTransform);
 
+    // The rects keep their place in the pool until the display lays out its
+    // contents again, which it does whenever their number changes.
     auto& hwc1VisibleRegion = hwc1Layer.visibleRegionScreen;
-    hwc1VisibleRegion.numRects = mVisibleRegion.size();
-    hwc_rect_t* rects = mDisplay.GetRects(hwc1VisibleRegion.numRects);
-    hwc1VisibleRegion.rects = rects;
+    if (hwc1VisibleRegion.rects == nullptr) {
+        hwc1VisibleRegion.numRects = mVisibleRegion.size();
+        hwc1VisibleRegion.rects = mDisplay.GetRects(hwc1VisibleRegion.numRects);
+    }
+    hwc_rect_t* rects = const_cast<hwc_rect_t*>(hwc1VisibleRegion.rects);
     for (size_t i = 0; i < mVisibleRegion.size(); i++) {
         rects[i] = mVisibleRegion[i];
     }
@@ -2330,21 +2390,25 @@ bool HWC2On1Adapter::prepareAllDisplays() {
 
     // Build an array of hwc_display_contents_1 to call prepare() on HWC1.
     mHwc1Contents.clear();
+    mHwc1ContentsDisplays.clear();
 
     // Always push the primary display
     auto primaryDisplayId = mHwc1DisplayMap[HWC_DISPLAY_PRIMARY];
     auto& primaryDisplay = mDisplays[primaryDisplayId];
     mHwc1Contents.push_back(primaryDisplay->getDisplayContents());
+    mHwc1ContentsDisplays.push_back(primaryDisplay);
 
     // Push the external display, if present
     if (mHwc1DisplayMap.count(HWC_DISPLAY_EXTERNAL) != 0) {
         auto externalDisplayId = mHwc1DisplayMap[HWC_DISPLAY_EXTERNAL];
         auto& externalDisplay = mDisplays[externalDisplayId];
         mHwc1Contents.push_back(externalDisplay->getDisplayContents());
+        mHwc1ContentsDisplays.push_back(externalDisplay);
     } else {
         // Even if an external display isn't present, we still need to send
         // at least two displays down to HWC1
         mHwc1Contents.push_back(nullptr);
+        mHwc1ContentsDisplays.push_back(nullptr);
     }
 
     // Push the hardware virtual display, if supported and present
@@ -2353,8 +2417,10 @@ bool HWC2On1Adapter::prepareAllDisplays() {
             auto virtualDisplayId = mHwc1DisplayMap[HWC_DISPLAY_VIRTUAL];
             auto& virtualDisplay = mDisplays[virtualDisplayId];
             mHwc1Contents.push_back(virtualDisplay->getDisplayContents());
+            mHwc1ContentsDisplays.push_back(virtualDisplay);
         } else {
             mHwc1Contents.push_back(nullptr);
+            mHwc1ContentsDisplays.push_back(nullptr);
         }
     }
 
@@ -2370,6 +2436,11 @@ bool HWC2On1Adapter::prepareAllDisplays() {
         }
     }
 
+    // Call HWC1 without the state lock held, so that vsync and hotplug events
+    // are not held up while it runs. The displays being prepared are kept
+    // alive by mHwc1ContentsDisplays, which is only used from this thread.
+    lock.unlock();
+
     ALOGV("Calling HWC1 prepare");
     {
         ATRACE_NAME("HWC1 prepare");
@@ -2394,9 +2465,7 @@ bool HWC2On1Adapter::prepareAllDisplays() {
             continue;
         }
 
-        auto displayId = mHwc1DisplayMap[hwc1Id];
-        auto& display = mDisplays[displayId];
-        display->generateChanges();
+        mHwc1ContentsDisplays[hwc1Id]->generateChanges();
     }
 
     return true;
@@ -2490,8 +2559,7 @@ Error HWC2On1Adapter::setAllDisplays() {
             continue;
         }
 
-        auto displayId = mHwc1DisplayMap[hwc1Id];
-        auto& display = mDisplays[displayId];
+        auto& display = mHwc1ContentsDisplays[hwc1Id];
         Error error = display->set(*mHwc1Contents[hwc1Id]);
         if (error != Error::None) {
             ALOGE("setAllDisplays: Failed to set display %zd: %s", hwc1Id,
@@ -2500,6 +2568,9 @@ Error HWC2On1Adapter::setAllDisplays() {
         }
     }
 
+    // Call HWC1 without the state lock held, see prepareAllDisplays
+    lock.unlock();
+
     ALOGV("Calling HWC1 set");
     {
         ATRACE_NAME("HWC1 set");
@@ -2514,8 +2585,7 @@ Error HWC2On1Adapter::setAllDisplays() {
             continue;
         }
 
-        auto displayId = mHwc1DisplayMap[hwc1Id];
-        auto& display = mDisplays[displayId];
+        auto& display = mHwc1ContentsDisplays[hwc1Id];
         auto retireFenceFd = mHwc1Contents[hwc1Id]->retireFenceFd;
         ALOGV("setAllDisplays: Adding retire fence %d to display %zd",
                 retireFenceFd, hwc1Id);
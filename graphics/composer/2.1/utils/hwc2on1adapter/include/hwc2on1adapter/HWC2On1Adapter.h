@@ -408,13 +408,15 @@ private:
             // which require locking.
             mutable std::recursive_mutex mStateMutex;
 
-            // Allocate RAM able to store all layers and rects used for
-            // communication with HWC1. Place allocated RAM in variable
-            // mHwc1RequestedContents.
-            void allocateRequestedContents();
+            // Make sure mHwc1RequestedContents is able to store all layers and
+            // rects used for communication with HWC1. It is only reallocated,
+            // with some headroom, when it is too small. Returns true if it was
+            // reallocated.
+            bool allocateRequestedContents();
 
             // Array of structs exchanged between client and hwc1 device.
-            // Sent to device upon calling prepare().
+            // Sent to device upon calling prepare(). It persists across frames
+            // so that only the layers that changed need to be rewritten.
             std::unique_ptr<hwc_display_contents_1> mHwc1RequestedContents;
     private:
             DeferredFence mRetireFence;
@@ -442,18 +444,38 @@ private:
 
             bool mHasColorTransform;
 
-            // All layers this Display is aware of.
-            std::multiset<std::shared_ptr<Layer>, SortLayersByZ> mLayers;
+            // All layers this Display is aware of, sorted by Z. Layers with
+            // the same Z keep their insertion order.
+            std::vector<std::shared_ptr<Layer>> mLayers;
+
+            // Inserts the layer into mLayers according to its Z, or removes
+            // it. Return false if the layer is not on this display.
+            void insertLayer(std::shared_ptr<Layer> layer);
+            bool removeLayer(const std::shared_ptr<Layer>& layer);
 
             // Mapping between layer index in array of hwc_display_contents_1*
             // passed to HWC1 during validate/set and Layer object.
-            std::unordered_map<size_t, std::shared_ptr<Layer>> mHwc1LayerMap;
+            std::vector<std::shared_ptr<Layer>> mHwc1LayerMap;
 
             // All communication with HWC1 via prepare/set is done with one
             // alloc. This pointer is pointing to a pool of hwc_rect_t.
             size_t mNumAvailableRects;
             hwc_rect_t* mNextAvailableRect;
 
+            // Number of layers and rects mHwc1RequestedContents can store.
+            size_t mHwc1LayerCapacity;
+            size_t mHwc1RectCapacity;
+
+            // True if layers were added, removed or reordered since the last
+            // call to prepare(), in which case the layout of
+            // mHwc1RequestedContents is rebuilt.
+            bool mLayersChanged;
+
+            // Statistics about the reuse of mHwc1RequestedContents, for dump.
+            uint64_t mNumContentsAllocations;
+            uint64_t mNumLayersRewritten;
+            uint64_t mNumLayersReused;
+
             // True if any of the Layers contained in this Display have been
             // updated with anything other than a buffer since last call to
             // Display::set()
@@ -560,8 +582,12 @@ private:
             void setHwc1Id(size_t id) { mHwc1Id = id; }
             size_t getHwc1Id() const { return mHwc1Id; }
 
-            // Write state to HWC1 communication struct.
-            void applyState(struct hwc_layer_1& hwc1Layer);
+            // Write state to HWC1 communication struct. The state that only
+            // changes with the geometry is skipped unless applyAll is set or
+            // it changed since the last call.
+            void applyState(struct hwc_layer_1& hwc1Layer, bool applyAll);
+
+            bool hasStateChanged() const { return mStateChanged; }
 
             std::string dump() const;
 
@@ -576,6 +602,12 @@ private:
                         !mDisplay.getDevice().supportsBackgroundColor());
             }
         private:
+            // Called by the setters of the state stored in the HWC1 layer.
+            void markStateChanged() {
+                mStateChanged = true;
+                mDisplay.markGeometryChanged();
+            }
+
             void applyCommonState(struct hwc_layer_1& hwc1Layer);
             void applySolidColorState(struct hwc_layer_1& hwc1Layer);
             void applySidebandState(struct hwc_layer_1& hwc1Layer);
@@ -605,6 +637,10 @@ private:
 
             size_t mHwc1Id;
             bool mHasUnsupportedPlaneAlpha;
+
+            // True if the state written by applyCommonState changed since it
+            // was last written.
+            bool mStateChanged;
     };
 
     // Utility tempate calling a Layer object method based on ID parameters:
@@ -677,6 +713,9 @@ private:
 
     bool prepareAllDisplays();
     std::vector<struct hwc_display_contents_1*> mHwc1Contents;
+    // Displays owning the entries of mHwc1Contents. Holding references to them
+    // allows calling into HWC1 without the state lock held.
+    std::vector<std::shared_ptr<Display>> mHwc1ContentsDisplays;
     HWC2::Error setAllDisplays();
 
     // Callbacks
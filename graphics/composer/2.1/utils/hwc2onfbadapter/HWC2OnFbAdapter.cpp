@@ -24,6 +24,9 @@
 #include <type_traits>
 
 #include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include <sys/prctl.h>
 #include <unistd.h> // for close
@@ -38,6 +41,47 @@ namespace android {
 
 namespace {
 
+// software vsync runs at native refresh rate divided by up to this
+constexpr uint32_t kMaxRefreshDivisor = 4;
+// but no slower than this
+constexpr float kMinRefreshRate = 20.0f;
+
+// samples needed before the vsync model is trusted
+constexpr uint32_t kMinLockSamples = 8;
+// the weight of a new sample in the mean phase error is 1/kErrorSmoothing
+constexpr int64_t kErrorSmoothing = 8;
+// a sample further than period/kOutlierFraction from a vsync is ignored
+constexpr int64_t kOutlierFraction = 4;
+// the model is locked while the mean phase error is below period/kLockFraction
+constexpr int64_t kLockFraction = 16;
+// the estimated period stays within nominal period +/- 1/kMaxDriftFraction
+constexpr int64_t kMaxDriftFraction = 50;
+
+int64_t floorDiv(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && a < 0) ? q - 1 : q;
+}
+
+int64_t ceilDiv(int64_t a, int64_t b) {
+    return -floorDiv(-a, b);
+}
+
+double toMs(int64_t ns) {
+    return double(ns) / 1e6;
+}
+
+void appendFormat(std::string& result, const char* format, ...)
+        __attribute__((format(printf, 2, 3)));
+
+void appendFormat(std::string& result, const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    result += buffer;
+}
+
 void dumpHook(hwc2_device_t* device, uint32_t* outSize, char* outBuffer) {
     auto& adapter = HWC2OnFbAdapter::cast(device);
     if (outBuffer) {
@@ -244,12 +288,12 @@ int32_t getDisplayConfigsHook(hwc2_device_t* device, hwc2_display_t display,
     }
 
     if (outConfigs) {
-        if (*outNumConfigs > 0) {
-            outConfigs[0] = adapter.getConfigId();
-            *outNumConfigs = 1;
+        *outNumConfigs = std::min(*outNumConfigs, adapter.getNumConfigs());
+        for (uint32_t i = 0; i < *outNumConfigs; i++) {
+            outConfigs[i] = adapter.getConfigId() + i;
         }
     } else {
-        *outNumConfigs = 1;
+        *outNumConfigs = adapter.getNumConfigs();
     }
 
     return HWC2_ERROR_NONE;
@@ -261,7 +305,7 @@ int32_t getDisplayAttributeHook(hwc2_device_t* device, hwc2_display_t display, h
     if (adapter.getDisplayId() != display) {
         return HWC2_ERROR_BAD_DISPLAY;
     }
-    if (adapter.getConfigId() != config) {
+    if (!adapter.hasConfig(config)) {
         return HWC2_ERROR_BAD_CONFIG;
     }
 
@@ -274,7 +318,7 @@ int32_t getDisplayAttributeHook(hwc2_device_t* device, hwc2_display_t display, h
             *outValue = int32_t(info.height);
             break;
         case HWC2_ATTRIBUTE_VSYNC_PERIOD:
-            *outValue = int32_t(info.vsync_period_ns);
+            *outValue = int32_t(adapter.getVsyncPeriod(config));
             break;
         case HWC2_ATTRIBUTE_DPI_X:
             *outValue = int32_t(info.xdpi_scaled);
@@ -296,7 +340,7 @@ int32_t getActiveConfigHook(hwc2_device_t* device, hwc2_display_t display,
         return HWC2_ERROR_BAD_DISPLAY;
     }
 
-    *outConfig = adapter.getConfigId();
+    *outConfig = adapter.getActiveConfig();
     return HWC2_ERROR_NONE;
 }
 
@@ -305,10 +349,11 @@ int32_t setActiveConfigHook(hwc2_device_t* device, hwc2_display_t display, hwc2_
     if (adapter.getDisplayId() != display) {
         return HWC2_ERROR_BAD_DISPLAY;
     }
-    if (adapter.getConfigId() != config) {
+    if (!adapter.hasConfig(config)) {
         return HWC2_ERROR_BAD_CONFIG;
     }
 
+    adapter.setActiveConfig(config);
     return HWC2_ERROR_NONE;
 }
 
@@ -663,7 +708,16 @@ HWC2OnFbAdapter::HWC2OnFbAdapter(framebuffer_device_t* fbDevice)
     // for FB devices
     mCapabilities.insert(Capability::PresentFenceIsNotReliable);
 
-    mVsyncThread.start(0, mFbInfo.vsync_period_ns);
+    mRefreshDivisors.push_back(1);
+    for (uint32_t divisor = 2; divisor <= kMaxRefreshDivisor; divisor++) {
+        if (mFbDevice->fps / divisor < kMinRefreshRate) {
+            break;
+        }
+        mRefreshDivisors.push_back(divisor);
+    }
+
+    mVsyncModel.reset(mFbInfo.vsync_period_ns);
+    mVsyncThread.start(&mVsyncModel, mRefreshDivisors[mActiveConfig - getConfigId()]);
 }
 
 HWC2OnFbAdapter& HWC2OnFbAdapter::cast(hw_device_t* device) {
@@ -691,14 +745,48 @@ const HWC2OnFbAdapter::Info& HWC2OnFbAdapter::getInfo() const {
     return mFbInfo;
 }
 
+uint32_t HWC2OnFbAdapter::getNumConfigs() const {
+    return uint32_t(mRefreshDivisors.size());
+}
+
+bool HWC2OnFbAdapter::hasConfig(hwc2_config_t config) const {
+    return config >= getConfigId() && config - getConfigId() < getNumConfigs();
+}
+
+int64_t HWC2OnFbAdapter::getVsyncPeriod(hwc2_config_t config) const {
+    return int64_t(mFbInfo.vsync_period_ns) * mRefreshDivisors[config - getConfigId()];
+}
+
+hwc2_config_t HWC2OnFbAdapter::getActiveConfig() const {
+    return mActiveConfig;
+}
+
+void HWC2OnFbAdapter::setActiveConfig(hwc2_config_t config) {
+    mActiveConfig = config;
+    mVsyncThread.setDivisor(mRefreshDivisors[config - getConfigId()]);
+}
+
 void HWC2OnFbAdapter::updateDebugString() {
+    mDebugString.clear();
     if (mFbDevice->common.version >= 1 && mFbDevice->dump) {
         char buffer[4096];
         mFbDevice->dump(mFbDevice, buffer, sizeof(buffer));
         buffer[sizeof(buffer) - 1] = '\0';
 
         mDebugString = buffer;
+        if (!mDebugString.empty() && mDebugString.back() != '\n') {
+            mDebugString += '\n';
+        }
     }
+
+    appendFormat(mDebugString, "HWC2OnFbAdapter:\n");
+    for (uint32_t i = 0; i < getNumConfigs(); i++) {
+        hwc2_config_t config = getConfigId() + i;
+        appendFormat(mDebugString, "  config %u: %.3f ms%s\n", config,
+                     toMs(getVsyncPeriod(config)), config == mActiveConfig ? " (active)" : "");
+    }
+    mVsyncModel.dump(mDebugString);
+    dumpPresentStats(mDebugString);
 }
 
 const std::string& HWC2OnFbAdapter::getDebugString() const {
@@ -782,14 +870,86 @@ void HWC2OnFbAdapter::setBuffer(buffer_handle_t buffer) {
 }
 
 bool HWC2OnFbAdapter::postBuffer() {
-    int error = 0;
-    if (mBuffer) {
-        error = mFbDevice->post(mFbDevice, mBuffer);
+    if (!mBuffer) {
+        return true;
+    }
+
+    const int64_t presentTime = VsyncThread::now();
+    const int64_t expectedVsync = mVsyncModel.nextVsync(presentTime, 1);
+
+    int error = mFbDevice->post(mFbDevice, mBuffer);
+
+    const int64_t postTime = VsyncThread::now();
+    if (error == 0) {
+        mVsyncModel.addSample(postTime);
     }
 
+    // When post blocks until the flip, which is what a locked model tells
+    // us, the frame landed on the vsync nearest to the time post returned.
+    // Otherwise it is scanned out on the next vsync at the earliest.
+    const int64_t landedVsync = mVsyncModel.isLocked() ? mVsyncModel.nearestVsync(postTime)
+                                                       : mVsyncModel.nextVsync(postTime, 1);
+    recordPresent(presentTime, postTime, expectedVsync, landedVsync, error == 0);
+
     return error == 0;
 }
 
+void HWC2OnFbAdapter::recordPresent(int64_t presentTime, int64_t postTime,
+                                    int64_t expectedVsync, int64_t landedVsync, bool posted) {
+    const int64_t period = mVsyncModel.getPeriod();
+
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    PresentStats& stats = mPresentStats;
+    if (!posted) {
+        stats.postErrors++;
+        return;
+    }
+
+    const int64_t missedVsyncs = floorDiv(landedVsync - expectedVsync + period / 2, period);
+    if (missedVsyncs > 0) {
+        stats.missedFrames++;
+        stats.missedVsyncs += uint64_t(missedVsyncs);
+        ALOGV("frame presented at %" PRId64 " missed %" PRId64 " vsync(s)", presentTime,
+              missedVsyncs);
+    }
+
+    const int64_t latency = std::max(landedVsync - presentTime, int64_t(0));
+    const int64_t bucket = std::min(latency / period, int64_t(4));
+    stats.latencyHistogram[bucket]++;
+    stats.latencyMin = stats.frames == 0 ? latency : std::min(stats.latencyMin, latency);
+    stats.latencyMax = std::max(stats.latencyMax, latency);
+    stats.latencySum += latency;
+
+    const int64_t postDuration = postTime - presentTime;
+    stats.postDurationMax = std::max(stats.postDurationMax, postDuration);
+    stats.postDurationSum += postDuration;
+
+    stats.frames++;
+}
+
+void HWC2OnFbAdapter::dumpPresentStats(std::string& result) const {
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    const PresentStats& stats = mPresentStats;
+    appendFormat(result,
+                 "  presented frames: %" PRIu64 ", missed: %" PRIu64 " (%" PRIu64
+                 " vsyncs), post errors: %" PRIu64 "\n",
+                 stats.frames, stats.missedFrames, stats.missedVsyncs, stats.postErrors);
+    if (stats.frames == 0) {
+        return;
+    }
+
+    appendFormat(result, "  present latency: min %.3f ms, avg %.3f ms, max %.3f ms\n",
+                 toMs(stats.latencyMin), toMs(stats.latencySum / int64_t(stats.frames)),
+                 toMs(stats.latencyMax));
+    appendFormat(result,
+                 "  present latency in vsyncs: <1: %" PRIu64 ", <2: %" PRIu64 ", <3: %" PRIu64
+                 ", <4: %" PRIu64 ", >=4: %" PRIu64 "\n",
+                 stats.latencyHistogram[0], stats.latencyHistogram[1], stats.latencyHistogram[2],
+                 stats.latencyHistogram[3], stats.latencyHistogram[4]);
+    appendFormat(result, "  post duration: avg %.3f ms, max %.3f ms\n",
+                 toMs(stats.postDurationSum / int64_t(stats.frames)), toMs(stats.postDurationMax));
+}
+
 void HWC2OnFbAdapter::setVsyncCallback(HWC2_PFN_VSYNC callback, hwc2_callback_data_t data) {
     mVsyncThread.setCallback(callback, data);
 }
@@ -815,6 +975,113 @@ void HWC2OnFbAdapter::getCapabilities(uint32_t* outCount,
     }
 }
 
+void HWC2OnFbAdapter::VsyncModel::reset(int64_t period) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mNominalPeriod = period;
+    mPeriod = period;
+    mReference = 0;
+    mReferenceIndex = 0;
+    mMeanError = 0;
+    mNumSamples = 0;
+    mNumOutliers = 0;
+    mNumResyncs = 0;
+}
+
+void HWC2OnFbAdapter::VsyncModel::addSample(int64_t timestamp) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mNumSamples == 0) {
+        mReference = timestamp;
+        mReferenceIndex = floorDiv(timestamp + mPeriod / 2, mPeriod);
+        mMeanError = mPeriod / kOutlierFraction;
+        mNumSamples = 1;
+        return;
+    }
+
+    const int64_t n = floorDiv(timestamp - mReference + mPeriod / 2, mPeriod);
+    const int64_t error = timestamp - mReference - n * mPeriod;
+    mMeanError += (std::abs(error) - mMeanError) / kErrorSmoothing;
+
+    if (std::abs(error) > mPeriod / kOutlierFraction) {
+        mNumOutliers++;
+        // Once unlocked, follow the samples to acquire the phase again.
+        if (!isLockedLocked()) {
+            mReference = timestamp;
+            mReferenceIndex += n;
+            mNumResyncs++;
+        }
+        return;
+    }
+
+    if (mNumSamples < kMinLockSamples) {
+        mNumSamples++;
+    }
+    if (n <= 0) {
+        return;
+    }
+
+    // Move the phase part of the way towards the sample, and attribute the
+    // error accumulated over the elapsed periods to the period.
+    mReference += n * mPeriod + error / 4;
+    mReferenceIndex += n;
+    mPeriod += error / (n * 8);
+    mPeriod = std::max(mPeriod, mNominalPeriod - mNominalPeriod / kMaxDriftFraction);
+    mPeriod = std::min(mPeriod, mNominalPeriod + mNominalPeriod / kMaxDriftFraction);
+}
+
+int64_t HWC2OnFbAdapter::VsyncModel::nextVsync(int64_t t, uint32_t divisor) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    // Without a lock, run a free clock at the nominal period.
+    const bool locked = isLockedLocked();
+    const int64_t reference = locked ? mReference : 0;
+    const int64_t referenceIndex = locked ? mReferenceIndex : 0;
+    const int64_t period = locked ? mPeriod : mNominalPeriod;
+
+    // Indices are kept across samples so that divided refresh rates stay on
+    // the same vsyncs.
+    int64_t index = referenceIndex + ceilDiv(t - reference, period);
+    index = ceilDiv(index, divisor) * divisor;
+    return reference + (index - referenceIndex) * period;
+}
+
+int64_t HWC2OnFbAdapter::VsyncModel::nearestVsync(int64_t t) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    const bool locked = isLockedLocked();
+    const int64_t reference = locked ? mReference : 0;
+    const int64_t period = locked ? mPeriod : mNominalPeriod;
+
+    return reference + floorDiv(t - reference + period / 2, period) * period;
+}
+
+bool HWC2OnFbAdapter::VsyncModel::isLocked() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return isLockedLocked();
+}
+
+bool HWC2OnFbAdapter::VsyncModel::isLockedLocked() const {
+    return mNumSamples >= kMinLockSamples && mMeanError < mPeriod / kLockFraction;
+}
+
+int64_t HWC2OnFbAdapter::VsyncModel::getPeriod() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return isLockedLocked() ? mPeriod : mNominalPeriod;
+}
+
+void HWC2OnFbAdapter::VsyncModel::dump(std::string& result) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    const bool locked = isLockedLocked();
+    appendFormat(result, "  vsync model: %s, period %.3f ms (nominal %.3f ms)",
+                 locked ? "locked" : "free running", toMs(locked ? mPeriod : mNominalPeriod),
+                 toMs(mNominalPeriod));
+    if (locked) {
+        const int64_t phase = mReference - floorDiv(mReference, mPeriod) * mPeriod;
+        appendFormat(result, ", phase %.3f ms", toMs(phase));
+    }
+    appendFormat(result,
+                 "\n  vsync samples: mean error %.3f ms, outliers %" PRIu64 ", resyncs %" PRIu64
+                 "\n",
+                 toMs(mMeanError), mNumOutliers, mNumResyncs);
+}
+
 int64_t HWC2OnFbAdapter::VsyncThread::now() {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -840,9 +1107,9 @@ bool HWC2OnFbAdapter::VsyncThread::sleepUntil(int64_t t) {
     }
 }
 
-void HWC2OnFbAdapter::VsyncThread::start(int64_t firstVsync, int64_t period) {
-    mNextVsync = firstVsync;
-    mPeriod = period;
+void HWC2OnFbAdapter::VsyncThread::start(const VsyncModel* model, uint32_t divisor) {
+    mModel = model;
+    mDivisor = divisor;
     mStarted = true;
     mThread = std::thread(&VsyncThread::vsyncLoop, this);
 }
@@ -870,6 +1137,11 @@ void HWC2OnFbAdapter::VsyncThread::enableCallback(bool enable) {
     mCondition.notify_all();
 }
 
+void HWC2OnFbAdapter::VsyncThread::setDivisor(uint32_t divisor) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDivisor = divisor;
+}
+
 void HWC2OnFbAdapter::VsyncThread::vsyncLoop() {
     prctl(PR_SET_NAME, "VsyncThread", 0, 0, 0);
 
@@ -886,24 +1158,22 @@ void HWC2OnFbAdapter::VsyncThread::vsyncLoop() {
             }
         }
 
+        const uint32_t divisor = mDivisor;
         lock.unlock();
 
-        // adjust mNextVsync if necessary
-        int64_t t = now();
-        if (mNextVsync < t) {
-            int64_t n = (t - mNextVsync + mPeriod - 1) / mPeriod;
-            mNextVsync += mPeriod * n;
-        }
-        bool fire = sleepUntil(mNextVsync);
+        // the model may shift its phase; never report a vsync twice
+        int64_t t = std::max(now(), mLastVsync + mModel->getPeriod() / 2);
+        int64_t nextVsync = mModel->nextVsync(t, divisor);
+        bool fire = sleepUntil(nextVsync);
 
         lock.lock();
 
         if (fire) {
-            ALOGV("VsyncThread(%" PRId64 ")", mNextVsync);
+            ALOGV("VsyncThread(%" PRId64 ")", nextVsync);
             if (mCallback) {
-                mCallback(mCallbackData, getDisplayId(), mNextVsync);
+                mCallback(mCallbackData, getDisplayId(), nextVsync);
             }
-            mNextVsync += mPeriod;
+            mLastVsync = nextVsync;
         }
     }
 }
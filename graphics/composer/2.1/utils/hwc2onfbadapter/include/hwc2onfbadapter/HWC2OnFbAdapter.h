@@ -22,6 +22,7 @@
 #include <string>
 #include <thread>
 #include <unordered_set>
+#include <vector>
 
 #define HWC2_INCLUDE_STRINGIFICATION
 #define HWC2_USE_CPP11
@@ -41,6 +42,7 @@ public:
     static HWC2OnFbAdapter& cast(hwc2_device_t* device);
 
     static hwc2_display_t getDisplayId();
+    // the config running at the native refresh rate of the framebuffer
     static hwc2_config_t getConfigId();
 
     void close();
@@ -56,6 +58,14 @@ public:
     };
     const Info& getInfo() const;
 
+    // Besides the native refresh rate, the software vsync can run at integer
+    // divisors of it.  Each divisor is exposed as a config.
+    uint32_t getNumConfigs() const;
+    bool hasConfig(hwc2_config_t config) const;
+    int64_t getVsyncPeriod(hwc2_config_t config) const;
+    hwc2_config_t getActiveConfig() const;
+    void setActiveConfig(hwc2_config_t config);
+
     void updateDebugString();
     const std::string& getDebugString() const;
 
@@ -97,23 +107,87 @@ private:
 
     std::unordered_set<HWC2::Capability> mCapabilities;
 
+    std::vector<uint32_t> mRefreshDivisors;
+    hwc2_config_t mActiveConfig{0};
+
+    /*
+     * Estimates the phase and period of the hardware vsync from the times
+     * post returns.  Framebuffer HALs usually block in post until the flip
+     * happens, so those times cluster around the hardware vsync.  The model
+     * locks once the samples are consistent and corrects the period for the
+     * drift between the reported and the actual refresh rate.  When post
+     * does not block, the model never locks and predictions follow a free
+     * running clock at the nominal period, as before.
+     */
+    class VsyncModel {
+    public:
+        void reset(int64_t period);
+        void addSample(int64_t timestamp);
+
+        // the first vsync at or after t, on a multiple of divisor periods
+        int64_t nextVsync(int64_t t, uint32_t divisor) const;
+        // the vsync nearest to t
+        int64_t nearestVsync(int64_t t) const;
+
+        bool isLocked() const;
+        int64_t getPeriod() const;
+        void dump(std::string& result) const;
+
+    private:
+        bool isLockedLocked() const;
+
+        mutable std::mutex mMutex;
+        int64_t mNominalPeriod{0};
+        int64_t mPeriod{0};
+        // time and index of a vsync the samples are measured against
+        int64_t mReference{0};
+        int64_t mReferenceIndex{0};
+        // moving average of the absolute phase error of the samples
+        int64_t mMeanError{0};
+        uint32_t mNumSamples{0};
+        uint64_t mNumOutliers{0};
+        uint64_t mNumResyncs{0};
+    };
+    VsyncModel mVsyncModel;
+
+    struct PresentStats {
+        uint64_t frames{0};
+        uint64_t missedFrames{0};
+        uint64_t missedVsyncs{0};
+        uint64_t postErrors{0};
+        // present latency, from presentDisplay to the vsync the frame
+        // landed on, in whole vsync periods: <1, <2, <3, <4, >=4
+        uint64_t latencyHistogram[5]{};
+        int64_t latencyMin{0};
+        int64_t latencyMax{0};
+        int64_t latencySum{0};
+        int64_t postDurationMax{0};
+        int64_t postDurationSum{0};
+    };
+    void recordPresent(int64_t presentTime, int64_t postTime, int64_t expectedVsync,
+                       int64_t landedVsync, bool posted);
+    void dumpPresentStats(std::string& result) const;
+
+    mutable std::mutex mStatsMutex;
+    PresentStats mPresentStats;
+
     class VsyncThread {
     public:
         static int64_t now();
         static bool sleepUntil(int64_t t);
 
-        void start(int64_t first, int64_t period);
+        void start(const VsyncModel* model, uint32_t divisor);
         void stop();
         void setCallback(HWC2_PFN_VSYNC callback, hwc2_callback_data_t data);
         void enableCallback(bool enable);
+        void setDivisor(uint32_t divisor);
 
     private:
         void vsyncLoop();
-        bool waitUntilNextVsync();
 
         std::thread mThread;
-        int64_t mNextVsync{0};
-        int64_t mPeriod{0};
+        const VsyncModel* mModel{nullptr};
+        int64_t mLastVsync{0};
 
         std::mutex mMutex;
         std::condition_variable mCondition;
@@ -121,6 +195,7 @@ private:
         HWC2_PFN_VSYNC mCallback{nullptr};
         hwc2_callback_data_t mCallbackData{nullptr};
         bool mCallbackEnabled{false};
+        uint32_t mDivisor{1};
     };
     VsyncThread mVsyncThread;
 };
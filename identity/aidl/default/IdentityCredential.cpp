@@ -29,6 +29,7 @@
 
 #include <cppbor.h>
 #include <cppbor_parse.h>
+#include <cppbor_view.h>
 
 namespace aidl::android::hardware::identity {
 
@@ -100,6 +101,13 @@ int IdentityCredential::initialize() {
     storageKey_ = storageKeyItem->value();
     credentialPrivKey_ = credentialPrivKeyItem->value();
 
+    // Entries and the signing key are all encrypted with the storage key, so
+    // set up its cipher context once for the lifetime of the credential.
+    if (!storageKeyDecryptor_.init(storageKey_)) {
+        LOG(ERROR) << "Error setting up decryption with storageKey";
+        return IIdentityCredentialStore::STATUS_INVALID_DATA;
+    }
+
     return IIdentityCredentialStore::STATUS_OK;
 }
 
@@ -496,9 +504,6 @@ ndk::ScopedAStatus IdentityCredential::startRetrieval(
         profileIdToAccessCheckResult_[profile.id] = accessControlCheck;
     }
 
-    deviceNameSpacesMap_ = cppbor::Map();
-    currentNameSpaceDeviceNameSpacesMap_ = cppbor::Map();
-
     requestCountsRemaining_ = requestCounts;
     currentNameSpace_ = "";
 
@@ -508,6 +513,22 @@ ndk::ScopedAStatus IdentityCredential::startRetrieval(
     // Finally, calculate the size of DeviceNameSpaces. We need to know it ahead of time.
     expectedDeviceNameSpacesSize_ = calcDeviceNameSpacesSize();
 
+    // DeviceNameSpaces is encoded as entries are retrieved, starting with the
+    // header of the map of name spaces.
+    encodedDeviceNameSpaces_.clear();
+    encodedDeviceNameSpaces_.reserve(expectedDeviceNameSpacesSize_);
+    deviceNameSpacesMatchRequest_ = true;
+    numNameSpacesEncoded_ = 0;
+    currentNameSpaceEncoded_ = false;
+    cppbor::encodeHeader(cppbor::MAP, expectedNumNameSpaces_,
+                         std::back_inserter(encodedDeviceNameSpaces_));
+
+    ndk::ScopedAStatus macStatus = startDeviceAuthenticationMac();
+    if (!macStatus.isOk()) {
+        return macStatus;
+    }
+    appendToDeviceNameSpaces(0);
+
     numStartRetrievalCalls_ += 1;
     return ndk::ScopedAStatus::ok();
 }
@@ -549,6 +570,7 @@ size_t IdentityCredential::calcDeviceNameSpacesSize() {
      */
     size_t ret = 0;
     size_t numNamespacesWithValues = 0;
+    expectedNumEntriesByNameSpace_.clear();
     for (const RequestNamespace& rns : requestNamespaces_) {
         vector<RequestDataItem> itemsToInclude;
 
@@ -607,8 +629,10 @@ size_t IdentityCredential::calcDeviceNameSpacesSize() {
             ret += item.size;
         }
 
+        expectedNumEntriesByNameSpace_[rns.namespaceName] = itemsToInclude.size();
         numNamespacesWithValues++;
     }
+    expectedNumNameSpaces_ = numNamespacesWithValues;
 
     // Now that we now the nunber of namespaces with values, we know how many
     // bytes the DeviceNamespaces map in the beginning is going to take up.
@@ -617,6 +641,115 @@ size_t IdentityCredential::calcDeviceNameSpacesSize() {
     return ret;
 }
 
+ndk::ScopedAStatus IdentityCredential::startDeviceAuthenticationMac() {
+    // If there's no signing key or no sessionTranscript or no reader ephemeral
+    // public key, we return the empty MAC.
+    computeMac_ = signingKeyBlob_.size() > 0 && sessionTranscript_.size() > 0 &&
+                  readerPublicKey_.size() > 0;
+    if (!computeMac_) {
+        return ndk::ScopedAStatus::ok();
+    }
+
+    vector<uint8_t> docTypeAsBlob(docType_.begin(), docType_.end());
+    vector<uint8_t> signingKey;
+    if (!storageKeyDecryptor_.decrypt(signingKeyBlob_, docTypeAsBlob, &signingKey)) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_INVALID_DATA, "Error decrypting signingKeyBlob"));
+    }
+
+    optional<vector<uint8_t>> sharedSecret = support::ecdh(readerPublicKey_, signingKey);
+    if (!sharedSecret) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_FAILED, "Error doing ECDH"));
+    }
+
+    vector<uint8_t> salt = {0x00};
+    vector<uint8_t> info = {};
+    optional<vector<uint8_t>> derivedKey = support::hkdf(sharedSecret.value(), salt, info, 32);
+    if (!derivedKey) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_FAILED, "Error deriving key from shared secret"));
+    }
+
+    // The MAC is calculated over DeviceAuthentication, which is
+    //
+    //   DeviceAuthentication = [
+    //       "DeviceAuthentication",
+    //       SessionTranscript,
+    //       DocType,
+    //       #6.24(bstr .cbor DeviceNameSpaces)
+    //   ]
+    //
+    // Everything but DeviceNameSpaces is known by now, and so is the size of
+    // DeviceNameSpaces, so the MAC is started here and DeviceNameSpaces fed to
+    // it as entries are retrieved.
+    vector<uint8_t> prefix;
+    auto iter = std::back_inserter(prefix);
+    cppbor::encodeHeader(cppbor::ARRAY, 4, iter);
+    cppbor::Tstr("DeviceAuthentication").encode(iter);
+    sessionTranscriptItem_->encode(iter);
+    cppbor::Tstr(docType_).encode(iter);
+    cppbor::encodeHeader(cppbor::SEMANTIC, 24, iter);
+    cppbor::encodeHeader(cppbor::BSTR, expectedDeviceNameSpacesSize_, iter);
+
+    if (!deviceAuthenticationMac_.init(derivedKey.value(),
+                                       prefix.size() + expectedDeviceNameSpacesSize_) ||
+        !deviceAuthenticationMac_.update(prefix)) {
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_FAILED, "Error MACing data"));
+    }
+    return ndk::ScopedAStatus::ok();
+}
+
+void IdentityCredential::appendToDeviceNameSpaces(size_t begin) {
+    if (!computeMac_) {
+        return;
+    }
+    // This only fails if more data is retrieved than calculated at
+    // startRetrieval() time, which finishRetrieval() reports.
+    if (!deviceAuthenticationMac_.update(encodedDeviceNameSpaces_.data() + begin,
+                                         encodedDeviceNameSpaces_.size() - begin)) {
+        deviceNameSpacesMatchRequest_ = false;
+    }
+}
+
+void IdentityCredential::addEntryToDeviceNameSpaces() {
+    size_t begin = encodedDeviceNameSpaces_.size();
+    auto iter = std::back_inserter(encodedDeviceNameSpaces_);
+
+    // Name spaces only appear once they have an entry, the same way they are
+    // counted by calcDeviceNameSpacesSize().
+    if (!currentNameSpaceEncoded_) {
+        auto it = expectedNumEntriesByNameSpace_.find(currentNameSpace_);
+        if (it == expectedNumEntriesByNameSpace_.end()) {
+            deviceNameSpacesMatchRequest_ = false;
+            expectedNumEntriesInNameSpace_ = 0;
+        } else {
+            expectedNumEntriesInNameSpace_ = it->second;
+        }
+        cppbor::Tstr(currentNameSpace_).encode(iter);
+        cppbor::encodeHeader(cppbor::MAP, expectedNumEntriesInNameSpace_, iter);
+        currentNameSpaceEncoded_ = true;
+        numEntriesEncodedInNameSpace_ = 0;
+        numNameSpacesEncoded_++;
+    }
+
+    cppbor::Tstr(currentName_).encode(iter);
+    encodedDeviceNameSpaces_.insert(encodedDeviceNameSpaces_.end(), entryValue_.begin(),
+                                    entryValue_.end());
+    numEntriesEncodedInNameSpace_++;
+
+    appendToDeviceNameSpaces(begin);
+}
+
+void IdentityCredential::finishNameSpaceInDeviceNameSpaces() {
+    if (currentNameSpaceEncoded_ &&
+        numEntriesEncodedInNameSpace_ != expectedNumEntriesInNameSpace_) {
+        deviceNameSpacesMatchRequest_ = false;
+    }
+    currentNameSpaceEncoded_ = false;
+}
+
 ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
         const string& nameSpace, const string& name, int32_t entrySize,
         const vector<int32_t>& accessControlProfileIds) {
@@ -656,11 +789,7 @@ ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
                     "Moved to new name space but one or more entries need to be retrieved "
                     "in current name space"));
         }
-        if (currentNameSpaceDeviceNameSpacesMap_.size() > 0) {
-            deviceNameSpacesMap_.add(currentNameSpace_,
-                                     std::move(currentNameSpaceDeviceNameSpacesMap_));
-        }
-        currentNameSpaceDeviceNameSpacesMap_ = cppbor::Map();
+        finishNameSpaceInDeviceNameSpaces();
 
         requestCountsRemaining_.erase(requestCountsRemaining_.begin());
         currentNameSpace_ = nameSpace;
@@ -720,18 +849,20 @@ ndk::ScopedAStatus IdentityCredential::startRetrieveEntryValue(
 
 ndk::ScopedAStatus IdentityCredential::retrieveEntryValue(const vector<uint8_t>& encryptedContent,
                                                           vector<uint8_t>* outContent) {
-    optional<vector<uint8_t>> content =
-            support::decryptAes128Gcm(storageKey_, encryptedContent, entryAdditionalData_);
-    if (!content) {
+    // The chunk is decrypted straight into the entry value with the context
+    // set up in initialize().
+    size_t chunkBegin = entryValue_.size();
+    if (!storageKeyDecryptor_.decrypt(encryptedContent, entryAdditionalData_, &entryValue_)) {
         return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                 IIdentityCredentialStore::STATUS_INVALID_DATA, "Error decrypting data"));
     }
 
-    size_t chunkSize = content.value().size();
+    size_t chunkSize = entryValue_.size() - chunkBegin;
 
     if (chunkSize > entryRemainingBytes_) {
         LOG(ERROR) << "Retrieved chunk of size " << chunkSize
                    << " is bigger than remaining space of size " << entryRemainingBytes_;
+        entryValue_.resize(chunkBegin);
         return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                 IIdentityCredentialStore::STATUS_INVALID_DATA,
                 "Retrieved chunk is bigger than remaining space"));
@@ -740,86 +871,55 @@ ndk::ScopedAStatus IdentityCredential::retrieveEntryValue(const vector<uint8_t>&
     entryRemainingBytes_ -= chunkSize;
     if (entryRemainingBytes_ > 0) {
         if (chunkSize != IdentityCredentialStore::kGcmChunkSize) {
+            entryValue_.resize(chunkBegin);
             return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                     IIdentityCredentialStore::STATUS_INVALID_DATA,
                     "Retrieved non-final chunk of size which isn't kGcmChunkSize"));
         }
     }
 
-    entryValue_.insert(entryValue_.end(), content.value().begin(), content.value().end());
+    outContent->assign(entryValue_.begin() + chunkBegin, entryValue_.end());
 
     if (entryRemainingBytes_ == 0) {
-        auto [entryValueItem, _, message] = cppbor::parse(entryValue_);
-        if (entryValueItem == nullptr) {
+        // The value goes into DeviceNameSpaces as it was stored, so it only
+        // needs to be checked, not decoded.
+        auto [entryValueView, newPos, message] = cppbor::parseView(entryValue_);
+        if (!entryValueView || newPos != entryValue_.data() + entryValue_.size()) {
             return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                     IIdentityCredentialStore::STATUS_INVALID_DATA,
                     "Retrieved data which is invalid CBOR"));
         }
-        currentNameSpaceDeviceNameSpacesMap_.add(currentName_, std::move(entryValueItem));
+        addEntryToDeviceNameSpaces();
     }
 
-    *outContent = content.value();
     return ndk::ScopedAStatus::ok();
 }
 
 ndk::ScopedAStatus IdentityCredential::finishRetrieval(vector<uint8_t>* outMac,
                                                        vector<uint8_t>* outDeviceNameSpaces) {
-    if (currentNameSpaceDeviceNameSpacesMap_.size() > 0) {
-        deviceNameSpacesMap_.add(currentNameSpace_,
-                                 std::move(currentNameSpaceDeviceNameSpacesMap_));
-    }
-    vector<uint8_t> encodedDeviceNameSpaces = deviceNameSpacesMap_.encode();
+    finishNameSpaceInDeviceNameSpaces();
 
-    if (encodedDeviceNameSpaces.size() != expectedDeviceNameSpacesSize_) {
-        LOG(ERROR) << "encodedDeviceNameSpaces is " << encodedDeviceNameSpaces.size() << " bytes, "
-                   << "was expecting " << expectedDeviceNameSpacesSize_;
+    if (encodedDeviceNameSpaces_.size() != expectedDeviceNameSpacesSize_) {
+        LOG(ERROR) << "encodedDeviceNameSpaces is " << encodedDeviceNameSpaces_.size()
+                   << " bytes, was expecting " << expectedDeviceNameSpacesSize_;
         return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                 IIdentityCredentialStore::STATUS_INVALID_DATA,
                 StringPrintf(
                         "Unexpected CBOR size %zd for encodedDeviceNameSpaces, was expecting %zd",
-                        encodedDeviceNameSpaces.size(), expectedDeviceNameSpacesSize_)
+                        encodedDeviceNameSpaces_.size(), expectedDeviceNameSpacesSize_)
                         .c_str()));
     }
+    if (!deviceNameSpacesMatchRequest_ || numNameSpacesEncoded_ != expectedNumNameSpaces_) {
+        LOG(ERROR) << "Retrieved entries don't match the requested name spaces and entries";
+        return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
+                IIdentityCredentialStore::STATUS_INVALID_DATA,
+                "Retrieved entries don't match the requested name spaces and entries"));
+    }
 
-    // If there's no signing key or no sessionTranscript or no reader ephemeral
-    // public key, we return the empty MAC.
+    // The MAC, if any, has been fed all of DeviceAuthentication by now.
     optional<vector<uint8_t>> mac;
-    if (signingKeyBlob_.size() > 0 && sessionTranscript_.size() > 0 &&
-        readerPublicKey_.size() > 0) {
-        cppbor::Array array;
-        array.add("DeviceAuthentication");
-        array.add(sessionTranscriptItem_->clone());
-        array.add(docType_);
-        array.add(cppbor::Semantic(24, encodedDeviceNameSpaces));
-        vector<uint8_t> encodedDeviceAuthentication = array.encode();
-
-        vector<uint8_t> docTypeAsBlob(docType_.begin(), docType_.end());
-        optional<vector<uint8_t>> signingKey =
-                support::decryptAes128Gcm(storageKey_, signingKeyBlob_, docTypeAsBlob);
-        if (!signingKey) {
-            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
-                    IIdentityCredentialStore::STATUS_INVALID_DATA,
-                    "Error decrypting signingKeyBlob"));
-        }
-
-        optional<vector<uint8_t>> sharedSecret =
-                support::ecdh(readerPublicKey_, signingKey.value());
-        if (!sharedSecret) {
-            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
-                    IIdentityCredentialStore::STATUS_FAILED, "Error doing ECDH"));
-        }
-
-        vector<uint8_t> salt = {0x00};
-        vector<uint8_t> info = {};
-        optional<vector<uint8_t>> derivedKey = support::hkdf(sharedSecret.value(), salt, info, 32);
-        if (!derivedKey) {
-            return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
-                    IIdentityCredentialStore::STATUS_FAILED,
-                    "Error deriving key from shared secret"));
-        }
-
-        mac = support::coseMac0(derivedKey.value(), {},        // payload
-                                encodedDeviceAuthentication);  // additionalData
+    if (computeMac_) {
+        mac = deviceAuthenticationMac_.finish();
         if (!mac) {
             return ndk::ScopedAStatus(AStatus_fromServiceSpecificErrorWithMessage(
                     IIdentityCredentialStore::STATUS_FAILED, "Error MACing data"));
@@ -827,7 +927,7 @@ ndk::ScopedAStatus IdentityCredential::finishRetrieval(vector<uint8_t>* outMac,
     }
 
     *outMac = mac.value_or(vector<uint8_t>({}));
-    *outDeviceNameSpaces = encodedDeviceNameSpaces;
+    *outDeviceNameSpaces = encodedDeviceNameSpaces_;
     return ndk::ScopedAStatus::ok();
 }
 
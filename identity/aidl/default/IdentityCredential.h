@@ -44,7 +44,14 @@ class IdentityCredential : public BnIdentityCredential {
         : credentialData_(credentialData),
           numStartRetrievalCalls_(0),
           authChallenge_(0),
-          expectedDeviceNameSpacesSize_(0) {}
+          expectedDeviceNameSpacesSize_(0),
+          expectedNumNameSpaces_(0),
+          deviceNameSpacesMatchRequest_(true),
+          numNameSpacesEncoded_(0),
+          currentNameSpaceEncoded_(false),
+          numEntriesEncodedInNameSpace_(0),
+          expectedNumEntriesInNameSpace_(0),
+          computeMac_(false) {}
 
     // Parses and decrypts credentialData_, return a status code from
     // IIdentityCredentialStore. Must be called right after construction.
@@ -83,6 +90,7 @@ class IdentityCredential : public BnIdentityCredential {
     bool testCredential_;
     vector<uint8_t> storageKey_;
     vector<uint8_t> credentialPrivKey_;
+    ::android::hardware::identity::support::Aes128GcmDecryptor storageKeyDecryptor_;
 
     // Set by createEphemeralKeyPair()
     vector<uint8_t> ephemeralPublicKey_;
@@ -107,11 +115,22 @@ class IdentityCredential : public BnIdentityCredential {
     vector<uint8_t> itemsRequest_;
     vector<int32_t> requestCountsRemaining_;
     map<string, set<string>> requestedNameSpacesAndNames_;
-    cppbor::Map deviceNameSpacesMap_;
-    cppbor::Map currentNameSpaceDeviceNameSpacesMap_;
 
     // Calculated at startRetrieval() time.
     size_t expectedDeviceNameSpacesSize_;
+    size_t expectedNumNameSpaces_;
+    map<string, size_t> expectedNumEntriesByNameSpace_;
+
+    // DeviceNameSpaces is encoded as entries are retrieved and, if a MAC is to
+    // be returned, fed to deviceAuthenticationMac_ as it grows.
+    vector<uint8_t> encodedDeviceNameSpaces_;
+    bool deviceNameSpacesMatchRequest_;
+    size_t numNameSpacesEncoded_;
+    bool currentNameSpaceEncoded_;
+    size_t numEntriesEncodedInNameSpace_;
+    size_t expectedNumEntriesInNameSpace_;
+    bool computeMac_;
+    ::android::hardware::identity::support::CoseMac0Builder deviceAuthenticationMac_;
 
     // Set at startRetrieveEntryValue() time.
     string currentNameSpace_;
@@ -121,6 +140,10 @@ class IdentityCredential : public BnIdentityCredential {
     vector<uint8_t> entryAdditionalData_;
 
     size_t calcDeviceNameSpacesSize();
+    ndk::ScopedAStatus startDeviceAuthenticationMac();
+    void appendToDeviceNameSpaces(size_t begin);
+    void addEntryToDeviceNameSpaces();
+    void finishNameSpaceInDeviceNameSpaces();
 };
 
 }  // namespace aidl::android::hardware::identity
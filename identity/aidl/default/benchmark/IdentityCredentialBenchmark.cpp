@@ -0,0 +1,305 @@
+/*
+ * Copyright 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the latency of presenting a 50 element credential with the reference implementation,
+// in process and without binder, from loading the credential to getting DeviceNameSpaces and its
+// MAC back.
+
+#define LOG_TAG "IdentityCredentialBenchmark"
+
+#include "IdentityCredentialStore.h"
+
+#include <android/hardware/identity/support/IdentityCredentialSupport.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <cppbor.h>
+#include <cppbor_parse.h>
+
+namespace aidl::android::hardware::identity {
+namespace {
+
+using ::aidl::android::hardware::keymaster::HardwareAuthToken;
+using ::std::optional;
+using ::std::shared_ptr;
+using ::std::string;
+using ::std::vector;
+
+using namespace ::android::hardware::identity;
+
+constexpr char kDocType[] = "org.iso.18013-5.2019.mdl";
+constexpr int kNumEntries = 50;
+
+// Large enough to be split in two chunks.
+constexpr size_t kPortraitSize = 100 * 1024;
+
+struct Entry {
+    string nameSpace;
+    string name;
+    vector<uint8_t> valueCbor;
+    vector<vector<uint8_t>> encryptedChunks;
+};
+
+struct Fixture {
+    bool ok = false;
+    shared_ptr<IIdentityCredentialStore> store;
+    vector<uint8_t> credentialData;
+    vector<uint8_t> signingKeyBlob;
+    vector<uint8_t> readerPublicKey;
+    SecureAccessControlProfile profile;
+    vector<Entry> entries;
+    vector<int32_t> entryCounts;
+    vector<RequestNamespace> requestNamespaces;
+};
+
+// A portrait and mostly short values, split over two name spaces like the
+// elements of an mDL.
+vector<Entry> makeEntries() {
+    vector<Entry> entries;
+    for (int n = 0; n < kNumEntries; n++) {
+        Entry entry;
+        entry.nameSpace = n < 40 ? "org.iso.18013.5.1" : "org.iso.18013.5.1.aamva";
+        entry.name = "element_" + std::to_string(n);
+        if (n == 0) {
+            entry.valueCbor = cppbor::Bstr(vector<uint8_t>(kPortraitSize, 0x42)).encode();
+        } else if (n % 2 == 0) {
+            entry.valueCbor = cppbor::Uint(n * 1000).encode();
+        } else {
+            entry.valueCbor = cppbor::Tstr("value of element " + std::to_string(n)).encode();
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+bool provision(Fixture* fixture) {
+    fixture->store = ndk::SharedRefBase::make<IdentityCredentialStore>();
+    HardwareInformation hwInfo;
+    if (!fixture->store->getHardwareInformation(&hwInfo).isOk()) {
+        return false;
+    }
+
+    shared_ptr<IWritableIdentityCredential> writable;
+    vector<Certificate> attestationCertificate;
+    if (!fixture->store->createCredential(kDocType, true /* testCredential */, &writable).isOk() ||
+        !writable->getAttestationCertificate({0x01}, {0x02}, &attestationCertificate).isOk()) {
+        return false;
+    }
+
+    // The implementation checks the size of ProofOfProvisioning, so build the
+    // same structure here along with the requested name spaces.
+    fixture->entries = makeEntries();
+    cppbor::Map signedNameSpaces;
+    cppbor::Array signedEntries;
+    RequestNamespace requestNamespace;
+    for (size_t n = 0; n < fixture->entries.size(); n++) {
+        const Entry& entry = fixture->entries[n];
+        auto [value, _, message] = cppbor::parse(entry.valueCbor);
+        signedEntries.add(cppbor::Map("name", entry.name, "value", std::move(value),
+                                      "accessControlProfiles", cppbor::Array(0)));
+        RequestDataItem item;
+        item.name = entry.name;
+        item.size = entry.valueCbor.size();
+        item.accessControlProfileIds = {0};
+        requestNamespace.items.push_back(item);
+
+        if (n + 1 == fixture->entries.size() ||
+            fixture->entries[n + 1].nameSpace != entry.nameSpace) {
+            fixture->entryCounts.push_back(requestNamespace.items.size());
+            requestNamespace.namespaceName = entry.nameSpace;
+            fixture->requestNamespaces.push_back(std::move(requestNamespace));
+            requestNamespace = RequestNamespace();
+            signedNameSpaces.add(entry.nameSpace, std::move(signedEntries));
+            signedEntries = cppbor::Array();
+        }
+    }
+    cppbor::Array proofOfProvisioning("ProofOfProvisioning", kDocType,
+                                      cppbor::Array(cppbor::Map("id", 0)),
+                                      std::move(signedNameSpaces), true);
+
+    writable->setExpectedProofOfProvisioningSize(proofOfProvisioning.encodedSize());
+    if (!writable->startPersonalization(1, fixture->entryCounts).isOk() ||
+        !writable->addAccessControlProfile(0, Certificate(), false, 0, 0, &fixture->profile)
+                 .isOk()) {
+        return false;
+    }
+    for (Entry& entry : fixture->entries) {
+        if (!writable->beginAddEntry({0}, entry.nameSpace, entry.name, entry.valueCbor.size())
+                     .isOk()) {
+            return false;
+        }
+        for (const auto& chunk : support::chunkVector(entry.valueCbor, hwInfo.dataChunkSize)) {
+            vector<uint8_t> encryptedChunk;
+            if (!writable->addEntryValue(chunk, &encryptedChunk).isOk()) {
+                return false;
+            }
+            entry.encryptedChunks.push_back(std::move(encryptedChunk));
+        }
+    }
+    vector<uint8_t> proofOfProvisioningSignature;
+    if (!writable->finishAddingEntries(&fixture->credentialData, &proofOfProvisioningSignature)
+                 .isOk()) {
+        return false;
+    }
+
+    // Signing keys are generated ahead of presentations.
+    shared_ptr<IIdentityCredential> credential;
+    Certificate signingKeyCertificate;
+    if (!fixture->store
+                 ->getCredential(CipherSuite::CIPHERSUITE_ECDHE_HKDF_ECDSA_WITH_AES_256_GCM_SHA256,
+                                 fixture->credentialData, &credential)
+                 .isOk() ||
+        !credential->generateSigningKeyPair(&fixture->signingKeyBlob, &signingKeyCertificate)
+                 .isOk()) {
+        return false;
+    }
+
+    optional<vector<uint8_t>> readerKeyPair = support::createEcKeyPair();
+    if (!readerKeyPair) {
+        return false;
+    }
+    optional<vector<uint8_t>> readerPublicKey =
+            support::ecKeyPairGetPublicKey(readerKeyPair.value());
+    if (!readerPublicKey) {
+        return false;
+    }
+    fixture->readerPublicKey = readerPublicKey.value();
+    return true;
+}
+
+const Fixture& getFixture() {
+    static Fixture* fixture = [] {
+        auto* fixture = new Fixture();
+        fixture->ok = provision(fixture);
+        return fixture;
+    }();
+    return *fixture;
+}
+
+// Loads the credential and does the key exchange with the reader.
+bool startPresentation(const Fixture& fixture, shared_ptr<IIdentityCredential>* credential,
+                       vector<uint8_t>* sessionTranscript) {
+    vector<uint8_t> ephemeralKeyPair;
+    if (!fixture.store
+                 ->getCredential(CipherSuite::CIPHERSUITE_ECDHE_HKDF_ECDSA_WITH_AES_256_GCM_SHA256,
+                                 fixture.credentialData, credential)
+                 .isOk() ||
+        !(*credential)->setReaderEphemeralPublicKey(fixture.readerPublicKey).isOk() ||
+        !(*credential)->createEphemeralKeyPair(&ephemeralKeyPair).isOk()) {
+        return false;
+    }
+
+    optional<vector<uint8_t>> ephemeralPublicKey = support::ecKeyPairGetPublicKey(ephemeralKeyPair);
+    if (!ephemeralPublicKey) {
+        return false;
+    }
+    auto [getXYSuccess, ephX, ephY] = support::ecPublicKeyGetXandY(ephemeralPublicKey.value());
+    if (!getXYSuccess) {
+        return false;
+    }
+    vector<uint8_t> deviceEngagementBytes = cppbor::Map("ephX", ephX, "ephY", ephY).encode();
+    *sessionTranscript = cppbor::Array(cppbor::Semantic(24, deviceEngagementBytes),
+                                       cppbor::Semantic(24, cppbor::Tstr("ignored").encode()))
+                                 .encode();
+
+    return (*credential)->setRequestedNamespaces(fixture.requestNamespaces).isOk();
+}
+
+// Retrieves every element, the way a reader requesting all of them would.
+bool retrieveEntries(const Fixture& fixture, IIdentityCredential* credential,
+                     const vector<uint8_t>& sessionTranscript) {
+    if (!credential
+                 ->startRetrieval({fixture.profile}, HardwareAuthToken(), {} /* itemsRequest */,
+                                  fixture.signingKeyBlob, sessionTranscript,
+                                  {} /* readerSignature */, fixture.entryCounts)
+                 .isOk()) {
+        return false;
+    }
+
+    vector<uint8_t> content;
+    for (const Entry& entry : fixture.entries) {
+        if (!credential
+                     ->startRetrieveEntryValue(entry.nameSpace, entry.name, entry.valueCbor.size(),
+                                               {0})
+                     .isOk()) {
+            return false;
+        }
+        for (const auto& encryptedChunk : entry.encryptedChunks) {
+            if (!credential->retrieveEntryValue(encryptedChunk, &content).isOk()) {
+                return false;
+            }
+        }
+    }
+
+    vector<uint8_t> mac;
+    vector<uint8_t> deviceNameSpaces;
+    if (!credential->finishRetrieval(&mac, &deviceNameSpaces).isOk()) {
+        return false;
+    }
+    benchmark::DoNotOptimize(mac.data());
+    return !mac.empty();
+}
+
+}  // namespace
+
+// A whole presentation, including the key exchange.
+static void BM_Presentation(benchmark::State& state) {
+    const Fixture& fixture = getFixture();
+    if (!fixture.ok) {
+        state.SkipWithError("Error provisioning the credential");
+        return;
+    }
+
+    for (auto _ : state) {
+        shared_ptr<IIdentityCredential> credential;
+        vector<uint8_t> sessionTranscript;
+        if (!startPresentation(fixture, &credential, &sessionTranscript) ||
+            !retrieveEntries(fixture, credential.get(), sessionTranscript)) {
+            state.SkipWithError("Error presenting the credential");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kNumEntries);
+}
+BENCHMARK(BM_Presentation)->Unit(benchmark::kMicrosecond);
+
+// Only startRetrieval() to finishRetrieval(), repeated within one session.
+static void BM_RetrieveEntries(benchmark::State& state) {
+    const Fixture& fixture = getFixture();
+    shared_ptr<IIdentityCredential> credential;
+    vector<uint8_t> sessionTranscript;
+    if (!fixture.ok || !startPresentation(fixture, &credential, &sessionTranscript)) {
+        state.SkipWithError("Error setting up the presentation");
+        return;
+    }
+
+    for (auto _ : state) {
+        if (!retrieveEntries(fixture, credential.get(), sessionTranscript)) {
+            state.SkipWithError("Error retrieving entries");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kNumEntries);
+}
+BENCHMARK(BM_RetrieveEntries)->Unit(benchmark::kMicrosecond);
+
+}  // namespace aidl::android::hardware::identity
+
+BENCHMARK_MAIN();
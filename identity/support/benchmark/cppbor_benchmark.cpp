@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the encoders and parsers of cppbor on documents shaped like the DeviceResponse of an
+// identity credential presentation: namespaces holding arrays of issuer-signed items, some tagged
+// as embedded CBOR, with a mix of short text values and larger byte string values.
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "cppbor.h"
+#include "cppbor_parse.h"
+#include "cppbor_view.h"
+
+using namespace cppbor;
+
+namespace {
+
+Map makeElement(int digestId) {
+    Map element("digestID", digestId,  //
+                "random", std::vector<uint8_t>(16, static_cast<uint8_t>(digestId)),
+                "elementIdentifier", "element_" + std::to_string(digestId));
+    if (digestId % 4 == 0) {
+        element.add("elementValue", std::vector<uint8_t>(256, 0x42));
+    } else {
+        element.add("elementValue", "value of element " + std::to_string(digestId));
+    }
+    return element;
+}
+
+// Returns the encoding of a document of at least size bytes.
+std::vector<uint8_t> makeDocument(size_t size) {
+    Array taggedItems;
+    Array plainItems;
+    int digestId = 0;
+    size_t approximateSize = 0;
+    while (approximateSize < size) {
+        Map element = makeElement(digestId++);
+        approximateSize += element.encodedSize();
+        if (digestId % 2 == 0) {
+            taggedItems.add(Semantic(24, Bstr(element.encode())));
+        } else {
+            plainItems.add(std::move(element));
+        }
+    }
+
+    Map nameSpaces("org.iso.18013.5.1", std::move(taggedItems),  //
+                   "org.iso.18013.5.1.aamva", std::move(plainItems));
+    Map document("docType", "org.iso.18013.5.1.mDL",  //
+                 "issuerSigned", Map("nameSpaces", std::move(nameSpaces)));
+    return Map("version", "1.0", "documents", Array(std::move(document)), "status", 0).encode();
+}
+
+const Item* findInMap(const Map* map, const std::string& key) {
+    for (size_t i = 0; i < map->size(); ++i) {
+        auto [keyItem, value] = (*map)[i];
+        if (keyItem->asTstr() && keyItem->asTstr()->value() == key) return value.get();
+    }
+    return nullptr;
+}
+
+// Visits every element of the document the way a reader looking for specific data elements would,
+// returning the total size of their values.
+size_t walkItem(const Item& response) {
+    const Item* documents = findInMap(response.asMap(), "documents");
+    const Item* issuerSigned = findInMap((*documents->asArray())[0]->asMap(), "issuerSigned");
+    const Map* nameSpaces = findInMap(issuerSigned->asMap(), "nameSpaces")->asMap();
+
+    size_t total = 0;
+    for (size_t i = 0; i < nameSpaces->size(); ++i) {
+        const Array* items = (*nameSpaces)[i].second->asArray();
+        for (size_t j = 0; j < items->size(); ++j) {
+            const Item* entry = (*items)[j].get();
+            if (entry->asSemantic()) {
+                total += entry->asSemantic()->child()->asBstr()->value().size();
+            } else {
+                total += findInMap(entry->asMap(), "elementIdentifier")->asTstr()->value().size();
+            }
+        }
+    }
+    return total;
+}
+
+size_t walkView(const ItemView& response) {
+    auto issuerSigned = (*response.get("documents"))[0].get("issuerSigned");
+    auto nameSpaces = issuerSigned->get("nameSpaces");
+
+    size_t total = 0;
+    size_t index = 0;
+    for (auto& entry : *nameSpaces) {
+        if (index++ % 2 == 0) continue;  // Skip the keys.
+        for (auto& item : entry) {
+            if (item.type() == SEMANTIC) {
+                total += item.child().bstrValue().second;
+            } else {
+                total += item.get("elementIdentifier")->tstrValue().size();
+            }
+        }
+    }
+    return total;
+}
+
+}  // namespace
+
+static void BM_EncodeCallback(benchmark::State& state) {
+    auto [item, pos, message] = parse(makeDocument(state.range(0)));
+    for (auto _ : state) {
+        std::vector<uint8_t> encoding;
+        encoding.reserve(item->encodedSize());
+        item->encode(std::back_inserter(encoding));
+        benchmark::DoNotOptimize(encoding.data());
+    }
+    state.SetBytesProcessed(state.iterations() * item->encodedSize());
+}
+BENCHMARK(BM_EncodeCallback)->Arg(2 << 10)->Arg(16 << 10)->Arg(64 << 10);
+
+static void BM_EncodeBuffer(benchmark::State& state) {
+    auto [item, pos, message] = parse(makeDocument(state.range(0)));
+    for (auto _ : state) {
+        std::vector<uint8_t> encoding = item->encode();
+        benchmark::DoNotOptimize(encoding.data());
+    }
+    state.SetBytesProcessed(state.iterations() * item->encodedSize());
+}
+BENCHMARK(BM_EncodeBuffer)->Arg(2 << 10)->Arg(16 << 10)->Arg(64 << 10);
+
+static void BM_ParseItem(benchmark::State& state) {
+    std::vector<uint8_t> encoding = makeDocument(state.range(0));
+    for (auto _ : state) {
+        auto [item, pos, message] = parse(encoding);
+        benchmark::DoNotOptimize(walkItem(*item));
+    }
+    state.SetBytesProcessed(state.iterations() * encoding.size());
+}
+BENCHMARK(BM_ParseItem)->Arg(2 << 10)->Arg(16 << 10)->Arg(64 << 10);
+
+static void BM_ParseView(benchmark::State& state) {
+    std::vector<uint8_t> encoding = makeDocument(state.range(0));
+    for (auto _ : state) {
+        auto [view, pos, message] = parseView(encoding);
+        benchmark::DoNotOptimize(walkView(*view));
+    }
+    state.SetBytesProcessed(state.iterations() * encoding.size());
+}
+BENCHMARK(BM_ParseView)->Arg(2 << 10)->Arg(16 << 10)->Arg(64 << 10);
+
+BENCHMARK_MAIN();
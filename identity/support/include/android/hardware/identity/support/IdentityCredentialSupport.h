@@ -18,6 +18,7 @@
 #define IDENTITY_SUPPORT_INCLUDE_IDENTITY_CREDENTIAL_UTILS_H_
 
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
 #include <tuple>
@@ -104,6 +105,34 @@ optional<vector<uint8_t>> encryptAes128Gcm(const vector<uint8_t>& key, const vec
                                            const vector<uint8_t>& data,
                                            const vector<uint8_t>& additionalAuthenticatedData);
 
+// An AES-128-GCM decryption context which is keyed once and then decrypts any
+// number of messages in the format produced by encryptAes128Gcm(). This avoids
+// setting up a cipher context and key schedule for every message, which adds
+// up when decrypting many small entries or chunks with the same key.
+//
+// Instances are not thread-safe.
+class Aes128GcmDecryptor {
+  public:
+    Aes128GcmDecryptor();
+    ~Aes128GcmDecryptor();
+    Aes128GcmDecryptor(Aes128GcmDecryptor&& other);
+    Aes128GcmDecryptor& operator=(Aes128GcmDecryptor&& other);
+
+    // Sets |key|, which must be kAes128GcmKeySize bytes. Returns false on
+    // failure, in which case decrypt() will fail until init() succeeds.
+    bool init(const vector<uint8_t>& key);
+
+    // Decrypts |encryptedData| using |additionalAuthenticatedData| and appends
+    // the resulting plaintext to |plainText|. Returns false on failure, in
+    // which case |plainText| is left unchanged.
+    bool decrypt(const vector<uint8_t>& encryptedData,
+                 const vector<uint8_t>& additionalAuthenticatedData, vector<uint8_t>* plainText);
+
+  private:
+    struct Context;
+    std::unique_ptr<Context> context_;
+};
+
 // ---------------------------------------------------------------------------
 // EC crypto functionality / abstraction (only supports P-256).
 // ---------------------------------------------------------------------------
@@ -264,6 +293,37 @@ optional<vector<uint8_t>> coseSignGetX5Chain(const vector<uint8_t>& signatureCos
 optional<vector<uint8_t>> coseMac0(const vector<uint8_t>& key, const vector<uint8_t>& data,
                                    const vector<uint8_t>& detachedContent);
 
+// Calculates the same COSE_Mac0 as coseMac0() with empty |data|, for detached
+// content which is supplied in pieces. Only the HMAC context is kept, so the
+// detached content never needs to be assembled in memory. Its size must be
+// known up front since it's part of the data being MACed.
+//
+// Instances are not thread-safe.
+class CoseMac0Builder {
+  public:
+    CoseMac0Builder();
+    ~CoseMac0Builder();
+    CoseMac0Builder(CoseMac0Builder&& other);
+    CoseMac0Builder& operator=(CoseMac0Builder&& other);
+
+    // Starts a new MAC with |key| for |detachedContentSize| bytes of detached
+    // content. Returns false on failure.
+    bool init(const vector<uint8_t>& key, size_t detachedContentSize);
+
+    // Adds the next |size| bytes of detached content. Returns false if this is
+    // more than announced to init() or on failure.
+    bool update(const uint8_t* data, size_t size);
+    bool update(const vector<uint8_t>& data) { return update(data.data(), data.size()); }
+
+    // Returns the COSE_Mac0, or nothing if less detached content than announced
+    // to init() was supplied or an error occurred.
+    optional<vector<uint8_t>> finish();
+
+  private:
+    struct Context;
+    std::unique_ptr<Context> context_;
+};
+
 // ---------------------------------------------------------------------------
 // Utility functions specific to IdentityCredential.
 // ---------------------------------------------------------------------------
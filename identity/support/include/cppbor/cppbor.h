@@ -161,22 +161,22 @@ class Item {
     }
 
     /**
-     * Encodes the Item into a new std::vector<uint8_t>.
+     * Encodes the Item into a new std::vector<uint8_t>.  The vector is allocated once with the exact
+     * encoded size and filled in a single pass over the Item.
      */
     std::vector<uint8_t> encode() const {
-        std::vector<uint8_t> retval;
-        retval.reserve(encodedSize());
-        encode(std::back_inserter(retval));
+        std::vector<uint8_t> retval(encodedSize());
+        encode(retval.data(), retval.data() + retval.size());
         return retval;
     }
 
     /**
-     * Encodes the Item into a new std::string.
+     * Encodes the Item into a new std::string, the same way as encode().
      */
     std::string toString() const {
-        std::string retval;
-        retval.reserve(encodedSize());
-        encode([&](uint8_t v) { retval.push_back(v); });
+        std::string retval(encodedSize(), '\0');
+        uint8_t* data = reinterpret_cast<uint8_t*>(retval.data());
+        encode(data, data + retval.size());
         return retval;
     }
 
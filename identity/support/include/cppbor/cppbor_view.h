@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <tuple>
+
+#include "cppbor.h"
+
+namespace cppbor {
+
+class ItemView;
+
+using ViewParseResult = std::tuple<std::optional<ItemView> /* result */,
+                                   const uint8_t* /* newPos */, std::string /* errMsg */>;
+
+/**
+ * ItemView is a non-owning view of a CBOR data item in an encoded buffer.  String values are
+ * returned as spans into the buffer and the entries of compound items are decoded when they are
+ * visited, so examining a large structure costs no allocation.  ItemViews can only be obtained
+ * from parseView(), which validates the encoding, so navigating a view never reads past the item.
+ *
+ * The accessors for a specific type must only be called on views of that type.
+ */
+class ItemView {
+  public:
+    class Iterator;
+
+    MajorType type() const { return mType; }
+
+    /**
+     * Returns the additional info of the header: the value of a UINT, the length of a BSTR or TSTR,
+     * the number of entries of an ARRAY, the number of key/value pairs of a MAP, the tag of a
+     * SEMANTIC or the simple value of a SIMPLE.
+     */
+    uint64_t addlInfo() const { return mAddlInfo; }
+
+    /**
+     * Returns the encoding of the item, header included.  Useful to hash or copy a sub-structure
+     * without decoding it.
+     */
+    std::pair<const uint8_t*, size_t> encoded() const {
+        return {mHdrBegin, static_cast<size_t>(mEnd - mHdrBegin)};
+    }
+
+    // UINT or NINT
+    int64_t intValue() const {
+        return mType == NINT ? -1 - static_cast<int64_t>(mAddlInfo)
+                             : static_cast<int64_t>(mAddlInfo);
+    }
+
+    // BSTR
+    std::pair<const uint8_t*, size_t> bstrValue() const {
+        return {mValueBegin, static_cast<size_t>(mAddlInfo)};
+    }
+
+    // TSTR
+    std::string_view tstrValue() const {
+        return {reinterpret_cast<const char*>(mValueBegin), static_cast<size_t>(mAddlInfo)};
+    }
+
+    // SIMPLE
+    bool isBool() const { return mType == SIMPLE && (mAddlInfo == TRUE || mAddlInfo == FALSE); }
+    bool boolValue() const { return mAddlInfo == TRUE; }
+    bool isNull() const { return mType == SIMPLE && mAddlInfo == NULL_V; }
+
+    // SEMANTIC
+    uint64_t semanticTag() const { return mAddlInfo; }
+    ItemView child() const { return decode(mValueBegin, mEnd); }
+
+    /**
+     * Returns the number of entries of an ARRAY, the number of key/value pairs of a MAP, 1 for a
+     * SEMANTIC and 0 otherwise.
+     */
+    size_t size() const;
+
+    /**
+     * Iterate over the entries of an ARRAY, MAP or SEMANTIC.  The keys and values of a MAP are
+     * visited in turn, the same way they are stored in a Map.
+     */
+    Iterator begin() const;
+    Iterator end() const;
+
+    /**
+     * Returns the entry at index of an ARRAY.  This walks the preceding entries, so prefer
+     * iterating when visiting all of them.
+     */
+    ItemView operator[](size_t index) const;
+
+    /**
+     * Returns the value associated with key in a MAP, if any.
+     */
+    std::optional<ItemView> get(std::string_view key) const;
+    std::optional<ItemView> get(int64_t key) const;
+
+    /**
+     * Parses the viewed item into an owning Item.
+     */
+    std::unique_ptr<Item> toItem() const;
+
+  private:
+    friend ViewParseResult parseView(const uint8_t* begin, const uint8_t* end);
+
+    ItemView() = default;
+
+    // Decodes the already validated item starting at pos.
+    static ItemView decode(const uint8_t* pos, const uint8_t* end);
+
+    MajorType mType = UINT;
+    uint64_t mAddlInfo = 0;
+    const uint8_t* mHdrBegin = nullptr;
+    const uint8_t* mValueBegin = nullptr;
+    const uint8_t* mEnd = nullptr;
+};
+
+class ItemView::Iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = ItemView;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const ItemView*;
+    using reference = const ItemView&;
+
+    const ItemView& operator*() const { return mCurrent; }
+    const ItemView* operator->() const { return &mCurrent; }
+
+    Iterator& operator++() {
+        if (--mRemaining > 0) mCurrent = decode(mCurrent.mEnd, mLimit);
+        return *this;
+    }
+
+    Iterator operator++(int) {
+        Iterator previous = *this;
+        ++*this;
+        return previous;
+    }
+
+    bool operator==(const Iterator& other) const { return mRemaining == other.mRemaining; }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+  private:
+    friend class ItemView;
+
+    Iterator(const ItemView& parent, uint64_t remaining)
+        : mRemaining(remaining), mLimit(parent.mEnd) {
+        if (mRemaining > 0) mCurrent = decode(parent.mValueBegin, mLimit);
+    }
+
+    ItemView mCurrent;
+    uint64_t mRemaining;
+    const uint8_t* mLimit;
+};
+
+/**
+ * Parse the first CBOR data item (possibly compound) from the range [begin, end) into an ItemView.
+ *
+ * The whole item is validated, but nothing is copied or allocated: the returned view refers to the
+ * input buffer, which must outlive it and any view obtained from it.  The returned tuple has the
+ * same meaning as the ParseResult of parse(), except that the view is empty if parsing fails.
+ */
+ViewParseResult parseView(const uint8_t* begin, const uint8_t* end);
+
+/**
+ * Parse the first CBOR data item (possibly compound) from the byte vector into an ItemView.  See
+ * parseView() above.
+ */
+inline ViewParseResult parseView(const std::vector<uint8_t>& encoding) {
+    return parseView(encoding.data(), encoding.data() + encoding.size());
+}
+
+}  // namespace cppbor
@@ -362,84 +362,137 @@ optional<vector<uint8_t>> getRandom(size_t numBytes) {
     return output;
 }
 
-optional<vector<uint8_t>> decryptAes128Gcm(const vector<uint8_t>& key,
-                                           const vector<uint8_t>& encryptedData,
-                                           const vector<uint8_t>& additionalAuthenticatedData) {
-    int cipherTextSize = int(encryptedData.size()) - kAesGcmIvSize - kAesGcmTagSize;
-    if (cipherTextSize < 0) {
-        LOG(ERROR) << "encryptedData too small";
-        return {};
-    }
-    unsigned char* nonce = (unsigned char*)encryptedData.data();
-    unsigned char* cipherText = nonce + kAesGcmIvSize;
-    unsigned char* tag = cipherText + cipherTextSize;
+struct Aes128GcmDecryptor::Context {
+    EvpCipherCtxPtr ctx;
+};
 
-    vector<uint8_t> plainText;
-    plainText.resize(cipherTextSize);
+Aes128GcmDecryptor::Aes128GcmDecryptor() = default;
+Aes128GcmDecryptor::~Aes128GcmDecryptor() = default;
+Aes128GcmDecryptor::Aes128GcmDecryptor(Aes128GcmDecryptor&& other) = default;
+Aes128GcmDecryptor& Aes128GcmDecryptor::operator=(Aes128GcmDecryptor&& other) = default;
+
+bool Aes128GcmDecryptor::init(const vector<uint8_t>& key) {
+    context_.reset();
+    if (key.size() != kAes128GcmKeySize) {
+        LOG(ERROR) << "key is not kAes128GcmKeySize bytes";
+        return false;
+    }
 
     auto ctx = EvpCipherCtxPtr(EVP_CIPHER_CTX_new());
     if (ctx.get() == nullptr) {
         LOG(ERROR) << "EVP_CIPHER_CTX_new: failed";
-        return {};
+        return false;
     }
 
     if (EVP_DecryptInit_ex(ctx.get(), EVP_aes_128_gcm(), NULL, NULL, NULL) != 1) {
         LOG(ERROR) << "EVP_DecryptInit_ex: failed";
-        return {};
+        return false;
     }
 
     if (EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, kAesGcmIvSize, NULL) != 1) {
         LOG(ERROR) << "EVP_CIPHER_CTX_ctrl: failed setting nonce length";
-        return {};
+        return false;
     }
 
-    if (EVP_DecryptInit_ex(ctx.get(), NULL, NULL, (unsigned char*)key.data(), nonce) != 1) {
-        LOG(ERROR) << "EVP_DecryptInit_ex: failed";
-        return {};
+    // The key schedule is set up once here, decrypt() only sets the nonce.
+    if (EVP_DecryptInit_ex(ctx.get(), NULL, NULL, key.data(), NULL) != 1) {
+        LOG(ERROR) << "EVP_DecryptInit_ex: failed setting key";
+        return false;
+    }
+
+    context_ = std::make_unique<Context>();
+    context_->ctx = std::move(ctx);
+    return true;
+}
+
+bool Aes128GcmDecryptor::decrypt(const vector<uint8_t>& encryptedData,
+                                 const vector<uint8_t>& additionalAuthenticatedData,
+                                 vector<uint8_t>* plainText) {
+    if (context_ == nullptr) {
+        LOG(ERROR) << "Aes128GcmDecryptor used without a key";
+        return false;
+    }
+    if (encryptedData.size() < kAesGcmIvSize + kAesGcmTagSize) {
+        LOG(ERROR) << "encryptedData too small";
+        return false;
+    }
+    int cipherTextSize = int(encryptedData.size() - kAesGcmIvSize - kAesGcmTagSize);
+    const unsigned char* nonce = encryptedData.data();
+    const unsigned char* cipherText = nonce + kAesGcmIvSize;
+    unsigned char* tag = const_cast<unsigned char*>(cipherText + cipherTextSize);
+    EVP_CIPHER_CTX* ctx = context_->ctx.get();
+
+    if (EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, nonce) != 1) {
+        LOG(ERROR) << "EVP_DecryptInit_ex: failed setting nonce";
+        return false;
     }
 
     int numWritten;
     if (additionalAuthenticatedData.size() > 0) {
-        if (EVP_DecryptUpdate(ctx.get(), NULL, &numWritten,
-                              (unsigned char*)additionalAuthenticatedData.data(),
+        if (EVP_DecryptUpdate(ctx, NULL, &numWritten, additionalAuthenticatedData.data(),
                               additionalAuthenticatedData.size()) != 1) {
             LOG(ERROR) << "EVP_DecryptUpdate: failed for additionalAuthenticatedData";
-            return {};
+            return false;
         }
         if ((size_t)numWritten != additionalAuthenticatedData.size()) {
             LOG(ERROR) << "EVP_DecryptUpdate: Unexpected outl=" << numWritten << " (expected "
                        << additionalAuthenticatedData.size() << ") for additionalAuthenticatedData";
-            return {};
+            return false;
         }
     }
 
-    if (EVP_DecryptUpdate(ctx.get(), (unsigned char*)plainText.data(), &numWritten, cipherText,
-                          cipherTextSize) != 1) {
-        LOG(ERROR) << "EVP_DecryptUpdate: failed";
-        return {};
-    }
-    if (numWritten != cipherTextSize) {
-        LOG(ERROR) << "EVP_DecryptUpdate: Unexpected outl=" << numWritten << " (expected "
-                   << cipherTextSize << ")";
-        return {};
+    // Decrypt straight into the caller's buffer, and drop the plaintext again
+    // if the tag doesn't match.
+    size_t plainTextBegin = plainText->size();
+    plainText->resize(plainTextBegin + cipherTextSize);
+    unsigned char* out = plainText->data() + plainTextBegin;
+
+    numWritten = 0;
+    if (cipherTextSize > 0) {
+        if (EVP_DecryptUpdate(ctx, out, &numWritten, cipherText, cipherTextSize) != 1) {
+            LOG(ERROR) << "EVP_DecryptUpdate: failed";
+            plainText->resize(plainTextBegin);
+            return false;
+        }
+        if (numWritten != cipherTextSize) {
+            LOG(ERROR) << "EVP_DecryptUpdate: Unexpected outl=" << numWritten << " (expected "
+                       << cipherTextSize << ")";
+            plainText->resize(plainTextBegin);
+            return false;
+        }
     }
 
-    if (!EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, kAesGcmTagSize, tag)) {
+    if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, kAesGcmTagSize, tag)) {
         LOG(ERROR) << "EVP_CIPHER_CTX_ctrl: failed setting expected tag";
-        return {};
+        plainText->resize(plainTextBegin);
+        return false;
     }
 
-    int ret = EVP_DecryptFinal_ex(ctx.get(), (unsigned char*)plainText.data() + numWritten,
-                                  &numWritten);
-    if (ret != 1) {
+    if (EVP_DecryptFinal_ex(ctx, out + numWritten, &numWritten) != 1) {
         LOG(ERROR) << "EVP_DecryptFinal_ex: failed";
-        return {};
+        plainText->resize(plainTextBegin);
+        return false;
     }
     if (numWritten != 0) {
         LOG(ERROR) << "EVP_DecryptFinal_ex: Unexpected non-zero outl=" << numWritten;
-        return {};
+        plainText->resize(plainTextBegin);
+        return false;
     }
 
+    return true;
+}
+
+optional<vector<uint8_t>> decryptAes128Gcm(const vector<uint8_t>& key,
+                                           const vector<uint8_t>& encryptedData,
+                                           const vector<uint8_t>& additionalAuthenticatedData) {
+    Aes128GcmDecryptor decryptor;
+    if (!decryptor.init(key)) {
+        return {};
+    }
+    vector<uint8_t> plainText;
+    if (!decryptor.decrypt(encryptedData, additionalAuthenticatedData, &plainText)) {
+        return {};
+    }
     return plainText;
 }
 
@@ -1825,6 +1878,102 @@ optional<vector<uint8_t>> coseMac0(const vector<uint8_t>& key, const vector<uint
     return array.encode();
 }
 
+struct CoseMac0Builder::Context {
+    Context() { HMAC_CTX_init(&ctx); }
+    ~Context() { HMAC_CTX_cleanup(&ctx); }
+
+    HMAC_CTX ctx;
+    vector<uint8_t> encodedProtectedHeaders;
+    size_t detachedContentRemaining = 0;
+};
+
+CoseMac0Builder::CoseMac0Builder() = default;
+CoseMac0Builder::~CoseMac0Builder() = default;
+CoseMac0Builder::CoseMac0Builder(CoseMac0Builder&& other) = default;
+CoseMac0Builder& CoseMac0Builder::operator=(CoseMac0Builder&& other) = default;
+
+bool CoseMac0Builder::init(const vector<uint8_t>& key, size_t detachedContentSize) {
+    context_.reset();
+    auto context = std::make_unique<Context>();
+    if (HMAC_Init_ex(&context->ctx, key.data(), key.size(), EVP_sha256(), nullptr /* impl */) !=
+        1) {
+        LOG(ERROR) << "Error initializing HMAC_CTX";
+        return false;
+    }
+
+    cppbor::Map protectedHeaders;
+    protectedHeaders.add(COSE_LABEL_ALG, COSE_ALG_HMAC_256_256);
+    context->encodedProtectedHeaders = coseEncodeHeaders(protectedHeaders);
+
+    // This is what coseBuildToBeMACed() produces, up to the detached content
+    // itself which is the last element of the structure.
+    vector<uint8_t> toBeMACedPrefix;
+    auto iter = std::back_inserter(toBeMACedPrefix);
+    cppbor::encodeHeader(cppbor::ARRAY, 4, iter);
+    cppbor::Tstr("MAC0").encode(iter);
+    cppbor::Bstr(context->encodedProtectedHeaders).encode(iter);
+    cppbor::Bstr(vector<uint8_t>()).encode(iter);
+    cppbor::encodeHeader(cppbor::BSTR, detachedContentSize, iter);
+    if (HMAC_Update(&context->ctx, toBeMACedPrefix.data(), toBeMACedPrefix.size()) != 1) {
+        LOG(ERROR) << "Error updating HMAC_CTX";
+        return false;
+    }
+
+    context->detachedContentRemaining = detachedContentSize;
+    context_ = std::move(context);
+    return true;
+}
+
+bool CoseMac0Builder::update(const uint8_t* data, size_t size) {
+    if (context_ == nullptr) {
+        LOG(ERROR) << "CoseMac0Builder used without being initialized";
+        return false;
+    }
+    if (size > context_->detachedContentRemaining) {
+        LOG(ERROR) << "Got " << size << " bytes of detached content, only "
+                   << context_->detachedContentRemaining << " remaining";
+        return false;
+    }
+    if (HMAC_Update(&context_->ctx, data, size) != 1) {
+        LOG(ERROR) << "Error updating HMAC_CTX";
+        return false;
+    }
+    context_->detachedContentRemaining -= size;
+    return true;
+}
+
+optional<vector<uint8_t>> CoseMac0Builder::finish() {
+    if (context_ == nullptr) {
+        LOG(ERROR) << "CoseMac0Builder used without being initialized";
+        return {};
+    }
+    unique_ptr<Context> context = std::move(context_);
+    if (context->detachedContentRemaining != 0) {
+        LOG(ERROR) << "Missing " << context->detachedContentRemaining
+                   << " bytes of detached content";
+        return {};
+    }
+
+    vector<uint8_t> mac;
+    mac.resize(32);
+    unsigned int size = 0;
+    if (HMAC_Final(&context->ctx, mac.data(), &size) != 1) {
+        LOG(ERROR) << "Error finalizing HMAC_CTX";
+        return {};
+    }
+    if (size != 32) {
+        LOG(ERROR) << "Expected 32 bytes from HMAC_Final, got " << size;
+        return {};
+    }
+
+    cppbor::Array array;
+    array.add(context->encodedProtectedHeaders);
+    array.add(cppbor::Map());
+    array.add(cppbor::Null());
+    array.add(mac);
+    return array.encode();
+}
+
 // ---------------------------------------------------------------------------
 // Utility functions specific to IdentityCredential.
 // ---------------------------------------------------------------------------
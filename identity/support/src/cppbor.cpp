@@ -17,6 +17,8 @@
 #include "cppbor.h"
 #include "cppbor_parse.h"
 
+#include <cstring>
+
 #define LOG_TAG "CppBor"
 #include <android-base/logging.h>
 
@@ -150,7 +152,8 @@ bool Simple::operator==(const Simple& other) const& {
 uint8_t* Bstr::encode(uint8_t* pos, const uint8_t* end) const {
     pos = encodeHeader(mValue.size(), pos, end);
     if (!pos || end - pos < static_cast<ptrdiff_t>(mValue.size())) return nullptr;
-    return std::copy(mValue.begin(), mValue.end(), pos);
+    if (!mValue.empty()) memcpy(pos, mValue.data(), mValue.size());
+    return pos + mValue.size();
 }
 
 void Bstr::encodeValue(EncodeCallback encodeCallback) const {
@@ -162,7 +165,8 @@ void Bstr::encodeValue(EncodeCallback encodeCallback) const {
 uint8_t* Tstr::encode(uint8_t* pos, const uint8_t* end) const {
     pos = encodeHeader(mValue.size(), pos, end);
     if (!pos || end - pos < static_cast<ptrdiff_t>(mValue.size())) return nullptr;
-    return std::copy(mValue.begin(), mValue.end(), pos);
+    if (!mValue.empty()) memcpy(pos, mValue.data(), mValue.size());
+    return pos + mValue.size();
 }
 
 void Tstr::encodeValue(EncodeCallback encodeCallback) const {
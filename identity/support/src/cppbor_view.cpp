@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cppbor_view.h"
+
+#include <limits>
+#include <sstream>
+
+#include "cppbor_parse.h"
+
+#define LOG_TAG "CppBor"
+#include <android-base/logging.h>
+
+namespace cppbor {
+
+namespace {
+
+struct Header {
+    MajorType type;
+    uint64_t addlInfo;
+    const uint8_t* valueBegin;
+};
+
+struct ViewError {
+    const uint8_t* position = nullptr;
+    std::string message;
+};
+
+std::string insufficientLengthString(size_t bytesNeeded, size_t bytesAvail,
+                                     const std::string& type) {
+    std::stringstream errStream;
+    errStream << "Need " << bytesNeeded << " byte(s) for " << type << ", have " << bytesAvail
+              << ".";
+    return errStream.str();
+}
+
+/**
+ * Decodes the header at pos.  Returns false and fills in error if the header is truncated or uses
+ * an additional info value that isn't supported.
+ */
+bool decodeHeader(const uint8_t* pos, const uint8_t* end, Header* header, ViewError* error) {
+    const uint8_t* hdrBegin = pos;
+    header->type = static_cast<MajorType>(*pos & 0xE0);
+    uint8_t tagInt = *pos & 0x1F;
+    ++pos;
+
+    if (tagInt < ONE_BYTE_LENGTH) {
+        header->addlInfo = tagInt;
+        header->valueBegin = pos;
+        return true;
+    }
+    if (tagInt > EIGHT_BYTE_LENGTH) {
+        error->position = hdrBegin;
+        error->message = "Unsupported additional info value.";
+        return false;
+    }
+
+    size_t lengthSize = size_t{1} << (tagInt - ONE_BYTE_LENGTH);
+    if (static_cast<size_t>(end - pos) < lengthSize) {
+        error->position = hdrBegin;
+        error->message = insufficientLengthString(lengthSize, end - pos, "length field");
+        return false;
+    }
+
+    uint64_t addlInfo = 0;
+    for (size_t i = 0; i < lengthSize; ++i) {
+        addlInfo = (addlInfo << 8) | *pos++;
+    }
+    header->addlInfo = addlInfo;
+    header->valueBegin = pos;
+    return true;
+}
+
+/**
+ * Validates the item starting at pos.  Returns one past its end, or nullptr after filling in error.
+ */
+const uint8_t* validate(const uint8_t* pos, const uint8_t* end, ViewError* error) {
+    Header header;
+    if (!decodeHeader(pos, end, &header, error)) return nullptr;
+
+    uint64_t entryCount = 0;
+    const char* typeName = nullptr;
+    switch (header.type) {
+        case UINT:
+            return header.valueBegin;
+
+        case NINT:
+            if (header.addlInfo > std::numeric_limits<int64_t>::max()) {
+                error->position = pos;
+                error->message = "NINT values that don't fit in int64_t are not supported.";
+                return nullptr;
+            }
+            return header.valueBegin;
+
+        case BSTR:
+        case TSTR:
+            if (static_cast<uint64_t>(end - header.valueBegin) < header.addlInfo) {
+                error->position = pos;
+                error->message = insufficientLengthString(
+                        header.addlInfo, end - header.valueBegin,
+                        header.type == BSTR ? "byte string" : "text string");
+                return nullptr;
+            }
+            return header.valueBegin + header.addlInfo;
+
+        case SIMPLE:
+            if (header.addlInfo != TRUE && header.addlInfo != FALSE && header.addlInfo != NULL_V) {
+                error->position = pos;
+                error->message = "Unsupported simple value.";
+                return nullptr;
+            }
+            return header.valueBegin;
+
+        case ARRAY:
+            entryCount = header.addlInfo;
+            typeName = "array";
+            break;
+
+        case MAP:
+            // Checked against the buffer size before doubling, so it can't overflow.
+            if (header.addlInfo > static_cast<uint64_t>(end - header.valueBegin)) {
+                entryCount = std::numeric_limits<uint64_t>::max();
+            } else {
+                entryCount = header.addlInfo * 2;
+            }
+            typeName = "map";
+            break;
+
+        case SEMANTIC:
+            entryCount = 1;
+            typeName = "semantic";
+            break;
+    }
+
+    const uint8_t* entryPos = header.valueBegin;
+    for (; entryCount > 0; --entryCount) {
+        if (entryPos == end) {
+            error->position = pos;
+            error->message = std::string("Not enough entries for ") + typeName + ".";
+            return nullptr;
+        }
+        entryPos = validate(entryPos, end, error);
+        if (!entryPos) return nullptr;
+    }
+    return entryPos;
+}
+
+/**
+ * Returns one past the end of the already validated item starting at pos.
+ */
+const uint8_t* skip(const uint8_t* pos, const uint8_t* end) {
+    Header header;
+    ViewError error;
+    CHECK(decodeHeader(pos, end, &header, &error));
+
+    uint64_t entryCount = 0;
+    switch (header.type) {
+        case BSTR:
+        case TSTR:
+            return header.valueBegin + header.addlInfo;
+        case ARRAY:
+            entryCount = header.addlInfo;
+            break;
+        case MAP:
+            entryCount = header.addlInfo * 2;
+            break;
+        case SEMANTIC:
+            entryCount = 1;
+            break;
+        default:
+            return header.valueBegin;
+    }
+
+    const uint8_t* entryPos = header.valueBegin;
+    for (; entryCount > 0; --entryCount) {
+        entryPos = skip(entryPos, end);
+    }
+    return entryPos;
+}
+
+}  // namespace
+
+ViewParseResult parseView(const uint8_t* begin, const uint8_t* end) {
+    if (begin == end) {
+        return {std::nullopt, begin, insufficientLengthString(1, 0, "header")};
+    }
+
+    ViewError error;
+    const uint8_t* itemEnd = validate(begin, end, &error);
+    if (!itemEnd) {
+        return {std::nullopt, error.position, std::move(error.message)};
+    }
+    return {ItemView::decode(begin, itemEnd), itemEnd, ""};
+}
+
+ItemView ItemView::decode(const uint8_t* pos, const uint8_t* end) {
+    Header header;
+    ViewError error;
+    CHECK(decodeHeader(pos, end, &header, &error));
+
+    ItemView view;
+    view.mType = header.type;
+    view.mAddlInfo = header.addlInfo;
+    view.mHdrBegin = pos;
+    view.mValueBegin = header.valueBegin;
+    view.mEnd = skip(pos, end);
+    return view;
+}
+
+size_t ItemView::size() const {
+    switch (mType) {
+        case ARRAY:
+        case MAP:
+            return mAddlInfo;
+        case SEMANTIC:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+ItemView::Iterator ItemView::begin() const {
+    switch (mType) {
+        case ARRAY:
+        case SEMANTIC:
+            return Iterator(*this, size());
+        case MAP:
+            return Iterator(*this, size() * 2);
+        default:
+            return end();
+    }
+}
+
+ItemView::Iterator ItemView::end() const {
+    return Iterator(*this, 0);
+}
+
+ItemView ItemView::operator[](size_t index) const {
+    CHECK(mType == ARRAY && index < size());
+    auto iter = begin();
+    while (index-- > 0) ++iter;
+    return *iter;
+}
+
+std::optional<ItemView> ItemView::get(std::string_view key) const {
+    CHECK(mType == MAP);
+    for (auto iter = begin(); iter != end(); ++iter) {
+        bool match = iter->type() == TSTR && iter->tstrValue() == key;
+        ++iter;
+        if (match) return *iter;
+    }
+    return std::nullopt;
+}
+
+std::optional<ItemView> ItemView::get(int64_t key) const {
+    CHECK(mType == MAP);
+    for (auto iter = begin(); iter != end(); ++iter) {
+        bool match = (iter->type() == UINT || iter->type() == NINT) && iter->intValue() == key;
+        ++iter;
+        if (match) return *iter;
+    }
+    return std::nullopt;
+}
+
+std::unique_ptr<Item> ItemView::toItem() const {
+    return std::move(std::get<0>(parse(mHdrBegin, mEnd)));
+}
+
+}  // namespace cppbor
@@ -436,6 +436,67 @@ TEST(IdentityCredentialSupport, CoseMac0DetachedContent) {
             support::cborPrettyPrint(mac.value()));
 }
 
+TEST(IdentityCredentialSupport, CoseMac0Builder) {
+    vector<uint8_t> key;
+    key.resize(32);
+    vector<uint8_t> detachedContent = {0x10, 0x11, 0x12, 0x13};
+
+    optional<vector<uint8_t>> expected = support::coseMac0(key, {}, detachedContent);
+    ASSERT_TRUE(expected);
+
+    support::CoseMac0Builder builder;
+    ASSERT_TRUE(builder.init(key, detachedContent.size()));
+    ASSERT_TRUE(builder.update(detachedContent.data(), 1));
+    ASSERT_TRUE(builder.update(detachedContent.data() + 1, 3));
+    EXPECT_FALSE(builder.update(detachedContent.data(), 1));
+    optional<vector<uint8_t>> mac = builder.finish();
+    ASSERT_TRUE(mac);
+    EXPECT_EQ(expected.value(), mac.value());
+
+    // All the announced detached content must be supplied.
+    ASSERT_TRUE(builder.init(key, detachedContent.size()));
+    ASSERT_TRUE(builder.update(detachedContent.data(), 2));
+    EXPECT_FALSE(builder.finish());
+}
+
+TEST(IdentityCredentialSupport, Aes128GcmDecryptor) {
+    vector<uint8_t> key = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                           0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    vector<uint8_t> nonce = {0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b};
+    vector<uint8_t> additionalData = strToVec("additionalData");
+    vector<uint8_t> data = strToVec("data");
+
+    optional<vector<uint8_t>> encrypted =
+            support::encryptAes128Gcm(key, nonce, data, additionalData);
+    ASSERT_TRUE(encrypted);
+    optional<vector<uint8_t>> encryptedEmpty = support::encryptAes128Gcm(key, nonce, {}, {});
+    ASSERT_TRUE(encryptedEmpty);
+
+    // The same context decrypts several messages, appending the plaintexts.
+    support::Aes128GcmDecryptor decryptor;
+    ASSERT_TRUE(decryptor.init(key));
+    vector<uint8_t> plainText;
+    ASSERT_TRUE(decryptor.decrypt(encrypted.value(), additionalData, &plainText));
+    ASSERT_TRUE(decryptor.decrypt(encryptedEmpty.value(), {}, &plainText));
+    ASSERT_TRUE(decryptor.decrypt(encrypted.value(), additionalData, &plainText));
+    EXPECT_EQ(strToVec("datadata"), plainText);
+
+    // Failures leave the plaintext untouched and the context usable.
+    vector<uint8_t> tampered = encrypted.value();
+    tampered.back() ^= 0x01;
+    EXPECT_FALSE(decryptor.decrypt(tampered, additionalData, &plainText));
+    EXPECT_FALSE(decryptor.decrypt(encrypted.value(), {}, &plainText));
+    EXPECT_EQ(strToVec("datadata"), plainText);
+    ASSERT_TRUE(decryptor.decrypt(encrypted.value(), additionalData, &plainText));
+    EXPECT_EQ(strToVec("datadatadata"), plainText);
+
+    EXPECT_EQ(data, support::decryptAes128Gcm(key, encrypted.value(), additionalData));
+
+    vector<uint8_t> shortKey = {0x00, 0x01, 0x02};
+    EXPECT_FALSE(decryptor.init(shortKey));
+    EXPECT_FALSE(decryptor.decrypt(encrypted.value(), additionalData, &plainText));
+}
+
 }  // namespace identity
 }  // namespace hardware
 }  // namespace android
@@ -22,6 +22,7 @@
 
 #include "cppbor.h"
 #include "cppbor_parse.h"
+#include "cppbor_view.h"
 
 using namespace cppbor;
 using namespace std;
@@ -1007,6 +1008,140 @@ TEST(FullParserTest, MapWithTruncatedEntry) {
     EXPECT_EQ(encoding.data() + 3, pos);
     EXPECT_EQ("Need 4 byte(s) for length field, have 3.", message);
 }
+
+TEST(EncodeTest, BufferMatchesCallback) {
+    Map val("key1", Array(Map("key_a", 99, "key_b", vector<uint8_t>(300, 0x5a)), "foo"), "key2",
+            true, -70000, Semantic(24, Bstr(vector<uint8_t>{1, 2, 3})), "key3", nullptr);
+
+    vector<uint8_t> callbackEncoding;
+    val.encode(back_inserter(callbackEncoding));
+
+    auto encoding = val.encode();
+    EXPECT_EQ(val.encodedSize(), encoding.size());
+    EXPECT_EQ(callbackEncoding, encoding);
+    EXPECT_EQ(string(callbackEncoding.begin(), callbackEncoding.end()), val.toString());
+}
+
+TEST(ViewParserTest, Scalars) {
+    auto encoding = Array(10, -10, true, false, nullptr).encode();
+    auto [view, pos, message] = parseView(encoding);
+    ASSERT_TRUE(view.has_value()) << message;
+    EXPECT_EQ(encoding.data() + encoding.size(), pos);
+    EXPECT_EQ(ARRAY, view->type());
+    ASSERT_EQ(5U, view->size());
+
+    EXPECT_EQ(UINT, (*view)[0].type());
+    EXPECT_EQ(10, (*view)[0].intValue());
+    EXPECT_EQ(NINT, (*view)[1].type());
+    EXPECT_EQ(-10, (*view)[1].intValue());
+    EXPECT_TRUE((*view)[2].isBool());
+    EXPECT_TRUE((*view)[2].boolValue());
+    EXPECT_TRUE((*view)[3].isBool());
+    EXPECT_FALSE((*view)[3].boolValue());
+    EXPECT_TRUE((*view)[4].isNull());
+}
+
+TEST(ViewParserTest, Strings) {
+    vector<uint8_t> bytes(1000, 0x33);
+    auto encoding = Array("hello", bytes).encode();
+    auto [view, pos, message] = parseView(encoding);
+    ASSERT_TRUE(view.has_value()) << message;
+
+    EXPECT_EQ(TSTR, (*view)[0].type());
+    EXPECT_EQ("hello", (*view)[0].tstrValue());
+
+    auto [data, size] = (*view)[1].bstrValue();
+    EXPECT_EQ(BSTR, (*view)[1].type());
+    EXPECT_EQ(bytes, vector<uint8_t>(data, data + size));
+    // The value is a span of the input, not a copy.
+    EXPECT_EQ(encoding.data() + encoding.size() - bytes.size(), data);
+}
+
+TEST(ViewParserTest, Map) {
+    auto encoding = Map("key1", Map(1, "one", -2, "minus two"), "key2", Array(1, 2, 3)).encode();
+    auto [view, pos, message] = parseView(encoding);
+    ASSERT_TRUE(view.has_value()) << message;
+    EXPECT_EQ(2U, view->size());
+
+    auto key1 = view->get("key1");
+    ASSERT_TRUE(key1.has_value());
+    EXPECT_EQ("one", key1->get(1)->tstrValue());
+    EXPECT_EQ("minus two", key1->get(-2)->tstrValue());
+    EXPECT_FALSE(key1->get(2).has_value());
+    EXPECT_FALSE(view->get("key3").has_value());
+
+    int64_t sum = 0;
+    for (auto& entry : *view->get("key2")) {
+        sum += entry.intValue();
+    }
+    EXPECT_EQ(6, sum);
+
+    vector<string_view> keys;
+    size_t index = 0;
+    for (auto& entry : *view) {
+        if (index++ % 2 == 0) keys.push_back(entry.tstrValue());
+    }
+    EXPECT_THAT(keys, ::testing::ElementsAre("key1", "key2"));
+}
+
+TEST(ViewParserTest, Semantic) {
+    auto encoding = Semantic(24, Bstr(vector<uint8_t>{1, 2, 3})).encode();
+    auto [view, pos, message] = parseView(encoding);
+    ASSERT_TRUE(view.has_value()) << message;
+    EXPECT_EQ(SEMANTIC, view->type());
+    EXPECT_EQ(24U, view->semanticTag());
+    EXPECT_EQ(BSTR, view->child().type());
+    EXPECT_EQ(3U, view->child().bstrValue().second);
+}
+
+TEST(ViewParserTest, Complex) {
+    vector<uint8_t> vec = {0x01, 0x02, 0x08, 0x03};
+    Map val("Outer1",
+            Array(Map("Inner1", 99,  //
+                      "Inner2", vec),
+                  "foo"),
+            "Outer2", 10);
+
+    auto encoding = val.encode();
+    auto [view, pos, message] = parseView(encoding);
+    ASSERT_TRUE(view.has_value()) << message;
+
+    auto inner = (*view->get("Outer1"))[0];
+    auto [begin, size] = inner.encoded();
+    EXPECT_EQ(Map("Inner1", 99, "Inner2", vec).encode(), vector<uint8_t>(begin, begin + size));
+    EXPECT_EQ(val, *view->toItem());
+}
+
+TEST(ViewParserTest, Errors) {
+    auto truncated = Array(1, 2, 3, 400000).encode();
+    auto [view, pos, message] = parseView(truncated.data(), truncated.data() + truncated.size() - 1);
+    EXPECT_FALSE(view.has_value());
+    EXPECT_EQ(truncated.data() + truncated.size() - 5, pos);
+    EXPECT_EQ("Need 4 byte(s) for length field, have 3.", message);
+
+    auto missingEntry = Array(1, 2, 3).encode();
+    tie(view, pos, message) =
+            parseView(missingEntry.data(), missingEntry.data() + missingEntry.size() - 1);
+    EXPECT_FALSE(view.has_value());
+    EXPECT_EQ(missingEntry.data(), pos);
+    EXPECT_EQ("Not enough entries for array.", message);
+
+    vector<uint8_t> shortString = {0x43, 0x01, 0x02};
+    tie(view, pos, message) = parseView(shortString);
+    EXPECT_FALSE(view.has_value());
+    EXPECT_EQ("Need 3 byte(s) for byte string, have 2.", message);
+
+    vector<uint8_t> bigNint = {0x3B, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    tie(view, pos, message) = parseView(bigNint);
+    EXPECT_FALSE(view.has_value());
+    EXPECT_EQ("NINT values that don't fit in int64_t are not supported.", message);
+
+    vector<uint8_t> undefined = {0xF7};
+    tie(view, pos, message) = parseView(undefined);
+    EXPECT_FALSE(view.has_value());
+    EXPECT_EQ("Unsupported simple value.", message);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
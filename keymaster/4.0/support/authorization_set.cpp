@@ -91,20 +91,15 @@ void AuthorizationSet::Deduplicate() {
     if (data_.empty()) return;
 
     Sort();
-    std::vector<KeyParameter> result;
-
-    auto curr = data_.begin();
-    auto prev = curr++;
-    for (; curr != data_.end(); ++prev, ++curr) {
-        if (prev->tag == Tag::INVALID) continue;
 
-        if (!keyParamEqual(*prev, *curr)) {
-            result.push_back(std::move(*prev));
-        }
-    }
-    result.push_back(std::move(*prev));
+    // Invalid entries sort first.  They are dropped, unless there is nothing else.
+    auto first = std::find_if(data_.begin(), data_.end(),
+                              [](const KeyParameter& param) { return param.tag != Tag::INVALID; });
+    if (first == data_.end()) --first;
+    data_.erase(data_.begin(), first);
 
-    std::swap(data_, result);
+    // Compact in place rather than moving every entry into a new vector.
+    data_.erase(std::unique(data_.begin(), data_.end(), keyParamEqual), data_.end());
 }
 
 void AuthorizationSet::Union(const AuthorizationSet& other) {
@@ -452,6 +447,226 @@ void AuthorizationSet::Deserialize(std::istream* in) {
     deserialize(*in, &data_);
 }
 
+/**
+ * Flat format is a single buffer that can be searched in place:
+ * | 32 bit magic                 |
+ * | 32 bit element_count         | number of entries
+ * | 32 bit blobs_size            | total bytes used by blob data
+ * --------------------------------
+ * | element_count entries        | fixed size, ordered by tag
+ * --------------------------------
+ * | blobs_size bytes of data     | this is where the blob data is stored
+ *
+ * Flat format of an entry:
+ * | 32 bit tag             |
+ * | 32 bit blob_length     | zero unless the tag is a BYTES or BIGNUM tag
+ * | 64 bit value           | the integer, enum, date or bool value, or the blob offset
+ *
+ * Like the stream format, all fields are in host byte order.
+ */
+
+namespace {
+
+constexpr uint32_t kFlatMagic = 0x4b4d4146;  // "KMAF"
+constexpr size_t kFlatHeaderSize = 3 * sizeof(uint32_t);
+constexpr size_t kFlatEntrySize = 2 * sizeof(uint32_t) + sizeof(uint64_t);
+
+template <typename T>
+void writeFlat(uint8_t* pos, T value) {
+    memcpy(pos, &value, sizeof(T));
+}
+
+template <typename T>
+T readFlat(const uint8_t* pos) {
+    T value;
+    memcpy(&value, pos, sizeof(T));
+    return value;
+}
+
+bool isFlatTagType(TagType type) {
+    switch (type) {
+        case TagType::ENUM:
+        case TagType::ENUM_REP:
+        case TagType::UINT:
+        case TagType::UINT_REP:
+        case TagType::ULONG:
+        case TagType::ULONG_REP:
+        case TagType::DATE:
+        case TagType::BOOL:
+        case TagType::BIGNUM:
+        case TagType::BYTES:
+            return true;
+        case TagType::INVALID:
+            return false;
+    }
+    return false;
+}
+
+bool isBlobTagType(TagType type) {
+    return type == TagType::BIGNUM || type == TagType::BYTES;
+}
+
+uint64_t flatValue(const KeyParameter& param) {
+    switch (typeFromTag(param.tag)) {
+        case TagType::ULONG:
+        case TagType::ULONG_REP:
+            return param.f.longInteger;
+        case TagType::DATE:
+            return param.f.dateTime;
+        case TagType::BOOL:
+            return param.f.boolValue ? 1 : 0;
+        default:
+            return param.f.integer;
+    }
+}
+
+bool setFlatValue(uint64_t value, KeyParameter* param) {
+    switch (typeFromTag(param->tag)) {
+        case TagType::ULONG:
+        case TagType::ULONG_REP:
+            param->f.longInteger = value;
+            return true;
+        case TagType::DATE:
+            param->f.dateTime = value;
+            return true;
+        case TagType::BOOL:
+            param->f.boolValue = value != 0;
+            return value <= 1;
+        default:
+            param->f.integer = value;
+            return value <= std::numeric_limits<uint32_t>::max();
+    }
+}
+
+struct TagLess {
+    bool operator()(const KeyParameter& param, Tag tag) const { return param.tag < tag; }
+    bool operator()(Tag tag, const KeyParameter& param) const { return tag < param.tag; }
+};
+
+}  // namespace
+
+bool AuthorizationSet::SerializeFlat(std::vector<uint8_t>* out) const {
+    std::vector<const KeyParameter*> entries;
+    entries.reserve(data_.size());
+    uint64_t blobs_size = 0;
+    for (const auto& param : data_) {
+        if (!isFlatTagType(typeFromTag(param.tag))) {
+            // Invalid entries are skipped, as in the stream format.
+            if (param.tag != Tag::INVALID) {
+                LOG(WARNING) << "Trying to serialize unknown tag " << unsigned(param.tag);
+            }
+            continue;
+        }
+        if (isBlobTagType(typeFromTag(param.tag))) blobs_size += param.blob.size();
+        entries.push_back(&param);
+    }
+    if (blobs_size > std::numeric_limits<uint32_t>::max()) return false;
+
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const KeyParameter* a, const KeyParameter* b) { return a->tag < b->tag; });
+
+    out->resize(kFlatHeaderSize + entries.size() * kFlatEntrySize + blobs_size);
+    uint8_t* pos = out->data();
+    uint8_t* blobs = pos + kFlatHeaderSize + entries.size() * kFlatEntrySize;
+    writeFlat<uint32_t>(pos, kFlatMagic);
+    writeFlat<uint32_t>(pos + sizeof(uint32_t), entries.size());
+    writeFlat<uint32_t>(pos + 2 * sizeof(uint32_t), blobs_size);
+    pos += kFlatHeaderSize;
+
+    uint32_t blob_offset = 0;
+    for (const KeyParameter* param : entries) {
+        writeFlat<uint32_t>(pos, static_cast<uint32_t>(param->tag));
+        if (isBlobTagType(typeFromTag(param->tag))) {
+            uint32_t blob_length = param->blob.size();
+            writeFlat<uint32_t>(pos + sizeof(uint32_t), blob_length);
+            writeFlat<uint64_t>(pos + 2 * sizeof(uint32_t), blob_offset);
+            if (blob_length) memcpy(blobs + blob_offset, &param->blob[0], blob_length);
+            blob_offset += blob_length;
+        } else {
+            writeFlat<uint32_t>(pos + sizeof(uint32_t), 0);
+            writeFlat<uint64_t>(pos + 2 * sizeof(uint32_t), flatValue(*param));
+        }
+        pos += kFlatEntrySize;
+    }
+    return true;
+}
+
+bool AuthorizationSet::DeserializeFlat(const uint8_t* data, size_t size) {
+    AuthorizationSetView view;
+    if (!view.Parse(data, size)) return false;
+    *this = view.ToAuthorizationSet();
+    return true;
+}
+
+AuthorizationSetView::AuthorizationSetView(const AuthorizationSet& set) {
+    data_.resize(set.size());
+    for (size_t i = 0; i < data_.size(); ++i) {
+        const KeyParameter& param = set[i];
+        data_[i].tag = param.tag;
+        data_[i].f = param.f;
+        data_[i].blob.setToExternal(const_cast<uint8_t*>(param.blob.data()), param.blob.size());
+    }
+    std::stable_sort(data_.begin(), data_.end(),
+                     [](const KeyParameter& a, const KeyParameter& b) { return a.tag < b.tag; });
+}
+
+bool AuthorizationSetView::Parse(const uint8_t* data, size_t size) {
+    data_.clear();
+    if (size < kFlatHeaderSize || readFlat<uint32_t>(data) != kFlatMagic) return false;
+    uint32_t element_count = readFlat<uint32_t>(data + sizeof(uint32_t));
+    uint32_t blobs_size = readFlat<uint32_t>(data + 2 * sizeof(uint32_t));
+    uint64_t entries_size = uint64_t(element_count) * kFlatEntrySize;
+    if (kFlatHeaderSize + entries_size + blobs_size != size) return false;
+
+    const uint8_t* pos = data + kFlatHeaderSize;
+    const uint8_t* blobs = pos + entries_size;
+    std::vector<KeyParameter> result(element_count);
+    for (uint32_t i = 0; i < element_count; ++i, pos += kFlatEntrySize) {
+        KeyParameter& param = result[i];
+        param.tag = static_cast<Tag>(readFlat<uint32_t>(pos));
+        uint32_t blob_length = readFlat<uint32_t>(pos + sizeof(uint32_t));
+        uint64_t value = readFlat<uint64_t>(pos + 2 * sizeof(uint32_t));
+
+        // Lookups rely on the order, so don't trust it.
+        if (!isFlatTagType(typeFromTag(param.tag))) return false;
+        if (i > 0 && param.tag < result[i - 1].tag) return false;
+
+        if (isBlobTagType(typeFromTag(param.tag))) {
+            if (value > blobs_size || blob_length > blobs_size - value) return false;
+            param.blob.setToExternal(const_cast<uint8_t*>(blobs + value), blob_length);
+        } else if (blob_length != 0 || !setFlatValue(value, &param)) {
+            return false;
+        }
+    }
+
+    data_ = std::move(result);
+    return true;
+}
+
+int AuthorizationSetView::find(Tag tag, int begin) const {
+    if (begin < -1 || begin + 1 >= static_cast<int>(data_.size())) return -1;
+    auto iter = std::lower_bound(data_.begin() + (1 + begin), data_.end(), tag, TagLess());
+    if (iter != data_.end() && iter->tag == tag) return iter - data_.begin();
+    return -1;
+}
+
+size_t AuthorizationSetView::GetTagCount(Tag tag) const {
+    auto range = EqualRange(tag);
+    return range.second - range.first;
+}
+
+std::pair<std::vector<KeyParameter>::const_iterator, std::vector<KeyParameter>::const_iterator>
+AuthorizationSetView::EqualRange(Tag tag) const {
+    return std::equal_range(data_.begin(), data_.end(), tag, TagLess());
+}
+
+AuthorizationSet AuthorizationSetView::ToAuthorizationSet() const {
+    AuthorizationSet result;
+    // Copying a KeyParameter copies its blob.
+    result.append(data_.begin(), data_.end());
+    return result;
+}
+
 AuthorizationSetBuilder& AuthorizationSetBuilder::RsaKey(uint32_t key_size,
                                                          uint64_t public_exponent) {
     Authorization(TAG_ALGORITHM, Algorithm::RSA);
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the stream serialization of AuthorizationSet with the flat format read in place by
+// AuthorizationSetView.  Each iteration parses a set of key characteristics and then makes the
+// lookups an operation typically makes before it is allowed to start.
+
+#define LOG_TAG "keymaster4support_benchmark"
+
+#include <keymasterV4_0/authorization_set.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace test {
+
+namespace {
+
+const uint8_t kApplicationId[] = "com.example.benchmark";
+const uint8_t kAttestationApplicationId[256] = {0x30, 0x82, 0x00, 0xfc};
+
+// Roughly what keystore stores for an RSA signing key bound to a few secure user ids.  The
+// argument adds more secure ids to grow the set.
+AuthorizationSet makeCharacteristics(int extraUserSecureIds) {
+    AuthorizationSetBuilder builder;
+    builder.RsaSigningKey(2048, 65537)
+            .Digest(Digest::SHA_2_256, Digest::SHA_2_512)
+            .Padding(PaddingMode::RSA_PSS, PaddingMode::RSA_PKCS1_1_5_SIGN)
+            .Authorization(TAG_ORIGIN, KeyOrigin::GENERATED)
+            .Authorization(TAG_OS_VERSION, 110000U)
+            .Authorization(TAG_OS_PATCHLEVEL, 202009U)
+            .Authorization(TAG_VENDOR_PATCHLEVEL, 20200905U)
+            .Authorization(TAG_BOOT_PATCHLEVEL, 20200905U)
+            .Authorization(TAG_USER_AUTH_TYPE, HardwareAuthenticatorType::PASSWORD)
+            .Authorization(TAG_AUTH_TIMEOUT, 300U)
+            .Authorization(TAG_CREATION_DATETIME, 1600000000000ULL)
+            .Authorization(TAG_USER_ID, 0U)
+            .Authorization(TAG_APPLICATION_ID, kApplicationId, sizeof(kApplicationId))
+            .Authorization(TAG_ATTESTATION_APPLICATION_ID, kAttestationApplicationId,
+                           sizeof(kAttestationApplicationId));
+    for (int i = 0; i <= extraUserSecureIds; ++i) {
+        builder.Authorization(TAG_USER_SECURE_ID, 0x1234567800000000ULL + i);
+    }
+    return std::move(builder);
+}
+
+template <typename Set>
+bool checkCharacteristics(const Set& set) {
+    auto algorithm = set.GetTagValue(TAG_ALGORITHM);
+    auto keySize = set.GetTagValue(TAG_KEY_SIZE);
+    auto timeout = set.GetTagValue(TAG_AUTH_TIMEOUT);
+    benchmark::DoNotOptimize(set.GetTagValue(TAG_ACTIVE_DATETIME));
+    benchmark::DoNotOptimize(set.GetTagValue(TAG_USAGE_EXPIRE_DATETIME));
+    benchmark::DoNotOptimize(set.GetTagCount(TAG_USER_SECURE_ID));
+    return algorithm.isOk() && algorithm.value() == Algorithm::RSA && keySize.isOk() &&
+           keySize.value() == 2048 && timeout.isOk() &&
+           set.Contains(TAG_PURPOSE, KeyPurpose::SIGN) &&
+           set.Contains(TAG_DIGEST, Digest::SHA_2_256) &&
+           set.Contains(TAG_PADDING, PaddingMode::RSA_PSS) && !set.Contains(TAG_NO_AUTH_REQUIRED);
+}
+
+}  // namespace
+
+static void BM_ParseStream(benchmark::State& state) {
+    std::stringstream out;
+    makeCharacteristics(state.range(0)).Serialize(&out);
+    const std::string serialized = out.str();
+
+    for (auto _ : state) {
+        std::istringstream in(serialized);
+        AuthorizationSet set;
+        set.Deserialize(&in);
+        if (!in || !checkCharacteristics(set)) {
+            state.SkipWithError("Stream deserialization failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * serialized.size());
+}
+BENCHMARK(BM_ParseStream)->Arg(0)->Arg(16)->Arg(64);
+
+static void BM_ParseFlat(benchmark::State& state) {
+    std::vector<uint8_t> serialized;
+    if (!makeCharacteristics(state.range(0)).SerializeFlat(&serialized)) {
+        state.SkipWithError("Flat serialization failed");
+        return;
+    }
+
+    for (auto _ : state) {
+        AuthorizationSetView view;
+        if (!view.Parse(serialized) || !checkCharacteristics(view)) {
+            state.SkipWithError("Flat parsing failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * serialized.size());
+}
+BENCHMARK(BM_ParseFlat)->Arg(0)->Arg(16)->Arg(64);
+
+static void BM_SerializeStream(benchmark::State& state) {
+    const AuthorizationSet set = makeCharacteristics(state.range(0));
+
+    for (auto _ : state) {
+        std::stringstream out;
+        set.Serialize(&out);
+        benchmark::DoNotOptimize(out.tellp());
+    }
+}
+BENCHMARK(BM_SerializeStream)->Arg(0)->Arg(16)->Arg(64);
+
+static void BM_SerializeFlat(benchmark::State& state) {
+    const AuthorizationSet set = makeCharacteristics(state.range(0));
+
+    std::vector<uint8_t> out;
+    for (auto _ : state) {
+        set.SerializeFlat(&out);
+        benchmark::DoNotOptimize(out.data());
+    }
+}
+BENCHMARK(BM_SerializeFlat)->Arg(0)->Arg(16)->Arg(64);
+
+static void BM_LookupScan(benchmark::State& state) {
+    const AuthorizationSet set = makeCharacteristics(state.range(0));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(checkCharacteristics(set));
+    }
+}
+BENCHMARK(BM_LookupScan)->Arg(0)->Arg(16)->Arg(64);
+
+static void BM_LookupBinarySearch(benchmark::State& state) {
+    const AuthorizationSet set = makeCharacteristics(state.range(0));
+    const AuthorizationSetView view(set);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(checkCharacteristics(view));
+    }
+}
+BENCHMARK(BM_LookupBinarySearch)->Arg(0)->Arg(16)->Arg(64);
+
+static void BM_Deduplicate(benchmark::State& state) {
+    AuthorizationSet set = makeCharacteristics(state.range(0));
+    set.push_back(set);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        AuthorizationSet copy = set;
+        state.ResumeTiming();
+        copy.Deduplicate();
+        benchmark::DoNotOptimize(copy.size());
+    }
+}
+BENCHMARK(BM_Deduplicate)->Arg(0)->Arg(16)->Arg(64);
+
+}  // namespace test
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
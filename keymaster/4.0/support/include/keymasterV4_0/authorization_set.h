@@ -222,6 +222,20 @@ class AuthorizationSet {
     void Serialize(std::ostream* out) const;
     void Deserialize(std::istream* in);
 
+    /**
+     * Serializes the set into a single contiguous buffer, replacing the contents of \p out.  The
+     * entries are ordered by tag, keeping the relative order of repeated tags, so that the result
+     * can be searched in place by AuthorizationSetView.  Returns false if the set is too large to
+     * be serialized.
+     */
+    bool SerializeFlat(std::vector<uint8_t>* out) const;
+
+    /**
+     * Replaces the contents of this set with the entries of a buffer written by SerializeFlat().
+     * Returns false, leaving the set unchanged, if the buffer is malformed.
+     */
+    bool DeserializeFlat(const uint8_t* data, size_t size);
+
    private:
     NullOr<const KeyParameter&> GetEntry(Tag tag) const;
 
@@ -305,6 +319,79 @@ class AuthorizationSetBuilder : public AuthorizationSet {
     }
 };
 
+/**
+ * A read-only collection of KeyParameters sorted by tag, so that lookups are binary searches
+ * instead of scans.  A view is either built from an AuthorizationSet or parsed from a buffer
+ * written by AuthorizationSet::SerializeFlat().  Either way the blobs of BYTES and BIGNUM entries
+ * are not copied: they refer to the source set or buffer, which must outlive the view and must not
+ * be modified while it is in use.  Copying a view makes deep copies of the blobs.
+ */
+class AuthorizationSetView {
+   public:
+    typedef KeyParameter value_type;
+
+    AuthorizationSetView() {}
+
+    explicit AuthorizationSetView(const AuthorizationSet& set);
+
+    /**
+     * Parses a buffer written by AuthorizationSet::SerializeFlat().  Returns false, leaving the
+     * view empty, if the buffer is malformed.
+     */
+    bool Parse(const uint8_t* data, size_t size);
+    bool Parse(const std::vector<uint8_t>& data) { return Parse(data.data(), data.size()); }
+
+    size_t size() const { return data_.size(); }
+    bool empty() const { return data_.empty(); }
+
+    std::vector<KeyParameter>::const_iterator begin() const { return data_.begin(); }
+    std::vector<KeyParameter>::const_iterator end() const { return data_.end(); }
+
+    const KeyParameter& operator[](int n) const { return data_[n]; }
+
+    /**
+     * Returns the offset of the next entry that matches \p tag, starting from the element after \p
+     * begin.  If not found, or if \p begin is the last entry or beyond, returns -1.  Entries with
+     * the same tag are adjacent.
+     */
+    int find(Tag tag, int begin = -1) const;
+
+    bool Contains(Tag tag) const { return find(tag) != -1; }
+
+    template <TagType tag_type, Tag tag, typename ValueT>
+    bool Contains(TypedTag<tag_type, tag> ttag, const ValueT& value) const {
+        auto range = EqualRange(tag);
+        for (auto param = range.first; param != range.second; ++param) {
+            auto entry = authorizationValue(ttag, *param);
+            if (entry.isOk() && static_cast<ValueT>(entry.value()) == value) return true;
+        }
+        return false;
+    }
+
+    /**
+     * Returns the number of \p tag entries.
+     */
+    size_t GetTagCount(Tag tag) const;
+
+    template <typename T>
+    inline NullOr<const typename TypedTag2ValueType<T>::type&> GetTagValue(T tag) const {
+        int pos = find(tag);
+        if (pos != -1) return authorizationValue(tag, data_[pos]);
+        return {};
+    }
+
+    /**
+     * Returns an AuthorizationSet that owns copies of the entries, in tag order.
+     */
+    AuthorizationSet ToAuthorizationSet() const;
+
+   private:
+    std::pair<std::vector<KeyParameter>::const_iterator, std::vector<KeyParameter>::const_iterator>
+    EqualRange(Tag tag) const;
+
+    std::vector<KeyParameter> data_;
+};
+
 }  // namespace V4_0
 }  // namespace keymaster
 }  // namespace hardware
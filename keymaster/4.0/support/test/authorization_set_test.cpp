@@ -0,0 +1,294 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <keymasterV4_0/authorization_set.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace test {
+
+namespace {
+
+// Layout of the flat format, see authorization_set.cpp.
+constexpr size_t kHeaderSize = 12;
+constexpr size_t kEntrySize = 16;
+constexpr size_t kEntryBlobLengthOffset = 4;
+constexpr size_t kEntryValueOffset = 8;
+
+// Keymaster 4.0 defines no UINT_REP or BIGNUM tag, so make some up.
+constexpr Tag kUintRepTag = static_cast<Tag>(static_cast<uint32_t>(TagType::UINT_REP) | 9000);
+constexpr Tag kBignumTag = static_cast<Tag>(static_cast<uint32_t>(TagType::BIGNUM) | 9001);
+
+const uint8_t kApplicationId[] = "com.example.test";
+const uint8_t kBignum[] = {0x01, 0x00, 0x01, 0x7f, 0xff};
+
+KeyParameter makeUintRep(uint32_t value) {
+    KeyParameter param;
+    param.tag = kUintRepTag;
+    param.f.integer = value;
+    return param;
+}
+
+KeyParameter makeBignum(const uint8_t* data, size_t size) {
+    KeyParameter param;
+    param.tag = kBignumTag;
+    param.blob.setToExternal(const_cast<uint8_t*>(data), size);
+    // Make the parameter own its blob.
+    return KeyParameter(param);
+}
+
+// One or more entries of every tag type, unsorted, with repeated tags.
+AuthorizationSet makeSetOfAllTypes() {
+    AuthorizationSet set =
+            AuthorizationSetBuilder()
+                    .Authorization(TAG_APPLICATION_ID, kApplicationId, sizeof(kApplicationId))
+                    .Authorization(TAG_PURPOSE, KeyPurpose::SIGN)
+                    .Authorization(TAG_ALGORITHM, Algorithm::RSA)
+                    .Authorization(TAG_KEY_SIZE, 2048U)
+                    .Authorization(TAG_RSA_PUBLIC_EXPONENT, 65537ULL)
+                    .Authorization(TAG_USER_SECURE_ID, 0x0123456789abcdefULL)
+                    .Authorization(TAG_ACTIVE_DATETIME, 1600000000000ULL)
+                    .Authorization(TAG_NO_AUTH_REQUIRED)
+                    .Authorization(TAG_PURPOSE, KeyPurpose::VERIFY)
+                    .Authorization(TAG_USER_SECURE_ID, 42ULL)
+                    .Authorization(TAG_APPLICATION_DATA, kApplicationId, size_t(0));
+    set.push_back(makeUintRep(7));
+    set.push_back(makeBignum(kBignum, sizeof(kBignum)));
+    set.push_back(makeUintRep(3));
+    return set;
+}
+
+// The entries in the order SerializeFlat() writes them.
+std::vector<KeyParameter> sortedByTag(const AuthorizationSet& set) {
+    std::vector<KeyParameter> sorted(set.begin(), set.end());
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const KeyParameter& a, const KeyParameter& b) { return a.tag < b.tag; });
+    return sorted;
+}
+
+std::vector<uint8_t> serialize(const AuthorizationSet& set) {
+    std::vector<uint8_t> buffer;
+    EXPECT_TRUE(set.SerializeFlat(&buffer));
+    return buffer;
+}
+
+void writeEntryField(std::vector<uint8_t>* buffer, size_t entry, size_t offset, uint32_t value) {
+    memcpy(buffer->data() + kHeaderSize + entry * kEntrySize + offset, &value, sizeof(value));
+}
+
+void writeEntryValue(std::vector<uint8_t>* buffer, size_t entry, uint64_t value) {
+    memcpy(buffer->data() + kHeaderSize + entry * kEntrySize + kEntryValueOffset, &value,
+           sizeof(value));
+}
+
+size_t entryOf(const AuthorizationSetView& view, Tag tag) {
+    int pos = view.find(tag);
+    EXPECT_NE(-1, pos);
+    return pos;
+}
+
+}  // namespace
+
+TEST(AuthorizationSetFlatTest, RoundTripOfAllTagTypes) {
+    AuthorizationSet set = makeSetOfAllTypes();
+    std::vector<uint8_t> buffer = serialize(set);
+
+    AuthorizationSetView view;
+    ASSERT_TRUE(view.Parse(buffer));
+    std::vector<KeyParameter> expected = sortedByTag(set);
+    ASSERT_EQ(expected.size(), view.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], view[i]) << "entry " << i;
+    }
+
+    AuthorizationSet deserialized;
+    ASSERT_TRUE(deserialized.DeserializeFlat(buffer.data(), buffer.size()));
+    ASSERT_EQ(expected.size(), deserialized.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], deserialized[i]) << "entry " << i;
+    }
+}
+
+TEST(AuthorizationSetFlatTest, LookupsInParsedView) {
+    AuthorizationSet set = makeSetOfAllTypes();
+    std::vector<uint8_t> buffer = serialize(set);
+    AuthorizationSetView view;
+    ASSERT_TRUE(view.Parse(buffer));
+
+    EXPECT_EQ(Algorithm::RSA, view.GetTagValue(TAG_ALGORITHM).value());
+    EXPECT_EQ(2048U, view.GetTagValue(TAG_KEY_SIZE).value());
+    EXPECT_EQ(65537ULL, view.GetTagValue(TAG_RSA_PUBLIC_EXPONENT).value());
+    EXPECT_EQ(1600000000000ULL, view.GetTagValue(TAG_ACTIVE_DATETIME).value());
+    EXPECT_TRUE(view.Contains(TAG_NO_AUTH_REQUIRED));
+    EXPECT_TRUE(view.Contains(TAG_PURPOSE, KeyPurpose::SIGN));
+    EXPECT_TRUE(view.Contains(TAG_PURPOSE, KeyPurpose::VERIFY));
+    EXPECT_FALSE(view.Contains(TAG_PURPOSE, KeyPurpose::ENCRYPT));
+    EXPECT_TRUE(view.Contains(TAG_USER_SECURE_ID, 0x0123456789abcdefULL));
+    EXPECT_EQ(2U, view.GetTagCount(TAG_USER_SECURE_ID));
+    EXPECT_EQ(2U, view.GetTagCount(kUintRepTag));
+    EXPECT_FALSE(view.Contains(TAG_EC_CURVE));
+
+    // Repeated tags keep their relative order.
+    int first = view.find(kUintRepTag);
+    ASSERT_NE(-1, first);
+    EXPECT_EQ(7U, view[first].f.integer);
+    EXPECT_EQ(3U, view[view.find(kUintRepTag, first)].f.integer);
+    EXPECT_EQ(-1, view.find(kUintRepTag, first + 1));
+
+    // Starting points outside the view find nothing.
+    int size = static_cast<int>(view.size());
+    EXPECT_EQ(-1, view.find(kUintRepTag, size - 1));
+    EXPECT_EQ(-1, view.find(kUintRepTag, size));
+    EXPECT_EQ(-1, view.find(kUintRepTag, size + 10));
+    EXPECT_EQ(-1, view.find(kUintRepTag, -2));
+
+    // Blobs refer to the buffer.
+    const KeyParameter& bignum = view[entryOf(view, kBignumTag)];
+    ASSERT_EQ(sizeof(kBignum), bignum.blob.size());
+    EXPECT_EQ(0, memcmp(kBignum, bignum.blob.data(), sizeof(kBignum)));
+    EXPECT_GE(bignum.blob.data(), buffer.data());
+    EXPECT_LE(bignum.blob.data() + bignum.blob.size(), buffer.data() + buffer.size());
+    EXPECT_EQ(0U, view.GetTagValue(TAG_APPLICATION_DATA).value().size());
+}
+
+TEST(AuthorizationSetFlatTest, EmptySet) {
+    std::vector<uint8_t> buffer = serialize(AuthorizationSet());
+    EXPECT_EQ(kHeaderSize, buffer.size());
+
+    AuthorizationSetView view;
+    EXPECT_TRUE(view.Parse(buffer));
+    EXPECT_TRUE(view.empty());
+}
+
+TEST(AuthorizationSetFlatTest, SkipsInvalidEntries) {
+    AuthorizationSet set = AuthorizationSetBuilder().Authorization(TAG_KEY_SIZE, 256U);
+    set.push_back(KeyParameter());
+    std::vector<uint8_t> buffer = serialize(set);
+    AuthorizationSetView view;
+    ASSERT_TRUE(view.Parse(buffer));
+    ASSERT_EQ(1U, view.size());
+    EXPECT_EQ(Tag::KEY_SIZE, view[0].tag);
+}
+
+TEST(AuthorizationSetFlatTest, RejectsTruncatedBuffers) {
+    std::vector<uint8_t> buffer = serialize(makeSetOfAllTypes());
+    AuthorizationSetView view;
+    for (size_t size = 0; size < buffer.size(); ++size) {
+        EXPECT_FALSE(view.Parse(buffer.data(), size)) << "size " << size;
+        EXPECT_TRUE(view.empty());
+    }
+}
+
+TEST(AuthorizationSetFlatTest, RejectsOversizedBuffers) {
+    std::vector<uint8_t> buffer = serialize(makeSetOfAllTypes());
+    AuthorizationSetView view;
+
+    std::vector<uint8_t> trailing = buffer;
+    trailing.push_back(0);
+    EXPECT_FALSE(view.Parse(trailing));
+
+    // Counts that claim more data than there is, including ones that overflow 32 bits.
+    for (uint32_t count : {0xffffffffU, 0x10000000U, 0x0fffffffU}) {
+        std::vector<uint8_t> tooManyEntries = buffer;
+        memcpy(tooManyEntries.data() + 4, &count, sizeof(count));
+        EXPECT_FALSE(view.Parse(tooManyEntries)) << "element count " << count;
+
+        std::vector<uint8_t> tooManyBlobBytes = buffer;
+        memcpy(tooManyBlobBytes.data() + 8, &count, sizeof(count));
+        EXPECT_FALSE(view.Parse(tooManyBlobBytes)) << "blobs size " << count;
+    }
+    EXPECT_TRUE(view.empty());
+}
+
+TEST(AuthorizationSetFlatTest, RejectsBlobsOutsideTheBuffer) {
+    std::vector<uint8_t> buffer = serialize(makeSetOfAllTypes());
+    AuthorizationSetView view;
+    ASSERT_TRUE(view.Parse(buffer));
+    size_t entry = entryOf(view, kBignumTag);
+    uint32_t blobsSize;
+    memcpy(&blobsSize, buffer.data() + 8, sizeof(blobsSize));
+
+    std::vector<uint8_t> badLength = buffer;
+    writeEntryField(&badLength, entry, kEntryBlobLengthOffset, blobsSize + 1);
+    EXPECT_FALSE(view.Parse(badLength));
+
+    std::vector<uint8_t> badOffset = buffer;
+    writeEntryValue(&badOffset, entry, blobsSize);
+    EXPECT_FALSE(view.Parse(badOffset));
+
+    // An offset that wraps around when the length is added to it.
+    std::vector<uint8_t> wrappingOffset = buffer;
+    writeEntryValue(&wrappingOffset, entry, 0xfffffffffffffffcULL);
+    EXPECT_FALSE(view.Parse(wrappingOffset));
+}
+
+TEST(AuthorizationSetFlatTest, RejectsMalformedEntries) {
+    std::vector<uint8_t> buffer = serialize(makeSetOfAllTypes());
+    AuthorizationSetView view;
+    ASSERT_TRUE(view.Parse(buffer));
+    size_t keySize = entryOf(view, Tag::KEY_SIZE);
+    size_t noAuthRequired = entryOf(view, Tag::NO_AUTH_REQUIRED);
+
+    std::vector<uint8_t> badMagic = buffer;
+    badMagic[0] ^= 0xff;
+    EXPECT_FALSE(view.Parse(badMagic));
+
+    std::vector<uint8_t> invalidTag = buffer;
+    writeEntryField(&invalidTag, keySize, 0, static_cast<uint32_t>(Tag::INVALID));
+    EXPECT_FALSE(view.Parse(invalidTag));
+
+    // Lookups are binary searches, so out of order tags must not be accepted.
+    std::vector<uint8_t> unsorted = buffer;
+    std::swap_ranges(unsorted.begin() + kHeaderSize, unsorted.begin() + kHeaderSize + kEntrySize,
+                     unsorted.begin() + kHeaderSize + kEntrySize);
+    EXPECT_FALSE(view.Parse(unsorted));
+
+    std::vector<uint8_t> blobLengthOfInteger = buffer;
+    writeEntryField(&blobLengthOfInteger, keySize, kEntryBlobLengthOffset, 1);
+    EXPECT_FALSE(view.Parse(blobLengthOfInteger));
+
+    std::vector<uint8_t> integerTooLarge = buffer;
+    writeEntryValue(&integerTooLarge, keySize, 0x100000000ULL);
+    EXPECT_FALSE(view.Parse(integerTooLarge));
+
+    std::vector<uint8_t> boolTooLarge = buffer;
+    writeEntryValue(&boolTooLarge, noAuthRequired, 2);
+    EXPECT_FALSE(view.Parse(boolTooLarge));
+    EXPECT_TRUE(view.empty());
+}
+
+TEST(AuthorizationSetFlatTest, FailedDeserializeLeavesSetUnchanged) {
+    std::vector<uint8_t> buffer = serialize(makeSetOfAllTypes());
+    AuthorizationSet set = AuthorizationSetBuilder().Authorization(TAG_KEY_SIZE, 256U);
+    EXPECT_FALSE(set.DeserializeFlat(buffer.data(), buffer.size() - 1));
+    ASSERT_EQ(1U, set.size());
+    EXPECT_EQ(256U, set.GetTagValue(TAG_KEY_SIZE).value());
+}
+
+}  // namespace test
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
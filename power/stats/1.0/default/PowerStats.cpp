@@ -22,10 +22,14 @@
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <ctype.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <algorithm>
 #include <exception>
+#include <string_view>
 #include <thread>
 
 namespace android {
@@ -38,12 +42,14 @@ namespace implementation {
 #define MAX_FILE_PATH_LEN 128
 #define MAX_DEVICE_NAME_LEN 64
 #define MAX_QUEUE_SIZE 8192
+#define ENERGY_BUFFER_SIZE 4096
 
 constexpr char kIioDirRoot[] = "/sys/bus/iio/devices/";
 constexpr char kDeviceName[] = "pm_device_name";
 constexpr char kDeviceType[] = "iio:device";
 constexpr uint32_t MAX_SAMPLING_RATE = 10;
 constexpr uint64_t WRITE_TIMEOUT_NS = 1000000000;
+constexpr uint64_t NS_PER_SEC = 1000000000;
 
 void PowerStats::findIioPowerMonitorNodes() {
     struct dirent* ent;
@@ -123,47 +129,116 @@ size_t PowerStats::parsePowerRails() {
     return index;
 }
 
-int PowerStats::parseIioEnergyNode(std::string devName) {
-    int ret = 0;
-    std::string data;
-    std::string fileName = devName + "/energy_value";
-    if (!android::base::ReadFileToString(fileName, &data)) {
-        ALOGE("Error reading file: %s", fileName.c_str());
-        return -1;
+void PowerStats::openIioEnergyNodes() {
+    for (const auto& path : mPm.devicePaths) {
+        IioEnergyNode node;
+        node.fileName = path + "/energy_value";
+        // Rails are numbered in the order of enabled_rails, which energy_value lists them in too.
+        for (const auto& railData : mPm.railsInfo) {
+            if (railData.second.devicePath == path) {
+                node.rails.push_back({railData.first, railData.second.index});
+            }
+        }
+        std::sort(node.rails.begin(), node.rails.end(),
+                  [](const RailSlot& a, const RailSlot& b) { return a.index < b.index; });
+        node.fd.reset(TEMP_FAILURE_RETRY(open(node.fileName.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (node.fd < 0) {
+            ALOGW("Failed to open file: %s", node.fileName.c_str());
+        }
+        node.buffer.resize(ENERGY_BUFFER_SIZE);
+        mPm.energyNodes.push_back(std::move(node));
+    }
+}
+
+// Parses a decimal number like strtoull(), without needing the string to be terminated.
+static uint64_t parseUint64(const char* pos, const char* end) {
+    while (pos < end && isspace(static_cast<unsigned char>(*pos))) {
+        pos++;
+    }
+    uint64_t value = 0;
+    for (; pos < end && *pos >= '0' && *pos <= '9'; pos++) {
+        uint64_t digit = *pos - '0';
+        if (value > (ULLONG_MAX - digit) / 10) {
+            return ULLONG_MAX;
+        }
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+int PowerStats::parseIioEnergyNode(IioEnergyNode* node) {
+    if (node->fd < 0) {
+        node->fd.reset(TEMP_FAILURE_RETRY(open(node->fileName.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (node->fd < 0) {
+            ALOGE("Error reading file: %s", node->fileName.c_str());
+            return -1;
+        }
     }
 
-    std::istringstream energyData(data);
-    std::string line;
+    // The contents are regenerated by every read at offset 0, so they must be read in one call.
+    ssize_t size;
+    while (true) {
+        size = TEMP_FAILURE_RETRY(pread(node->fd, node->buffer.data(), node->buffer.size(), 0));
+        if (size < 0) {
+            ALOGE("Error reading file: %s", node->fileName.c_str());
+            return -1;
+        }
+        if (static_cast<size_t>(size) < node->buffer.size()) {
+            break;
+        }
+        node->buffer.resize(node->buffer.size() * 2);
+    }
+
+    const char* pos = node->buffer.data();
+    const char* end = pos + size;
     uint64_t timestamp = 0;
     bool timestampRead = false;
-    while (std::getline(energyData, line)) {
-        std::vector<std::string> words = android::base::Split(line, ",");
+    size_t slot = 0;
+    for (const char* lineEnd; pos < end; pos = lineEnd + 1) {
+        lineEnd = static_cast<const char*>(memchr(pos, '\n', end - pos));
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        const char* comma = static_cast<const char*>(memchr(pos, ',', lineEnd - pos));
         if (timestampRead == false) {
-            if (words.size() == 1) {
-                timestamp = strtoull(words[0].c_str(), NULL, 10);
+            if (comma == nullptr) {
+                timestamp = parseUint64(pos, lineEnd);
                 if (timestamp == 0 || timestamp == ULLONG_MAX) {
                     ALOGW("Potentially wrong timestamp: %" PRIu64, timestamp);
                 }
                 timestampRead = true;
             }
-        } else if (words.size() == 2) {
-            std::string railName = words[0];
-            if (mPm.railsInfo.count(railName) != 0) {
-                size_t index = mPm.railsInfo[railName].index;
-                mPm.reading[index].index = index;
-                mPm.reading[index].timestamp = timestamp;
-                mPm.reading[index].energy = strtoull(words[1].c_str(), NULL, 10);
-                if (mPm.reading[index].energy == ULLONG_MAX) {
-                    ALOGW("Potentially wrong energy value: %" PRIu64, mPm.reading[index].energy);
+        } else if (comma != nullptr && memchr(comma + 1, ',', lineEnd - comma - 1) == nullptr) {
+            std::string_view railName(pos, comma - pos);
+            uint32_t index;
+            if (slot < node->rails.size() && node->rails[slot].railName == railName) {
+                index = node->rails[slot].index;
+            } else {
+                auto railData = mPm.railsInfo.find(railName);
+                if (railData == mPm.railsInfo.end()) {
+                    slot++;
+                    continue;
                 }
+                index = railData->second.index;
+                if (slot < node->rails.size()) {
+                    node->rails[slot] = {railData->first, index};
+                } else {
+                    node->rails.push_back({railData->first, index});
+                }
+            }
+            slot++;
+            mPm.reading[index].index = index;
+            mPm.reading[index].timestamp = timestamp;
+            mPm.reading[index].energy = parseUint64(comma + 1, lineEnd);
+            if (mPm.reading[index].energy == ULLONG_MAX) {
+                ALOGW("Potentially wrong energy value: %" PRIu64, mPm.reading[index].energy);
             }
         } else {
-            ALOGW("Unexpected format in file: %s", fileName.c_str());
-            ret = -1;
-            break;
+            ALOGW("Unexpected format in file: %s", node->fileName.c_str());
+            return -1;
         }
     }
-    return ret;
+    return 0;
 }
 
 Status PowerStats::parseIioEnergyNodes() {
@@ -172,8 +247,8 @@ Status PowerStats::parseIioEnergyNodes() {
         return Status::NOT_SUPPORTED;
     }
 
-    for (const auto& devicePath : mPm.devicePaths) {
-        if (parseIioEnergyNode(devicePath) < 0) {
+    for (auto& node : mPm.energyNodes) {
+        if (parseIioEnergyNode(&node) < 0) {
             ALOGE("Error in parsing power stats");
             ret = Status::FILESYSTEM_ERROR;
             break;
@@ -190,6 +265,14 @@ PowerStats::PowerStats() {
     } else {
         mPm.hwEnabled = true;
         mPm.reading.resize(numRails);
+        openIioEnergyNodes();
+    }
+}
+
+PowerStats::~PowerStats() {
+    mStopSampling = true;
+    if (mSamplerThread.joinable()) {
+        mSamplerThread.join();
     }
 }
 
@@ -261,33 +344,62 @@ Return<void> PowerStats::streamEnergyData(uint32_t timeMs, uint32_t samplingRate
         _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
         return Void();
     }
-    std::thread pollThread = std::thread([this, sps, numSamples]() {
-        uint64_t sleepTimeUs = 1000000 / sps;
-        uint32_t currSamples = 0;
-        while (currSamples < numSamples) {
-            mPm.mLock.lock();
-            if (parseIioEnergyNodes() == Status::SUCCESS) {
-                mPm.fmqSynchronized->writeBlocking(&mPm.reading[0], mPm.reading.size(),
-                                                   WRITE_TIMEOUT_NS);
-                mPm.mLock.unlock();
-                currSamples++;
-                if (usleep(sleepTimeUs) < 0) {
-                    ALOGW("Sleep interrupted");
-                    break;
-                }
-            } else {
-                mPm.mLock.unlock();
+    // The previous stream has ended, since it released the queue.
+    if (mSamplerThread.joinable()) {
+        mSamplerThread.join();
+    }
+    mSamplerThread = std::thread(&PowerStats::sampleEnergyData, this, sps, numSamples);
+    _hidl_cb(*(mPm.fmqSynchronized)->getDesc(), numSamples, mPm.reading.size(), Status::SUCCESS);
+    return Void();
+}
+
+void PowerStats::sampleEnergyData(uint32_t sps, uint32_t numSamples) {
+    std::vector<EnergyData> batch;
+    android::base::unique_fd timerFd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC));
+    struct itimerspec deadlines = {};
+    if (numSamples == 0 || timerFd < 0 || clock_gettime(CLOCK_MONOTONIC, &deadlines.it_value) < 0) {
+        numSamples = 0;
+    } else {
+        // Samples are taken on absolute deadlines, so time spent sampling doesn't add up to drift.
+        uint64_t periodNs = NS_PER_SEC / sps;
+        deadlines.it_interval.tv_sec = periodNs / NS_PER_SEC;
+        deadlines.it_interval.tv_nsec = periodNs % NS_PER_SEC;
+        if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &deadlines, nullptr) < 0) {
+            ALOGE("Failed to start sampling timer");
+            numSamples = 0;
+        }
+    }
+
+    uint32_t currSamples = 0;
+    while (currSamples < numSamples && !mStopSampling) {
+        uint64_t expirations;
+        if (TEMP_FAILURE_RETRY(read(timerFd, &expirations, sizeof(expirations))) !=
+            sizeof(expirations)) {
+            ALOGW("Sampling timer interrupted");
+            break;
+        }
+        if (expirations > 1) {
+            ALOGW("Missed %" PRIu64 " sampling periods", expirations - 1);
+        }
+
+        {
+            std::lock_guard<std::mutex> _lock(mPm.mLock);
+            if (parseIioEnergyNodes() != Status::SUCCESS) {
                 break;
             }
+            batch.assign(mPm.reading.begin(), mPm.reading.end());
         }
-        mPm.mLock.lock();
-        mPm.fmqSynchronized = nullptr;
-        mPm.mLock.unlock();
-        return;
-    });
-    pollThread.detach();
-    _hidl_cb(*(mPm.fmqSynchronized)->getDesc(), numSamples, mPm.reading.size(), Status::SUCCESS);
-    return Void();
+
+        // All the rails of a period go in a single write, made without holding the lock.  The
+        // queue is only released by this thread, so it can't go away meanwhile.
+        if (!mPm.fmqSynchronized->writeBlocking(batch.data(), batch.size(), WRITE_TIMEOUT_NS)) {
+            ALOGW("Failed to write energy data");
+        }
+        currSamples++;
+    }
+
+    std::lock_guard<std::mutex> _lock(mPm.mLock);
+    mPm.fmqSynchronized = nullptr;
 }
 
 uint32_t PowerStats::addPowerEntity(const std::string& name, PowerEntityType type) {
@@ -17,10 +17,13 @@
 #ifndef ANDROID_HARDWARE_POWERSTATS_V1_0_POWERSTATS_H
 #define ANDROID_HARDWARE_POWERSTATS_V1_0_POWERSTATS_H
 
+#include <android-base/unique_fd.h>
 #include <android/hardware/power/stats/1.0/IPowerStats.h>
 #include <fmq/MessageQueue.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <atomic>
+#include <thread>
 #include <unordered_map>
 
 namespace android {
@@ -52,11 +55,28 @@ struct RailData {
     uint32_t samplingRate;
 };
 
+struct RailSlot {
+    std::string railName;
+    uint32_t index;
+};
+
+// The energy_value node of an IIO power monitor, kept open so that sampling it costs a single
+// pread() and a parse that allocates nothing.
+struct IioEnergyNode {
+    std::string fileName;
+    android::base::unique_fd fd;
+    std::vector<char> buffer;
+    // Rails in the order in which they are listed in energy_value, so that lines can be matched
+    // without looking the names up.  Relearned if the order changes.
+    std::vector<RailSlot> rails;
+};
+
 struct OnDeviceMmt {
     std::mutex mLock;
     bool hwEnabled;
     std::vector<std::string> devicePaths;
-    std::map<std::string, RailData> railsInfo;
+    std::vector<IioEnergyNode> energyNodes;
+    std::map<std::string, RailData, std::less<>> railsInfo;
     std::vector<EnergyData> reading;
     std::unique_ptr<MessageQueueSync> fmqSynchronized;
 };
@@ -72,6 +92,7 @@ class IStateResidencyDataProvider {
 struct PowerStats : public IPowerStats {
    public:
     PowerStats();
+    ~PowerStats();
     uint32_t addPowerEntity(const std::string& name, PowerEntityType type);
     void addStateResidencyDataProvider(std::shared_ptr<IStateResidencyDataProvider> p);
     // Methods from ::android::hardware::power::stats::V1_0::IPowerStats follow.
@@ -94,8 +115,12 @@ struct PowerStats : public IPowerStats {
     OnDeviceMmt mPm;
     void findIioPowerMonitorNodes();
     size_t parsePowerRails();
-    int parseIioEnergyNode(std::string devName);
+    void openIioEnergyNodes();
+    int parseIioEnergyNode(IioEnergyNode* node);
     Status parseIioEnergyNodes();
+    void sampleEnergyData(uint32_t sps, uint32_t numSamples);
+    std::thread mSamplerThread;
+    std::atomic<bool> mStopSampling{false};
     std::vector<PowerEntityInfo> mPowerEntityInfos;
     std::unordered_map<uint32_t, PowerEntityStateSpace> mPowerEntityStateSpaces;
     std::unordered_map<uint32_t, std::shared_ptr<IStateResidencyDataProvider>>
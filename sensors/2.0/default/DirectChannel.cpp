@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DirectChannel.h"
+
+#include <log/log.h>
+#include <sensors/convert.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::SensorsEventFormatOffset;
+using ::android::hardware::sensors::V1_0::SharedMemFormat;
+using ::android::hardware::sensors::V1_0::SharedMemType;
+using ::android::hardware::sensors::V1_0::implementation::convertToSensorEvent;
+
+static constexpr size_t kEventSize = static_cast<size_t>(SensorsEventFormatOffset::TOTAL_LENGTH);
+static constexpr size_t kOffsetAtomicCounter =
+        static_cast<size_t>(SensorsEventFormatOffset::ATOMIC_COUNTER);
+static constexpr size_t kOffsetTimestamp = static_cast<size_t>(SensorsEventFormatOffset::TIMESTAMP);
+
+static_assert(sizeof(sensors_event_t) == kEventSize,
+              "sensors_event_t does not match the direct channel record layout");
+static_assert(offsetof(sensors_event_t, reserved0) == kOffsetAtomicCounter,
+              "sensors_event_t.reserved0 does not overlay the atomic counter");
+
+std::shared_ptr<DirectChannel> DirectChannel::create(const SharedMemInfo& mem) {
+    if (mem.type != SharedMemType::ASHMEM || mem.format != SharedMemFormat::SENSORS_EVENT) {
+        return nullptr;
+    }
+
+    const native_handle_t* handle = mem.memoryHandle.getNativeHandle();
+    if (handle == nullptr || handle->numFds < 1 || handle->data[0] < 0 || mem.size < kEventSize) {
+        return nullptr;
+    }
+
+    // The mapping stays valid after the handle is closed by the caller, so the fd does not need to
+    // be duplicated.
+    void* buffer = mmap(nullptr, mem.size, PROT_READ | PROT_WRITE, MAP_SHARED, handle->data[0], 0);
+    if (buffer == MAP_FAILED) {
+        ALOGE("Failed to map direct channel memory: %s", strerror(errno));
+        return nullptr;
+    }
+
+    // Upon return of channel registration, the shared memory must be formatted to all zeros
+    memset(buffer, 0, mem.size);
+    return std::shared_ptr<DirectChannel>(
+            new DirectChannel(static_cast<uint8_t*>(buffer), mem.size));
+}
+
+DirectChannel::DirectChannel(uint8_t* buffer, size_t size)
+    : mBuffer(buffer),
+      mSize(size),
+      mRecordCount(size / kEventSize),
+      mNextRecord(0),
+      mCounter(0) {}
+
+DirectChannel::~DirectChannel() {
+    munmap(mBuffer, mSize);
+}
+
+void DirectChannel::write(const Event& event, int32_t reportToken) {
+    sensors_event_t record;
+    convertToSensorEvent(event, &record);
+    record.version = kEventSize;
+    record.sensor = reportToken;
+
+    std::lock_guard<std::mutex> lock(mWriteLock);
+
+    // A counter value of 0 indicates an empty record, so skip it when the counter wraps
+    if (++mCounter == 0) {
+        mCounter = 1;
+    }
+
+    uint8_t* dst = mBuffer + mNextRecord * kEventSize;
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(&record);
+    memcpy(dst, src, kOffsetAtomicCounter);
+    memcpy(dst + kOffsetTimestamp, src + kOffsetTimestamp, kEventSize - kOffsetTimestamp);
+    __atomic_store_n(reinterpret_cast<uint32_t*>(dst + kOffsetAtomicCounter), mCounter,
+                     __ATOMIC_RELEASE);
+
+    if (++mNextRecord == mRecordCount) {
+        mNextRecord = 0;
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_V2_0_DIRECTCHANNEL_H
+#define ANDROID_HARDWARE_SENSORS_V2_0_DIRECTCHANNEL_H
+
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <memory>
+#include <mutex>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::Event;
+using ::android::hardware::sensors::V1_0::SharedMemInfo;
+
+/**
+ * A direct report channel backed by a memory mapped shared memory region. Events are written as
+ * SharedMemFormat::SENSORS_EVENT records into the region, which is treated as a ring buffer.
+ */
+class DirectChannel {
+   public:
+    /**
+     * Map the shared memory described by mem. Returns nullptr if the memory type or format is not
+     * supported or the memory cannot be mapped. The memory is zeroed on success.
+     */
+    static std::shared_ptr<DirectChannel> create(const SharedMemInfo& mem);
+
+    ~DirectChannel();
+
+    /**
+     * Write a single event into the next record of the channel, tagged with reportToken. The
+     * atomic counter of the record is published last so that readers never observe a partially
+     * written record.
+     */
+    void write(const Event& event, int32_t reportToken);
+
+   private:
+    DirectChannel(uint8_t* buffer, size_t size);
+
+    uint8_t* const mBuffer;
+    const size_t mSize;
+
+    /**
+     * Number of whole records that fit in the memory region
+     */
+    const size_t mRecordCount;
+
+    /**
+     * Lock to serialize writers; several sensors may report into the same channel
+     */
+    std::mutex mWriteLock;
+    size_t mNextRecord;
+    uint32_t mCounter;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SENSORS_V2_0_DIRECTCHANNEL_H
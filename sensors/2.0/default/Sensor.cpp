@@ -18,7 +18,9 @@
 
 #include <utils/SystemClock.h>
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 namespace android {
 namespace hardware {
@@ -28,9 +30,30 @@ namespace implementation {
 
 using ::android::hardware::sensors::V1_0::MetaDataEventType;
 using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V1_0::SensorFlagShift;
 using ::android::hardware::sensors::V1_0::SensorStatus;
 
 static constexpr float kDefaultMaxDelayUs = 10 * 1000 * 1000;
+static constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
+
+// Sensors that support direct report advertise every rate level up to VERY_FAST on ashmem
+static constexpr uint32_t kDirectReportFlags =
+        static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_ASHMEM) |
+        (static_cast<uint32_t>(RateLevel::VERY_FAST)
+         << static_cast<uint32_t>(SensorFlagShift::DIRECT_REPORT));
+
+static int64_t directReportNominalRateHz(RateLevel rate) {
+    switch (rate) {
+        case RateLevel::NORMAL:
+            return 50;
+        case RateLevel::FAST:
+            return 200;
+        case RateLevel::VERY_FAST:
+            return 800;
+        default:
+            return 0;
+    }
+}
 
 Sensor::Sensor(ISensorsEventCallback* callback)
     : mIsEnabled(false),
@@ -101,30 +124,56 @@ void Sensor::startThread(Sensor* sensor) {
 
 void Sensor::run() {
     std::unique_lock<std::mutex> runLock(mRunMutex);
-    constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
 
     while (!mStopThread) {
-        if (!mIsEnabled || mMode == OperationMode::DATA_INJECTION) {
+        bool streaming = mIsEnabled && mMode == OperationMode::NORMAL;
+        if (!streaming && mDirectReports.empty()) {
             mWaitCV.wait(runLock, [&] {
-                return ((mIsEnabled && mMode == OperationMode::NORMAL) || mStopThread);
+                return ((mIsEnabled && mMode == OperationMode::NORMAL) || !mDirectReports.empty() ||
+                        mStopThread);
             });
         } else {
-            timespec curTime;
-            clock_gettime(CLOCK_REALTIME, &curTime);
-            int64_t now = (curTime.tv_sec * kNanosecondsInSeconds) + curTime.tv_nsec;
-            int64_t nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-
-            if (now >= nextSampleTime) {
-                mLastSampleTimeNs = now;
-                nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-                mCallback->postEvents(readEvents(), isWakeUpSensor());
+            int64_t now = ::android::elapsedRealtimeNano();
+            int64_t nextWakeTime = std::numeric_limits<int64_t>::max();
+
+            if (streaming) {
+                int64_t nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
+                if (now >= nextSampleTime) {
+                    mLastSampleTimeNs = now;
+                    nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
+                    mCallback->postEvents(readEvents(), isWakeUpSensor());
+                }
+                nextWakeTime = nextSampleTime;
             }
 
-            mWaitCV.wait_for(runLock, std::chrono::nanoseconds(nextSampleTime - now));
+            nextWakeTime = std::min(nextWakeTime, writeDirectReports(now));
+            mWaitCV.wait_for(runLock, std::chrono::nanoseconds(nextWakeTime - now));
         }
     }
 }
 
+int64_t Sensor::writeDirectReports(int64_t now) {
+    int64_t nextReportTime = std::numeric_limits<int64_t>::max();
+    for (auto& report : mDirectReports) {
+        DirectReport& direct = report.second;
+        if (now >= direct.nextReportTimeNs) {
+            for (const Event& event : readEvents()) {
+                direct.channel->write(event, mSensorInfo.sensorHandle /* reportToken */);
+            }
+
+            // Schedule against absolute deadlines so that wake up latency does not accumulate
+            // into drift. If more than a full period was missed, resynchronize instead of
+            // writing a burst of late events.
+            direct.nextReportTimeNs += direct.periodNs;
+            if (direct.nextReportTimeNs <= now) {
+                direct.nextReportTimeNs = now + direct.periodNs;
+            }
+        }
+        nextReportTime = std::min(nextReportTime, direct.nextReportTimeNs);
+    }
+    return nextReportTime;
+}
+
 bool Sensor::isWakeUpSensor() {
     return mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::WAKE_UP);
 }
@@ -170,6 +219,40 @@ Result Sensor::injectEvent(const Event& event) {
     return result;
 }
 
+RateLevel Sensor::getDirectReportMaxRate() const {
+    return static_cast<RateLevel>(
+            (mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::MASK_DIRECT_REPORT)) >>
+            static_cast<uint32_t>(SensorFlagShift::DIRECT_REPORT));
+}
+
+Result Sensor::configDirectReport(const std::shared_ptr<DirectChannel>& channel,
+                                  int32_t channelHandle, RateLevel rate, int32_t* reportToken) {
+    if (rate == RateLevel::STOP) {
+        stopDirectReport(channelHandle);
+        return Result::OK;
+    }
+
+    if (channel == nullptr || rate > getDirectReportMaxRate()) {
+        return Result::BAD_VALUE;
+    }
+
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    DirectReport& report = mDirectReports[channelHandle];
+    report.channel = channel;
+    report.periodNs = kNanosecondsInSeconds / directReportNominalRateHz(rate);
+    report.nextReportTimeNs = ::android::elapsedRealtimeNano();
+    *reportToken = mSensorInfo.sensorHandle;
+    mWaitCV.notify_all();
+    return Result::OK;
+}
+
+void Sensor::stopDirectReport(int32_t channelHandle) {
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    if (mDirectReports.erase(channelHandle) > 0) {
+        mWaitCV.notify_all();
+    }
+}
+
 OnChangeSensor::OnChangeSensor(ISensorsEventCallback* callback)
     : Sensor(callback), mPreviousEventSet(false) {}
 
@@ -210,7 +293,8 @@ AccelSensor::AccelSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
     mSensorInfo.fifoReservedEventCount = 0;
     mSensorInfo.fifoMaxEventCount = 0;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::DATA_INJECTION);
+    mSensorInfo.flags =
+            static_cast<uint32_t>(SensorFlagBits::DATA_INJECTION) | kDirectReportFlags;
 };
 
 PressureSensor::PressureSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
@@ -248,7 +332,7 @@ MagnetometerSensor::MagnetometerSensor(int32_t sensorHandle, ISensorsEventCallba
     mSensorInfo.fifoReservedEventCount = 0;
     mSensorInfo.fifoMaxEventCount = 0;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = 0;
+    mSensorInfo.flags = kDirectReportFlags;
 };
 
 LightSensor::LightSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
@@ -305,7 +389,7 @@ GyroSensor::GyroSensor(int32_t sensorHandle, ISensorsEventCallback* callback) :
     mSensorInfo.fifoReservedEventCount = 0;
     mSensorInfo.fifoMaxEventCount = 0;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = 0;
+    mSensorInfo.flags = kDirectReportFlags;
 };
 
 AmbientTempSensor::AmbientTempSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
@@ -17,9 +17,12 @@
 #ifndef ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_H
 #define ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_H
 
+#include "DirectChannel.h"
+
 #include <android/hardware/sensors/1.0/types.h>
 
 #include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -27,6 +30,7 @@
 
 using ::android::hardware::sensors::V1_0::Event;
 using ::android::hardware::sensors::V1_0::OperationMode;
+using ::android::hardware::sensors::V1_0::RateLevel;
 using ::android::hardware::sensors::V1_0::Result;
 using ::android::hardware::sensors::V1_0::SensorInfo;
 using ::android::hardware::sensors::V1_0::SensorType;
@@ -57,8 +61,31 @@ class Sensor {
     bool supportsDataInjection() const;
     Result injectEvent(const Event& event);
 
+    /**
+     * Start, update or stop (RateLevel::STOP) reporting this sensor into a direct channel. On
+     * success, reportToken is set to the token that identifies this sensor's events in the
+     * channel.
+     */
+    Result configDirectReport(const std::shared_ptr<DirectChannel>& channel,
+                              int32_t channelHandle, RateLevel rate, int32_t* reportToken);
+    void stopDirectReport(int32_t channelHandle);
+
    protected:
+    struct DirectReport {
+        std::shared_ptr<DirectChannel> channel;
+        int64_t periodNs;
+        int64_t nextReportTimeNs;
+    };
+
     void run();
+
+    /**
+     * Write an event into each direct channel whose deadline has passed. Returns the earliest
+     * deadline of the remaining direct reports.
+     */
+    int64_t writeDirectReports(int64_t now);
+
+    RateLevel getDirectReportMaxRate() const;
     virtual std::vector<Event> readEvents();
     static void startThread(Sensor* sensor);
 
@@ -77,6 +104,11 @@ class Sensor {
     ISensorsEventCallback* mCallback;
 
     OperationMode mMode;
+
+    /**
+     * Active direct reports keyed by channel handle, guarded by mRunMutex
+     */
+    std::map<int32_t, DirectReport> mDirectReports;
 };
 
 class OnChangeSensor : public Sensor {
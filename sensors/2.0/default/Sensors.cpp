@@ -38,6 +38,7 @@ constexpr const char* kWakeLockName = "SensorsHAL_WAKEUP";
 Sensors::Sensors()
     : mEventQueueFlag(nullptr),
       mNextHandle(1),
+      mNextDirectChannelHandle(1),
       mOutstandingWakeUpEvents(0),
       mReadWakeLockQueueRun(false),
       mAutoReleaseWakeLockTime(0),
@@ -99,6 +100,17 @@ Return<Result> Sensors::initialize(
         sensor.second->activate(false /* enable */);
     }
 
+    // Tear down all direct channels, re-initializing the HAL invalidates their handles
+    {
+        std::lock_guard<std::mutex> lock(mDirectChannelLock);
+        for (const auto& channel : mDirectChannels) {
+            for (const auto& sensor : mSensors) {
+                sensor.second->stopDirectReport(channel.first);
+            }
+        }
+        mDirectChannels.clear();
+    }
+
     // Stop the Wake Lock thread if it is currently running
     if (mReadWakeLockQueueRun.load()) {
         mReadWakeLockQueueRun = false;
@@ -164,20 +176,70 @@ Return<Result> Sensors::injectSensorData(const Event& event) {
     return Result::BAD_VALUE;
 }
 
-Return<void> Sensors::registerDirectChannel(const SharedMemInfo& /* mem */,
+Return<void> Sensors::registerDirectChannel(const SharedMemInfo& mem,
                                             registerDirectChannel_cb _hidl_cb) {
-    _hidl_cb(Result::INVALID_OPERATION, -1 /* channelHandle */);
-    return Return<void>();
+    std::shared_ptr<DirectChannel> channel = DirectChannel::create(mem);
+    if (channel == nullptr) {
+        _hidl_cb(Result::BAD_VALUE, -1 /* channelHandle */);
+        return Void();
+    }
+
+    std::lock_guard<std::mutex> lock(mDirectChannelLock);
+    int32_t channelHandle = mNextDirectChannelHandle++;
+    mDirectChannels[channelHandle] = channel;
+    _hidl_cb(Result::OK, channelHandle);
+    return Void();
 }
 
-Return<Result> Sensors::unregisterDirectChannel(int32_t /* channelHandle */) {
-    return Result::INVALID_OPERATION;
+Return<Result> Sensors::unregisterDirectChannel(int32_t channelHandle) {
+    std::lock_guard<std::mutex> lock(mDirectChannelLock);
+    auto channel = mDirectChannels.find(channelHandle);
+    if (channel == mDirectChannels.end()) {
+        // Unregistering an unknown channel is a no-op
+        return Result::OK;
+    }
+
+    // Stop all sensors that are still reporting into the channel before releasing it
+    for (const auto& sensor : mSensors) {
+        sensor.second->stopDirectReport(channelHandle);
+    }
+    mDirectChannels.erase(channel);
+    return Result::OK;
 }
 
-Return<void> Sensors::configDirectReport(int32_t /* sensorHandle */, int32_t /* channelHandle */,
-                                         RateLevel /* rate */, configDirectReport_cb _hidl_cb) {
-    _hidl_cb(Result::INVALID_OPERATION, 0 /* reportToken */);
-    return Return<void>();
+Return<void> Sensors::configDirectReport(int32_t sensorHandle, int32_t channelHandle,
+                                         RateLevel rate, configDirectReport_cb _hidl_cb) {
+    std::lock_guard<std::mutex> lock(mDirectChannelLock);
+    auto channel = mDirectChannels.find(channelHandle);
+    if (channel == mDirectChannels.end()) {
+        _hidl_cb(Result::BAD_VALUE, 0 /* reportToken */);
+        return Void();
+    }
+
+    // A sensor handle of -1 stops all sensors reporting into the channel
+    if (sensorHandle == -1) {
+        if (rate != RateLevel::STOP) {
+            _hidl_cb(Result::BAD_VALUE, 0 /* reportToken */);
+            return Void();
+        }
+        for (const auto& sensor : mSensors) {
+            sensor.second->stopDirectReport(channelHandle);
+        }
+        _hidl_cb(Result::OK, 0 /* reportToken */);
+        return Void();
+    }
+
+    auto sensor = mSensors.find(sensorHandle);
+    if (sensor == mSensors.end()) {
+        _hidl_cb(Result::BAD_VALUE, 0 /* reportToken */);
+        return Void();
+    }
+
+    int32_t reportToken = 0;
+    Result result =
+            sensor->second->configDirectReport(channel->second, channelHandle, rate, &reportToken);
+    _hidl_cb(result, reportToken);
+    return Void();
 }
 
 void Sensors::postEvents(const std::vector<Event>& events, bool wakeup) {
@@ -17,6 +17,7 @@
 #ifndef ANDROID_HARDWARE_SENSORS_V2_0_SENSORS_H
 #define ANDROID_HARDWARE_SENSORS_V2_0_SENSORS_H
 
+#include "DirectChannel.h"
 #include "Sensor.h"
 
 #include <android/hardware/sensors/2.0/ISensors.h>
@@ -146,6 +147,21 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
      */
     int32_t mNextHandle;
 
+    /**
+     * Registered direct channels keyed by channel handle
+     */
+    std::map<int32_t, std::shared_ptr<DirectChannel>> mDirectChannels;
+
+    /**
+     * The next available direct channel handle
+     */
+    int32_t mNextDirectChannelHandle;
+
+    /**
+     * Lock to protect the direct channels
+     */
+    std::mutex mDirectChannelLock;
+
     /**
      * Lock to protect writes to the FMQs
      */
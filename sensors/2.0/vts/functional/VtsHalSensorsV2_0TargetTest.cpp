@@ -564,6 +564,16 @@ TEST_P(SensorsHidlTest, MagnetometerAshmemDirectReportOperationVeryFast) {
                               RateLevel::VERY_FAST, NullChecker());
 }
 
+// Measure delivery jitter of accel direct report with ashmem at very fast rate
+TEST_P(SensorsHidlTest, AccelerometerAshmemDirectReportJitterVeryFast) {
+    testDirectReportJitter(SensorType::ACCELEROMETER, SharedMemType::ASHMEM, RateLevel::VERY_FAST);
+}
+
+// Measure delivery jitter of gyro direct report with ashmem at very fast rate
+TEST_P(SensorsHidlTest, GyroscopeAshmemDirectReportJitterVeryFast) {
+    testDirectReportJitter(SensorType::GYROSCOPE, SharedMemType::ASHMEM, RateLevel::VERY_FAST);
+}
+
 // Test sensor event direct report with gralloc for accel sensor at normal rate
 TEST_P(SensorsHidlTest, AccelerometerGrallocDirectReportOperationNormal) {
     testDirectReportOperation(SensorType::ACCELEROMETER, SharedMemType::GRALLOC, RateLevel::NORMAL,
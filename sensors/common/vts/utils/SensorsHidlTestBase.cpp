@@ -23,7 +23,9 @@
 #include <log/log.h>
 #include <utils/SystemClock.h>
 
+#include <algorithm>
 #include <cinttypes>
+#include <cmath>
 
 using ::android::sp;
 using ::android::hardware::hidl_string;
@@ -356,6 +358,109 @@ void SensorsHidlTestBase::testDirectReportOperation(SensorType type, SharedMemTy
     EXPECT_EQ(unregisterDirectChannel(channelHandle), Result::OK);
 }
 
+void SensorsHidlTestBase::testDirectReportJitter(SensorType type, SharedMemType memType,
+                                                 RateLevel rate) {
+    constexpr size_t kEventSize = static_cast<size_t>(SensorsEventFormatOffset::TOTAL_LENGTH);
+    constexpr size_t kNEvent = 8192;
+    constexpr size_t kMemSize = kEventSize * kNEvent;
+
+    // Long enough to collect a few thousand intervals at VERY_FAST without wrapping the buffer
+    constexpr float kTestTimeSec = 2.f;
+
+    // The spread of the sample intervals allowed, relative to their mean
+    constexpr double kMaxRelativeStddev = 0.5;
+
+    SensorInfo sensor = defaultSensorByType(type);
+
+    if (!isValidType(sensor.type) || !isDirectReportRateSupported(sensor, rate) ||
+        !isDirectChannelTypeSupported(sensor, memType)) {
+        return;
+    }
+
+    std::unique_ptr<SensorsTestSharedMemory> mem(
+        SensorsTestSharedMemory::create(memType, kMemSize));
+    ASSERT_NE(mem, nullptr);
+
+    int32_t channelHandle;
+    registerDirectChannel(mem->getSharedMemInfo(),
+                          [&channelHandle](auto result, auto channelHandle_) {
+                              ASSERT_EQ(result, Result::OK);
+                              channelHandle = channelHandle_;
+                          });
+
+    configDirectReport(sensor.sensorHandle, channelHandle, rate,
+                       [](auto result, auto) { ASSERT_EQ(result, Result::OK); });
+
+    usleep(static_cast<useconds_t>(kTestTimeSec * 1e6f));
+
+    configDirectReport(sensor.sensorHandle, channelHandle, RateLevel::STOP,
+                       [](auto result, auto) { EXPECT_EQ(result, Result::OK); });
+    EXPECT_EQ(unregisterDirectChannel(channelHandle), Result::OK);
+
+    std::vector<int64_t> intervals;
+    int64_t lastTimestamp = -1;
+    for (const auto& e : mem->parseEvents()) {
+        if (isMetaSensorType(e.sensorType)) {
+            continue;
+        }
+        if (lastTimestamp >= 0) {
+            intervals.push_back(e.timestamp - lastTimestamp);
+        }
+        lastTimestamp = e.timestamp;
+    }
+    ASSERT_GT(intervals.size(), 1u);
+
+    double mean = 0;
+    for (int64_t interval : intervals) {
+        mean += interval;
+    }
+    mean /= intervals.size();
+
+    double variance = 0;
+    double maxDeviation = 0;
+    for (int64_t interval : intervals) {
+        variance += (interval - mean) * (interval - mean);
+        maxDeviation = std::max(maxDeviation, std::abs(interval - mean));
+    }
+    double stddev = std::sqrt(variance / intervals.size());
+
+    std::sort(intervals.begin(), intervals.end());
+    int64_t p99 = intervals[intervals.size() * 99 / 100];
+
+    ALOGI("Direct report jitter for sensor type %d at rate %d: %zu intervals, mean %.1f us, "
+          "stddev %.1f us, p99 %.1f us, max deviation %.1f us",
+          static_cast<int>(type), static_cast<int>(rate), intervals.size(), mean / 1000.0,
+          stddev / 1000.0, p99 / 1000.0, maxDeviation / 1000.0);
+    RecordProperty("mean_interval_us", std::to_string(mean / 1000.0));
+    RecordProperty("stddev_interval_us", std::to_string(stddev / 1000.0));
+    RecordProperty("p99_interval_us", std::to_string(p99 / 1000.0));
+    RecordProperty("max_deviation_us", std::to_string(maxDeviation / 1000.0));
+
+    float nominalFreq = 0.f;
+    switch (rate) {
+        case RateLevel::NORMAL:
+            nominalFreq = 50;
+            break;
+        case RateLevel::FAST:
+            nominalFreq = 200;
+            break;
+        case RateLevel::VERY_FAST:
+            nominalFreq = 800;
+            break;
+        case RateLevel::STOP:
+            FAIL();
+    }
+
+    // The mean interval must match a rate between 55% and 220% of nominal, as in
+    // testDirectReportOperation, and a sample may at most be skipped now and then.
+    const double shortestPeriodNs = 1e9 / (nominalFreq * 2.2f);
+    const double longestPeriodNs = 1e9 / (nominalFreq * 0.55f);
+    EXPECT_GE(mean, shortestPeriodNs);
+    EXPECT_LE(mean, longestPeriodNs);
+    EXPECT_LE(p99, 2 * longestPeriodNs);
+    EXPECT_LE(stddev, kMaxRelativeStddev * mean);
+}
+
 void SensorsHidlTestBase::testStreamingOperation(SensorType type,
                                                  std::chrono::nanoseconds samplingPeriod,
                                                  std::chrono::seconds duration,
@@ -110,6 +110,7 @@ class SensorsHidlTestBase : public testing::TestWithParam<std::string> {
     void testBatchingOperation(SensorType type);
     void testDirectReportOperation(SensorType type, SharedMemType memType, RateLevel rate,
                                    const SensorEventsChecker& checker);
+    void testDirectReportJitter(SensorType type, SharedMemType memType, RateLevel rate);
 
     static void assertTypeMatchStringType(SensorType type, const hidl_string& stringType);
     static void assertTypeMatchReportMode(SensorType type, SensorFlagBits reportMode);
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.tv.tuner@1.0-AvBufferRing"
+
+#include "AvBufferRing.h"
+#include <cutils/ashmem.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utils/Log.h>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+AvBufferRing::~AvBufferRing() {
+    if (mBase != nullptr) {
+        munmap(mBase, mSize);
+    }
+    if (mHandle != nullptr) {
+        native_handle_close(mHandle);
+        native_handle_delete(mHandle);
+    }
+}
+
+bool AvBufferRing::init(uint32_t size) {
+    int fd = ashmem_create_region("tuner_av_buffer", size);
+    if (fd < 0) {
+        ALOGW("Failed to create AV memory of size %u", size);
+        return false;
+    }
+
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ALOGW("Failed to map AV memory: %s", strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    mHandle = native_handle_create(1 /* numFds */, 0 /* numInts */);
+    if (mHandle == nullptr) {
+        munmap(base, size);
+        close(fd);
+        return false;
+    }
+    mHandle->data[0] = fd;
+    mBase = static_cast<uint8_t*>(base);
+    mSize = size;
+
+    return true;
+}
+
+uint32_t AvBufferRing::getFrameLimit_l(uint32_t offset) const {
+    if (mFrames.empty()) {
+        return mSize;
+    }
+
+    uint32_t tail = mFrames.front().offset;
+    uint32_t head = mFrames.back().offset + mFrames.back().size;
+    if (head > tail && offset >= head) {
+        // The frames in use don't wrap around yet, so everything to the end is free
+        return mSize;
+    }
+    return tail;
+}
+
+void AvBufferRing::beginFrame() {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mFrameOffset = mFrames.empty() ? 0 : mFrames.back().offset + mFrames.back().size;
+    mFrameSize = 0;
+    mFrameStarted = true;
+}
+
+bool AvBufferRing::appendToFrame(const uint8_t* data, uint32_t size) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (!mFrameStarted) {
+        return false;
+    }
+
+    uint32_t limit = getFrameLimit_l(mFrameOffset);
+    if (mFrameOffset + mFrameSize + size > limit) {
+        // A frame running into the end of the buffer moves back to the start if it fits there
+        if (mFrameOffset == 0 || limit != mSize || mFrameSize + size > getFrameLimit_l(0)) {
+            return false;
+        }
+        memmove(mBase, mBase + mFrameOffset, mFrameSize);
+        mFrameOffset = 0;
+    }
+
+    memcpy(mBase + mFrameOffset + mFrameSize, data, size);
+    mFrameSize += size;
+
+    return true;
+}
+
+bool AvBufferRing::commitFrame(uint64_t* avDataId, uint32_t* offset, uint32_t* size) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (!mFrameStarted || mFrameSize == 0) {
+        mFrameStarted = false;
+        return false;
+    }
+
+    Frame frame = {
+            .avDataId = mNextAvDataId++,
+            .offset = mFrameOffset,
+            .size = mFrameSize,
+            .released = false,
+    };
+    mFrames.push_back(frame);
+    mFrameStarted = false;
+
+    *avDataId = frame.avDataId;
+    *offset = frame.offset;
+    *size = frame.size;
+
+    return true;
+}
+
+void AvBufferRing::abortFrame() {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    mFrameStarted = false;
+}
+
+bool AvBufferRing::release(uint64_t avDataId) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    // Frames are mostly released in the order they were delivered, so start from the oldest
+    auto it = mFrames.begin();
+    while (it != mFrames.end() && it->avDataId != avDataId) {
+        it++;
+    }
+    if (it == mFrames.end() || it->released) {
+        return false;
+    }
+    it->released = true;
+
+    while (!mFrames.empty() && mFrames.front().released) {
+        mFrames.pop_front();
+    }
+
+    return true;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_TV_TUNER_V1_0_AVBUFFERRING_H_
+#define ANDROID_HARDWARE_TV_TUNER_V1_0_AVBUFFERRING_H_
+
+#include <cutils/native_handle.h>
+#include <deque>
+#include <mutex>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+/**
+ * Shared memory that a media filter assembles audio/video frames into.
+ *
+ * Frames are laid out one after the other and wrap around to the start of the buffer, so
+ * each frame is contiguous and can be referenced by an offset in a media event. A frame
+ * keeps its space until the client gives it back through IFilter::releaseAvHandle. Frames
+ * may be released in any order, but space is only reclaimed up to the oldest frame still
+ * held by the client.
+ */
+class AvBufferRing {
+  public:
+    AvBufferRing() = default;
+
+    ~AvBufferRing();
+
+    /**
+     * Allocates and maps the shared memory. Return false if it fails.
+     */
+    bool init(uint32_t size);
+    bool isValid() const { return mBase != nullptr; }
+    const native_handle_t* getHandle() const { return mHandle; }
+
+    /**
+     * Frame assembly. These are only called by the thread dispatching the filter input,
+     * one frame at a time.
+     *
+     * appendToFrame returns false if the frame doesn't fit in the free space, in which case
+     * the frame should be aborted. commitFrame hands the frame over to the client and
+     * returns the id to release it with.
+     */
+    void beginFrame();
+    bool appendToFrame(const uint8_t* data, uint32_t size);
+    bool commitFrame(uint64_t* avDataId, uint32_t* offset, uint32_t* size);
+    void abortFrame();
+    bool isFrameStarted() const { return mFrameStarted; }
+
+    /**
+     * Gives a committed frame back. Return false if the id is unknown or already released.
+     */
+    bool release(uint64_t avDataId);
+
+  private:
+    struct Frame {
+        uint64_t avDataId;
+        uint32_t offset;
+        uint32_t size;
+        bool released;
+    };
+
+    // Where a frame starting at the given offset has to end. Expected to hold mLock.
+    uint32_t getFrameLimit_l(uint32_t offset) const;
+
+    uint8_t* mBase = nullptr;
+    uint32_t mSize = 0;
+    native_handle_t* mHandle = nullptr;
+
+    std::mutex mLock;
+    /**
+     * Committed frames whose space hasn't been reclaimed yet, oldest first.
+     */
+    std::deque<Frame> mFrames;
+    uint64_t mNextAvDataId = 1;
+
+    // The frame being assembled
+    bool mFrameStarted = false;
+    uint32_t mFrameOffset = 0;
+    uint32_t mFrameSize = 0;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_TV_TUNER_V1_0_AVBUFFERRING_H_
@@ -60,17 +60,19 @@ Return<void> Demux::openFilter(const DemuxFilterType& type, uint32_t bufferSize,
     ALOGV("%s", __FUNCTION__);
 
     uint32_t filterId;
+    {
+        std::lock_guard<std::mutex> lock(mFilterEngineLock);
+        if (!mUnusedFilterIds.empty()) {
+            filterId = *mUnusedFilterIds.begin();
+
+            mUnusedFilterIds.erase(filterId);
+        } else {
+            filterId = ++mLastUsedFilterId;
+        }
 
-    if (!mUnusedFilterIds.empty()) {
-        filterId = *mUnusedFilterIds.begin();
-
-        mUnusedFilterIds.erase(filterId);
-    } else {
-        filterId = ++mLastUsedFilterId;
+        mUsedFilterIds.insert(filterId);
     }
 
-    mUsedFilterIds.insert(filterId);
-
     if (cb == nullptr) {
         ALOGW("callback can't be null");
         _hidl_cb(Result::INVALID_ARGUMENT, new Filter());
@@ -84,7 +86,10 @@ Return<void> Demux::openFilter(const DemuxFilterType& type, uint32_t bufferSize,
         return Void();
     }
 
-    mFilters[filterId] = filter;
+    {
+        std::lock_guard<std::mutex> lock(mFilterEngineLock);
+        mFilters[filterId] = filter;
+    }
 
     _hidl_cb(Result::SUCCESS, filter);
     return Void();
@@ -120,6 +125,7 @@ Return<void> Demux::getAvSyncTime(AvSyncHwId /* avSyncHwId */, getAvSyncTime_cb
 Return<Result> Demux::close() {
     ALOGV("%s", __FUNCTION__);
 
+    std::lock_guard<std::mutex> lock(mFilterEngineLock);
     mUnusedFilterIds.clear();
     mUsedFilterIds.clear();
     mLastUsedFilterId = -1;
@@ -166,6 +172,8 @@ Result Demux::removeFilter(uint32_t filterId) {
     ALOGV("%s", __FUNCTION__);
 
     // resetFilterRecords(filterId);
+    std::lock_guard<std::mutex> lock(mFilterEngineLock);
+    mFilterEngine.removeFilter(filterId);
     mUsedFilterIds.erase(filterId);
     mRecordFilterIds.erase(filterId);
     mUnusedFilterIds.insert(filterId);
@@ -174,35 +182,56 @@ Result Demux::removeFilter(uint32_t filterId) {
     return Result::SUCCESS;
 }
 
-void Demux::startBroadcastTsFilter(vector<uint8_t> data) {
-    set<uint32_t>::iterator it;
-    for (it = mUsedFilterIds.begin(); it != mUsedFilterIds.end(); it++) {
-        uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-        if (DEBUG_FILTER) {
-            ALOGW("start ts filter pid: %d", pid);
-        }
-        if (pid == mFilters[*it]->getTpid()) {
-            mFilters[*it]->updateFilterOutput(data);
-        }
+void Demux::setFilterInput(uint32_t filterId, TsFilterEngine::OutputType outputType,
+                           uint16_t pid, TsFilterEngine::Listener* listener) {
+    std::lock_guard<std::mutex> lock(mFilterEngineLock);
+    mFilterEngine.addFilter(filterId, outputType, pid, listener);
+}
+
+void Demux::processFilterInput(const uint8_t* data, size_t size) {
+    filterInput(data, size);
+    dispatchFilterOutput();
+}
+
+void Demux::filterInput(const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mFilterEngineLock);
+    if (DEBUG_FILTER) {
+        ALOGW("[Demux] filter %zu bytes of input", size);
     }
+    mFilterEngine.process(data, size);
 }
 
-void Demux::sendFrontendInputToRecord(vector<uint8_t> data) {
-    set<uint32_t>::iterator it;
-    for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        if (DEBUG_FILTER) {
-            ALOGW("update record filter output");
+void Demux::dispatchFilterOutput() {
+    vector<sp<Filter>> filters;
+    vector<sp<Filter>> recordFilters;
+    {
+        // The filter callbacks may close or configure filters, so they are made once the demux
+        // is unlocked
+        std::lock_guard<std::mutex> lock(mFilterEngineLock);
+        for (uint32_t filterId : mUsedFilterIds) {
+            std::map<uint32_t, sp<Filter>>::iterator it = mFilters.find(filterId);
+            if (it != mFilters.end()) {
+                filters.push_back(it->second);
+            }
+        }
+        if (mIsRecording) {
+            for (uint32_t filterId : mRecordFilterIds) {
+                std::map<uint32_t, sp<Filter>>::iterator it = mFilters.find(filterId);
+                if (it != mFilters.end()) {
+                    recordFilters.push_back(it->second);
+                }
+            }
         }
-        mFilters[*it]->updateRecordOutput(data);
     }
-}
 
-bool Demux::startBroadcastFilterDispatcher() {
-    set<uint32_t>::iterator it;
+    startBroadcastFilterDispatcher(filters);
+    startRecordFilterDispatcher(recordFilters);
+}
 
+bool Demux::startBroadcastFilterDispatcher(const vector<sp<Filter>>& filters) {
     // Handle the output data per filter type
-    for (it = mUsedFilterIds.begin(); it != mUsedFilterIds.end(); it++) {
-        if (mFilters[*it]->startFilterHandler() != Result::SUCCESS) {
+    for (const sp<Filter>& filter : filters) {
+        if (filter->startFilterHandler() != Result::SUCCESS) {
             return false;
         }
     }
@@ -210,11 +239,9 @@ bool Demux::startBroadcastFilterDispatcher() {
     return true;
 }
 
-bool Demux::startRecordFilterDispatcher() {
-    set<uint32_t>::iterator it;
-
-    for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        if (mFilters[*it]->startRecordFilterHandler() != Result::SUCCESS) {
+bool Demux::startRecordFilterDispatcher(const vector<sp<Filter>>& recordFilters) {
+    for (const sp<Filter>& filter : recordFilters) {
+        if (filter->startRecordFilterHandler() != Result::SUCCESS) {
             return false;
         }
     }
@@ -222,16 +249,13 @@ bool Demux::startRecordFilterDispatcher() {
     return true;
 }
 
-Result Demux::startFilterHandler(uint32_t filterId) {
-    return mFilters[filterId]->startFilterHandler();
-}
-
-void Demux::updateFilterOutput(uint16_t filterId, vector<uint8_t> data) {
-    mFilters[filterId]->updateFilterOutput(data);
-}
-
-uint16_t Demux::getFilterTpid(uint32_t filterId) {
-    return mFilters[filterId]->getTpid();
+void Demux::flushFilterInput(uint32_t filterId) {
+    std::lock_guard<std::mutex> lock(mFilterEngineLock);
+    mFilterEngine.resetFilter(filterId);
+    std::map<uint32_t, sp<Filter>>::iterator it = mFilters.find(filterId);
+    if (it != mFilters.end()) {
+        it->second->flushInput();
+    }
 }
 
 Result Demux::startFrontendInputLoop() {
@@ -257,7 +281,7 @@ void Demux::frontendInputThreadLoop() {
     // TODO take the packet size from the frontend setting
     int packetSize = 188;
     int writePacketAmount = 6;
-    char* buffer = new char[packetSize];
+    vector<uint8_t> buffer(packetSize * writePacketAmount);
     ALOGW("[Demux] Frontend input thread loop start %s", mFrontendSourceFile.c_str());
     if (!inputData.is_open()) {
         mFrontendInputThreadRunning = false;
@@ -267,40 +291,18 @@ void Demux::frontendInputThreadLoop() {
     while (mFrontendInputThreadRunning) {
         // move the stream pointer for packet size * 6 every read until the end
         while (mKeepFetchingDataFromFrontend) {
-            for (int i = 0; i < writePacketAmount; i++) {
-                inputData.read(buffer, packetSize);
-                if (!inputData) {
-                    mKeepFetchingDataFromFrontend = false;
-                    mFrontendInputThreadRunning = false;
-                    break;
-                }
-                // filter and dispatch filter output
-                vector<uint8_t> byteBuffer;
-                byteBuffer.resize(packetSize);
-                for (int index = 0; index < byteBuffer.size(); index++) {
-                    byteBuffer[index] = static_cast<uint8_t>(buffer[index]);
-                }
-                if (mIsRecording) {
-                    // Feed the data into the Dvr recording input
-                    sendFrontendInputToRecord(byteBuffer);
-                } else {
-                    // Feed the data into the broadcast demux filter
-                    startBroadcastTsFilter(byteBuffer);
-                }
-            }
-            if (mIsRecording) {
-                // Dispatch the data into the broadcasting filters.
-                startRecordFilterDispatcher();
-            } else {
-                // Dispatch the data into the broadcasting filters.
-                startBroadcastFilterDispatcher();
+            inputData.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+            if (!inputData) {
+                mKeepFetchingDataFromFrontend = false;
+                mFrontendInputThreadRunning = false;
             }
+            // filter and dispatch filter output
+            processFilterInput(buffer.data(), inputData.gcount() / packetSize * packetSize);
             usleep(100);
         }
     }
 
     ALOGW("[Demux] Frontend Input thread end.");
-    delete[] buffer;
     inputData.close();
 }
 
@@ -316,23 +318,27 @@ void Demux::setIsRecording(bool isRecording) {
 }
 
 bool Demux::attachRecordFilter(int filterId) {
-    if (mFilters[filterId] == nullptr || mDvr == nullptr) {
+    std::lock_guard<std::mutex> lock(mFilterEngineLock);
+    std::map<uint32_t, sp<Filter>>::iterator it = mFilters.find(filterId);
+    if (it == mFilters.end() || mDvr == nullptr) {
         return false;
     }
 
     mRecordFilterIds.insert(filterId);
-    mFilters[filterId]->attachFilterToRecord(mDvr);
+    it->second->attachFilterToRecord(mDvr);
 
     return true;
 }
 
 bool Demux::detachRecordFilter(int filterId) {
-    if (mFilters[filterId] == nullptr || mDvr == nullptr) {
+    std::lock_guard<std::mutex> lock(mFilterEngineLock);
+    std::map<uint32_t, sp<Filter>>::iterator it = mFilters.find(filterId);
+    if (it == mFilters.end() || mDvr == nullptr) {
         return false;
     }
 
     mRecordFilterIds.erase(filterId);
-    mFilters[filterId]->detachFilterFromRecord();
+    it->second->detachFilterFromRecord();
 
     return true;
 }
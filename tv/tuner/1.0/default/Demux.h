@@ -25,6 +25,7 @@
 #include "Filter.h"
 #include "Frontend.h"
 #include "TimeFilter.h"
+#include "TsFilterEngine.h"
 #include "Tuner.h"
 
 using namespace std;
@@ -85,9 +86,24 @@ class Demux : public IDemux {
     Result removeFilter(uint32_t filterId);
     bool attachRecordFilter(int filterId);
     bool detachRecordFilter(int filterId);
-    Result startFilterHandler(uint32_t filterId);
-    void updateFilterOutput(uint16_t filterId, vector<uint8_t> data);
-    uint16_t getFilterTpid(uint32_t filterId);
+    /**
+     * Sets what the filter engine passes on to a filter. Called when the filter is configured.
+     */
+    void setFilterInput(uint32_t filterId, TsFilterEngine::OutputType outputType, uint16_t pid,
+                        TsFilterEngine::Listener* listener);
+    /**
+     * Filters the demux input, from the frontend or from DVR playback, and has the filters
+     * write out their output.
+     */
+    void processFilterInput(const uint8_t* data, size_t size);
+    /**
+     * The two halves of processFilterInput(), for callers that must not hold their own locks
+     * while the filter callbacks run: filterInput() only assembles the filter output, and
+     * dispatchFilterOutput() writes it out and notifies the clients.
+     */
+    void filterInput(const uint8_t* data, size_t size);
+    void dispatchFilterOutput();
+    void flushFilterInput(uint32_t filterId);
     void setIsRecording(bool isRecording);
 
   private:
@@ -118,15 +134,12 @@ class Demux : public IDemux {
     void deleteEventFlag();
     bool readDataFromMQ();
     /**
-     * A dispatcher to read and dispatch input data to all the started filters.
-     * Each filter handler handles the data filtering/output writing/filterEvent updating.
+     * A dispatcher to have all the filters write out the output of the last input.
+     * Each filter handler handles the data output writing/filterEvent updating.
      * Note that recording filters are not included.
      */
-    bool startBroadcastFilterDispatcher();
-    void startBroadcastTsFilter(vector<uint8_t> data);
-
-    void sendFrontendInputToRecord(vector<uint8_t> data);
-    bool startRecordFilterDispatcher();
+    bool startBroadcastFilterDispatcher(const vector<sp<Filter>>& filters);
+    bool startRecordFilterDispatcher(const vector<sp<Filter>>& recordFilters);
 
     uint32_t mDemuxId;
     uint32_t mCiCamId;
@@ -183,10 +196,15 @@ class Demux : public IDemux {
      */
     std::mutex mFrontendInputThreadLock;
 
-    // temp handle single PES filter
-    // TODO handle mulptiple Pes filters
-    int mPesSizeLeft = 0;
-    vector<uint8_t> mPesOutput;
+    /**
+     * Does the PID filtering and reassembly for all the filters of the demux
+     */
+    TsFilterEngine mFilterEngine;
+    /**
+     * Lock held while the input is filtered, to protect the filter engine and mFilters. The
+     * filters dispatch their output to the client after it is released.
+     */
+    std::mutex mFilterEngineLock;
 
     const bool DEBUG_FILTER = false;
 };
@@ -17,6 +17,7 @@
 #define LOG_TAG "android.hardware.tv.tuner@1.0-Dvr"
 
 #include "Dvr.h"
+#include <cutils/properties.h>
 #include <utils/Log.h>
 
 namespace android {
@@ -132,6 +133,17 @@ Return<Result> Dvr::start() {
         pthread_setname_np(mDvrThread, "playback_waiting_loop");
     } else if (mType == DvrType::RECORD) {
         mRecordStatus = RecordStatus::DATA_READY;
+        {
+            std::lock_guard<std::mutex> lock(mWriteLock);
+            char indexFile[PROPERTY_VALUE_MAX];
+            if (property_get("vendor.tuner.dvr.index_file", indexFile, "") > 0) {
+                mRecordIndex = std::make_unique<TsIndex>();
+                if (!mRecordIndex->create(indexFile)) {
+                    ALOGW("[Dvr] recording without an index");
+                    mRecordIndex = nullptr;
+                }
+            }
+        }
         mIsRecordStarted = true;
         mDemux->setIsRecording(mIsRecordStarted | mIsRecordFilterAttached);
     }
@@ -151,6 +163,11 @@ Return<Result> Dvr::stop() {
     mIsRecordStarted = false;
     mDemux->setIsRecording(mIsRecordStarted | mIsRecordFilterAttached);
 
+    {
+        std::lock_guard<std::mutex> lock(mWriteLock);
+        mRecordIndex = nullptr;
+    }
+
     return Result::SUCCESS;
 }
 
@@ -159,6 +176,20 @@ Return<Result> Dvr::flush() {
 
     mRecordStatus = RecordStatus::DATA_READY;
 
+    if (mType == DvrType::PLAYBACK) {
+        // A client seeking in its recording flushes before writing from the new position:
+        // drop the data still queued from the old one, and anything the filters have
+        // partially assembled from it.
+        std::lock_guard<std::mutex> lock(mPlaybackLock);
+        vector<uint8_t> staleData(mDvrMQ->availableToRead());
+        mDvrMQ->read(staleData.data(), staleData.size());
+
+        std::map<uint32_t, sp<IFilter>>::iterator it;
+        for (it = mFilters.begin(); it != mFilters.end(); it++) {
+            mDemux->flushFilterInput(it->first);
+        }
+    }
+
     return Result::SUCCESS;
 }
 
@@ -210,10 +241,15 @@ void Dvr::playbackThreadLoop() {
         }
         // Our current implementation filter the data and write it into the filter FMQ immediately
         // after the DATA_READY from the VTS/framework
-        if (!readPlaybackFMQ() || !startFilterDispatcher()) {
+        std::unique_lock<std::mutex> playbackLock(mPlaybackLock);
+        if (!readPlaybackFMQ()) {
             ALOGD("[Dvr] playback data failed to be filtered. Ending thread");
             break;
         }
+        playbackLock.unlock();
+
+        // Dispatched unlocked: a client may flush from its filter callback
+        mDemux->dispatchFilterOutput();
 
         maySendPlaybackStatusCallback();
     }
@@ -251,45 +287,21 @@ PlaybackStatus Dvr::checkPlaybackStatusChange(uint32_t availableToWrite, uint32_
 }
 
 bool Dvr::readPlaybackFMQ() {
-    // Read playback data from the input FMQ
-    int size = mDvrMQ->availableToRead();
+    // Read the whole packets available from the input FMQ and filter them in one go
     int playbackPacketSize = mDvrSettings.playback().packetSize;
-    vector<uint8_t> dataOutputBuffer;
-    dataOutputBuffer.resize(playbackPacketSize);
-
-    // Dispatch the packet to the PID matching filter output buffer
-    for (int i = 0; i < size / playbackPacketSize; i++) {
-        if (!mDvrMQ->read(dataOutputBuffer.data(), playbackPacketSize)) {
-            return false;
-        }
-        startTpidFilter(dataOutputBuffer);
+    int size = mDvrMQ->availableToRead() / playbackPacketSize * playbackPacketSize;
+    if (size == 0) {
+        return true;
     }
 
-    return true;
-}
-
-void Dvr::startTpidFilter(vector<uint8_t> data) {
-    std::map<uint32_t, sp<IFilter>>::iterator it;
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-        if (DEBUG_DVR) {
-            ALOGW("[Dvr] start ts filter pid: %d", pid);
-        }
-        if (pid == mDemux->getFilterTpid(it->first)) {
-            mDemux->updateFilterOutput(it->first, data);
-        }
+    mPlaybackBuffer.resize(size);
+    if (!mDvrMQ->read(mPlaybackBuffer.data(), size)) {
+        return false;
     }
-}
-
-bool Dvr::startFilterDispatcher() {
-    std::map<uint32_t, sp<IFilter>>::iterator it;
-
-    // Handle the output data per filter type
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        if (mDemux->startFilterHandler(it->first) != Result::SUCCESS) {
-            return false;
-        }
+    if (DEBUG_DVR) {
+        ALOGW("[Dvr] filter %d bytes of playback data", size);
     }
+    mDemux->filterInput(mPlaybackBuffer.data(), size);
 
     return true;
 }
@@ -298,6 +310,10 @@ bool Dvr::writeRecordFMQ(const std::vector<uint8_t>& data) {
     std::lock_guard<std::mutex> lock(mWriteLock);
     ALOGW("[Dvr] write record FMQ");
     if (mDvrMQ->write(data.data(), data.size())) {
+        // Offsets in the index count the bytes the client received
+        if (mRecordIndex != nullptr) {
+            mRecordIndex->addPackets(data.data(), data.size());
+        }
         mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
         maySendRecordStatusCallback();
         return true;
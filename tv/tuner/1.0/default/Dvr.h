@@ -23,6 +23,7 @@
 #include <set>
 #include "Demux.h"
 #include "Frontend.h"
+#include "TsIndex.h"
 #include "Tuner.h"
 
 using namespace std;
@@ -100,12 +101,10 @@ class Dvr : public IDvr {
     RecordStatus checkRecordStatusChange(uint32_t availableToWrite, uint32_t availableToRead,
                                          uint32_t highThreshold, uint32_t lowThreshold);
     /**
-     * A dispatcher to read and dispatch input data to all the started filters.
-     * Each filter handler handles the data filtering/output writing/filterEvent updating.
+     * Reads the playback input and has the demux filter it. The filter output is dispatched
+     * separately, once mPlaybackLock is released.
      */
     bool readPlaybackFMQ();
-    void startTpidFilter(vector<uint8_t> data);
-    bool startFilterDispatcher();
     static void* __threadLoopPlayback(void* user);
     static void* __threadLoopRecord(void* user);
     void playbackThreadLoop();
@@ -113,6 +112,7 @@ class Dvr : public IDvr {
 
     unique_ptr<DvrMQ> mDvrMQ;
     EventFlag* mDvrEventFlag;
+    vector<uint8_t> mPlaybackBuffer;
     /**
      * Demux callbacks used on filter events or IO buffer status
      */
@@ -136,6 +136,11 @@ class Dvr : public IDvr {
      * Lock to protect writes to the FMQs
      */
     std::mutex mWriteLock;
+    /**
+     * Lock held while the playback data is read and filtered, so that a flush doesn't
+     * race with it. It is not held while the filter callbacks run.
+     */
+    std::mutex mPlaybackLock;
     /**
      * Lock to protect writes to the input status
      */
@@ -150,6 +155,13 @@ class Dvr : public IDvr {
     // Recording is ready when both of the following are set to true.
     bool mIsRecordStarted = false;
     bool mIsRecordFilterAttached = false;
+
+    /**
+     * Side index of the recording, built while recording when the
+     * vendor.tuner.dvr.index_file property names the file to keep it in.
+     * Playback clients use it to find where to resume from for a given time.
+     */
+    unique_ptr<TsIndex> mRecordIndex;
 };
 
 }  // namespace implementation
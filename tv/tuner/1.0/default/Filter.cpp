@@ -17,6 +17,7 @@
 #define LOG_TAG "android.hardware.tv.tuner@1.0-Filter"
 
 #include "Filter.h"
+#include <inttypes.h>
 #include <utils/Log.h>
 
 namespace android {
@@ -37,6 +38,11 @@ Filter::Filter(DemuxFilterType type, uint32_t filterId, uint32_t bufferSize,
     mBufferSize = bufferSize;
     mCallback = cb;
     mDemux = demux;
+
+    if (mType.mainType == DemuxFilterMainType::TS) {
+        DemuxTsFilterType tsType = mType.subType.tsFilterType();
+        mIsMediaFilter = tsType == DemuxTsFilterType::AUDIO || tsType == DemuxTsFilterType::VIDEO;
+    }
 }
 
 Filter::~Filter() {}
@@ -88,6 +94,11 @@ Return<Result> Filter::configure(const DemuxFilterSettings& settings) {
             break;
     }
 
+    TsFilterEngine::OutputType outputType;
+    if (mDemux != nullptr && getEngineOutputType(&outputType)) {
+        mDemux->setFilterInput(mFilterId, outputType, mTpid, this);
+    }
+
     return Result::SUCCESS;
 }
 
@@ -101,6 +112,7 @@ Return<Result> Filter::stop() {
     ALOGV("%s", __FUNCTION__);
 
     mFilterThreadRunning = false;
+    mFilterEventReady.notify_all();
 
     std::lock_guard<std::mutex> lock(mFilterThreadLock);
 
@@ -117,12 +129,28 @@ Return<Result> Filter::flush() {
     delete[] buffer;
     mFilterStatus = DemuxFilterStatus::DATA_READY;
 
+    if (mIsMediaFilter) {
+        // Drop the frames that haven't been delivered yet
+        std::lock_guard<std::mutex> lock(mFilterEventLock);
+        for (int i = 0; i < mFilterEvent.events.size(); i++) {
+            mAvBuffer.release(mFilterEvent.events[i].media().avDataId);
+        }
+        mFilterEvent.events.resize(0);
+    }
+
     return Result::SUCCESS;
 }
 
-Return<Result> Filter::releaseAvHandle(const hidl_handle& /*avMemory*/, uint64_t /*avDataId*/) {
+Return<Result> Filter::releaseAvHandle(const hidl_handle& /*avMemory*/, uint64_t avDataId) {
     ALOGV("%s", __FUNCTION__);
 
+    if (!mIsMediaFilter) {
+        return Result::INVALID_STATE;
+    }
+    if (!mAvBuffer.release(avDataId)) {
+        return Result::INVALID_ARGUMENT;
+    }
+
     return Result::SUCCESS;
 }
 
@@ -143,6 +171,11 @@ bool Filter::createFilterMQ() {
         return false;
     }
 
+    if (mIsMediaFilter && !mAvBuffer.init(mBufferSize)) {
+        ALOGW("Failed to create AV memory of filter with id: %d", mFilterId);
+        return false;
+    }
+
     mFilterMQ = std::move(tmpFilterMQ);
 
     if (EventFlag::createEventFlag(mFilterMQ->getEventFlagWord(), &mFilterEventFlag) != OK) {
@@ -170,6 +203,12 @@ void Filter::filterThreadLoop() {
     std::lock_guard<std::mutex> lock(mFilterThreadLock);
     mFilterThreadRunning = true;
 
+    if (mIsMediaFilter) {
+        mediaFilterThreadLoop();
+        ALOGD("[Filter] filter thread ended.");
+        return;
+    }
+
     // For the first time of filter output, implementation needs to send the filter
     // Event Callback without waiting for the DATA_CONSUMED to init the process.
     while (mFilterThreadRunning) {
@@ -232,17 +271,61 @@ void Filter::filterThreadLoop() {
     ALOGD("[Filter] filter thread ended.");
 }
 
+void Filter::mediaFilterThreadLoop() {
+    // Media data doesn't go through the FMQ, so there is no DATA_CONSUMED to wait for. Events
+    // are sent as soon as the frames are assembled and the client paces us by releasing them.
+    DemuxFilterEvent filterEvent;
+    while (mFilterThreadRunning) {
+        {
+            std::unique_lock<std::mutex> lock(mFilterEventLock);
+            mFilterEventReady.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return mFilterEvent.events.size() > 0 || !mFilterThreadRunning;
+            });
+            if (mFilterEvent.events.size() == 0) {
+                continue;
+            }
+            filterEvent = std::move(mFilterEvent);
+            mFilterEvent.events.resize(0);
+        }
+        mCallback->onFilterEvent(filterEvent);
+    }
+}
+
 void Filter::maySendFilterStatusCallback() {
-    std::lock_guard<std::mutex> lock(mFilterStatusLock);
+    updateFilterStatus();
+    sendPendingFilterStatus();
+}
+
+void Filter::updateFilterStatus() {
     int availableToRead = mFilterMQ->availableToRead();
     int availableToWrite = mFilterMQ->availableToWrite();
     int fmqSize = mFilterMQ->getQuantumCount();
 
+    std::lock_guard<std::mutex> lock(mFilterStatusLock);
     DemuxFilterStatus newStatus = checkFilterStatusChange(
             availableToWrite, availableToRead, ceil(fmqSize * 0.75), ceil(fmqSize * 0.25));
     if (mFilterStatus != newStatus) {
-        mCallback->onFilterStatus(newStatus);
         mFilterStatus = newStatus;
+        mPendingFilterStatus.push_back(newStatus);
+    }
+}
+
+void Filter::queueFilterStatus(DemuxFilterStatus status) {
+    std::lock_guard<std::mutex> lock(mFilterStatusLock);
+    if (mFilterStatus != status) {
+        mFilterStatus = status;
+        mPendingFilterStatus.push_back(status);
+    }
+}
+
+void Filter::sendPendingFilterStatus() {
+    vector<DemuxFilterStatus> statuses;
+    {
+        std::lock_guard<std::mutex> lock(mFilterStatusLock);
+        statuses.swap(mPendingFilterStatus);
+    }
+    for (DemuxFilterStatus status : statuses) {
+        mCallback->onFilterStatus(status);
     }
 }
 
@@ -263,166 +346,173 @@ uint16_t Filter::getTpid() {
     return mTpid;
 }
 
-void Filter::updateFilterOutput(vector<uint8_t> data) {
-    std::lock_guard<std::mutex> lock(mFilterOutputLock);
-    ALOGD("[Filter] filter output updated");
-    mFilterOutput.insert(mFilterOutput.end(), data.begin(), data.end());
+void Filter::flushInput() {
+    if (mAvBuffer.isFrameStarted()) {
+        mAvBuffer.abortFrame();
+    }
 }
 
-void Filter::updateRecordOutput(vector<uint8_t> data) {
-    std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
-    ALOGD("[Filter] record filter output updated");
-    mRecordFilterOutput.insert(mRecordFilterOutput.end(), data.begin(), data.end());
+bool Filter::getEngineOutputType(TsFilterEngine::OutputType* outputType) {
+    if (mType.mainType != DemuxFilterMainType::TS) {
+        return false;
+    }
+    switch (mType.subType.tsFilterType()) {
+        case DemuxTsFilterType::SECTION:
+            *outputType = TsFilterEngine::OutputType::SECTION;
+            return true;
+        case DemuxTsFilterType::PES:
+            *outputType = TsFilterEngine::OutputType::PES;
+            return true;
+        case DemuxTsFilterType::AUDIO:
+        case DemuxTsFilterType::VIDEO:
+            *outputType = TsFilterEngine::OutputType::PES_STREAM;
+            return true;
+        case DemuxTsFilterType::TS:
+            *outputType = TsFilterEngine::OutputType::TS;
+            return true;
+        case DemuxTsFilterType::RECORD:
+            *outputType = TsFilterEngine::OutputType::RECORD;
+            return true;
+        default:
+            // PCR and TEMI filters have no output in this implementation
+            return false;
+    }
 }
 
 Result Filter::startFilterHandler() {
-    std::lock_guard<std::mutex> lock(mFilterOutputLock);
-    switch (mType.mainType) {
-        case DemuxFilterMainType::TS:
-            switch (mType.subType.tsFilterType()) {
-                case DemuxTsFilterType::UNDEFINED:
-                    break;
-                case DemuxTsFilterType::SECTION:
-                    startSectionFilterHandler();
-                    break;
-                case DemuxTsFilterType::PES:
-                    startPesFilterHandler();
-                    break;
-                case DemuxTsFilterType::TS:
-                    startTsFilterHandler();
-                    break;
-                case DemuxTsFilterType::AUDIO:
-                case DemuxTsFilterType::VIDEO:
-                    startMediaFilterHandler();
-                    break;
-                case DemuxTsFilterType::PCR:
-                    startPcrFilterHandler();
-                    break;
-                case DemuxTsFilterType::TEMI:
-                    startTemiFilterHandler();
-                    break;
-                default:
-                    break;
-            }
-            break;
-        case DemuxFilterMainType::MMTP:
-            /*mmtpSettings*/
-            break;
-        case DemuxFilterMainType::IP:
-            /*ipSettings*/
-            break;
-        case DemuxFilterMainType::TLV:
-            /*tlvSettings*/
-            break;
-        case DemuxFilterMainType::ALP:
-            /*alpSettings*/
-            break;
-        default:
-            break;
+    // Sections, PES and TS packets are written out as the filter engine completes them, while
+    // audio and video frames are delivered once per dispatch
+    sendPendingFilterStatus();
+    if (mIsMediaFilter) {
+        return startMediaFilterHandler();
     }
     return Result::SUCCESS;
 }
 
-Result Filter::startSectionFilterHandler() {
-    if (mFilterOutput.empty()) {
-        return Result::SUCCESS;
-    }
-    if (!writeSectionsAndCreateEvent(mFilterOutput)) {
-        ALOGD("[Filter] filter %d fails to write into FMQ. Ending thread", mFilterId);
-        return Result::UNKNOWN_ERROR;
+void Filter::onSection(const uint8_t* data, size_t size) {
+    if (!writeSectionAndCreateEvent(data, size)) {
+        ALOGD("[Filter] filter %d fails to write section into FMQ", mFilterId);
+        updateFilterStatus();
     }
-
-    mFilterOutput.clear();
-
-    return Result::SUCCESS;
 }
 
-Result Filter::startPesFilterHandler() {
+void Filter::onPes(const uint8_t* data, size_t size) {
+    if (size > UINT16_MAX) {
+        // Too large for the event to describe
+        ALOGW("[Filter] dropping PES packet of length %zu on filter %d", size, mFilterId);
+        return;
+    }
+
     std::lock_guard<std::mutex> lock(mFilterEventLock);
-    if (mFilterOutput.empty()) {
-        return Result::SUCCESS;
+    if (!writeDataToFilterMQ(data, size)) {
+        ALOGD("[Filter] pes data write failed");
+        updateFilterStatus();
+        return;
+    }
+    updateFilterStatus();
+    DemuxFilterPesEvent pesEvent;
+    pesEvent = {
+            // temp dump meta data
+            .streamId = data[3],
+            .dataLength = static_cast<uint16_t>(size),
+    };
+    if (DEBUG_FILTER) {
+        ALOGD("[Filter] assembled pes data length %d", pesEvent.dataLength);
     }
 
-    for (int i = 0; i < mFilterOutput.size(); i += 188) {
-        if (mPesSizeLeft == 0) {
-            uint32_t prefix = (mFilterOutput[i + 4] << 16) | (mFilterOutput[i + 5] << 8) |
-                              mFilterOutput[i + 6];
-            if (DEBUG_FILTER) {
-                ALOGD("[Filter] prefix %d", prefix);
-            }
-            if (prefix == 0x000001) {
-                // TODO handle mulptiple Pes filters
-                mPesSizeLeft = (mFilterOutput[i + 8] << 8) | mFilterOutput[i + 9];
-                mPesSizeLeft += 6;
-                if (DEBUG_FILTER) {
-                    ALOGD("[Filter] pes data length %d", mPesSizeLeft);
-                }
-            } else {
-                continue;
-            }
-        }
+    int eventsSize = mFilterEvent.events.size();
+    mFilterEvent.events.resize(eventsSize + 1);
+    mFilterEvent.events[eventsSize].pes(pesEvent);
+}
 
-        int endPoint = min(184, mPesSizeLeft);
-        // append data and check size
-        vector<uint8_t>::const_iterator first = mFilterOutput.begin() + i + 4;
-        vector<uint8_t>::const_iterator last = mFilterOutput.begin() + i + 4 + endPoint;
-        mPesOutput.insert(mPesOutput.end(), first, last);
-        // size does not match then continue
-        mPesSizeLeft -= endPoint;
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] pes data left %d", mPesSizeLeft);
-        }
-        if (mPesSizeLeft > 0) {
-            continue;
-        }
-        // size match then create event
-        if (!writeDataToFilterMQ(mPesOutput)) {
-            ALOGD("[Filter] pes data write failed");
-            mFilterOutput.clear();
-            return Result::INVALID_STATE;
+Result Filter::startMediaFilterHandler() {
+    {
+        std::lock_guard<std::mutex> lock(mFilterEventLock);
+        if (mMediaEvents.empty()) {
+            return Result::SUCCESS;
         }
-        maySendFilterStatusCallback();
-        DemuxFilterPesEvent pesEvent;
-        pesEvent = {
-                // temp dump meta data
-                .streamId = mPesOutput[3],
-                .dataLength = static_cast<uint16_t>(mPesOutput.size()),
-        };
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] assembled pes data length %d", pesEvent.dataLength);
+        int size = mFilterEvent.events.size();
+        mFilterEvent.events.resize(size + mMediaEvents.size());
+        for (int i = 0; i < mMediaEvents.size(); i++) {
+            // Moving the handle in keeps it from being cloned along with the event
+            mMediaEvents[i].avMemory = hidl_handle(mAvBuffer.getHandle());
+            mFilterEvent.events[size + i].media(std::move(mMediaEvents[i]));
         }
+        mMediaEvents.clear();
+    }
+    mFilterEventReady.notify_one();
 
-        int size = mFilterEvent.events.size();
-        mFilterEvent.events.resize(size + 1);
-        mFilterEvent.events[size].pes(pesEvent);
-        mPesOutput.clear();
+    return Result::SUCCESS;
+}
+
+void Filter::onPesStart(const TsFilterEngine::PesHeader& header) {
+    mMediaEvent = {};
+    mMediaEvent.streamId = header.streamId;
+    mMediaEvent.isPtsPresent = header.isPtsPresent;
+    mMediaEvent.pts = header.pts;
+    mAvBuffer.beginFrame();
+}
+
+void Filter::onPesPayload(const uint8_t* data, size_t size) {
+    if (!mAvBuffer.isFrameStarted()) {
+        // Already dropped
+        return;
+    }
+    if (!mAvBuffer.appendToFrame(data, size)) {
+        // The client holds on to too many frames. Drop this one until it releases some.
+        mAvBuffer.abortFrame();
+        queueFilterStatus(DemuxFilterStatus::OVERFLOW);
+    }
+}
+
+void Filter::onPesEnd() {
+    if (!mAvBuffer.commitFrame(&mMediaEvent.avDataId, &mMediaEvent.offset,
+                               &mMediaEvent.dataLength)) {
+        return;
+    }
+    mMediaEvent.isSecureMemory = false;
+    {
+        std::lock_guard<std::mutex> lock(mFilterEventLock);
+        mMediaEvents.push_back(mMediaEvent);
     }
 
-    mFilterOutput.clear();
+    if (DEBUG_FILTER) {
+        ALOGD("[Filter] assembled media frame %" PRIu64 " length %u", mMediaEvent.avDataId,
+              mMediaEvent.dataLength);
+    }
 
-    return Result::SUCCESS;
+    // A frame that fits again ends an overflow
+    bool overflowed;
+    {
+        std::lock_guard<std::mutex> lock(mFilterStatusLock);
+        overflowed = mFilterStatus == DemuxFilterStatus::OVERFLOW;
+    }
+    if (overflowed) {
+        queueFilterStatus(DemuxFilterStatus::DATA_READY);
+    }
 }
 
-Result Filter::startTsFilterHandler() {
-    // TODO handle starting TS filter
-    return Result::SUCCESS;
+void Filter::onPesAbort() {
+    if (mAvBuffer.isFrameStarted()) {
+        mAvBuffer.abortFrame();
+    }
 }
 
-Result Filter::startMediaFilterHandler() {
-    DemuxFilterMediaEvent mediaEvent;
-    mediaEvent = {
-            // temp dump meta data
-            .pts = 0,
-            .dataLength = 530,
-            .avMemory = nullptr,
-            .isSecureMemory = false,
-    };
-    mFilterEvent.events.resize(1);
-    mFilterEvent.events[0].media(mediaEvent);
+void Filter::onTsPacket(const uint8_t* packet) {
+    // TS filters have no event of their own, the client reads the packets as the FMQ fills up
+    if (!writeDataToFilterMQ(packet, TsFilterEngine::TS_PACKET_SIZE)) {
+        ALOGD("[Filter] filter %d fails to write ts packet into FMQ", mFilterId);
+    }
+    updateFilterStatus();
+}
 
-    mFilterOutput.clear();
-    // TODO handle write FQM for media stream
-    return Result::SUCCESS;
+void Filter::onRecordData(const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
+    // Only keep the data while the filter is attached to a recording DVR
+    if (mDvr == nullptr) {
+        return;
+    }
+    mRecordFilterOutput.insert(mRecordFilterOutput.end(), data, data + size);
 }
 
 Result Filter::startRecordFilterHandler() {
@@ -446,40 +536,32 @@ Result Filter::startRecordFilterHandler() {
     return Result::SUCCESS;
 }
 
-Result Filter::startPcrFilterHandler() {
-    // TODO handle starting PCR filter
-    return Result::SUCCESS;
-}
-
-Result Filter::startTemiFilterHandler() {
-    // TODO handle starting TEMI filter
-    return Result::SUCCESS;
-}
-
-bool Filter::writeSectionsAndCreateEvent(vector<uint8_t> data) {
-    // TODO check how many sections has been read
-    ALOGD("[Filter] section hander");
+bool Filter::writeSectionAndCreateEvent(const uint8_t* data, size_t size) {
+    if (DEBUG_FILTER) {
+        ALOGD("[Filter] section hander");
+    }
     std::lock_guard<std::mutex> lock(mFilterEventLock);
-    if (!writeDataToFilterMQ(data)) {
+    if (!writeDataToFilterMQ(data, size)) {
         return false;
     }
-    int size = mFilterEvent.events.size();
-    mFilterEvent.events.resize(size + 1);
+    int eventsSize = mFilterEvent.events.size();
+    mFilterEvent.events.resize(eventsSize + 1);
+    // Only the long section syntax carries a version and section number
+    bool isLongSection = size >= 8 && (data[1] & 0x80);
     DemuxFilterSectionEvent secEvent;
     secEvent = {
-            // temp dump meta data
-            .tableId = 0,
-            .version = 1,
-            .sectionNum = 1,
-            .dataLength = static_cast<uint16_t>(data.size()),
+            .tableId = data[0],
+            .version = static_cast<uint16_t>(isLongSection ? (data[5] >> 1) & 0x1f : 0),
+            .sectionNum = static_cast<uint16_t>(isLongSection ? data[6] : 0),
+            .dataLength = static_cast<uint16_t>(size),
     };
-    mFilterEvent.events[size].section(secEvent);
+    mFilterEvent.events[eventsSize].section(secEvent);
     return true;
 }
 
-bool Filter::writeDataToFilterMQ(const std::vector<uint8_t>& data) {
+bool Filter::writeDataToFilterMQ(const uint8_t* data, size_t size) {
     std::lock_guard<std::mutex> lock(mWriteLock);
-    if (mFilterMQ->write(data.data(), data.size())) {
+    if (mFilterMQ->write(data, size)) {
         return true;
     }
     return false;
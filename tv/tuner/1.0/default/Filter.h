@@ -20,10 +20,13 @@
 #include <android/hardware/tv/tuner/1.0/IFilter.h>
 #include <fmq/MessageQueue.h>
 #include <math.h>
+#include <condition_variable>
 #include <set>
+#include "AvBufferRing.h"
 #include "Demux.h"
 #include "Dvr.h"
 #include "Frontend.h"
+#include "TsFilterEngine.h"
 
 using namespace std;
 
@@ -47,7 +50,11 @@ using FilterMQ = MessageQueue<uint8_t, kSynchronizedReadWrite>;
 class Demux;
 class Dvr;
 
-class Filter : public IFilter {
+/**
+ * The HIDL side of a filter. The demux's TsFilterEngine does the filtering and reassembly,
+ * and hands the output to the filter as its Listener, which then writes it out to the client.
+ */
+class Filter : public IFilter, public TsFilterEngine::Listener {
   public:
     Filter();
 
@@ -76,18 +83,36 @@ class Filter : public IFilter {
 
     /**
      * To create a FilterMQ and its Event Flag.
+     * Audio and video filters also get the shared memory their frames are assembled in.
      *
      * Return false is any of the above processes fails.
      */
     bool createFilterMQ();
     uint16_t getTpid();
-    void updateFilterOutput(vector<uint8_t> data);
-    void updateRecordOutput(vector<uint8_t> data);
+    /**
+     * Drops the audio or video frame being assembled. Used when the input jumps to another
+     * position.
+     */
+    void flushInput();
+    /**
+     * Delivers the output of the last input: the status changes and media frames. Called by the
+     * demux after it is unlocked, as the client may call back into it.
+     */
     Result startFilterHandler();
     Result startRecordFilterHandler();
     void attachFilterToRecord(const sp<Dvr> dvr);
     void detachFilterFromRecord();
 
+    // TsFilterEngine::Listener
+    virtual void onSection(const uint8_t* data, size_t size) override;
+    virtual void onPes(const uint8_t* data, size_t size) override;
+    virtual void onPesStart(const TsFilterEngine::PesHeader& header) override;
+    virtual void onPesPayload(const uint8_t* data, size_t size) override;
+    virtual void onPesEnd() override;
+    virtual void onPesAbort() override;
+    virtual void onTsPacket(const uint8_t* packet) override;
+    virtual void onRecordData(const uint8_t* data, size_t size) override;
+
   private:
     // Tuner service
     sp<Demux> mDemux;
@@ -104,9 +129,9 @@ class Filter : public IFilter {
     DemuxFilterSettings mFilterSettings;
 
     uint16_t mTpid;
+    bool mIsMediaFilter = false;
     sp<IFilter> mDataSource;
     bool mIsDataSourceDemux = true;
-    vector<uint8_t> mFilterOutput;
     vector<uint8_t> mRecordFilterOutput;
     unique_ptr<FilterMQ> mFilterMQ;
     EventFlag* mFilterEventFlag;
@@ -117,6 +142,8 @@ class Filter : public IFilter {
 
     // FMQ status local records
     DemuxFilterStatus mFilterStatus;
+    // Status changes not delivered to the client yet
+    vector<DemuxFilterStatus> mPendingFilterStatus;
     /**
      * If a specific filter's writing loop is still running
      */
@@ -132,31 +159,34 @@ class Filter : public IFilter {
     bool DEBUG_FILTER = false;
 
     /**
-     * Filter handlers to handle the data filtering.
-     * They are also responsible to write the filtered output into the filter FMQ
-     * and update the filterEvent bound with the same filterId.
+     * The output the demux's filter engine should produce for this filter. Return false if
+     * the engine doesn't handle the filter type.
      */
-    Result startSectionFilterHandler();
-    Result startPesFilterHandler();
-    Result startTsFilterHandler();
+    bool getEngineOutputType(TsFilterEngine::OutputType* outputType);
     Result startMediaFilterHandler();
-    Result startPcrFilterHandler();
-    Result startTemiFilterHandler();
     Result startFilterLoop();
 
+    /**
+     * Audio and video filters assemble the PES payloads straight into mAvBuffer and deliver
+     * events referencing them as soon as they are complete, instead of going through the
+     * filter FMQ.
+     */
+    void mediaFilterThreadLoop();
+
     void deleteEventFlag();
-    bool writeDataToFilterMQ(const std::vector<uint8_t>& data);
+    bool writeDataToFilterMQ(const uint8_t* data, size_t size);
     bool readDataFromMQ();
-    bool writeSectionsAndCreateEvent(vector<uint8_t> data);
+    bool writeSectionAndCreateEvent(const uint8_t* data, size_t size);
     void maySendFilterStatusCallback();
-    DemuxFilterStatus checkFilterStatusChange(uint32_t availableToWrite, uint32_t availableToRead,
-                                              uint32_t highThreshold, uint32_t lowThreshold);
     /**
-     * A dispatcher to read and dispatch input data to all the started filters.
-     * Each filter handler handles the data filtering/output writing/filterEvent updating.
+     * Records the status from the FMQ levels, or the given status, to be sent by
+     * sendPendingFilterStatus(). Used while the demux is locked.
      */
-    void startTsFilter(vector<uint8_t> data);
-    bool startFilterDispatcher();
+    void updateFilterStatus();
+    void queueFilterStatus(DemuxFilterStatus status);
+    void sendPendingFilterStatus();
+    DemuxFilterStatus checkFilterStatusChange(uint32_t availableToWrite, uint32_t availableToRead,
+                                              uint32_t highThreshold, uint32_t lowThreshold);
     static void* __threadLoopFilter(void* user);
     void filterThreadLoop();
 
@@ -170,17 +200,21 @@ class Filter : public IFilter {
     // TODO make each filter separate event lock
     std::mutex mFilterEventLock;
     /**
-     * Lock to protect writes to the input status
+     * Lock to protect the filter status and the status changes to send
      */
     std::mutex mFilterStatusLock;
     std::mutex mFilterThreadLock;
-    std::mutex mFilterOutputLock;
     std::mutex mRecordFilterOutputLock;
 
-    // temp handle single PES filter
-    // TODO handle mulptiple Pes filters
-    int mPesSizeLeft = 0;
-    vector<uint8_t> mPesOutput;
+    AvBufferRing mAvBuffer;
+    /**
+     * Signaled when media events are added to mFilterEvent
+     */
+    std::condition_variable mFilterEventReady;
+    // The PES packet being assembled into mAvBuffer
+    DemuxFilterMediaEvent mMediaEvent;
+    // Frames completed since the last startFilterHandler, protected by mFilterEventLock
+    vector<DemuxFilterMediaEvent> mMediaEvents;
 };
 
 }  // namespace implementation
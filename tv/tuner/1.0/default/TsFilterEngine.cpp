@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.tv.tuner@1.0-TsFilterEngine"
+
+#include "TsFilterEngine.h"
+#include <utils/Log.h>
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+const size_t SECTION_HEADER_SIZE = 3;
+const size_t PES_HEADER_SIZE = 6;
+
+}  // namespace
+
+TsFilterEngine::TsFilterEngine() : mPidSlots(PID_COUNT, -1) {}
+
+TsFilterEngine::~TsFilterEngine() {}
+
+void TsFilterEngine::addFilter(uint32_t filterId, OutputType type, uint16_t pid,
+                               Listener* listener) {
+    std::unique_ptr<FilterState> filter(new FilterState());
+    filter->filterId = filterId;
+    filter->type = type;
+    filter->pid = pid & (PID_COUNT - 1);
+    filter->listener = listener;
+    resetFilterState(filter.get());
+
+    mFilters[filterId] = std::move(filter);
+    rebuildPidTable();
+}
+
+void TsFilterEngine::removeFilter(uint32_t filterId) {
+    if (mFilters.erase(filterId) > 0) {
+        rebuildPidTable();
+    }
+}
+
+void TsFilterEngine::resetFilter(uint32_t filterId) {
+    auto it = mFilters.find(filterId);
+    if (it != mFilters.end()) {
+        resetFilterState(it->second.get());
+    }
+}
+
+void TsFilterEngine::rebuildPidTable() {
+    std::fill(mPidSlots.begin(), mPidSlots.end(), -1);
+    mPidFilters.clear();
+    mRecordFilters.clear();
+
+    for (auto& it : mFilters) {
+        FilterState* filter = it.second.get();
+        int16_t& slot = mPidSlots[filter->pid];
+        if (slot < 0) {
+            slot = mPidFilters.size();
+            mPidFilters.emplace_back();
+        }
+        mPidFilters[slot].push_back(filter);
+        if (filter->type == OutputType::RECORD) {
+            mRecordFilters.push_back(filter);
+        }
+    }
+}
+
+void TsFilterEngine::resetFilterState(FilterState* filter) {
+    if (filter->type == OutputType::PES_STREAM && filter->isUnitStarted) {
+        filter->listener->onPesAbort();
+    }
+    filter->continuityCounter = -1;
+    filter->isUnitStarted = false;
+    filter->unit.clear();
+    filter->unitSize = 0;
+    filter->isPesSizeKnown = false;
+    filter->pesSizeLeft = 0;
+    filter->recordData = nullptr;
+    filter->recordSize = 0;
+}
+
+void TsFilterEngine::process(const uint8_t* data, size_t size) {
+    for (size_t i = 0; i + TS_PACKET_SIZE <= size; i += TS_PACKET_SIZE) {
+        const uint8_t* packet = data + i;
+        // Skip packets that lost sync or have the transport error indicator set
+        if (packet[0] != 0x47 || (packet[1] & 0x80)) {
+            continue;
+        }
+        uint16_t pid = ((packet[1] & 0x1f) << 8) | packet[2];
+        int16_t slot = mPidSlots[pid];
+        if (slot < 0) {
+            continue;
+        }
+        for (FilterState* filter : mPidFilters[slot]) {
+            processPacket(filter, packet);
+        }
+    }
+
+    // Record data can't reference the input past this call
+    flushRecordData();
+}
+
+bool TsFilterEngine::checkContinuity(FilterState* filter, const uint8_t* packet) {
+    uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+    if (!(adaptationFieldControl & 0x1)) {
+        // The counter only advances on packets with payload
+        return true;
+    }
+
+    int continuityCounter = packet[3] & 0x0f;
+    int lastContinuityCounter = filter->continuityCounter;
+    filter->continuityCounter = continuityCounter;
+    bool discontinuityIndicator = (adaptationFieldControl & 0x2) && packet[4] > 0 &&
+                                  (packet[5] & 0x80);
+    if (lastContinuityCounter < 0 || discontinuityIndicator ||
+        continuityCounter == ((lastContinuityCounter + 1) & 0x0f)) {
+        return true;
+    }
+    if (continuityCounter == lastContinuityCounter) {
+        // Duplicate packet
+        return false;
+    }
+
+    // Packets were lost, so whatever was being assembled is broken
+    if (filter->type == OutputType::PES_STREAM && filter->isUnitStarted) {
+        filter->listener->onPesAbort();
+    }
+    filter->isUnitStarted = false;
+    filter->unit.clear();
+    return true;
+}
+
+void TsFilterEngine::processPacket(FilterState* filter, const uint8_t* packet) {
+    switch (filter->type) {
+        case OutputType::TS:
+            filter->listener->onTsPacket(packet);
+            return;
+        case OutputType::RECORD:
+            processRecordPacket(filter, packet);
+            return;
+        default:
+            break;
+    }
+
+    if (!checkContinuity(filter, packet)) {
+        return;
+    }
+
+    uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+    size_t payloadStart = 4;
+    if (adaptationFieldControl & 0x2) {
+        payloadStart += 1 + packet[4];
+    }
+    if (!(adaptationFieldControl & 0x1) || payloadStart >= TS_PACKET_SIZE) {
+        return;
+    }
+    const uint8_t* payload = packet + payloadStart;
+    size_t payloadSize = TS_PACKET_SIZE - payloadStart;
+    bool payloadUnitStart = packet[1] & 0x40;
+
+    switch (filter->type) {
+        case OutputType::SECTION:
+            processSectionPacket(filter, payload, payloadSize, payloadUnitStart);
+            break;
+        case OutputType::PES:
+            processPesPacket(filter, payload, payloadSize, payloadUnitStart);
+            break;
+        case OutputType::PES_STREAM:
+            processPesStreamPacket(filter, payload, payloadSize, payloadUnitStart);
+            break;
+        default:
+            break;
+    }
+}
+
+void TsFilterEngine::processSectionPacket(FilterState* filter, const uint8_t* payload,
+                                          size_t size, bool payloadUnitStart) {
+    if (!payloadUnitStart) {
+        // Not in sync with a section yet otherwise
+        if (filter->isUnitStarted) {
+            appendSectionData(filter, payload, size, true /* continueOnly */);
+        }
+        return;
+    }
+
+    // The pointer_field tells where the first new section starts. What comes before it ends
+    // the previous one.
+    size_t pointer = payload[0];
+    if (1 + pointer > size) {
+        filter->isUnitStarted = false;
+        return;
+    }
+    if (filter->isUnitStarted) {
+        appendSectionData(filter, payload + 1, pointer, true /* continueOnly */);
+        filter->isUnitStarted = false;
+    }
+    if (1 + pointer < size) {
+        appendSectionData(filter, payload + 1 + pointer, size - 1 - pointer,
+                          false /* continueOnly */);
+    }
+}
+
+void TsFilterEngine::appendSectionData(FilterState* filter, const uint8_t* data, size_t size,
+                                       bool continueOnly) {
+    while (size > 0) {
+        if (!filter->isUnitStarted) {
+            if (continueOnly || data[0] == 0xff) {
+                // The rest of the packet is stuffing
+                return;
+            }
+            if (size >= SECTION_HEADER_SIZE) {
+                size_t sectionSize =
+                        SECTION_HEADER_SIZE + (((data[1] & 0x0f) << 8) | data[2]);
+                if (sectionSize <= size) {
+                    // The section is whole in this packet, so there is no need to copy it
+                    filter->listener->onSection(data, sectionSize);
+                    data += sectionSize;
+                    size -= sectionSize;
+                    continue;
+                }
+            }
+            filter->isUnitStarted = true;
+            filter->unit.clear();
+            filter->unitSize = 0;
+        }
+
+        std::vector<uint8_t>& unit = filter->unit;
+        if (filter->unitSize == 0) {
+            size_t headerSize = std::min(SECTION_HEADER_SIZE - unit.size(), size);
+            unit.insert(unit.end(), data, data + headerSize);
+            data += headerSize;
+            size -= headerSize;
+            if (unit.size() < SECTION_HEADER_SIZE) {
+                return;
+            }
+            filter->unitSize = SECTION_HEADER_SIZE + (((unit[1] & 0x0f) << 8) | unit[2]);
+        }
+
+        size_t appendSize = std::min(filter->unitSize - unit.size(), size);
+        unit.insert(unit.end(), data, data + appendSize);
+        data += appendSize;
+        size -= appendSize;
+        if (unit.size() == filter->unitSize) {
+            filter->listener->onSection(unit.data(), unit.size());
+            filter->isUnitStarted = false;
+            if (continueOnly) {
+                return;
+            }
+        }
+    }
+}
+
+void TsFilterEngine::processPesPacket(FilterState* filter, const uint8_t* payload, size_t size,
+                                      bool payloadUnitStart) {
+    std::vector<uint8_t>& unit = filter->unit;
+    if (payloadUnitStart) {
+        // An unbounded PES packet ends where the next one starts. A bounded one that isn't
+        // complete by then lost data.
+        if (filter->isUnitStarted && filter->unitSize == 0) {
+            filter->listener->onPes(unit.data(), unit.size());
+        }
+        filter->isUnitStarted = false;
+
+        if (size < PES_HEADER_SIZE || payload[0] != 0x00 || payload[1] != 0x00 ||
+            payload[2] != 0x01) {
+            return;
+        }
+        uint16_t pesPacketLength = (payload[4] << 8) | payload[5];
+        filter->isUnitStarted = true;
+        filter->unitSize = pesPacketLength != 0 ? PES_HEADER_SIZE + pesPacketLength : 0;
+        unit.clear();
+    } else if (!filter->isUnitStarted) {
+        // Not in sync with a PES packet yet
+        return;
+    }
+
+    if (filter->unitSize != 0) {
+        size = std::min(size, filter->unitSize - unit.size());
+    }
+    unit.insert(unit.end(), payload, payload + size);
+
+    if (filter->unitSize != 0 && unit.size() == filter->unitSize) {
+        filter->listener->onPes(unit.data(), unit.size());
+        filter->isUnitStarted = false;
+    }
+}
+
+void TsFilterEngine::processPesStreamPacket(FilterState* filter, const uint8_t* payload,
+                                            size_t size, bool payloadUnitStart) {
+    Listener* listener = filter->listener;
+    if (payloadUnitStart) {
+        // Video PES packets usually leave their length unset and end where the next one starts
+        if (filter->isUnitStarted) {
+            listener->onPesEnd();
+            filter->isUnitStarted = false;
+        }
+
+        if (size < 9 || payload[0] != 0x00 || payload[1] != 0x00 || payload[2] != 0x01) {
+            return;
+        }
+        uint16_t pesPacketLength = (payload[4] << 8) | payload[5];
+        uint8_t ptsDtsFlags = payload[7] >> 6;
+        uint8_t headerDataLength = payload[8];
+        size_t headerSize = 9 + headerDataLength;
+        if (headerSize > size || (pesPacketLength != 0 && pesPacketLength < 3 + headerDataLength)) {
+            ALOGW("[TsFilterEngine] malformed PES header on filter %u", filter->filterId);
+            return;
+        }
+
+        PesHeader header = {
+                .streamId = payload[3],
+                .packetLength = pesPacketLength,
+                .isPtsPresent = (ptsDtsFlags & 0x2) && headerDataLength >= 5,
+                .pts = 0,
+        };
+        if (header.isPtsPresent) {
+            const uint8_t* pts = payload + 9;
+            header.pts = (static_cast<uint64_t>((pts[0] >> 1) & 0x07) << 30) | (pts[1] << 22) |
+                         ((pts[2] >> 1) << 15) | (pts[3] << 7) | (pts[4] >> 1);
+        }
+        filter->isUnitStarted = true;
+        filter->isPesSizeKnown = pesPacketLength != 0;
+        filter->pesSizeLeft = filter->isPesSizeKnown ? pesPacketLength - 3 - headerDataLength : 0;
+        listener->onPesStart(header);
+
+        payload += headerSize;
+        size -= headerSize;
+    } else if (!filter->isUnitStarted) {
+        // Not in sync with a PES packet yet
+        return;
+    }
+
+    if (filter->isPesSizeKnown) {
+        size = std::min<size_t>(size, filter->pesSizeLeft);
+        filter->pesSizeLeft -= size;
+    }
+    if (size > 0) {
+        listener->onPesPayload(payload, size);
+    }
+
+    if (filter->isPesSizeKnown && filter->pesSizeLeft == 0) {
+        listener->onPesEnd();
+        filter->isUnitStarted = false;
+    }
+}
+
+void TsFilterEngine::processRecordPacket(FilterState* filter, const uint8_t* packet) {
+    // Extend the run while the recorded packets are back to back in the input
+    if (filter->recordSize > 0 && filter->recordData + filter->recordSize == packet) {
+        filter->recordSize += TS_PACKET_SIZE;
+        return;
+    }
+    if (filter->recordSize > 0) {
+        filter->listener->onRecordData(filter->recordData, filter->recordSize);
+    }
+    filter->recordData = packet;
+    filter->recordSize = TS_PACKET_SIZE;
+}
+
+void TsFilterEngine::flushRecordData() {
+    for (FilterState* filter : mRecordFilters) {
+        if (filter->recordSize > 0) {
+            filter->listener->onRecordData(filter->recordData, filter->recordSize);
+            filter->recordData = nullptr;
+            filter->recordSize = 0;
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_TV_TUNER_V1_0_TSFILTERENGINE_H_
+#define ANDROID_HARDWARE_TV_TUNER_V1_0_TSFILTERENGINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+/**
+ * Filters a TS by PID and turns the packets of each filter into its output: sections, PES
+ * packets or recording data.
+ *
+ * The engine doesn't know about HIDL, FMQs or threads. The demux feeds it the input from the
+ * frontend or from DVR playback, and each filter gets its output through a Listener on the
+ * same thread. It isn't thread-safe, so the caller serializes input and filter changes.
+ */
+class TsFilterEngine {
+  public:
+    static const int TS_PACKET_SIZE = 188;
+    static const int PID_COUNT = 0x2000;
+
+    enum class OutputType {
+        // Complete PSI/SI sections
+        SECTION,
+        // Complete PES packets
+        PES,
+        // PES packets passed through as their TS packets arrive, for audio and video frames
+        // that are too large to buffer up
+        PES_STREAM,
+        // The TS packets themselves
+        TS,
+        // Runs of TS packets to record, referencing the input
+        RECORD,
+    };
+
+    struct PesHeader {
+        uint8_t streamId;
+        // The PES_packet_length, 0 if unbounded
+        uint16_t packetLength;
+        bool isPtsPresent;
+        uint64_t pts;
+    };
+
+    /**
+     * Receives the output of a filter. Only the calls for the filter's output type are made.
+     */
+    class Listener {
+      public:
+        virtual ~Listener() {}
+
+        // A complete section, starting with the table_id
+        virtual void onSection(const uint8_t* /* data */, size_t /* size */) {}
+        // A complete PES packet, starting with the packet_start_code_prefix
+        virtual void onPes(const uint8_t* /* data */, size_t /* size */) {}
+        // A streamed PES packet: its header, the payload in pieces, and its end. A packet is
+        // ended by its length, or by the start of the next one if it is unbounded. A packet cut
+        // short by lost packets is aborted instead.
+        virtual void onPesStart(const PesHeader& /* header */) {}
+        virtual void onPesPayload(const uint8_t* /* data */, size_t /* size */) {}
+        virtual void onPesEnd() {}
+        virtual void onPesAbort() {}
+        // A whole TS packet of the PID
+        virtual void onTsPacket(const uint8_t* /* packet */) {}
+        // Consecutive TS packets of the recorded PID. Points into the input, and is only valid
+        // during the call.
+        virtual void onRecordData(const uint8_t* /* data */, size_t /* size */) {}
+    };
+
+    TsFilterEngine();
+
+    ~TsFilterEngine();
+
+    /**
+     * Adds a filter, or replaces the filter with the same id. The listener must stay valid
+     * until the filter is removed.
+     */
+    void addFilter(uint32_t filterId, OutputType type, uint16_t pid, Listener* listener);
+    void removeFilter(uint32_t filterId);
+    /**
+     * Drops the partially assembled output of a filter, for when its input jumps to another
+     * position.
+     */
+    void resetFilter(uint32_t filterId);
+    size_t getFilterCount() const { return mFilters.size(); }
+
+    /**
+     * Filters the input. Only whole 188 byte packets are used.
+     */
+    void process(const uint8_t* data, size_t size);
+
+  private:
+    struct FilterState {
+        uint32_t filterId;
+        OutputType type;
+        uint16_t pid;
+        Listener* listener;
+
+        // Continuity counter of the last packet with payload, -1 if none yet
+        int continuityCounter;
+        // Section or PES packet being assembled
+        bool isUnitStarted;
+        std::vector<uint8_t> unit;
+        // Size of the unit once known, 0 before that or for unbounded PES packets
+        size_t unitSize;
+        // Streamed PES packet
+        bool isPesSizeKnown;
+        uint32_t pesSizeLeft;
+        // Run of packets to record that hasn't been passed on yet
+        const uint8_t* recordData;
+        size_t recordSize;
+    };
+
+    void rebuildPidTable();
+    void resetFilterState(FilterState* filter);
+    bool checkContinuity(FilterState* filter, const uint8_t* packet);
+    void processPacket(FilterState* filter, const uint8_t* packet);
+    void processSectionPacket(FilterState* filter, const uint8_t* payload, size_t size,
+                              bool payloadUnitStart);
+    /**
+     * Appends to the section being assembled and passes on the ones completed. With
+     * continueOnly, stops after completing the current section instead of starting new ones.
+     */
+    void appendSectionData(FilterState* filter, const uint8_t* data, size_t size,
+                           bool continueOnly);
+    void processPesPacket(FilterState* filter, const uint8_t* payload, size_t size,
+                          bool payloadUnitStart);
+    void processPesStreamPacket(FilterState* filter, const uint8_t* payload, size_t size,
+                                bool payloadUnitStart);
+    void processRecordPacket(FilterState* filter, const uint8_t* packet);
+    void flushRecordData();
+
+    std::map<uint32_t, std::unique_ptr<FilterState>> mFilters;
+    /**
+     * Index into mPidFilters for each PID, -1 for PIDs without filters. Lets the packets
+     * nobody asked for be dropped with a single lookup.
+     */
+    std::vector<int16_t> mPidSlots;
+    std::vector<std::vector<FilterState*>> mPidFilters;
+    std::vector<FilterState*> mRecordFilters;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_TV_TUNER_V1_0_TSFILTERENGINE_H_
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.tv.tuner@1.0-TsIndex"
+
+#include "TsIndex.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/Log.h>
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+const uint32_t INDEX_MAGIC = 0x58495354;  // "TSIX"
+const uint32_t INDEX_VERSION = 1;
+const size_t INITIAL_CAPACITY = 64 * 1024;
+
+const int TS_PACKET_SIZE = 188;
+// PCRs are 33 bits of 90 kHz base times 300 plus a 27 MHz extension
+const uint64_t PCR_MODULUS = (1ULL << 33) * 300;
+// PCRs come at least every 100ms, so a gap of over a second is a discontinuity
+const uint64_t MAX_PCR_INTERVAL = 27000000;
+
+uint64_t parsePcr(const uint8_t* pcr) {
+    uint64_t base = (static_cast<uint64_t>(pcr[0]) << 25) | (pcr[1] << 17) | (pcr[2] << 9) |
+                    (pcr[3] << 1) | (pcr[4] >> 7);
+    uint64_t extension = ((pcr[4] & 0x01) << 8) | pcr[5];
+    return base * 300 + extension;
+}
+
+// Returns true if a video PES starts in the payload with an H.264 IDR slice or an SPS, which
+// is how streams without the random_access_indicator mark their key frames
+bool startsWithIdr(const uint8_t* payload, int size) {
+    if (size < 9 || payload[0] != 0x00 || payload[1] != 0x00 || payload[2] != 0x01 ||
+        (payload[3] & 0xf0) != 0xe0) {
+        return false;
+    }
+    for (int i = 9 + payload[8]; i + 3 < size; i++) {
+        if (payload[i] == 0x00 && payload[i + 1] == 0x00 && payload[i + 2] == 0x01) {
+            uint8_t nalType = payload[i + 3] & 0x1f;
+            if (nalType == 5 || nalType == 7) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+TsIndex::~TsIndex() {
+    close();
+}
+
+bool TsIndex::create(const char* path) {
+    close();
+
+    mFd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (mFd < 0) {
+        ALOGW("[TsIndex] can't create %s: %s", path, strerror(errno));
+        return false;
+    }
+    mWritable = true;
+
+    size_t size = sizeof(Header) + INITIAL_CAPACITY * sizeof(Entry);
+    if (ftruncate(mFd, size) != 0) {
+        ALOGW("[TsIndex] can't size %s: %s", path, strerror(errno));
+        close();
+        return false;
+    }
+    mMapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+    if (mMapping == MAP_FAILED) {
+        mMapping = nullptr;
+        close();
+        return false;
+    }
+    mMappingSize = size;
+    mHeader = static_cast<Header*>(mMapping);
+    mEntries = reinterpret_cast<Entry*>(mHeader + 1);
+    mCapacity = INITIAL_CAPACITY;
+
+    mHeader->magic = INDEX_MAGIC;
+    mHeader->version = INDEX_VERSION;
+    mHeader->entryCount = 0;
+
+    mBytesIndexed = 0;
+    mPcrPid = -1;
+    mHasPcr = false;
+    mLastPcr = 0;
+    mTime = 0;
+
+    return true;
+}
+
+bool TsIndex::open(const char* path) {
+    close();
+
+    mFd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (mFd < 0) {
+        ALOGW("[TsIndex] can't open %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(mFd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+        close();
+        return false;
+    }
+    mMapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, mFd, 0);
+    if (mMapping == MAP_FAILED) {
+        mMapping = nullptr;
+        close();
+        return false;
+    }
+    mMappingSize = st.st_size;
+    mHeader = static_cast<Header*>(mMapping);
+    mEntries = reinterpret_cast<Entry*>(mHeader + 1);
+    mCapacity = (mMappingSize - sizeof(Header)) / sizeof(Entry);
+
+    if (mHeader->magic != INDEX_MAGIC || mHeader->version != INDEX_VERSION) {
+        ALOGW("[TsIndex] %s isn't a TS index", path);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void TsIndex::close() {
+    if (mWritable && mHeader != nullptr) {
+        // Drop the unused capacity
+        ftruncate(mFd, sizeof(Header) + mHeader->entryCount * sizeof(Entry));
+    }
+    if (mMapping != nullptr) {
+        munmap(mMapping, mMappingSize);
+    }
+    if (mFd >= 0) {
+        ::close(mFd);
+    }
+
+    mFd = -1;
+    mWritable = false;
+    mMapping = nullptr;
+    mMappingSize = 0;
+    mHeader = nullptr;
+    mEntries = nullptr;
+    mCapacity = 0;
+}
+
+bool TsIndex::grow() {
+    size_t capacity = mCapacity * 2;
+    size_t size = sizeof(Header) + capacity * sizeof(Entry);
+    if (ftruncate(mFd, size) != 0) {
+        return false;
+    }
+    void* mapping = mremap(mMapping, mMappingSize, size, MREMAP_MAYMOVE);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    mMapping = mapping;
+    mMappingSize = size;
+    mHeader = static_cast<Header*>(mMapping);
+    mEntries = reinterpret_cast<Entry*>(mHeader + 1);
+    mCapacity = capacity;
+
+    return true;
+}
+
+void TsIndex::updateTime(uint64_t pcr) {
+    if (mHasPcr) {
+        uint64_t delta = (pcr + PCR_MODULUS - mLastPcr) % PCR_MODULUS;
+        // Keep the time running across a discontinuity instead of jumping with the PCR
+        if (delta <= MAX_PCR_INTERVAL) {
+            mTime += delta;
+        }
+    }
+    mHasPcr = true;
+    mLastPcr = pcr;
+}
+
+void TsIndex::addEntry(uint64_t offset, uint8_t flags) {
+    size_t count = mHeader->entryCount;
+    if (count == mCapacity && !grow()) {
+        ALOGW("[TsIndex] index full, dropping entry at %" PRIu64, offset);
+        return;
+    }
+
+    mEntries[count].offsetAndFlags = offset | (static_cast<uint64_t>(flags) << 56);
+    mEntries[count].time = mTime;
+    // Publish the entry to readers of a recording in progress only once it is complete
+    __atomic_store_n(&mHeader->entryCount, count + 1, __ATOMIC_RELEASE);
+}
+
+void TsIndex::addPackets(const uint8_t* data, size_t size) {
+    if (!mWritable) {
+        return;
+    }
+
+    for (size_t i = 0; i + TS_PACKET_SIZE <= size; i += TS_PACKET_SIZE) {
+        const uint8_t* packet = data + i;
+        if (packet[0] != 0x47) {
+            continue;
+        }
+
+        uint8_t flags = 0;
+        uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+        int payloadStart = 4;
+        if (adaptationFieldControl & 0x2) {
+            uint8_t adaptationFieldLength = packet[4];
+            if (adaptationFieldLength > 0) {
+                uint8_t adaptationFlags = packet[5];
+                if (adaptationFlags & 0x40) {
+                    flags |= FLAG_RANDOM_ACCESS;
+                }
+                if ((adaptationFlags & 0x10) && adaptationFieldLength >= 7) {
+                    // Follow the first PCR PID we see
+                    int pid = ((packet[1] & 0x1f) << 8) | packet[2];
+                    if (mPcrPid < 0) {
+                        mPcrPid = pid;
+                    }
+                    if (pid == mPcrPid) {
+                        updateTime(parsePcr(packet + 6));
+                        flags |= FLAG_PCR;
+                    }
+                }
+            }
+            payloadStart += 1 + adaptationFieldLength;
+        }
+
+        bool payloadUnitStart = packet[1] & 0x40;
+        if (payloadUnitStart && (adaptationFieldControl & 0x1) && !(flags & FLAG_RANDOM_ACCESS) &&
+            payloadStart < TS_PACKET_SIZE &&
+            startsWithIdr(packet + payloadStart, TS_PACKET_SIZE - payloadStart)) {
+            flags |= FLAG_IDR;
+        }
+
+        if (flags != 0) {
+            addEntry(mBytesIndexed + i, flags);
+        }
+    }
+
+    mBytesIndexed += size;
+}
+
+size_t TsIndex::getEntryCount() const {
+    if (mHeader == nullptr) {
+        return 0;
+    }
+    return std::min<size_t>(__atomic_load_n(&mHeader->entryCount, __ATOMIC_ACQUIRE), mCapacity);
+}
+
+uint64_t TsIndex::getDuration() const {
+    size_t count = getEntryCount();
+    return count > 0 ? mEntries[count - 1].time : 0;
+}
+
+bool TsIndex::findRandomAccessPoint(uint64_t time, uint64_t* offset, uint64_t* pointTime) const {
+    size_t count = getEntryCount();
+    const Entry* begin = mEntries;
+    const Entry* it = std::upper_bound(begin, begin + count, time,
+                                       [](uint64_t t, const Entry& entry) { return t < entry.time; });
+
+    // Random access points are at most a GOP apart, so this only walks back a few entries
+    while (it != begin) {
+        it--;
+        if (it->isRandomAccessPoint()) {
+            *offset = it->getOffset();
+            *pointTime = it->time;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
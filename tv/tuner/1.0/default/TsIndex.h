@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_TV_TUNER_V1_0_TSINDEX_H_
+#define ANDROID_HARDWARE_TV_TUNER_V1_0_TSINDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+/**
+ * A side index of a TS recording, kept in a memory-mapped file next to it.
+ *
+ * While recording, every packet carrying a PCR and every random access point gets a 16 byte
+ * entry with its byte offset in the recording and the recording time at that packet. Times
+ * are in 27 MHz units from the first PCR, and are kept monotonic across PCR wrap-arounds and
+ * discontinuities. Playback then finds the random access point to resume from for any time
+ * with a binary search, instead of reading the recording from the start.
+ *
+ * The entry count in the file header is updated after each entry, so the index of a
+ * recording in progress can be opened for time-shift playback.
+ */
+class TsIndex {
+  public:
+    static const uint8_t FLAG_PCR = 0x01;
+    static const uint8_t FLAG_RANDOM_ACCESS = 0x02;  // random_access_indicator set
+    static const uint8_t FLAG_IDR = 0x04;            // H.264 IDR or SPS starts in the packet
+
+    struct Entry {
+        uint64_t offsetAndFlags;  // Byte offset in the low 56 bits, flags in the top 8
+        uint64_t time;
+
+        uint64_t getOffset() const { return offsetAndFlags & ((1ULL << 56) - 1); }
+        uint8_t getFlags() const { return offsetAndFlags >> 56; }
+        bool isRandomAccessPoint() const {
+            return getFlags() & (FLAG_RANDOM_ACCESS | FLAG_IDR);
+        }
+    };
+
+    TsIndex() = default;
+
+    ~TsIndex();
+
+    /**
+     * Creates an empty index file to record into, replacing any existing one.
+     */
+    bool create(const char* path);
+
+    /**
+     * Opens an existing index file read-only. Entries added by the recorder after this call
+     * are only visible up to the size the file had when it was opened.
+     */
+    bool open(const char* path);
+
+    void close();
+
+    /**
+     * Indexes the next packets of the recording. Only whole 188 byte packets are indexed,
+     * but the offsets keep counting every byte passed in.
+     */
+    void addPackets(const uint8_t* data, size_t size);
+
+    /**
+     * Finds the last random access point at or before the given time. Return false if there
+     * is none.
+     */
+    bool findRandomAccessPoint(uint64_t time, uint64_t* offset, uint64_t* pointTime) const;
+
+    size_t getEntryCount() const;
+    const Entry* getEntries() const { return mEntries; }
+    uint64_t getDuration() const;
+
+  private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t entryCount;
+    };
+
+    void addEntry(uint64_t offset, uint8_t flags);
+    bool grow();
+    void updateTime(uint64_t pcr);
+
+    int mFd = -1;
+    bool mWritable = false;
+    void* mMapping = nullptr;
+    size_t mMappingSize = 0;
+    Header* mHeader = nullptr;
+    Entry* mEntries = nullptr;
+    size_t mCapacity = 0;
+
+    // Recording state
+    uint64_t mBytesIndexed = 0;
+    int mPcrPid = -1;
+    bool mHasPcr = false;
+    uint64_t mLastPcr = 0;
+    uint64_t mTime = 0;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_TV_TUNER_V1_0_TSINDEX_H_
@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Seek latency on a DVR recording with the TS index, against scanning from the start.
+//
+// The recording is TUNER_SEEK_BENCHMARK_FILE (default /data/local/tmp/tuner_seek_benchmark.ts)
+// with its index next to it. If either is missing, a synthetic 20 Mbps recording of
+// TUNER_SEEK_BENCHMARK_SIZE_MB (default 4096) is generated and indexed the way the DVR does
+// while recording. A recording without an index is indexed in place first.
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "TsIndex.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+const int TS_PACKET_SIZE = 188;
+const uint16_t VIDEO_PID = 0x100;
+const uint64_t PCR_CLOCK = 27000000;
+// 20 Mbps with a PCR every 40ms and a random access point every second
+const int PACKETS_PER_PCR = 20000000 / 8 / 25 / TS_PACKET_SIZE;
+const int PCRS_PER_GOP = 25;
+// What a playback client reads after a seek before it can start feeding the DVR
+const size_t READ_AFTER_SEEK = 64 * 1024;
+
+std::string getEnv(const char* name, const char* defaultValue) {
+    const char* value = getenv(name);
+    return value != nullptr && value[0] != '\0' ? value : defaultValue;
+}
+
+void writePcrPacket(uint8_t* packet, uint64_t pcr, bool randomAccess, uint8_t continuity) {
+    memset(packet, 0xff, TS_PACKET_SIZE);
+    packet[0] = 0x47;
+    packet[1] = (randomAccess ? 0x40 : 0x00) | (VIDEO_PID >> 8);
+    packet[2] = VIDEO_PID & 0xff;
+    packet[3] = 0x30 | (continuity & 0x0f);
+    packet[4] = 7;
+    packet[5] = 0x10 | (randomAccess ? 0x40 : 0x00);
+    uint64_t base = pcr / 300;
+    uint64_t extension = pcr % 300;
+    packet[6] = base >> 25;
+    packet[7] = base >> 17;
+    packet[8] = base >> 9;
+    packet[9] = base >> 1;
+    packet[10] = ((base & 0x01) << 7) | 0x7e | (extension >> 8);
+    packet[11] = extension;
+    if (randomAccess) {
+        // PES header without PTS, followed by an IDR slice
+        const uint8_t pes[] = {0x00, 0x00, 0x01, 0xe0, 0x00, 0x00, 0x80, 0x00, 0x00,
+                               0x00, 0x00, 0x00, 0x01, 0x65};
+        memcpy(packet + 12, pes, sizeof(pes));
+    }
+}
+
+// Fills whole PCR intervals of the synthetic stream into the buffer, starting at the given one
+size_t fillRecording(std::vector<uint8_t>* buffer, uint64_t firstInterval, size_t intervals) {
+    buffer->resize(intervals * PACKETS_PER_PCR * TS_PACKET_SIZE);
+    uint8_t* packet = buffer->data();
+    for (size_t i = 0; i < intervals; i++) {
+        uint64_t interval = firstInterval + i;
+        for (int p = 0; p < PACKETS_PER_PCR; p++, packet += TS_PACKET_SIZE) {
+            uint8_t continuity = interval * PACKETS_PER_PCR + p;
+            if (p == 0) {
+                writePcrPacket(packet, interval * PCR_CLOCK / 25, interval % PCRS_PER_GOP == 0,
+                               continuity);
+                continue;
+            }
+            packet[0] = 0x47;
+            packet[1] = VIDEO_PID >> 8;
+            packet[2] = VIDEO_PID & 0xff;
+            packet[3] = 0x10 | (continuity & 0x0f);
+            memset(packet + 4, continuity, TS_PACKET_SIZE - 4);
+        }
+    }
+    return buffer->size();
+}
+
+bool generateRecording(const std::string& path, const std::string& indexPath, uint64_t size) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    TsIndex index;
+    if (!index.create(indexPath.c_str())) {
+        close(fd);
+        return false;
+    }
+
+    std::vector<uint8_t> buffer;
+    const size_t intervalsPerWrite = 16;
+    bool success = true;
+    for (uint64_t interval = 0, written = 0; written < size && success;
+         interval += intervalsPerWrite) {
+        size_t chunkSize = fillRecording(&buffer, interval, intervalsPerWrite);
+        success = write(fd, buffer.data(), chunkSize) == static_cast<ssize_t>(chunkSize);
+        index.addPackets(buffer.data(), chunkSize);
+        written += chunkSize;
+    }
+    close(fd);
+    return success;
+}
+
+bool indexRecording(const std::string& path, const std::string& indexPath) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    TsIndex index;
+    if (!index.create(indexPath.c_str())) {
+        close(fd);
+        return false;
+    }
+    std::vector<uint8_t> buffer(TS_PACKET_SIZE * 4096);
+    ssize_t size;
+    while ((size = read(fd, buffer.data(), buffer.size())) > 0) {
+        index.addPackets(buffer.data(), size);
+    }
+    close(fd);
+    return size == 0;
+}
+
+class Recording {
+  public:
+    static Recording* get() {
+        static Recording recording;
+        return recording.mFd >= 0 ? &recording : nullptr;
+    }
+
+    int getFd() const { return mFd; }
+    uint64_t getSize() const { return mSize; }
+    const TsIndex& getIndex() const { return mIndex; }
+
+  private:
+    Recording() {
+        std::string path = getEnv("TUNER_SEEK_BENCHMARK_FILE",
+                                   "/data/local/tmp/tuner_seek_benchmark.ts");
+        std::string indexPath = path + ".idx";
+        uint64_t size = strtoull(getEnv("TUNER_SEEK_BENCHMARK_SIZE_MB", "4096").c_str(),
+                                 nullptr, 10) << 20;
+
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            if (!generateRecording(path, indexPath, size)) {
+                fprintf(stderr, "Can't generate %s\n", path.c_str());
+                return;
+            }
+        } else if (stat(indexPath.c_str(), &st) != 0 && !indexRecording(path, indexPath)) {
+            fprintf(stderr, "Can't index %s\n", path.c_str());
+            return;
+        }
+
+        if (!mIndex.open(indexPath.c_str())) {
+            return;
+        }
+        mFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (mFd >= 0 && fstat(mFd, &st) == 0) {
+            mSize = st.st_size;
+        }
+    }
+
+    int mFd = -1;
+    uint64_t mSize = 0;
+    TsIndex mIndex;
+};
+
+// Reads from the offset as a playback client does after a seek, and checks it landed on a
+// packet boundary
+bool readAfterSeek(int fd, uint64_t offset, std::vector<uint8_t>* buffer) {
+    ssize_t size = pread(fd, buffer->data(), buffer->size(), offset);
+    return size >= TS_PACKET_SIZE && (*buffer)[0] == 0x47;
+}
+
+// Drops the recording from the page cache so that the seek has to hit the storage
+void evictRecording(benchmark::State& state, int fd) {
+    if (state.range(0)) {
+        state.PauseTiming();
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        state.ResumeTiming();
+    }
+}
+
+}  // namespace
+
+static void BM_IndexRecording(benchmark::State& state) {
+    std::string indexPath = getEnv("TUNER_SEEK_BENCHMARK_FILE",
+                                   "/data/local/tmp/tuner_seek_benchmark.ts") + ".bench.idx";
+    TsIndex index;
+    if (!index.create(indexPath.c_str())) {
+        state.SkipWithError("Can't create the index");
+        return;
+    }
+    std::vector<uint8_t> buffer;
+    fillRecording(&buffer, 0, PCRS_PER_GOP);
+
+    for (auto _ : state) {
+        index.addPackets(buffer.data(), buffer.size());
+    }
+
+    state.SetBytesProcessed(state.iterations() * buffer.size());
+    state.counters["entries"] = index.getEntryCount();
+    index.close();
+    unlink(indexPath.c_str());
+}
+BENCHMARK(BM_IndexRecording);
+
+static void BM_SeekWithIndex(benchmark::State& state) {
+    Recording* recording = Recording::get();
+    if (recording == nullptr || recording->getIndex().getDuration() == 0) {
+        state.SkipWithError("No recording");
+        return;
+    }
+    const TsIndex& index = recording->getIndex();
+    std::mt19937_64 random(1);
+    std::uniform_int_distribution<uint64_t> times(0, index.getDuration());
+    std::vector<uint8_t> buffer(READ_AFTER_SEEK);
+
+    for (auto _ : state) {
+        evictRecording(state, recording->getFd());
+        uint64_t offset, pointTime;
+        if (!index.findRandomAccessPoint(times(random), &offset, &pointTime) ||
+            !readAfterSeek(recording->getFd(), offset, &buffer)) {
+            state.SkipWithError("Seek failed");
+            break;
+        }
+        benchmark::DoNotOptimize(buffer.data());
+    }
+
+    state.SetLabel(std::to_string(recording->getSize() >> 20) + " MiB, " +
+                   std::to_string(index.getDuration() / PCR_CLOCK) + " s");
+}
+BENCHMARK(BM_SeekWithIndex)->ArgName("cold")->Arg(0)->Arg(1)->UseRealTime();
+
+static void BM_FindRandomAccessPoint(benchmark::State& state) {
+    Recording* recording = Recording::get();
+    if (recording == nullptr || recording->getIndex().getDuration() == 0) {
+        state.SkipWithError("No recording");
+        return;
+    }
+    const TsIndex& index = recording->getIndex();
+    std::mt19937_64 random(1);
+    std::uniform_int_distribution<uint64_t> times(0, index.getDuration());
+
+    for (auto _ : state) {
+        uint64_t offset, pointTime;
+        benchmark::DoNotOptimize(index.findRandomAccessPoint(times(random), &offset, &pointTime));
+    }
+
+    state.counters["entries"] = index.getEntryCount();
+}
+BENCHMARK(BM_FindRandomAccessPoint);
+
+// What seeking costs without the index: reading from the start until the PCR of the target
+// time. Targets are kept within the first minute, and the cost grows linearly from there.
+static void BM_SeekByScanning(benchmark::State& state) {
+    Recording* recording = Recording::get();
+    if (recording == nullptr) {
+        state.SkipWithError("No recording");
+        return;
+    }
+    std::mt19937_64 random(1);
+    std::uniform_int_distribution<uint64_t> times(0, 60 * PCR_CLOCK);
+    std::vector<uint8_t> buffer(TS_PACKET_SIZE * 4096);
+    uint64_t bytesRead = 0;
+
+    for (auto _ : state) {
+        evictRecording(state, recording->getFd());
+        uint64_t target = times(random);
+        bool found = false;
+        uint64_t offset = 0;
+        while (!found) {
+            ssize_t size = pread(recording->getFd(), buffer.data(), buffer.size(), offset);
+            if (size < TS_PACKET_SIZE) {
+                break;
+            }
+            for (ssize_t i = 0; i + TS_PACKET_SIZE <= size && !found; i += TS_PACKET_SIZE) {
+                const uint8_t* packet = buffer.data() + i;
+                if (packet[0] == 0x47 && (packet[3] & 0x20) && packet[4] >= 7 &&
+                    (packet[5] & 0x10)) {
+                    uint64_t base = (static_cast<uint64_t>(packet[6]) << 25) |
+                                    (packet[7] << 17) | (packet[8] << 9) | (packet[9] << 1) |
+                                    (packet[10] >> 7);
+                    found = base * 300 >= target;
+                }
+            }
+            offset += size;
+            bytesRead += size;
+        }
+        benchmark::DoNotOptimize(found);
+    }
+
+    state.SetBytesProcessed(bytesRead);
+}
+BENCHMARK(BM_SeekByScanning)->ArgName("cold")->Arg(0)->Arg(1)->UseRealTime();
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Packets per second through the TS filter engine, per filter configuration.
+//
+// Replays TUNER_FILTER_BENCHMARK_FILE (default /data/local/tmp/tuner_filter_benchmark.ts, up to
+// its first 256 MiB) from memory, in the 1 KiB-ish chunks the frontend and DVR playback feed the
+// demux with. Without the file, a synthetic stream with PSI sections, a video and an audio PES
+// is used. The video and audio PIDs are taken from the first PES packets in the stream.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "TsFilterEngine.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+const int TS_PACKET_SIZE = TsFilterEngine::TS_PACKET_SIZE;
+const size_t MAX_STREAM_SIZE = 256 << 20;
+const size_t SYNTHETIC_PACKET_COUNT = 200000;
+// What the frontend input and DVR playback hand to the demux at once
+const size_t CHUNK_SIZE = 6 * TS_PACKET_SIZE;
+
+const uint16_t PAT_PID = 0x0000;
+const uint16_t EIT_PID = 0x0012;
+const uint16_t SYNTHETIC_VIDEO_PID = 0x0100;
+const uint16_t SYNTHETIC_AUDIO_PID = 0x0101;
+
+// Consumes the output like a filter would, without any HIDL around it
+class CountingListener : public TsFilterEngine::Listener {
+  public:
+    virtual void onSection(const uint8_t* data, size_t size) override { consume(data, size); }
+    virtual void onPes(const uint8_t* data, size_t size) override { consume(data, size); }
+    virtual void onPesPayload(const uint8_t* data, size_t size) override { consume(data, size); }
+    virtual void onPesEnd() override { mUnits++; }
+    virtual void onTsPacket(const uint8_t* packet) override { consume(packet, TS_PACKET_SIZE); }
+    virtual void onRecordData(const uint8_t* data, size_t size) override {
+        // Recording copies the data out once
+        mRecordBuffer.assign(data, data + size);
+        consume(mRecordBuffer.data(), size);
+    }
+
+    uint64_t getChecksum() const { return mChecksum; }
+
+  private:
+    void consume(const uint8_t* data, size_t size) {
+        mUnits++;
+        mChecksum += data[0] + data[size - 1] + size;
+    }
+
+    uint64_t mUnits = 0;
+    uint64_t mChecksum = 0;
+    std::vector<uint8_t> mRecordBuffer;
+};
+
+class Stream {
+  public:
+    static const Stream& get() {
+        static Stream stream;
+        return stream;
+    }
+
+    const std::vector<uint8_t>& getData() const { return mData; }
+    size_t getPacketCount() const { return mData.size() / TS_PACKET_SIZE; }
+    uint16_t getVideoPid() const { return mVideoPid; }
+    uint16_t getAudioPid() const { return mAudioPid; }
+    const std::string& getName() const { return mName; }
+
+  private:
+    Stream() {
+        const char* path = getenv("TUNER_FILTER_BENCHMARK_FILE");
+        mName = path != nullptr ? path : "/data/local/tmp/tuner_filter_benchmark.ts";
+        if (!load(mName)) {
+            mName = "synthetic";
+            generate();
+        }
+        mVideoPid = findPesPid(0xe0);
+        mAudioPid = findPesPid(0xc0);
+    }
+
+    bool load(const std::string& path) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == nullptr) {
+            return false;
+        }
+        mData.resize(MAX_STREAM_SIZE);
+        size_t size = fread(mData.data(), 1, mData.size(), file);
+        fclose(file);
+        mData.resize(size / TS_PACKET_SIZE * TS_PACKET_SIZE);
+        return !mData.empty();
+    }
+
+    // Returns the PID of the first PES with a stream_id in the 0xe0 (video) or 0xc0 (audio)
+    // range, or the null PID
+    uint16_t findPesPid(uint8_t streamIdBase) const {
+        for (size_t i = 0; i + TS_PACKET_SIZE <= mData.size(); i += TS_PACKET_SIZE) {
+            const uint8_t* packet = &mData[i];
+            if (packet[0] != 0x47 || !(packet[1] & 0x40) || !(packet[3] & 0x10)) {
+                continue;
+            }
+            size_t payloadStart = 4 + ((packet[3] & 0x20) ? 1 + packet[4] : 0);
+            if (payloadStart + 4 > TS_PACKET_SIZE) {
+                continue;
+            }
+            const uint8_t* payload = packet + payloadStart;
+            if (payload[0] == 0x00 && payload[1] == 0x00 && payload[2] == 0x01 &&
+                (payload[3] & (streamIdBase == 0xe0 ? 0xf0 : 0xe0)) == streamIdBase) {
+                return ((packet[1] & 0x1f) << 8) | packet[2];
+            }
+        }
+        return 0x1fff;
+    }
+
+    uint8_t* addPacket(uint16_t pid, bool payloadUnitStart) {
+        uint8_t& continuityCounter = mContinuityCounters[pid];
+        size_t offset = mData.size();
+        mData.resize(offset + TS_PACKET_SIZE, 0xff);
+        uint8_t* packet = &mData[offset];
+        packet[0] = 0x47;
+        packet[1] = (payloadUnitStart ? 0x40 : 0x00) | (pid >> 8);
+        packet[2] = pid & 0xff;
+        packet[3] = 0x10 | (continuityCounter++ & 0x0f);
+        return packet;
+    }
+
+    // A long-form section of the given size, split over as many packets as it takes
+    void addSection(uint16_t pid, uint8_t tableId, size_t sectionSize) {
+        std::vector<uint8_t> section(sectionSize, 0x5a);
+        section[0] = tableId;
+        section[1] = 0xb0 | ((sectionSize - 3) >> 8);
+        section[2] = (sectionSize - 3) & 0xff;
+        section[5] = 0xc1;
+
+        size_t offset = 0;
+        while (offset < section.size()) {
+            uint8_t* packet = addPacket(pid, offset == 0);
+            uint8_t* payload = packet + 4;
+            size_t payloadSize = TS_PACKET_SIZE - 4;
+            if (offset == 0) {
+                *payload++ = 0;  // pointer_field
+                payloadSize--;
+            }
+            size_t size = std::min(payloadSize, section.size() - offset);
+            memcpy(payload, &section[offset], size);
+            offset += size;
+        }
+    }
+
+    // A PES packet of the given payload size, unbounded if asked to like video usually is
+    void addPes(uint16_t pid, uint8_t streamId, size_t payloadSize, bool unbounded) {
+        std::vector<uint8_t> pes(14 + payloadSize, 0xa5);
+        pes[0] = 0x00;
+        pes[1] = 0x00;
+        pes[2] = 0x01;
+        pes[3] = streamId;
+        uint16_t length = unbounded ? 0 : pes.size() - 6;
+        pes[4] = length >> 8;
+        pes[5] = length & 0xff;
+        pes[6] = 0x80;
+        pes[7] = 0x80;  // PTS only
+        pes[8] = 5;
+        pes[9] = 0x21;
+
+        for (size_t offset = 0; offset < pes.size(); offset += TS_PACKET_SIZE - 4) {
+            uint8_t* packet = addPacket(pid, offset == 0);
+            size_t size = std::min<size_t>(TS_PACKET_SIZE - 4, pes.size() - offset);
+            if (size < TS_PACKET_SIZE - 4) {
+                // Stuff the last packet with an adaptation field
+                size_t stuffing = TS_PACKET_SIZE - 4 - size;
+                packet[3] |= 0x20;
+                packet[4] = stuffing - 1;
+                if (stuffing > 1) {
+                    packet[5] = 0x00;
+                }
+            }
+            memcpy(packet + TS_PACKET_SIZE - size, &pes[offset], size);
+        }
+    }
+
+    // A 20 Mbps-like mix: mostly video, some audio, PSI and null packets
+    void generate() {
+        mData.reserve(SYNTHETIC_PACKET_COUNT * TS_PACKET_SIZE);
+        while (getPacketCount() < SYNTHETIC_PACKET_COUNT) {
+            addSection(PAT_PID, 0x00, 16);
+            addSection(EIT_PID, 0x4e, 700);
+            for (int i = 0; i < 8; i++) {
+                addPes(SYNTHETIC_VIDEO_PID, 0xe0, 25 * 1024, true /* unbounded */);
+                addPes(SYNTHETIC_AUDIO_PID, 0xc0, 1500, false /* unbounded */);
+                addPacket(0x1fff, false);
+            }
+        }
+    }
+
+    std::string mName;
+    std::vector<uint8_t> mData;
+    uint16_t mVideoPid = 0x1fff;
+    uint16_t mAudioPid = 0x1fff;
+    uint8_t mContinuityCounters[TsFilterEngine::PID_COUNT] = {};
+};
+
+enum FilterConfig {
+    NO_FILTERS,
+    PAT_SECTION,
+    EIT_SECTION,
+    AUDIO_PES,
+    VIDEO_MEDIA,
+    VIDEO_TS,
+    RECORD_AV,
+    // Two recordings of video and audio, with live audio and video and the PSI on the side
+    MIXED,
+};
+
+const char* getFilterConfigName(int config) {
+    switch (config) {
+        case NO_FILTERS:
+            return "no_filters";
+        case PAT_SECTION:
+            return "pat_section";
+        case EIT_SECTION:
+            return "eit_section";
+        case AUDIO_PES:
+            return "audio_pes";
+        case VIDEO_MEDIA:
+            return "video_media";
+        case VIDEO_TS:
+            return "video_ts";
+        case RECORD_AV:
+            return "record_av";
+        case MIXED:
+            return "mixed";
+        default:
+            return "unknown";
+    }
+}
+
+void addFilters(TsFilterEngine* engine, int config, TsFilterEngine::Listener* listener) {
+    const Stream& stream = Stream::get();
+    uint32_t filterId = 0;
+    auto add = [&](TsFilterEngine::OutputType type, uint16_t pid) {
+        engine->addFilter(filterId++, type, pid, listener);
+    };
+
+    switch (config) {
+        case PAT_SECTION:
+            add(TsFilterEngine::OutputType::SECTION, PAT_PID);
+            break;
+        case EIT_SECTION:
+            add(TsFilterEngine::OutputType::SECTION, EIT_PID);
+            break;
+        case AUDIO_PES:
+            add(TsFilterEngine::OutputType::PES, stream.getAudioPid());
+            break;
+        case VIDEO_MEDIA:
+            add(TsFilterEngine::OutputType::PES_STREAM, stream.getVideoPid());
+            break;
+        case VIDEO_TS:
+            add(TsFilterEngine::OutputType::TS, stream.getVideoPid());
+            break;
+        case RECORD_AV:
+            add(TsFilterEngine::OutputType::RECORD, stream.getVideoPid());
+            add(TsFilterEngine::OutputType::RECORD, stream.getAudioPid());
+            break;
+        case MIXED:
+            add(TsFilterEngine::OutputType::SECTION, PAT_PID);
+            add(TsFilterEngine::OutputType::SECTION, EIT_PID);
+            add(TsFilterEngine::OutputType::PES_STREAM, stream.getVideoPid());
+            add(TsFilterEngine::OutputType::PES_STREAM, stream.getAudioPid());
+            add(TsFilterEngine::OutputType::TS, stream.getVideoPid());
+            for (int i = 0; i < 2; i++) {
+                add(TsFilterEngine::OutputType::RECORD, stream.getVideoPid());
+                add(TsFilterEngine::OutputType::RECORD, stream.getAudioPid());
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+}  // namespace
+
+static void BM_FilterStream(benchmark::State& state) {
+    const Stream& stream = Stream::get();
+    const std::vector<uint8_t>& data = stream.getData();
+    CountingListener listener;
+    TsFilterEngine engine;
+    addFilters(&engine, state.range(0), &listener);
+
+    for (auto _ : state) {
+        for (size_t offset = 0; offset < data.size(); offset += CHUNK_SIZE) {
+            engine.process(&data[offset], std::min(CHUNK_SIZE, data.size() - offset));
+        }
+    }
+
+    benchmark::DoNotOptimize(listener.getChecksum());
+    state.SetLabel(std::string(getFilterConfigName(state.range(0))) + " " + stream.getName());
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.counters["packets"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * stream.getPacketCount(),
+            benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_FilterStream)->DenseRange(NO_FILTERS, MIXED)->Unit(benchmark::kMillisecond);
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <vector>
+
+#include "TsFilterEngine.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+const size_t TS_PACKET_SIZE = TsFilterEngine::TS_PACKET_SIZE;
+const uint16_t PID = 0x100;
+
+using OutputType = TsFilterEngine::OutputType;
+using Bytes = std::vector<uint8_t>;
+
+class RecordingListener : public TsFilterEngine::Listener {
+  public:
+    void onSection(const uint8_t* data, size_t size) override {
+        sections.emplace_back(data, data + size);
+    }
+    void onPes(const uint8_t* data, size_t size) override { pes.emplace_back(data, data + size); }
+    void onPesStart(const TsFilterEngine::PesHeader& header) override {
+        pesHeaders.push_back(header);
+        streamed.emplace_back();
+    }
+    void onPesPayload(const uint8_t* data, size_t size) override {
+        ASSERT_FALSE(streamed.empty());
+        streamed.back().insert(streamed.back().end(), data, data + size);
+    }
+    void onPesEnd() override { pesEnds++; }
+    void onPesAbort() override { pesAborts++; }
+    void onTsPacket(const uint8_t* packet) override {
+        tsPackets.emplace_back(packet, packet + TS_PACKET_SIZE);
+    }
+
+    std::vector<Bytes> sections;
+    std::vector<Bytes> pes;
+    std::vector<TsFilterEngine::PesHeader> pesHeaders;
+    std::vector<Bytes> streamed;
+    int pesEnds = 0;
+    int pesAborts = 0;
+    std::vector<Bytes> tsPackets;
+};
+
+// A TS packet of PID with the payload, padded with 0xff stuffing
+Bytes makePacket(uint16_t pid, uint8_t continuityCounter, bool payloadUnitStart,
+                 const Bytes& payload) {
+    EXPECT_LE(payload.size(), TS_PACKET_SIZE - 4);
+    Bytes packet(TS_PACKET_SIZE, 0xff);
+    packet[0] = 0x47;
+    packet[1] = (payloadUnitStart ? 0x40 : 0x00) | ((pid >> 8) & 0x1f);
+    packet[2] = pid & 0xff;
+    packet[3] = 0x10 | (continuityCounter & 0x0f);
+    memcpy(packet.data() + 4, payload.data(), payload.size());
+    return packet;
+}
+
+// A section of the table with the given total size, filled with a counting pattern
+Bytes makeSection(uint8_t tableId, size_t size) {
+    Bytes section(size);
+    section[0] = tableId;
+    section[1] = 0xb0 | (((size - 3) >> 8) & 0x0f);
+    section[2] = (size - 3) & 0xff;
+    for (size_t i = 3; i < size; i++) {
+        section[i] = i & 0xff;
+    }
+    return section;
+}
+
+// A PES packet header with a PTS, packetLength 0 leaving the packet unbounded
+Bytes makePesHeader(uint16_t packetLength, uint64_t pts) {
+    return {0x00,
+            0x00,
+            0x01,
+            0xe0,
+            static_cast<uint8_t>(packetLength >> 8),
+            static_cast<uint8_t>(packetLength & 0xff),
+            0x80,
+            0x80,
+            0x05,
+            static_cast<uint8_t>(0x21 | ((pts >> 29) & 0x0e)),
+            static_cast<uint8_t>(pts >> 22),
+            static_cast<uint8_t>(0x01 | ((pts >> 14) & 0xfe)),
+            static_cast<uint8_t>(pts >> 7),
+            static_cast<uint8_t>(0x01 | ((pts << 1) & 0xfe))};
+}
+
+Bytes makePayload(size_t size, uint8_t seed) {
+    Bytes payload(size);
+    for (size_t i = 0; i < size; i++) {
+        payload[i] = (seed + i) & 0xff;
+    }
+    return payload;
+}
+
+Bytes slice(const Bytes& data, size_t offset, size_t size) {
+    return Bytes(data.begin() + offset, data.begin() + offset + size);
+}
+
+Bytes concat(std::initializer_list<Bytes> parts) {
+    Bytes result;
+    for (const Bytes& part : parts) {
+        result.insert(result.end(), part.begin(), part.end());
+    }
+    return result;
+}
+
+class TsFilterEngineTest : public ::testing::Test {
+  protected:
+    void process(const std::vector<Bytes>& packets) {
+        Bytes input;
+        for (const Bytes& packet : packets) {
+            input.insert(input.end(), packet.begin(), packet.end());
+        }
+        mEngine.process(input.data(), input.size());
+    }
+
+    TsFilterEngine mEngine;
+    RecordingListener mListener;
+};
+
+}  // namespace
+
+TEST_F(TsFilterEngineTest, SectionSpanningPackets) {
+    mEngine.addFilter(1, OutputType::SECTION, PID, &mListener);
+    Bytes section = makeSection(0x42, 400);
+
+    // 183 bytes follow the pointer_field in the first packet, 184 in the next ones
+    process({makePacket(PID, 0, true, concat({{0x00}, slice(section, 0, 183)})),
+             makePacket(PID, 1, false, slice(section, 183, 184)),
+             makePacket(PID, 2, false, slice(section, 367, 33))});
+
+    ASSERT_EQ(1u, mListener.sections.size());
+    EXPECT_EQ(section, mListener.sections[0]);
+}
+
+TEST_F(TsFilterEngineTest, SectionsInOnePacket) {
+    mEngine.addFilter(1, OutputType::SECTION, PID, &mListener);
+    Bytes first = makeSection(0x00, 20);
+    Bytes second = makeSection(0x02, 30);
+
+    process({makePacket(PID, 0, true, concat({{0x00}, first, second}))});
+
+    ASSERT_EQ(2u, mListener.sections.size());
+    EXPECT_EQ(first, mListener.sections[0]);
+    EXPECT_EQ(second, mListener.sections[1]);
+}
+
+TEST_F(TsFilterEngineTest, PointerFieldEndsPreviousSection) {
+    mEngine.addFilter(1, OutputType::SECTION, PID, &mListener);
+    Bytes first = makeSection(0x42, 200);
+    Bytes second = makeSection(0x46, 50);
+
+    // The pointer_field of the second packet skips the 17 bytes left of the first section
+    process({makePacket(PID, 0, true, concat({{0x00}, slice(first, 0, 183)})),
+             makePacket(PID, 1, true, concat({{17}, slice(first, 183, 17), second}))});
+
+    ASSERT_EQ(2u, mListener.sections.size());
+    EXPECT_EQ(first, mListener.sections[0]);
+    EXPECT_EQ(second, mListener.sections[1]);
+}
+
+TEST_F(TsFilterEngineTest, PointerFieldSkipsSectionJoinedMidway) {
+    mEngine.addFilter(1, OutputType::SECTION, PID, &mListener);
+    Bytes section = makeSection(0x42, 50);
+
+    // The tail of a section whose start was never seen is skipped
+    process({makePacket(PID, 5, true, concat({{10}, makePayload(10, 0x80), section}))});
+
+    ASSERT_EQ(1u, mListener.sections.size());
+    EXPECT_EQ(section, mListener.sections[0]);
+}
+
+TEST_F(TsFilterEngineTest, ContinuityLossDropsSection) {
+    mEngine.addFilter(1, OutputType::SECTION, PID, &mListener);
+    Bytes lost = makeSection(0x42, 400);
+    Bytes next = makeSection(0x46, 50);
+
+    // The packet with continuity counter 1 is missing, the ones after it would otherwise
+    // complete the section
+    process({makePacket(PID, 0, true, concat({{0x00}, slice(lost, 0, 183)})),
+             makePacket(PID, 2, false, slice(lost, 183, 184)),
+             makePacket(PID, 3, false, slice(lost, 367, 33)),
+             makePacket(PID, 4, true, concat({{0x00}, next}))});
+
+    ASSERT_EQ(1u, mListener.sections.size());
+    EXPECT_EQ(next, mListener.sections[0]);
+}
+
+TEST_F(TsFilterEngineTest, DuplicatePacketIgnored) {
+    mEngine.addFilter(1, OutputType::SECTION, PID, &mListener);
+    Bytes section = makeSection(0x42, 400);
+    Bytes middle = makePacket(PID, 1, false, slice(section, 183, 184));
+
+    process({makePacket(PID, 0, true, concat({{0x00}, slice(section, 0, 183)})), middle, middle,
+             makePacket(PID, 2, false, slice(section, 367, 33))});
+
+    ASSERT_EQ(1u, mListener.sections.size());
+    EXPECT_EQ(section, mListener.sections[0]);
+}
+
+TEST_F(TsFilterEngineTest, BoundedPes) {
+    mEngine.addFilter(1, OutputType::PES, PID, &mListener);
+    Bytes header = makePesHeader(3 + 5 + 250, 0);
+    Bytes pes = concat({header, makePayload(250, 1)});
+
+    process({makePacket(PID, 0, true, slice(pes, 0, 184)),
+             makePacket(PID, 1, false, slice(pes, 184, pes.size() - 184))});
+
+    ASSERT_EQ(1u, mListener.pes.size());
+    EXPECT_EQ(pes, mListener.pes[0]);
+}
+
+TEST_F(TsFilterEngineTest, UnboundedPesEndsAtNextStart) {
+    mEngine.addFilter(1, OutputType::PES, PID, &mListener);
+    Bytes first = concat({makePesHeader(0, 0), makePayload(184 * 2 - 14, 1)});
+    Bytes second = concat({makePesHeader(0, 0), makePayload(184 - 14, 2)});
+
+    process({makePacket(PID, 0, true, slice(first, 0, 184)),
+             makePacket(PID, 1, false, slice(first, 184, 184))});
+    // Nothing tells where the packet ends until the next one starts
+    EXPECT_TRUE(mListener.pes.empty());
+
+    process({makePacket(PID, 2, true, second)});
+    ASSERT_EQ(1u, mListener.pes.size());
+    EXPECT_EQ(first, mListener.pes[0]);
+}
+
+TEST_F(TsFilterEngineTest, ContinuityLossDropsPes) {
+    mEngine.addFilter(1, OutputType::PES, PID, &mListener);
+    Bytes lost = concat({makePesHeader(0, 0), makePayload(184 * 3 - 14, 1)});
+    Bytes next = concat({makePesHeader(0, 0), makePayload(184 - 14, 2)});
+
+    process({makePacket(PID, 0, true, slice(lost, 0, 184)),
+             makePacket(PID, 2, false, slice(lost, 368, 184)),
+             makePacket(PID, 3, true, next)});
+
+    EXPECT_TRUE(mListener.pes.empty());
+}
+
+TEST_F(TsFilterEngineTest, StreamedUnboundedPes) {
+    mEngine.addFilter(1, OutputType::PES_STREAM, PID, &mListener);
+    const uint64_t pts = 0x123456789;
+    Bytes firstPayload = makePayload(184 * 2 - 14, 1);
+    Bytes first = concat({makePesHeader(0, pts), firstPayload});
+
+    process({makePacket(PID, 0, true, slice(first, 0, 184)),
+             makePacket(PID, 1, false, slice(first, 184, 184))});
+    ASSERT_EQ(1u, mListener.pesHeaders.size());
+    EXPECT_EQ(0xe0, mListener.pesHeaders[0].streamId);
+    EXPECT_EQ(0, mListener.pesHeaders[0].packetLength);
+    EXPECT_TRUE(mListener.pesHeaders[0].isPtsPresent);
+    EXPECT_EQ(pts, mListener.pesHeaders[0].pts);
+    EXPECT_EQ(0, mListener.pesEnds);
+
+    process({makePacket(PID, 2, true, concat({makePesHeader(0, 0), makePayload(184 - 14, 2)}))});
+    EXPECT_EQ(1, mListener.pesEnds);
+    EXPECT_EQ(2u, mListener.pesHeaders.size());
+    EXPECT_EQ(firstPayload, mListener.streamed[0]);
+    EXPECT_EQ(0, mListener.pesAborts);
+}
+
+TEST_F(TsFilterEngineTest, StreamedBoundedPesEndsAtItsLength) {
+    mEngine.addFilter(1, OutputType::PES_STREAM, PID, &mListener);
+    Bytes payload = makePayload(100, 1);
+
+    process({makePacket(PID, 0, true, concat({makePesHeader(3 + 5 + 100, 0), payload}))});
+
+    EXPECT_EQ(1, mListener.pesEnds);
+    ASSERT_EQ(1u, mListener.streamed.size());
+    EXPECT_EQ(payload, mListener.streamed[0]);
+}
+
+TEST_F(TsFilterEngineTest, ContinuityLossAbortsStreamedPes) {
+    mEngine.addFilter(1, OutputType::PES_STREAM, PID, &mListener);
+    Bytes lost = concat({makePesHeader(0, 0), makePayload(184 * 3 - 14, 1)});
+
+    process({makePacket(PID, 0, true, slice(lost, 0, 184)),
+             makePacket(PID, 2, false, slice(lost, 368, 184))});
+    EXPECT_EQ(1, mListener.pesAborts);
+    EXPECT_EQ(0, mListener.pesEnds);
+
+    // The payload after the loss isn't passed on either
+    EXPECT_EQ(184u - 14, mListener.streamed[0].size());
+}
+
+TEST_F(TsFilterEngineTest, TsPacketsOfPidOnly) {
+    mEngine.addFilter(1, OutputType::TS, PID, &mListener);
+    Bytes packet = makePacket(PID, 0, false, makePayload(184, 1));
+
+    process({packet, makePacket(PID + 1, 0, false, makePayload(184, 2))});
+
+    ASSERT_EQ(1u, mListener.tsPackets.size());
+    EXPECT_EQ(packet, mListener.tsPackets[0]);
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "TsIndex.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+const size_t TS_PACKET_SIZE = 188;
+const uint16_t VIDEO_PID = 0x100;
+const uint16_t AUDIO_PID = 0x101;
+// 27 MHz ticks
+const uint64_t MS = 27000;
+const uint64_t PCR_MODULUS = (1ULL << 33) * 300;
+const uint8_t FLAG_PCR = TsIndex::FLAG_PCR;
+const uint8_t FLAG_RANDOM_ACCESS = TsIndex::FLAG_RANDOM_ACCESS;
+const uint8_t FLAG_IDR = TsIndex::FLAG_IDR;
+
+using Bytes = std::vector<uint8_t>;
+
+Bytes makeHeader(uint16_t pid, bool payloadUnitStart, uint8_t adaptationFieldControl) {
+    Bytes packet(TS_PACKET_SIZE, 0xff);
+    packet[0] = 0x47;
+    packet[1] = (payloadUnitStart ? 0x40 : 0x00) | ((pid >> 8) & 0x1f);
+    packet[2] = pid & 0xff;
+    packet[3] = adaptationFieldControl << 4;
+    return packet;
+}
+
+// A packet that is all adaptation field, with a PCR if hasPcr
+Bytes makeAdaptationPacket(uint16_t pid, bool hasPcr, uint64_t pcr, bool randomAccess) {
+    Bytes packet = makeHeader(pid, false, 0x2);
+    packet[4] = TS_PACKET_SIZE - 5;
+    packet[5] = (hasPcr ? 0x10 : 0x00) | (randomAccess ? 0x40 : 0x00);
+    if (hasPcr) {
+        uint64_t base = pcr / 300;
+        uint64_t extension = pcr % 300;
+        packet[6] = base >> 25;
+        packet[7] = base >> 17;
+        packet[8] = base >> 9;
+        packet[9] = base >> 1;
+        packet[10] = ((base & 0x1) << 7) | 0x7e | (extension >> 8);
+        packet[11] = extension & 0xff;
+    }
+    return packet;
+}
+
+Bytes makePcrPacket(uint64_t pcr, uint16_t pid = VIDEO_PID) {
+    return makeAdaptationPacket(pid, true, pcr, false);
+}
+
+// A packet starting a video PES whose first NAL unit is of the given type
+Bytes makeVideoPacket(uint8_t nalType, bool payloadUnitStart = true) {
+    Bytes packet = makeHeader(VIDEO_PID, payloadUnitStart, 0x1);
+    const Bytes payload = {0x00, 0x00, 0x01, 0xe0, 0x00, 0x00, 0x80, 0x00, 0x00,
+                           0x00, 0x00, 0x00, 0x01, nalType};
+    std::copy(payload.begin(), payload.end(), packet.begin() + 4);
+    return packet;
+}
+
+class TsIndexTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mPath = ::testing::TempDir() + "ts_index_test.idx";
+        ASSERT_TRUE(mIndex.create(mPath.c_str()));
+    }
+
+    void TearDown() override {
+        mIndex.close();
+        remove(mPath.c_str());
+    }
+
+    void add(const Bytes& packet) { mIndex.addPackets(packet.data(), packet.size()); }
+
+    const TsIndex::Entry& entry(size_t i) { return mIndex.getEntries()[i]; }
+
+    std::string mPath;
+    TsIndex mIndex;
+};
+
+}  // namespace
+
+TEST_F(TsIndexTest, IndexesPcrPackets) {
+    add(makeVideoPacket(1));
+    add(makePcrPacket(1000 * MS));
+    add(makePcrPacket(1100 * MS));
+
+    ASSERT_EQ(2u, mIndex.getEntryCount());
+    EXPECT_EQ(TS_PACKET_SIZE, entry(0).getOffset());
+    EXPECT_EQ(FLAG_PCR, entry(0).getFlags());
+    EXPECT_EQ(0u, entry(0).time);
+    EXPECT_EQ(2 * TS_PACKET_SIZE, entry(1).getOffset());
+    EXPECT_EQ(100 * MS, entry(1).time);
+    EXPECT_EQ(100 * MS, mIndex.getDuration());
+}
+
+TEST_F(TsIndexTest, KeepsTimeAcrossPcrWrap) {
+    add(makePcrPacket(PCR_MODULUS - 40 * MS));
+    add(makePcrPacket(60 * MS));
+
+    ASSERT_EQ(2u, mIndex.getEntryCount());
+    EXPECT_EQ(100 * MS, entry(1).time);
+}
+
+TEST_F(TsIndexTest, KeepsTimeAcrossDiscontinuities) {
+    add(makePcrPacket(1000 * MS));
+    add(makePcrPacket(1100 * MS));
+    // Jumps forward and back are both taken as a new time base
+    add(makePcrPacket(60000 * MS));
+    add(makePcrPacket(60100 * MS));
+    add(makePcrPacket(500 * MS));
+    add(makePcrPacket(600 * MS));
+
+    ASSERT_EQ(6u, mIndex.getEntryCount());
+    const uint64_t expected[] = {0, 100 * MS, 100 * MS, 200 * MS, 200 * MS, 300 * MS};
+    for (size_t i = 0; i < 6; i++) {
+        EXPECT_EQ(expected[i], entry(i).time) << "entry " << i;
+    }
+}
+
+TEST_F(TsIndexTest, FollowsFirstPcrPid) {
+    add(makePcrPacket(1000 * MS, VIDEO_PID));
+    add(makePcrPacket(9000 * MS, AUDIO_PID));
+    add(makePcrPacket(1100 * MS, VIDEO_PID));
+
+    ASSERT_EQ(2u, mIndex.getEntryCount());
+    EXPECT_EQ(2 * TS_PACKET_SIZE, entry(1).getOffset());
+    EXPECT_EQ(100 * MS, entry(1).time);
+}
+
+TEST_F(TsIndexTest, DetectsRandomAccessIndicator) {
+    add(makeAdaptationPacket(VIDEO_PID, false, 0, true));
+    add(makeAdaptationPacket(VIDEO_PID, true, 0, true));
+
+    ASSERT_EQ(2u, mIndex.getEntryCount());
+    EXPECT_EQ(FLAG_RANDOM_ACCESS, entry(0).getFlags());
+    EXPECT_EQ(FLAG_RANDOM_ACCESS | FLAG_PCR, entry(1).getFlags());
+    EXPECT_TRUE(entry(0).isRandomAccessPoint());
+}
+
+TEST_F(TsIndexTest, DetectsIdrAndSps) {
+    add(makeVideoPacket(5));         // IDR slice
+    add(makeVideoPacket(7));         // SPS
+    add(makeVideoPacket(1));         // Non-IDR slice
+    add(makeVideoPacket(5, false));  // Not the start of a PES
+
+    ASSERT_EQ(2u, mIndex.getEntryCount());
+    EXPECT_EQ(0u, entry(0).getOffset());
+    EXPECT_EQ(FLAG_IDR, entry(0).getFlags());
+    EXPECT_EQ(TS_PACKET_SIZE, entry(1).getOffset());
+    EXPECT_TRUE(entry(1).isRandomAccessPoint());
+}
+
+TEST_F(TsIndexTest, FindsRandomAccessPointBeforeTime) {
+    add(makePcrPacket(0));
+    add(makeVideoPacket(5));
+    add(makePcrPacket(100 * MS));
+    add(makePcrPacket(200 * MS));
+    add(makeVideoPacket(5));
+    add(makePcrPacket(300 * MS));
+
+    uint64_t offset = 0;
+    uint64_t time = 0;
+    ASSERT_TRUE(mIndex.findRandomAccessPoint(150 * MS, &offset, &time));
+    EXPECT_EQ(TS_PACKET_SIZE, offset);
+    EXPECT_EQ(0u, time);
+
+    ASSERT_TRUE(mIndex.findRandomAccessPoint(250 * MS, &offset, &time));
+    EXPECT_EQ(4 * TS_PACKET_SIZE, offset);
+    EXPECT_EQ(200 * MS, time);
+}
+
+TEST_F(TsIndexTest, NoRandomAccessPointWithoutKeyFrames) {
+    add(makePcrPacket(0));
+    add(makePcrPacket(100 * MS));
+
+    uint64_t offset = 0;
+    uint64_t time = 0;
+    EXPECT_FALSE(mIndex.findRandomAccessPoint(100 * MS, &offset, &time));
+}
+
+TEST_F(TsIndexTest, CountsPartialPacketsInOffsets) {
+    Bytes data = makePcrPacket(0);
+    data.resize(TS_PACKET_SIZE + 10, 0);
+    mIndex.addPackets(data.data(), data.size());
+    add(makePcrPacket(100 * MS));
+
+    ASSERT_EQ(2u, mIndex.getEntryCount());
+    EXPECT_EQ(TS_PACKET_SIZE + 10, entry(1).getOffset());
+}
+
+TEST_F(TsIndexTest, OpensRecordingInProgress) {
+    add(makePcrPacket(0));
+    add(makeVideoPacket(5));
+
+    TsIndex reader;
+    ASSERT_TRUE(reader.open(mPath.c_str()));
+    ASSERT_EQ(2u, reader.getEntryCount());
+    EXPECT_EQ(FLAG_IDR, reader.getEntries()[1].getFlags());
+
+    // Not writable
+    reader.addPackets(makePcrPacket(100 * MS).data(), TS_PACKET_SIZE);
+    EXPECT_EQ(2u, reader.getEntryCount());
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
@@ -30,6 +30,7 @@
 #include <android/hardware/tv/tuner/1.0/ITuner.h>
 #include <android/hardware/tv/tuner/1.0/types.h>
 #include <binder/MemoryDealer.h>
+#include <cutils/ashmem.h>
 #include <fmq/MessageQueue.h>
 #include <gtest/gtest.h>
 #include <hidl/GtestPrinter.h>
@@ -38,8 +39,11 @@
 #include <hidl/ServiceManagement.h>
 #include <hidl/Status.h>
 #include <hidlmemory/FrameworkUtils.h>
+#include <inttypes.h>
+#include <sys/mman.h>
 #include <utils/Condition.h>
 #include <utils/Mutex.h>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <map>
@@ -63,9 +67,12 @@ using android::hardware::MessageQueue;
 using android::hardware::MQDescriptorSync;
 using android::hardware::Return;
 using android::hardware::Void;
+using android::hardware::hidl_handle;
 using android::hardware::tv::tuner::V1_0::DataFormat;
+using android::hardware::tv::tuner::V1_0::DemuxFilterAvSettings;
 using android::hardware::tv::tuner::V1_0::DemuxFilterEvent;
 using android::hardware::tv::tuner::V1_0::DemuxFilterMainType;
+using android::hardware::tv::tuner::V1_0::DemuxFilterMediaEvent;
 using android::hardware::tv::tuner::V1_0::DemuxFilterPesDataSettings;
 using android::hardware::tv::tuner::V1_0::DemuxFilterPesEvent;
 using android::hardware::tv::tuner::V1_0::DemuxFilterRecordSettings;
@@ -151,6 +158,10 @@ const std::vector<uint8_t> goldenDataOutputBuffer{
 const uint32_t FMQ_SIZE_1M = 0x100000;
 const uint32_t FMQ_SIZE_16M = 0x1000000;
 
+// The recording fed to the media filter throughput test. It isn't shipped with the test;
+// push any TS file with a video stream there to run it.
+const string MEDIA_THROUGHPUT_INPUT_FILE = "/data/local/tmp/tuner_media_throughput.ts";
+
 struct FilterConf {
     DemuxFilterType type;
     DemuxFilterSettings setting;
@@ -382,6 +393,115 @@ bool FilterCallback::readFilterEventData() {
     return result;
 }
 
+// Consumes the frames of an audio or video filter like a decoder would: copies each frame out
+// of the AV memory and releases it right away.
+class MediaFilterCallback : public IFilterCallback {
+  public:
+    virtual ~MediaFilterCallback() {
+        if (mAvMemory != nullptr) {
+            munmap(mAvMemory, mAvMemorySize);
+        }
+    }
+
+    virtual Return<void> onFilterEvent(const DemuxFilterEvent& filterEvent) override {
+        android::Mutex::Autolock autoLock(mMsgLock);
+        for (int i = 0; i < filterEvent.events.size(); i++) {
+            const DemuxFilterMediaEvent& mediaEvent = filterEvent.events[i].media();
+            if (mAvMemory == nullptr && !mapAvMemory(mediaEvent.avMemory)) {
+                ADD_FAILURE() << "can't map the AV memory";
+                return Void();
+            }
+            EXPECT_LE(mediaEvent.offset + mediaEvent.dataLength, mAvMemorySize);
+            mFrame.resize(mediaEvent.dataLength);
+            memcpy(mFrame.data(), mAvMemory + mediaEvent.offset, mediaEvent.dataLength);
+            EXPECT_EQ(mFilter->releaseAvHandle(mediaEvent.avMemory, mediaEvent.avDataId),
+                      Result::SUCCESS);
+
+            mFramesReceived++;
+            mBytesReceived += mediaEvent.dataLength;
+        }
+        mLastEventTime = std::chrono::steady_clock::now();
+        mMsgCondition.signal();
+        return Void();
+    }
+
+    virtual Return<void> onFilterStatus(const DemuxFilterStatus status) override {
+        android::Mutex::Autolock autoLock(mMsgLock);
+        if (status == DemuxFilterStatus::OVERFLOW) {
+            mOverflowCount++;
+        }
+        return Void();
+    }
+
+    void setFilter(const sp<IFilter>& filter) { mFilter = filter; }
+
+    // Waits until no frame arrived for the given time
+    void waitForIdle(nsecs_t idleTime) {
+        android::Mutex::Autolock autoLock(mMsgLock);
+        while (mMsgCondition.waitRelative(mMsgLock, idleTime) != -ETIMEDOUT) {
+        }
+    }
+
+    uint64_t getFramesReceived() { return mFramesReceived; }
+    uint64_t getBytesReceived() { return mBytesReceived; }
+    uint32_t getOverflowCount() { return mOverflowCount; }
+    std::chrono::steady_clock::time_point getLastEventTime() { return mLastEventTime; }
+
+  private:
+    bool mapAvMemory(const hidl_handle& avMemory) {
+        if (avMemory.getNativeHandle() == nullptr || avMemory->numFds < 1) {
+            return false;
+        }
+        int size = ashmem_get_size_region(avMemory->data[0]);
+        if (size <= 0) {
+            return false;
+        }
+        // The mapping outlives the fd, which is only valid for the duration of the callback
+        void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, avMemory->data[0], 0);
+        if (base == MAP_FAILED) {
+            return false;
+        }
+        mAvMemory = static_cast<uint8_t*>(base);
+        mAvMemorySize = size;
+        return true;
+    }
+
+    sp<IFilter> mFilter;
+    uint8_t* mAvMemory = nullptr;
+    uint32_t mAvMemorySize = 0;
+    std::vector<uint8_t> mFrame;
+
+    uint64_t mFramesReceived = 0;
+    uint64_t mBytesReceived = 0;
+    uint32_t mOverflowCount = 0;
+    std::chrono::steady_clock::time_point mLastEventTime;
+
+    android::Mutex mMsgLock;
+    android::Condition mMsgCondition;
+};
+
+// Returns the PID of the first video PES found in the stream, or -1
+int findVideoPid(std::ifstream& inputData) {
+    uint8_t packet[188];
+    for (int i = 0; i < 100000; i++) {
+        if (!inputData.read(reinterpret_cast<char*>(packet), sizeof(packet))) {
+            break;
+        }
+        bool payloadUnitStart = packet[1] & 0x40;
+        uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x3;
+        int payloadStart = (adaptationFieldControl & 0x2) ? 5 + packet[4] : 4;
+        if (packet[0] != 0x47 || !payloadUnitStart || !(adaptationFieldControl & 0x1) ||
+            payloadStart + 4 > 188) {
+            continue;
+        }
+        const uint8_t* pes = packet + payloadStart;
+        if (pes[0] == 0x00 && pes[1] == 0x00 && pes[2] == 0x01 && (pes[3] & 0xf0) == 0xe0) {
+            return ((packet[1] & 0x1f) << 8) | packet[2];
+        }
+    }
+    return -1;
+}
+
 class DvrCallback : public IDvrCallback {
   public:
     virtual Return<void> onRecordStatus(DemuxFilterStatus status) override {
@@ -1475,6 +1595,127 @@ TEST_P(TunerHidlTest, RecordDataFlowWithTsRecordFilterTest) {
     ASSERT_TRUE(recordDataFlowTest(filterConf, recordSetting, goldenOutputFiles));
 }*/
 
+/*
+ * PERFORMANCE TESTS
+ */
+TEST_P(TunerHidlTest, PlaybackMediaFilterThroughputTest) {
+    description("Feed a local ts file through playback as fast as the HAL takes it and measure "
+                "the AV data a video filter delivers per second");
+
+    std::ifstream inputData(MEDIA_THROUGHPUT_INPUT_FILE, std::ifstream::binary);
+    if (!inputData.is_open()) {
+        GTEST_SKIP() << "No input file " << MEDIA_THROUGHPUT_INPUT_FILE;
+    }
+    int videoPid = findVideoPid(inputData);
+    if (videoPid < 0) {
+        GTEST_SKIP() << "No video stream in " << MEDIA_THROUGHPUT_INPUT_FILE;
+    }
+    inputData.clear();
+    inputData.seekg(0);
+
+    // Filter Configuration Module
+    ASSERT_TRUE(createDemux());
+    sp<MediaFilterCallback> filterCallback = new MediaFilterCallback();
+    DemuxFilterType type{
+            .mainType = DemuxFilterMainType::TS,
+    };
+    type.subType.tsFilterType(DemuxTsFilterType::VIDEO);
+    Result status;
+    mDemux->openFilter(type, FMQ_SIZE_16M, filterCallback,
+                       [&](Result result, const sp<IFilter>& filter) {
+                           mFilter = filter;
+                           status = result;
+                       });
+    ASSERT_EQ(status, Result::SUCCESS);
+    filterCallback->setFilter(mFilter);
+
+    DemuxTsFilterSettings tsFilterSetting{
+            .tpid = static_cast<uint16_t>(videoPid),
+    };
+    DemuxFilterAvSettings avFilterSetting{
+            .isPassthrough = false,
+    };
+    tsFilterSetting.filterSettings.av(avFilterSetting);
+    DemuxFilterSettings filterSetting;
+    filterSetting.ts(tsFilterSetting);
+    ASSERT_EQ(mFilter->configure(filterSetting), Result::SUCCESS);
+    ASSERT_EQ(mFilter->start(), Result::SUCCESS);
+
+    // Playback Input Module
+    PlaybackSettings playbackSetting{
+            .statusMask = 0xf,
+            .lowThreshold = 0x1000,
+            .highThreshold = 0x07fff,
+            .dataFormat = DataFormat::TS,
+            .packetSize = 188,
+    };
+    ASSERT_TRUE(addPlaybackToDemux(playbackSetting));
+    ASSERT_TRUE(getPlaybackMQDescriptor());
+    ASSERT_EQ(mDvr->attachFilter(mFilter), Result::SUCCESS);
+    ASSERT_EQ(mDvr->start(), Result::SUCCESS);
+
+    FilterMQ playbackMQ(mPlaybackMQDescriptor, true /* resetPointers */);
+    EventFlag* playbackMQEventFlag;
+    ASSERT_EQ(EventFlag::createEventFlag(playbackMQ.getEventFlagWord(), &playbackMQEventFlag),
+              android::OK);
+
+    // Write the whole file, only waiting when the playback FMQ is full
+    const int chunkSize = 188 * 256;
+    std::vector<char> chunk(chunkSize);
+    uint64_t bytesFed = 0;
+    const auto startTime = std::chrono::steady_clock::now();
+    auto lastProgressTime = startTime;
+    while (inputData.read(chunk.data(), chunkSize) || inputData.gcount() > 0) {
+        size_t size = inputData.gcount() / 188 * 188;
+        while (playbackMQ.availableToWrite() < size) {
+            playbackMQEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+            usleep(500);
+            if (std::chrono::steady_clock::now() - lastProgressTime >
+                std::chrono::nanoseconds(WAIT_TIMEOUT)) {
+                break;
+            }
+        }
+        // No ASSERT in the loop, the event flag still has to be deleted below
+        bool written = playbackMQ.write(reinterpret_cast<uint8_t*>(chunk.data()), size);
+        EXPECT_TRUE(written) << "playback FMQ isn't drained";
+        if (!written) {
+            break;
+        }
+        playbackMQEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+        bytesFed += size;
+        lastProgressTime = std::chrono::steady_clock::now();
+    }
+    const auto feedEndTime = std::chrono::steady_clock::now();
+
+    // Data Verify Module
+    filterCallback->waitForIdle(1000000000 /* 1s */);
+    uint64_t frames = filterCallback->getFramesReceived();
+    uint64_t bytes = filterCallback->getBytesReceived();
+    EXPECT_GT(frames, 0u) << "video filter didn't output any frame";
+
+    double feedSeconds = std::chrono::duration<double>(feedEndTime - startTime).count();
+    double deliverySeconds =
+            std::chrono::duration<double>(filterCallback->getLastEventTime() - startTime).count();
+    if (frames > 0 && deliverySeconds > 0) {
+        RecordProperty("inputMbps", std::to_string(bytesFed * 8 / feedSeconds / 1e6));
+        RecordProperty("mediaMbps", std::to_string(bytes * 8 / deliverySeconds / 1e6));
+        RecordProperty("framesPerSecond", std::to_string(frames / deliverySeconds));
+        RecordProperty("overflows", std::to_string(filterCallback->getOverflowCount()));
+        printf("pid %d: fed %.1f Mbps, delivered %" PRIu64 " frames, %.1f Mbps, %.0f frames/s, "
+               "%u overflows\n",
+               videoPid, bytesFed * 8 / feedSeconds / 1e6, frames,
+               bytes * 8 / deliverySeconds / 1e6, frames / deliverySeconds,
+               filterCallback->getOverflowCount());
+    }
+
+    // Clean Up Module
+    EventFlag::deleteEventFlag(&playbackMQEventFlag);
+    ASSERT_EQ(mFilter->stop(), Result::SUCCESS);
+    ASSERT_EQ(mDvr->stop(), Result::SUCCESS);
+    ASSERT_EQ(mFilter->close(), Result::SUCCESS);
+    ASSERT_TRUE(closeDemux());
+}
+
 }  // namespace
 
 INSTANTIATE_TEST_SUITE_P(